@@ -18,11 +18,12 @@ IF NOT %LastError%==0 GOTO :end
 IF %Argument%.==. (
     ECHO "Missing file name."
 ) ELSE (
-    build\transpiler.exe %Argument%
+    build\transpiler.exe --pch %Argument%
 
     IF NOT EXIST result mkdir result
     pushd result
-    cl %CommonCompilerFlags% -Fe:result ..\result.c /link %CommonLinkerFlags%
+    cl %CommonCompilerFlags% -c -Yc"df_prelude.h" -Fp:df_prelude.pch ..\df_prelude.c
+    cl %CommonCompilerFlags% -Yu"df_prelude.h" -Fp:df_prelude.pch -Fe:result ..\result.c df_prelude.obj /link %CommonLinkerFlags%
     set LastError2=%ERRORLEVEL%
     popd
 )
@@ -0,0 +1,243 @@
+// Binary AST format of D Flat
+//
+// Written by `transpiler --emit-ast=File.dfa` and read back by passing the .dfa file instead of the sources. Tools can
+// map the file and walk the records in place without deserializing them.
+//
+// Layout: a df_ast_header, the records, then the string section. All values are little-endian and every record is
+// 8-byte aligned. Every offset field (int32_t, named like the thing it points to) counts bytes from the offset field
+// itself, with 0 meaning none, so the image stays valid wherever it is mapped. Strings are NUL-terminated and stored
+// once each in the string section. Types are stored by their source name ("int", "f64", "Vec2"), operators by their
+// source spelling packed into a uint32_t ('=' | ('=' << 8) for ==).
+//
+// Readers reject an image whose header doesn't match, whose arrays aren't none exactly when their count is 0, or
+// with any other offset none or out of place. The only optional offsets are the initializer of a variable and the
+// definition, condition and action of a for; every string and every other child is required. The remaining fields
+// (kinds, operators, Value, Split, IsSoa, the array kind and length of types, the Reserved fields) and the text of the
+// strings are plain values.
+//
+// Children of each expression kind:
+//     var      [Initializer]
+//     paren    [Inner]
+//     binary   [LHS, RHS]
+//     unary    [Operand], Value is 1 when the operator follows it
+//     call     [Arguments...]
+//     index    [Array, Index]
+//     field    [Object]
+//     if       [Condition, True branch... (Split of them), False branch...]
+//     for      [Definition, Condition, Action, Body...]
+//     return   [Value]
+//     bench    [Body...]
+//     match    [Value, Cases...]
+//     case     [Values... (Split of them), Body...], no values for the else case
+//
+
+#ifndef DF_AST_H
+#define DF_AST_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define DF_AST_MAGIC "DFAB"
+#define DF_AST_VERSION 4
+
+enum df_ast_declaration_kind
+{
+    DF_AST_DECLARATION_expr,
+    DF_AST_DECLARATION_func,
+    DF_AST_DECLARATION_struct,
+};
+
+enum df_ast_expr_kind
+{
+    DF_AST_EXPR_char,
+    DF_AST_EXPR_int,
+    DF_AST_EXPR_real,
+    DF_AST_EXPR_string,
+    DF_AST_EXPR_id,
+    DF_AST_EXPR_var,
+    DF_AST_EXPR_paren,
+    DF_AST_EXPR_binary,
+    DF_AST_EXPR_call,
+    DF_AST_EXPR_index,
+    DF_AST_EXPR_field,
+    DF_AST_EXPR_if,
+    DF_AST_EXPR_for,
+    DF_AST_EXPR_return,
+    DF_AST_EXPR_inline,
+    DF_AST_EXPR_unary,
+    DF_AST_EXPR_bench,
+    DF_AST_EXPR_match,
+    DF_AST_EXPR_case,
+};
+
+enum df_ast_array_kind
+{
+    DF_AST_ARRAY_none,
+    DF_AST_ARRAY_fixed,
+    DF_AST_ARRAY_slice,
+};
+
+typedef struct df_ast_header
+{
+    char Magic[4];
+    uint32_t Version;
+    uint32_t Size;
+    uint32_t DeclarationCount;
+    int32_t Declarations; // df_ast_declaration[DeclarationCount]
+    int32_t Strings;
+    uint32_t StringsSize;
+    uint32_t Reserved;
+} df_ast_header;
+
+typedef struct df_ast_type
+{
+    int32_t Name;
+    uint32_t ArrayKind;
+    uint64_t ArrayLength;
+} df_ast_type;
+
+typedef struct df_ast_declaration
+{
+    uint32_t Kind;
+    int32_t Node; // df_ast_expr, df_ast_func or df_ast_struct
+} df_ast_declaration;
+
+typedef struct df_ast_expr
+{
+    uint32_t Kind;
+    uint32_t Operator;
+    uint64_t Value;   // char and int values, bits of real values
+    int32_t Name;     // Text of strings and inline C, names of ids, variables, calls, fields and benches
+    uint32_t ChildCount;
+    int32_t Children; // int32_t[ChildCount] offsets of df_ast_expr
+    uint32_t Split;
+    df_ast_type Type; // Variables only
+} df_ast_expr;
+
+typedef struct df_ast_func
+{
+    df_ast_type Type;
+    int32_t Name;
+    uint32_t ParameterCount;
+    int32_t Parameters; // int32_t[ParameterCount] offsets of var df_ast_expr
+    uint32_t ExpressionCount;
+    int32_t Expressions; // int32_t[ExpressionCount] offsets of df_ast_expr
+    uint32_t Reserved;
+} df_ast_func;
+
+typedef struct df_ast_struct
+{
+    int32_t Name;
+    uint32_t IsSoa;
+    uint32_t FieldCount;
+    int32_t Fields; // int32_t[FieldCount] offsets of var df_ast_expr
+} df_ast_struct;
+
+static const void* DF_AstResolve(const int32_t* Offset)
+{
+    return *Offset ? (const void*)((const char*)Offset + *Offset) : 0;
+}
+
+static const char* DF_AstString(const int32_t* Offset)
+{
+    return (const char*)DF_AstResolve(Offset);
+}
+
+// Index-th entry of an offset array such as df_ast_expr.Children.
+static const void* DF_AstElement(const int32_t* Array, uint32_t Index)
+{
+    const int32_t* Elements = (const int32_t*)DF_AstResolve(Array);
+    return Elements ? DF_AstResolve(&Elements[Index]) : 0;
+}
+
+static const df_ast_declaration* DF_AstDeclarations(const df_ast_header* Header)
+{
+    return (const df_ast_declaration*)DF_AstResolve(&Header->Declarations);
+}
+
+typedef struct df_ast_mapping
+{
+    const df_ast_header* Header;
+    uint64_t Size;
+#if defined(_WIN32)
+    HANDLE File;
+    HANDLE Mapping;
+#endif
+} df_ast_mapping;
+
+static void DF_AstUnmap(df_ast_mapping* Mapping)
+{
+#if defined(_WIN32)
+    if(Mapping->Header)
+    {
+        UnmapViewOfFile(Mapping->Header);
+    }
+    if(Mapping->Mapping)
+    {
+        CloseHandle(Mapping->Mapping);
+    }
+    if(Mapping->File != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(Mapping->File);
+    }
+#else
+    if(Mapping->Header)
+    {
+        munmap((void*)Mapping->Header, (size_t)Mapping->Size);
+    }
+#endif
+    memset(Mapping, 0, sizeof(*Mapping));
+}
+
+// Maps a .dfa file read-only and checks its header. Returns the header, or 0 when the file isn't a usable AST image.
+static const df_ast_header* DF_AstMap(const char* FileName, df_ast_mapping* Mapping)
+{
+    memset(Mapping, 0, sizeof(*Mapping));
+#if defined(_WIN32)
+    Mapping->File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    LARGE_INTEGER Size;
+    if((Mapping->File == INVALID_HANDLE_VALUE) || !GetFileSizeEx(Mapping->File, &Size) || (Size.QuadPart < (LONGLONG)sizeof(df_ast_header)))
+    {
+        DF_AstUnmap(Mapping);
+        return 0;
+    }
+    Mapping->Size = (uint64_t)Size.QuadPart;
+    Mapping->Mapping = CreateFileMappingA(Mapping->File, 0, PAGE_READONLY, 0, 0, 0);
+    Mapping->Header = Mapping->Mapping ? (const df_ast_header*)MapViewOfFile(Mapping->Mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+#else
+    int File = open(FileName, O_RDONLY);
+    struct stat FileStat;
+    if((File < 0) || (fstat(File, &FileStat) != 0) || (FileStat.st_size < (off_t)sizeof(df_ast_header)))
+    {
+        if(File >= 0)
+        {
+            close(File);
+        }
+        return 0;
+    }
+    Mapping->Size = (uint64_t)FileStat.st_size;
+    void* Memory = mmap(0, (size_t)Mapping->Size, PROT_READ, MAP_PRIVATE, File, 0);
+    close(File);
+    Mapping->Header = (Memory != MAP_FAILED) ? (const df_ast_header*)Memory : 0;
+#endif
+
+    const df_ast_header* Header = Mapping->Header;
+    if(!Header || (memcmp(Header->Magic, DF_AST_MAGIC, 4) != 0) || (Header->Version != DF_AST_VERSION) || (Header->Size != Mapping->Size))
+    {
+        DF_AstUnmap(Mapping);
+        return 0;
+    }
+    return Header;
+}
+
+#endif
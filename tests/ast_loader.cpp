@@ -0,0 +1,241 @@
+// Loader test of the binary AST format: damaged .dfa images have to be rejected, never crash the transpiler.
+//
+// Build and run from an empty directory, as it writes its files into the current one:
+//     cl -nologo -D_CRT_SECURE_NO_WARNINGS -Fe:ast_loader ..\tests\ast_loader.cpp && ast_loader
+//     g++ -o ast_loader ../tests/ast_loader.cpp -lpthread && ./ast_loader
+//
+// A valid image is written with --emit-ast, then every 4-byte slot is zeroed in turn (turning offsets into "none" and
+// counts into 0) and the image is truncated at every 8 bytes. Each damaged image is translated in full. Slots that
+// df_ast.h documents as optional, plain values and optional offsets, may give another valid image; every other slot,
+// from the header to the offsets and counts, and every truncation have to be rejected.
+
+#define main TranspilerMain
+#include "../transpiler.cpp"
+#undef main
+
+#define SOURCE_FILE_NAME "ast_loader.df"
+#define AST_FILE_NAME "ast_loader.dfa"
+#define DAMAGED_FILE_NAME "ast_loader_damaged.dfa"
+
+static const char* Source =
+    "Pair :: struct { A : int; B : int; }\n"
+    "Total : int = 0;\n"
+    "Sum :: (Values : []int, Count : int) -> int\n"
+    "{\n"
+    "    S : int = 0;\n"
+    "    for i : int = 0; i < len(Values); i++\n"
+    "    {\n"
+    "        if (Values[i] > 0) && (i < Count) { S += Values[i] * 2; } else { S -= -Values[i]; }\n"
+    "    }\n"
+    "    match Count\n"
+    "    {\n"
+    "        case 1, 2 { S += 1; }\n"
+    "        else { S += 3; }\n"
+    "    }\n"
+    "    return S;\n"
+    "}\n"
+    "main :: () -> int\n"
+    "{\n"
+    "    P : Pair;\n"
+    "    P.A = 1;\n"
+    "    bench \"sum\" { Total += P.A; }\n"
+    "    return Total;\n"
+    "}\n";
+
+static bool WriteBytes(const char* FileName, const char* Bytes, size_t Size)
+{
+    FILE* FileHandle = fopen(FileName, "wb");
+    if(!FileHandle)
+    {
+        return false;
+    }
+    bool Result = (fwrite(Bytes, 1, Size, FileHandle) == Size);
+    return (fclose(FileHandle) == 0) && Result;
+}
+
+static char* ReadBytes(const char* FileName, size_t* Size)
+{
+    FILE* FileHandle = fopen(FileName, "rb");
+    if(!FileHandle)
+    {
+        return NULL;
+    }
+    fseek(FileHandle, 0, SEEK_END);
+    *Size = (size_t)ftell(FileHandle);
+    fseek(FileHandle, 0, SEEK_SET);
+    char* Bytes = (char*)malloc(*Size);
+    if(Bytes && (fread(Bytes, 1, *Size, FileHandle) != *Size))
+    {
+        free(Bytes);
+        Bytes = NULL;
+    }
+    fclose(FileHandle);
+    return Bytes;
+}
+
+static void MarkOptional(bool* IsOptional, const char* Image, const void* Field, size_t Size)
+{
+    size_t Start = (size_t)((const char*)Field - Image);
+    for(size_t i = Start / 4; i < (Start + Size + 3) / 4; ++i)
+    {
+        IsOptional[i] = true;
+    }
+}
+
+// Walks the records of an undamaged image and marks the 4-byte slots that df_ast.h documents as optional.
+static void MarkOptionalSlots(const char* Image, size_t Size, bool* IsOptional)
+{
+    const df_ast_header* Header = (const df_ast_header*)Image;
+    MarkOptional(IsOptional, Image, &Header->Reserved, sizeof(Header->Reserved));
+    MarkOptional(IsOptional, Image, DF_AstResolve(&Header->Strings), Header->StringsSize);
+
+    const df_ast_expr** Stack = (const df_ast_expr**)malloc(sizeof(df_ast_expr*) * (Size / sizeof(df_ast_expr) + 1));
+    uint32_t StackCount = 0;
+    const df_ast_declaration* Declarations = DF_AstDeclarations(Header);
+    for(uint32_t i = 0; i < Header->DeclarationCount; ++i)
+    {
+        const df_ast_declaration* Declaration = &Declarations[i];
+        MarkOptional(IsOptional, Image, &Declaration->Kind, sizeof(Declaration->Kind));
+        const void* Node = DF_AstResolve(&Declaration->Node);
+        if(Declaration->Kind == DF_AST_DECLARATION_expr)
+        {
+            Stack[StackCount++] = (const df_ast_expr*)Node;
+        }
+        else if(Declaration->Kind == DF_AST_DECLARATION_func)
+        {
+            const df_ast_func* Function = (const df_ast_func*)Node;
+            MarkOptional(IsOptional, Image, &Function->Type.ArrayKind, sizeof(Function->Type.ArrayKind));
+            MarkOptional(IsOptional, Image, &Function->Type.ArrayLength, sizeof(Function->Type.ArrayLength));
+            MarkOptional(IsOptional, Image, &Function->Reserved, sizeof(Function->Reserved));
+            for(uint32_t j = 0; j < Function->ParameterCount; ++j)
+            {
+                Stack[StackCount++] = (const df_ast_expr*)DF_AstElement(&Function->Parameters, j);
+            }
+            for(uint32_t j = 0; j < Function->ExpressionCount; ++j)
+            {
+                Stack[StackCount++] = (const df_ast_expr*)DF_AstElement(&Function->Expressions, j);
+            }
+        }
+        else
+        {
+            const df_ast_struct* Struct = (const df_ast_struct*)Node;
+            MarkOptional(IsOptional, Image, &Struct->IsSoa, sizeof(Struct->IsSoa));
+            for(uint32_t j = 0; j < Struct->FieldCount; ++j)
+            {
+                Stack[StackCount++] = (const df_ast_expr*)DF_AstElement(&Struct->Fields, j);
+            }
+        }
+    }
+
+    while(StackCount)
+    {
+        const df_ast_expr* Expression = Stack[--StackCount];
+        MarkOptional(IsOptional, Image, &Expression->Kind, sizeof(Expression->Kind));
+        MarkOptional(IsOptional, Image, &Expression->Operator, sizeof(Expression->Operator));
+        MarkOptional(IsOptional, Image, &Expression->Value, sizeof(Expression->Value));
+        MarkOptional(IsOptional, Image, &Expression->Split, sizeof(Expression->Split));
+        MarkOptional(IsOptional, Image, &Expression->Type.ArrayKind, sizeof(Expression->Type.ArrayKind));
+        MarkOptional(IsOptional, Image, &Expression->Type.ArrayLength, sizeof(Expression->Type.ArrayLength));
+        const int32_t* Children = (const int32_t*)DF_AstResolve(&Expression->Children);
+        for(uint32_t j = 0; j < Expression->ChildCount; ++j)
+        {
+            if((Expression->Kind == DF_AST_EXPR_var) || ((Expression->Kind == DF_AST_EXPR_for) && (j < 3)))
+            {
+                MarkOptional(IsOptional, Image, &Children[j], sizeof(Children[j]));
+            }
+            if(Children[j])
+            {
+                Stack[StackCount++] = (const df_ast_expr*)DF_AstResolve(&Children[j]);
+            }
+        }
+    }
+    free(Stack);
+}
+
+static int32_t Transpile(const char* Option, const char* FileName)
+{
+    char* Arguments[3] = {(char*)"transpiler", (char*)(Option ? Option : FileName), (char*)FileName};
+    return TranspilerMain(Option ? 3 : 2, Arguments);
+}
+
+int main()
+{
+    if(!WriteBytes(SOURCE_FILE_NAME, Source, strlen(Source)) || (Transpile("--emit-ast=" AST_FILE_NAME, SOURCE_FILE_NAME) != 0))
+    {
+        fprintf(stderr, "FAIL: couldn't write %s.\n", AST_FILE_NAME);
+        return 1;
+    }
+    if(Transpile(NULL, AST_FILE_NAME) != 0)
+    {
+        fprintf(stderr, "FAIL: the undamaged %s doesn't translate.\n", AST_FILE_NAME);
+        return 1;
+    }
+
+    size_t Size = 0;
+    char* Image = ReadBytes(AST_FILE_NAME, &Size);
+    char* Damaged = Image ? (char*)malloc(Size) : NULL;
+    bool* IsOptional = Image ? (bool*)calloc(Size / 4 + 1, sizeof(bool)) : NULL;
+    if(!Damaged || !IsOptional)
+    {
+        fprintf(stderr, "FAIL: couldn't read %s.\n", AST_FILE_NAME);
+        return 1;
+    }
+
+    // The transpiler reports every damaged image, which would drown the result.
+#if defined(_WIN32)
+    freopen("NUL", "w", stderr);
+#else
+    freopen("/dev/null", "w", stderr);
+#endif
+
+    MarkOptionalSlots(Image, Size, IsOptional);
+    uint32_t RequiredCount = 0;
+    uint32_t AcceptedRequiredCount = 0;
+    uint32_t OptionalCount = 0;
+    uint32_t AcceptedOptionalCount = 0;
+    for(size_t Offset = 0; Offset + 4 <= Size; Offset += 4)
+    {
+        memcpy(Damaged, Image, Size);
+        memset(Damaged + Offset, 0, 4);
+        if(memcmp(Damaged + Offset, Image + Offset, 4) == 0)
+        {
+            continue;
+        }
+        WriteBytes(DAMAGED_FILE_NAME, Damaged, Size);
+        bool IsAccepted = (Transpile(NULL, DAMAGED_FILE_NAME) == 0);
+        if(IsOptional[Offset / 4])
+        {
+            ++OptionalCount;
+            AcceptedOptionalCount += IsAccepted;
+        }
+        else
+        {
+            ++RequiredCount;
+            if(IsAccepted)
+            {
+                printf("FAIL: the image was accepted with the required slot at byte %u zeroed.\n", (uint32_t)Offset);
+                ++AcceptedRequiredCount;
+            }
+        }
+    }
+
+    bool IsTruncationRejected = true;
+    for(size_t Length = 0; Length < Size; Length += 8)
+    {
+        WriteBytes(DAMAGED_FILE_NAME, Image, Length);
+        IsTruncationRejected = IsTruncationRejected && (Transpile(NULL, DAMAGED_FILE_NAME) != 0);
+    }
+
+    free(IsOptional);
+    free(Damaged);
+    free(Image);
+    if(!IsTruncationRejected || AcceptedRequiredCount)
+    {
+        printf("FAIL: %u of %u required slots zeroed were accepted, truncated images %s.\n", AcceptedRequiredCount, RequiredCount,
+               IsTruncationRejected ? "rejected" : "accepted");
+        return 1;
+    }
+    printf("OK: all %u required slots zeroed were rejected, %u of %u optional ones accepted, truncated images rejected.\n",
+           RequiredCount, AcceptedOptionalCount, OptionalCount);
+    return 0;
+}
@@ -0,0 +1,297 @@
+// Translation test of small D Flat programs: each is translated, compiled with the C compiler and run, and what it
+// prints has to match. Programs the transpiler has to refuse are checked for the error it reports instead.
+//
+// Build and run from an empty directory, as it writes its files into the current one:
+//     cl -nologo -D_CRT_SECURE_NO_WARNINGS -Fe:programs ..\tests\programs.cpp && programs
+//     g++ -o programs ../tests/programs.cpp -lpthread && ./programs
+//
+// The generated C is compiled with cl on Windows and with $CC (cc by default) elsewhere.
+
+#define main TranspilerMain
+#include "../transpiler.cpp"
+#undef main
+
+#define SOURCE_FILE_NAME "program.df"
+#define OUTPUT_FILE_NAME "program.txt"
+#define ERROR_FILE_NAME "program_errors.txt"
+
+// Output is what the program prints, or Error, when set, part of what the transpiler reports.
+struct test_program
+{
+    const char* Name;
+    const char* Source;
+    const char* Output;
+    const char* Error;
+};
+
+static const test_program Programs[] = {
+    // Narrow loop variables wrap around to negative values, so their divisions by powers of two can't become shifts.
+    {"narrow_counter",
+     "main :: () -> int\n"
+     "{\n"
+     "    S : int = 0;\n"
+     "    R : int = 0;\n"
+     "    for i : i8 = 120; i != -120; i++ { S = S + i / 4; R = R + i % 4; }\n"
+     "    N : int = 0;\n"
+     "    for j : int = 1; j < 100; j++ { N = N + j / 4; }\n"
+     "    printf(\"%d %d %d\\n\", S, R, N);\n"
+     "    return 0;\n"
+     "}\n",
+     "-2 0 1200\n", NULL},
+    // write_float has to round like printf, from the exact value of the double: these are all next to the half-way
+    // points of the sixth decimal, or on them.
+    {"float_rounding",
+     "Both :: (X : f64) -> int\n"
+     "{\n"
+     "    write_float(X);\n"
+     "    write_char(' ');\n"
+     "    flush();\n"
+     "    printf(\"%f\\n\", X);\n"
+     "    return 0;\n"
+     "}\n"
+     "main :: () -> int\n"
+     "{\n"
+     "    Both(0.0000005);\n"
+     "    Both(-0.0000005);\n"
+     "    Both(0.0000015);\n"
+     "    Both(0.0000025);\n"
+     "    Both(0.0078125);\n"
+     "    Both(0.0234375);\n"
+     "    Both(1.0000005);\n"
+     "    Both(0.9999995);\n"
+     "    Both(123456.1234565);\n"
+     "    return 0;\n"
+     "}\n",
+     "0.000000 0.000000\n"
+     "-0.000000 -0.000000\n"
+     "0.000002 0.000002\n"
+     "0.000003 0.000003\n"
+     "0.007812 0.007812\n"
+     "0.023438 0.023438\n"
+     "1.000001 1.000001\n"
+     "1.000000 1.000000\n"
+     "123456.123457 123456.123457\n",
+     NULL},
+    // Whole elements of #soa arrays are gathered from and scattered to the field arrays, including array fields.
+    {"soa_elements",
+     "Vec2 :: struct { X : int; Y : int; }\n"
+     "P :: struct #soa { Id : int; Pos : Vec2; Tags : [3]int; Name : string; }\n"
+     "Ps : [8]P;\n"
+     "Sum :: (Qs : []P) -> int\n"
+     "{\n"
+     "    S : int = 0;\n"
+     "    for i : int = 0; i < len(Qs); i++ { E : P = Qs[i]; S = S + E.Id + E.Pos.X + E.Tags[2]; }\n"
+     "    return S;\n"
+     "}\n"
+     "Swap :: (Qs : []P, A : int, B : int) -> int\n"
+     "{\n"
+     "    T : P = Qs[A];\n"
+     "    Qs[A] = Qs[B];\n"
+     "    Qs[B] = T;\n"
+     "    return 0;\n"
+     "}\n"
+     "main :: () -> int\n"
+     "{\n"
+     "    One : P;\n"
+     "    One.Id = 5;\n"
+     "    One.Pos.X = 10;\n"
+     "    One.Pos.Y = 20;\n"
+     "    One.Tags[2] = 3;\n"
+     "    One.Name = \"one\";\n"
+     "    for i : int = 0; i < 8; i++ { Ps[i].Id = i; Ps[i].Tags[2] = 100 * i; }\n"
+     "    Ps[3] = One;\n"
+     "    Q : P = Ps[3];\n"
+     "    Local : [4]P;\n"
+     "    Local[1] = Ps[3];\n"
+     "    Local[1].Tags[1] = 7;\n"
+     "    Swap(Ps, 0, 3);\n"
+     "    printf(\"%d %d %d %d %s %d %d\\n\", Q.Id, Q.Pos.Y, Q.Tags[2], Ps[0].Tags[2], Ps[0].Name, Local[1].Tags[1], Sum(Ps));\n"
+     "    return 0;\n"
+     "}\n",
+     "5 20 3 3 one 7 2543\n", NULL},
+    // Compound assignments of whole elements and #soa fields of #soa structs are refused.
+    {"soa_compound_assignment",
+     "P :: struct #soa { X : int; }\n"
+     "Ps : [4]P;\n"
+     "main :: () -> int { One : P; Ps[1] += One; return 0; }\n",
+     NULL, "whole elements of #soa arrays can only be assigned with '='"},
+    {"soa_field_of_soa_arrays",
+     "P :: struct #soa { X : int; }\n"
+     "Q :: struct #soa { Inner : [2]P; }\n"
+     "main :: () -> int { return 0; }\n",
+     NULL, "field 'Inner' of struct 'Q' can't have that type"},
+};
+
+// main printing X, initialized by Depth times Open, 0 and Depth times Close.
+struct nested_program
+{
+    const char* Name;
+    const char* Open;
+    const char* Close;
+    uint32_t Depth;
+    const char* Output;
+    const char* Error;
+};
+
+static const nested_program NestedPrograms[] = {
+    {"nested_calls", "F(", ")", 250, "250\n", NULL},
+    {"nested_indices", "A[", "]", 250, "0\n", NULL},
+    {"nested_parens_and_calls", "(F(", "))", 125, "125\n", NULL},
+    {"too_deep_calls", "F(", ")", 2000, NULL, "calls nested too deeply"},
+    {"too_deep_indices", "A[", "]", 20000, NULL, "indices nested too deeply"},
+    {"too_deep_parens", "(", ")", 300, NULL, "parentheses nested too deeply"},
+};
+
+static bool WriteBytes(const char* FileName, const char* Bytes, size_t Size)
+{
+    FILE* FileHandle = fopen(FileName, "wb");
+    if(!FileHandle)
+    {
+        return false;
+    }
+    bool Result = (fwrite(Bytes, 1, Size, FileHandle) == Size);
+    return (fclose(FileHandle) == 0) && Result;
+}
+
+static bool ReadText(const char* FileName, char* Text, size_t Capacity)
+{
+    FILE* FileHandle = fopen(FileName, "rb");
+    if(!FileHandle)
+    {
+        return false;
+    }
+    size_t Size = fread(Text, 1, Capacity - 1, FileHandle);
+    Text[Size] = 0;
+    fclose(FileHandle);
+    return true;
+}
+
+static bool CompileAndRun()
+{
+    char Command[512];
+#if defined(_WIN32)
+    snprintf(Command, sizeof(Command), "cl -nologo -W4 -WX -wd4201 -wd4100 -wd4189 -wd4505 -wd4127 -D_CRT_SECURE_NO_WARNINGS "
+                                       "-Fe:program result.c > NUL && program > %s", OUTPUT_FILE_NAME);
+#else
+    const char* Compiler = getenv("CC");
+    snprintf(Command, sizeof(Command), "%s -o program result.c -lm && ./program > %s", Compiler ? Compiler : "cc", OUTPUT_FILE_NAME);
+#endif
+    return system(Command) == 0;
+}
+
+// Translates SOURCE_FILE_NAME, then runs it and compares what it prints with Output, or looks for Error among the
+// errors reported.
+static bool RunProgram(const char* Name, const char* Output, const char* Error)
+{
+    char* Arguments[2] = {(char*)"transpiler", (char*)SOURCE_FILE_NAME};
+    char Text[4096] = "";
+    remove("result.c");
+    remove(OUTPUT_FILE_NAME);
+    freopen(ERROR_FILE_NAME, "w", stderr);
+    bool IsTranslated = (TranspilerMain(2, Arguments) == 0);
+    fflush(stderr);
+
+    bool Result;
+    if(Error)
+    {
+        Result = ReadText(ERROR_FILE_NAME, Text, sizeof(Text)) && strstr(Text, Error);
+        if(!Result)
+        {
+            printf("FAIL: %s reported \"%s\" instead of \"%s\".\n", Name, Text, Error);
+        }
+    }
+    else
+    {
+        Result = IsTranslated && CompileAndRun() && ReadText(OUTPUT_FILE_NAME, Text, sizeof(Text)) && (strcmp(Text, Output) == 0);
+        if(!Result)
+        {
+            printf("FAIL: %s printed \"%s\" instead of \"%s\".\n", Name, Text, Output);
+        }
+    }
+    return Result;
+}
+
+static bool WriteNestedSource(const char* FileName, const nested_program* Program)
+{
+    FILE* FileHandle = fopen(FileName, "wb");
+    if(!FileHandle)
+    {
+        return false;
+    }
+    fprintf(FileHandle, "F :: (X : int) -> int\n{\n    return X + 1;\n}\n"
+                        "main :: () -> int\n{\n    A : [4]int;\n    A[0] = 0;\n    X : int = ");
+    for(uint32_t i = 0; i < Program->Depth; ++i)
+    {
+        fprintf(FileHandle, "%s", Program->Open);
+    }
+    fprintf(FileHandle, "0");
+    for(uint32_t i = 0; i < Program->Depth; ++i)
+    {
+        fprintf(FileHandle, "%s", Program->Close);
+    }
+    fprintf(FileHandle, ";\n    printf(\"%%d\\n\", X);\n    return 0;\n}\n");
+    return fclose(FileHandle) == 0;
+}
+
+// More than a MiB of functions, main calling the last one.
+static bool WriteLargeSource(const char* FileName, uint32_t FunctionCount)
+{
+    FILE* FileHandle = fopen(FileName, "wb");
+    if(!FileHandle)
+    {
+        return false;
+    }
+    for(uint32_t i = 0; i < FunctionCount; ++i)
+    {
+        fprintf(FileHandle, "F%u :: (X : int) -> int\n{\n", i);
+        for(uint32_t j = 0; j < 25; ++j)
+        {
+            fprintf(FileHandle, "    X = X + 1;\n");
+        }
+        fprintf(FileHandle, "    return X + %u;\n}\n", i);
+    }
+    fprintf(FileHandle, "main :: () -> int\n{\n    printf(\"%%d %%d\\n\", F0(0), F%u(0));\n    return 0;\n}\n", FunctionCount - 1);
+    return fclose(FileHandle) == 0;
+}
+
+int main()
+{
+    uint32_t FailCount = 0;
+    uint32_t ProgramCount = sizeof(Programs) / sizeof(Programs[0]);
+    for(uint32_t i = 0; i < ProgramCount; ++i)
+    {
+        const test_program* Program = &Programs[i];
+        if(!WriteBytes(SOURCE_FILE_NAME, Program->Source, strlen(Program->Source)) ||
+           !RunProgram(Program->Name, Program->Output, Program->Error))
+        {
+            ++FailCount;
+        }
+    }
+
+    // The parser doesn't recurse into parentheses, but calls and indices count towards the same depth limit.
+    uint32_t NestedCount = sizeof(NestedPrograms) / sizeof(NestedPrograms[0]);
+    for(uint32_t i = 0; i < NestedCount; ++i)
+    {
+        const nested_program* Program = &NestedPrograms[i];
+        if(!WriteNestedSource(SOURCE_FILE_NAME, Program) || !RunProgram(Program->Name, Program->Output, Program->Error))
+        {
+            ++FailCount;
+        }
+    }
+    ProgramCount += NestedCount;
+
+    // Sources used to be cut at 1 MiB.
+    ++ProgramCount;
+    if(!WriteLargeSource(SOURCE_FILE_NAME, 2800) || !RunProgram("large_source", "25 2824\n", NULL))
+    {
+        ++FailCount;
+    }
+
+    if(FailCount)
+    {
+        printf("FAIL: %u of %u programs.\n", FailCount, ProgramCount);
+        return 1;
+    }
+    printf("OK: %u programs.\n", ProgramCount);
+    return 0;
+}
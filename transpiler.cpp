@@ -8,10 +8,273 @@
 //
 
 #include <assert.h>
+#include <errno.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "df_ast.h"
+
+// The few threading primitives used to parse declarations in parallel, see ParseDeclarations.
+#if defined(_WIN32)
+typedef SRWLOCK platform_mutex;
+
+struct platform_thread
+{
+    void (*Function)(void*);
+    void* Data;
+    HANDLE Handle;
+};
+
+static uint64_t AtomicAdd(uint64_t* Value, uint64_t Addend)
+{
+    return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)Value, (LONG64)Addend) + Addend;
+}
+
+static uint32_t AtomicIncrement(uint32_t* Value)
+{
+    return (uint32_t)InterlockedIncrement((volatile LONG*)Value);
+}
+
+static bool AtomicCompareExchange(uint64_t* Value, uint64_t Expected, uint64_t Desired)
+{
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)Value, (LONG64)Desired, (LONG64)Expected) == Expected;
+}
+
+static void InitMutex(platform_mutex* Mutex)
+{
+    InitializeSRWLock(Mutex);
+}
+
+static void LockMutex(platform_mutex* Mutex)
+{
+    AcquireSRWLockExclusive(Mutex);
+}
+
+static void UnlockMutex(platform_mutex* Mutex)
+{
+    ReleaseSRWLockExclusive(Mutex);
+}
+
+static DWORD WINAPI RunThread(void* Thread)
+{
+    ((platform_thread*)Thread)->Function(((platform_thread*)Thread)->Data);
+    return 0;
+}
+
+static bool StartThread(platform_thread* Thread, void (*Function)(void*), void* Data)
+{
+    Thread->Function = Function;
+    Thread->Data = Data;
+    Thread->Handle = CreateThread(NULL, 0, RunThread, Thread, 0, NULL);
+    return Thread->Handle != NULL;
+}
+
+static void JoinThread(platform_thread* Thread)
+{
+    WaitForSingleObject(Thread->Handle, INFINITE);
+    CloseHandle(Thread->Handle);
+}
+
+static uint32_t GetProcessorCount()
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return (uint32_t)Info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_mutex_t platform_mutex;
+
+struct platform_thread
+{
+    void (*Function)(void*);
+    void* Data;
+    pthread_t Handle;
+};
+
+static uint64_t AtomicAdd(uint64_t* Value, uint64_t Addend)
+{
+    return __atomic_add_fetch(Value, Addend, __ATOMIC_RELAXED);
+}
+
+static uint32_t AtomicIncrement(uint32_t* Value)
+{
+    return __atomic_add_fetch(Value, 1, __ATOMIC_RELAXED);
+}
+
+static bool AtomicCompareExchange(uint64_t* Value, uint64_t Expected, uint64_t Desired)
+{
+    return __atomic_compare_exchange_n(Value, &Expected, Desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void InitMutex(platform_mutex* Mutex)
+{
+    pthread_mutex_init(Mutex, NULL);
+}
+
+static void LockMutex(platform_mutex* Mutex)
+{
+    pthread_mutex_lock(Mutex);
+}
+
+static void UnlockMutex(platform_mutex* Mutex)
+{
+    pthread_mutex_unlock(Mutex);
+}
+
+static void* RunThread(void* Thread)
+{
+    ((platform_thread*)Thread)->Function(((platform_thread*)Thread)->Data);
+    return NULL;
+}
+
+static bool StartThread(platform_thread* Thread, void (*Function)(void*), void* Data)
+{
+    Thread->Function = Function;
+    Thread->Data = Data;
+    return pthread_create(&Thread->Handle, NULL, RunThread, Thread) == 0;
+}
+
+static void JoinThread(platform_thread* Thread)
+{
+    pthread_join(Thread->Handle, NULL);
+}
+
+static uint32_t GetProcessorCount()
+{
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (Count > 0) ? (uint32_t)Count : 1;
+}
+#endif
+
+// Every allocation of the transpiler goes through Allocate with the subsystem it belongs to, which keeps live and peak
+// byte counts per subsystem for --mem-report. The counts are atomic, as parsing threads allocate too.
+enum memory_tag
+{
+    MEMORY_input,      // Source texts and their bookkeeping
+    MEMORY_lexer,      // Token scratch
+    MEMORY_strings,    // Interned identifiers and literals
+    MEMORY_ast,        // Parsed declarations
+    MEMORY_translator, // Symbols, signatures and other translation state
+    MEMORY_output,     // Output buffers and AST images
+    MEMORY_scratch,    // Work stacks outgrowing their buffers
+
+    MEMORY_tag_count,
+};
+
+static const char* MemoryTagNames[MEMORY_tag_count] = {"input", "lexer", "strings", "ast", "translator", "output", "scratch"};
+
+struct memory_stats
+{
+    uint64_t Live;
+    uint64_t Peak;
+    uint64_t AllocationCount;
+};
+
+static memory_stats MemoryStats[MEMORY_tag_count];
+static memory_stats TotalMemoryStats;
+
+// Precedes every allocation, keeping the alignment of malloc.
+struct alignas(16) allocation_header
+{
+    uint64_t Size;
+    uint64_t Tag;
+};
+
+static void CountAllocation(memory_stats* Stats, uint64_t Size)
+{
+    uint64_t Live = AtomicAdd(&Stats->Live, Size);
+    AtomicAdd(&Stats->AllocationCount, 1);
+    for(uint64_t Peak = AtomicAdd(&Stats->Peak, 0); (Live > Peak) && !AtomicCompareExchange(&Stats->Peak, Peak, Live);
+        Peak = AtomicAdd(&Stats->Peak, 0))
+    {
+    }
+}
+
+// Unsigned wrap-around takes Size off.
+static void CountDeallocation(memory_stats* Stats, uint64_t Size)
+{
+    AtomicAdd(&Stats->Live, 0 - Size);
+}
+
+static void* Allocate(memory_tag Tag, size_t Size)
+{
+    allocation_header* Header = (allocation_header*)malloc(sizeof(allocation_header) + Size);
+    if(!Header)
+    {
+        fprintf(stderr, "Error: out of memory.\n");
+        exit(1);
+    }
+    Header->Size = Size;
+    Header->Tag = Tag;
+    CountAllocation(&MemoryStats[Tag], Size);
+    CountAllocation(&TotalMemoryStats, Size);
+    return Header + 1;
+}
+
+static void Deallocate(void* Memory)
+{
+    if(!Memory)
+    {
+        return;
+    }
+    allocation_header* Header = (allocation_header*)Memory - 1;
+    CountDeallocation(&MemoryStats[Header->Tag], Header->Size);
+    CountDeallocation(&TotalMemoryStats, Header->Size);
+    free(Header);
+}
+
+// Memory keeps the tag it was allocated with.
+static void* Reallocate(memory_tag Tag, void* Memory, size_t Size)
+{
+    if(!Memory)
+    {
+        return Allocate(Tag, Size);
+    }
+
+    allocation_header* Header = (allocation_header*)Memory - 1;
+    uint64_t OldSize = Header->Size;
+    Header = (allocation_header*)realloc(Header, sizeof(allocation_header) + Size);
+    if(!Header)
+    {
+        fprintf(stderr, "Error: out of memory.\n");
+        exit(1);
+    }
+    Header->Size = Size;
+    CountDeallocation(&MemoryStats[Header->Tag], OldSize);
+    CountDeallocation(&TotalMemoryStats, OldSize);
+    CountAllocation(&MemoryStats[Header->Tag], Size);
+    CountAllocation(&TotalMemoryStats, Size);
+    return Header + 1;
+}
+
+static void PrintMemoryReport()
+{
+    printf("%-12s %14s %14s %12s\n", "memory", "live bytes", "peak bytes", "allocations");
+    for(uint32_t i = 0; i < MEMORY_tag_count; ++i)
+    {
+        printf("%-12s %14llu %14llu %12llu\n", MemoryTagNames[i], (unsigned long long)MemoryStats[i].Live, (unsigned long long)MemoryStats[i].Peak,
+               (unsigned long long)MemoryStats[i].AllocationCount);
+    }
+    printf("%-12s %14llu %14llu %12llu\n", "total", (unsigned long long)TotalMemoryStats.Live, (unsigned long long)TotalMemoryStats.Peak,
+           (unsigned long long)TotalMemoryStats.AllocationCount);
+    fflush(stdout);
+}
 
 enum token
 {
@@ -28,13 +291,28 @@ enum token
     TOKEN_char,
     TOKEN_int,
     TOKEN_float,
+    TOKEN_i8,
+    TOKEN_i16,
+    TOKEN_i32,
+    TOKEN_i64,
+    TOKEN_u8,
+    TOKEN_u16,
+    TOKEN_u32,
+    TOKEN_u64,
+    TOKEN_f32,
+    TOKEN_f64,
     TOKEN_string,
+    TOKEN_arena,
 
     // Control
     TOKEN_if,
     TOKEN_else,
     TOKEN_for,
     TOKEN_return,
+    TOKEN_struct,
+    TOKEN_bench,
+    TOKEN_match,
+    TOKEN_case,
 
     // Operators
     TOKEN_double_colon,
@@ -56,8 +334,13 @@ enum token
     TOKEN_oror,
 
     TOKEN_inline,
+
+    TOKEN_count,
 };
 
+// Indexed by Token - TOKEN_i8.
+static const char* SizedTypeNames[] = {"i8", "i16", "i32", "i64", "u8", "u16", "u32", "u64", "f32", "f64"};
+
 struct lexer
 {
     // Lexer variables
@@ -77,6 +360,9 @@ struct lexer
     uint64_t IntNumber;
     char* String;
     int32_t StringLength;
+
+    // Parentheses, calls and indices open around the token, see ParseExpression.
+    uint32_t NestingDepth;
 };
 
 struct location
@@ -85,6 +371,7 @@ struct location
     int32_t LineOffset;
 };
 
+// The input must be followed by LEXER_PADDING NULs, InputStreamEnd can stop before them to lex only a part of it.
 static void InitLexer(lexer* Lexer, const char* InputStream, const char* InputStreamEnd, char* StringStorage, int32_t StringStorageLength)
 {
     Lexer->InputStream = (char*)InputStream;
@@ -92,6 +379,7 @@ static void InitLexer(lexer* Lexer, const char* InputStream, const char* InputSt
     Lexer->ParsePoint = Lexer->InputStream;
     Lexer->StringStorage = StringStorage;
     Lexer->StringStorageLength = StringStorageLength;
+    Lexer->NestingDepth = 0;
 }
 
 static void GetLocation(location* Location, lexer* Lexer, char* CurrentPoint)
@@ -180,6 +468,11 @@ static int32_t ParseString(lexer* Lexer, char* ParsePoint)
     char* OutputEnd = Lexer->StringStorage + Lexer->StringStorageLength;
     while(*ParsePoint != '"')
     {
+        if((*ParsePoint == '\0') && (ParsePoint >= Lexer->EndOfFile))
+        {
+            return Tokenize(Lexer, TOKEN_parse_error, Start - 1, ParsePoint - 1);
+        }
+
         int Character;
         if(*ParsePoint == '\\')
         {
@@ -209,377 +502,301 @@ static int32_t ParseString(lexer* Lexer, char* ParsePoint)
     return Tokenize(Lexer, TOKEN_string_text, Start, ParsePoint);
 }
 
-static token MatchToken(lexer* Lexer)
+// Keywords, operators and comment openers, the lexemes with a fixed spelling. They are compiled below into the
+// transition table of a DFA which matches the longest one in a single pass, and names along with the keywords.
+struct lexeme_spelling
 {
-    if(strcmp(Lexer->String, "char") == 0)
-    {
-        return TOKEN_char;
-    }
-    if(strcmp(Lexer->String, "int") == 0)
-    {
-        return TOKEN_int;
-    }
-    if(strcmp(Lexer->String, "float") == 0)
-    {
-        return TOKEN_float;
-    }
-    if(strcmp(Lexer->String, "string") == 0)
-    {
-        return TOKEN_string;
-    }
-    if(strcmp(Lexer->String, "if") == 0)
+    const char* Spelling;
+    int32_t Token;
+};
+
+// Comments are skipped rather than returned, so their lexemes stay out of the token range.
+enum lexeme
+{
+    LEXEME_line_comment = -2,
+    LEXEME_block_comment = -1,
+};
+
+static constexpr lexeme_spelling LexemeSpellings[] = {
+    {"char", TOKEN_char},       {"int", TOKEN_int},    {"float", TOKEN_float}, {"i8", TOKEN_i8},     {"i16", TOKEN_i16},
+    {"i32", TOKEN_i32},         {"i64", TOKEN_i64},    {"u8", TOKEN_u8},       {"u16", TOKEN_u16},   {"u32", TOKEN_u32},
+    {"u64", TOKEN_u64},         {"f32", TOKEN_f32},    {"f64", TOKEN_f64},     {"string", TOKEN_string}, {"arena", TOKEN_arena},
+    {"if", TOKEN_if},           {"else", TOKEN_else},  {"for", TOKEN_for},     {"return", TOKEN_return}, {"struct", TOKEN_struct},
+    {"bench", TOKEN_bench},     {"match", TOKEN_match}, {"case", TOKEN_case},
+    {"::", TOKEN_double_colon}, {":=", TOKEN_coloneq}, {"+=", TOKEN_pluseq},  {"++", TOKEN_plusplus}, {"-=", TOKEN_minuseq},
+    {"--", TOKEN_minusminus},   {"->", TOKEN_arrow},   {"*=", TOKEN_muleq},   {"/=", TOKEN_diveq},    {"%=", TOKEN_modeq},
+    {"==", TOKEN_eq},           {"!=", TOKEN_noteq},   {"<=", TOKEN_lesseq},  {"<>", TOKEN_inline},   {">=", TOKEN_moreeq},
+    {"&&", TOKEN_andand},       {"||", TOKEN_oror},    {"//", LEXEME_line_comment}, {"/*", LEXEME_block_comment},
+};
+
+// What a byte can start. The input ends with a NUL sentinel, so scans stop on it without checking bounds.
+enum char_kind
+{
+    CHAR_other,
+    CHAR_end,
+    CHAR_space,
+    CHAR_letter,
+    CHAR_digit,
+    CHAR_operator,
+    CHAR_quote,
+    CHAR_apostrophe,
+};
+
+// Source texts are followed by this many NULs: the sentinel, and room for an escape cut off by the end of input.
+#define LEXER_PADDING 4
+
+#define MAX_LEXER_CLASS_COUNT 48
+#define MAX_LEXER_STATE_COUNT 128
+
+// Bytes of the spellings get classes 1 and up, the other letters and digits share one more, and every other byte is
+// class 0 which no state leaves on. State 0 is the start, and a 0 transition ends the match with the token accepted by
+// the current state.
+struct lexer_tables
+{
+    uint8_t CharKinds[256];
+    uint8_t ByteClasses[256];
+    uint8_t Transitions[MAX_LEXER_STATE_COUNT][MAX_LEXER_CLASS_COUNT];
+    int32_t Accepts[MAX_LEXER_STATE_COUNT];
+    uint32_t ClassCount;
+    uint32_t StateCount;
+    bool IsEveryStateAccepting;
+};
+
+template<uint32_t SpellingCount>
+static constexpr lexer_tables MakeLexerTables(const lexeme_spelling (&Spellings)[SpellingCount])
+{
+    lexer_tables Tables = {};
+    Tables.CharKinds[0] = CHAR_end;
+    Tables.CharKinds[(uint8_t)' '] = Tables.CharKinds[(uint8_t)'\t'] = Tables.CharKinds[(uint8_t)'\r'] = CHAR_space;
+    Tables.CharKinds[(uint8_t)'\n'] = Tables.CharKinds[(uint8_t)'\f'] = CHAR_space;
+    for(uint32_t Character = 0; Character < 256; ++Character)
     {
-        return TOKEN_if;
+        if(((Character >= 'a') && (Character <= 'z')) || ((Character >= 'A') && (Character <= 'Z')) || (Character == '_'))
+        {
+            Tables.CharKinds[Character] = CHAR_letter;
+        }
+        else if((Character >= '0') && (Character <= '9'))
+        {
+            Tables.CharKinds[Character] = CHAR_digit;
+        }
     }
-    if(strcmp(Lexer->String, "else") == 0)
+    Tables.CharKinds[(uint8_t)'"'] = CHAR_quote;
+    Tables.CharKinds[(uint8_t)'\''] = CHAR_apostrophe;
+
+    // Every spelling is a path from the start, sharing its prefixes with the spellings before it.
+    bool IsWordState[MAX_LEXER_STATE_COUNT] = {};
+    Tables.ClassCount = 1;
+    Tables.StateCount = 1;
+    for(uint32_t i = 0; i < SpellingCount; ++i)
     {
-        return TOKEN_else;
+        bool IsWord = (Tables.CharKinds[(uint8_t)Spellings[i].Spelling[0]] == CHAR_letter);
+        uint32_t State = 0;
+        for(const char* Character = Spellings[i].Spelling; *Character; ++Character)
+        {
+            uint8_t Byte = (uint8_t)*Character;
+            if(!Tables.ByteClasses[Byte])
+            {
+                Tables.ByteClasses[Byte] = (uint8_t)Tables.ClassCount++;
+                Tables.CharKinds[Byte] = IsWord ? Tables.CharKinds[Byte] : (uint8_t)CHAR_operator;
+            }
+            uint8_t* Next = &Tables.Transitions[State][Tables.ByteClasses[Byte]];
+            if(!*Next)
+            {
+                // A single character is a token by itself, and a prefix of a keyword is a name.
+                Tables.Accepts[Tables.StateCount] = IsWord ? TOKEN_id : ((State == 0) ? Byte : 0);
+                IsWordState[Tables.StateCount] = IsWord;
+                *Next = (uint8_t)Tables.StateCount++;
+            }
+            State = *Next;
+        }
+        Tables.Accepts[State] = Spellings[i].Token;
     }
-    if(strcmp(Lexer->String, "for") == 0)
+
+    // Words leave the keywords for the state of names on any letter or digit they don't continue with, and stay in it
+    // up to the end of the word.
+    uint32_t NameClass = Tables.ClassCount++;
+    uint32_t NameState = Tables.StateCount++;
+    Tables.Accepts[NameState] = TOKEN_id;
+    IsWordState[NameState] = true;
+    for(uint32_t Character = 0; Character < 256; ++Character)
     {
-        return TOKEN_for;
+        bool IsLetter = (Tables.CharKinds[Character] == CHAR_letter);
+        if(!IsLetter && (Tables.CharKinds[Character] != CHAR_digit))
+        {
+            continue;
+        }
+        if(!Tables.ByteClasses[Character])
+        {
+            Tables.ByteClasses[Character] = (uint8_t)NameClass;
+        }
+        uint8_t Class = Tables.ByteClasses[Character];
+        if(IsLetter && !Tables.Transitions[0][Class])
+        {
+            Tables.Transitions[0][Class] = (uint8_t)NameState;
+        }
+        for(uint32_t State = 1; State < Tables.StateCount; ++State)
+        {
+            if(IsWordState[State] && !Tables.Transitions[State][Class])
+            {
+                Tables.Transitions[State][Class] = (uint8_t)NameState;
+            }
+        }
     }
-    if(strcmp(Lexer->String, "return") == 0)
+
+    // Without a state that accepts nothing, a match never has to back up to an earlier accepting state.
+    Tables.IsEveryStateAccepting = true;
+    for(uint32_t State = 1; State < Tables.StateCount; ++State)
     {
-        return TOKEN_return;
+        Tables.IsEveryStateAccepting = Tables.IsEveryStateAccepting && (Tables.Accepts[State] != 0);
     }
-    return TOKEN_id;
-}
-
-static bool IsWhitespace(char Character)
-{
-    return Character == ' ' || Character == '\t' || Character == '\r' || Character == '\n' || Character == '\f';
-}
-
-static bool IsUppercase(char Character)
-{
-    return (Character >= 'A') && (Character <= 'Z');
-}
-
-static bool IsLowercase(char Character)
-{
-    return (Character >= 'a') && (Character <= 'z');
+    return Tables;
 }
 
-static bool IsLetter(char Character)
-{
-    return IsUppercase(Character) || IsLowercase(Character) || Character == '_';
-}
+static constexpr lexer_tables LexerTables = MakeLexerTables(LexemeSpellings);
+static_assert(LexerTables.IsEveryStateAccepting, "Every prefix of an operator must be a token by itself.");
+static_assert(LexerTables.ClassCount <= MAX_LEXER_CLASS_COUNT, "Too many byte classes for the lexer tables.");
 
-static bool IsDigit(char Character)
+static char_kind GetCharKind(char Character)
 {
-    return (Character >= '0') && (Character <= '9');
+    return (char_kind)LexerTables.CharKinds[(uint8_t)Character];
 }
 
-static bool IsSymbol(char Character)
+// Walks the DFA from ParsePoint, returning the longest matching lexeme and setting End past it.
+static int32_t MatchLexeme(char* ParsePoint, char** End)
 {
-    return IsLetter(Character) || IsDigit(Character);
+    uint32_t State = 0;
+    for(;;)
+    {
+        uint32_t Next = LexerTables.Transitions[State][LexerTables.ByteClasses[(uint8_t)*ParsePoint]];
+        if(!Next)
+        {
+            break;
+        }
+        State = Next;
+        ++ParsePoint;
+    }
+    *End = ParsePoint;
+    return LexerTables.Accepts[State];
 }
 
 static bool IsType(int32_t Token)
 {
-    return (Token == TOKEN_char) || (Token == TOKEN_int) || (Token == TOKEN_float) || (Token == TOKEN_string);
-}
-
-static bool IsBinaryOperator(int32_t Token)
-{
-    return (Token == '+') || (Token == '-') || (Token == '*') || (Token == '/') || (Token == '%') || (Token == '<') || (Token == '>') || (Token == TOKEN_eq) ||
-            (Token == TOKEN_noteq) || (Token == TOKEN_lesseq) || (Token == TOKEN_moreeq) || (Token == TOKEN_andand) || (Token == TOKEN_oror);
+    return (Token >= TOKEN_char) && (Token <= TOKEN_arena);
 }
 
 static int32_t GetToken(lexer* Lexer)
 {
     char* ParsePoint = Lexer->ParsePoint;
-
-    // Skipping whitespace and comments
     for(;;)
     {
-        while((ParsePoint < Lexer->EndOfFile) && IsWhitespace(*ParsePoint))
+        while(GetCharKind(*ParsePoint) == CHAR_space)
         {
             ++ParsePoint;
         }
-
-        if((ParsePoint < Lexer->EndOfFile) && (ParsePoint[0] == '/') && (ParsePoint[1] == '/'))
+        if(ParsePoint >= Lexer->EndOfFile)
         {
-            while((ParsePoint < Lexer->EndOfFile) && (*ParsePoint != '\r') && (*ParsePoint != '\n'))
-            {
-                ++ParsePoint;
-            }
-            continue;
+            return TokenizeEOF(Lexer);
         }
 
-        if((ParsePoint < Lexer->EndOfFile) && (ParsePoint[0] == '/') && (ParsePoint[1] == '*'))
+        switch(GetCharKind(*ParsePoint))
         {
-            char* Start = ParsePoint;
-            ParsePoint += 2;
-
-            while((ParsePoint < Lexer->EndOfFile) && ((ParsePoint[0] != '*') || (ParsePoint[1] != '/')))
-            {
-                ++ParsePoint;
-            }
-            
-            if(ParsePoint == Lexer->EndOfFile)
+            default:
             {
-                return Tokenize(Lexer, TOKEN_parse_error, Start, ParsePoint - 1);
-            }
-
-            ParsePoint += 2;
-            continue;
-        }
-
-        break;
-    }
-
-    if(ParsePoint >= Lexer->EndOfFile)
-    {
-        return TokenizeEOF(Lexer);
-    }
-
-    switch(*ParsePoint)
-    {
-        default:
-        {
-            if(IsLetter(*ParsePoint))
+                return Tokenize(Lexer, *ParsePoint, ParsePoint, ParsePoint);
+            } break;
+            case CHAR_letter:
             {
-                int32_t Length = 0;
+                char* End;
+                int32_t Token = MatchLexeme(ParsePoint, &End);
+                int32_t Length = (int32_t)(End - ParsePoint);
                 Lexer->String = Lexer->StringStorage;
-                Lexer->StringLength = Length;
-
-                do
+                Lexer->StringLength = 0;
+                if(Length >= Lexer->StringStorageLength)
                 {
-                    if(Length + 1 >= Lexer->StringStorageLength)
-                    {
-                        return Tokenize(Lexer, TOKEN_parse_error, ParsePoint, ParsePoint + Length);
-                    }
-                    Lexer->String[Length] = ParsePoint[Length];
-                    ++Length;
-                } while(IsSymbol(ParsePoint[Length]));
-                Lexer->StringLength = Length;
-                Lexer->String[Lexer->StringLength++] = '\0';
-                return Tokenize(Lexer, MatchToken(Lexer), ParsePoint, ParsePoint + Length - 1);
-            }
-            else if (IsDigit(*ParsePoint))
+                    return Tokenize(Lexer, TOKEN_parse_error, ParsePoint, ParsePoint + Lexer->StringStorageLength - 1);
+                }
+                memcpy(Lexer->String, ParsePoint, (size_t)Length);
+                Lexer->String[Length] = '\0';
+                Lexer->StringLength = Length + 1;
+                return Tokenize(Lexer, Token, ParsePoint, End - 1);
+            } break;
+            case CHAR_digit:
             {
                 char* NextPoint = ParsePoint;
-
-                while((NextPoint < Lexer->EndOfFile) && IsDigit(*NextPoint))
+                while(GetCharKind(*NextPoint) == CHAR_digit)
                 {
                     ++NextPoint;
                 }
-                if(NextPoint < Lexer->EndOfFile)
+
+                // Out of range literals are errors rather than silently clamped values.
+                errno = 0;
+                if(*NextPoint == '.')
+                {
+                    Lexer->RealNumber = strtod((char*)ParsePoint, (char**)&NextPoint);
+                    return Tokenize(Lexer, (errno == ERANGE) ? TOKEN_parse_error : TOKEN_real_number, ParsePoint, NextPoint - 1);
+                }
+                Lexer->IntNumber = strtoull((char*)ParsePoint, (char**)&NextPoint, 10);
+                return Tokenize(Lexer, (errno == ERANGE) ? TOKEN_parse_error : TOKEN_int_number, ParsePoint, NextPoint - 1);
+            } break;
+            case CHAR_operator:
+            {
+                char* End;
+                int32_t Token = MatchLexeme(ParsePoint, &End);
+                if(Token == LEXEME_line_comment)
                 {
-                    if(*NextPoint == '.')
+                    ParsePoint = End;
+                    while((*ParsePoint != '\r') && (*ParsePoint != '\n') && (*ParsePoint != '\0'))
                     {
-                        Lexer->RealNumber = strtod((char*)ParsePoint, (char**)&NextPoint);
-                        return Tokenize(Lexer, TOKEN_real_number, ParsePoint, NextPoint - 1);
+                        ++ParsePoint;
                     }
-                    else
+                    continue;
+                }
+                if(Token == LEXEME_block_comment)
+                {
+                    char* Start = ParsePoint;
+                    ParsePoint = End;
+                    while((ParsePoint[0] != '*') || (ParsePoint[1] != '/'))
                     {
-                        Lexer->IntNumber = strtoul((char*)ParsePoint, (char**)&NextPoint, 10);
-                        return Tokenize(Lexer, TOKEN_int_number, ParsePoint, NextPoint - 1);
+                        if((*ParsePoint == '\0') && (ParsePoint >= Lexer->EndOfFile))
+                        {
+                            return Tokenize(Lexer, TOKEN_parse_error, Start, ParsePoint - 1);
+                        }
+                        ++ParsePoint;
                     }
+                    ParsePoint += 2;
+                    continue;
                 }
-            }
-        }
+                return Tokenize(Lexer, Token, ParsePoint, End - 1);
+            } break;
+            case CHAR_quote:
+            {
+                return ParseString(Lexer, ParsePoint + 1);
+            } break;
+            case CHAR_apostrophe:
+            {
+                char* Start = ParsePoint;
 
-single_char:
-        return Tokenize(Lexer, *ParsePoint, ParsePoint, ParsePoint);
+                Lexer->IntNumber = ParseChar(ParsePoint + 1, &ParsePoint);
 
-        case ':':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == ':')
+                if(Lexer->IntNumber < 0)
                 {
-                    return Tokenize(Lexer, TOKEN_double_colon, ParsePoint, ParsePoint + 1);
+                    return Tokenize(Lexer, TOKEN_parse_error, Start, Start);
                 }
-                if(ParsePoint[1] == '=')
+                if(*ParsePoint != '\'')
                 {
-                    return Tokenize(Lexer, TOKEN_coloneq, ParsePoint, ParsePoint + 1);
+                    return Tokenize(Lexer, TOKEN_parse_error, Start, ParsePoint);
                 }
-            }
+                return Tokenize(Lexer, TOKEN_char_number, Start, ParsePoint);
+            } break;
         }
-        goto single_char;
+    }
+}
 
-        case '+':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '+')
-                {
-                    return Tokenize(Lexer, TOKEN_plusplus, ParsePoint, ParsePoint + 1);
-                }
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_pluseq, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '-':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '-')
-                {
-                    return Tokenize(Lexer, TOKEN_minusminus, ParsePoint, ParsePoint + 1);
-                }
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_minuseq, ParsePoint, ParsePoint + 1);
-                }
-                if(ParsePoint[1] == '>')
-                {
-                    return Tokenize(Lexer, TOKEN_arrow, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '*':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_muleq, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '/':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_diveq, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '%':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_modeq, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '=':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_eq, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '!':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_noteq, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '<':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_lesseq, ParsePoint, ParsePoint + 1);
-                }
-                if(ParsePoint[1] == '>')
-                {
-                    return Tokenize(Lexer, TOKEN_inline, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '>':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '=')
-                {
-                    return Tokenize(Lexer, TOKEN_moreeq, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '|':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '|')
-                {
-                    return Tokenize(Lexer, TOKEN_oror, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '&':
-        {
-            if(ParsePoint + 1 < Lexer->EndOfFile)
-            {
-                if(ParsePoint[1] == '&')
-                {
-                    return Tokenize(Lexer, TOKEN_andand, ParsePoint, ParsePoint + 1);
-                }
-            }
-        }
-        goto single_char;
-
-        case '"':
-        {
-            return ParseString(Lexer, ParsePoint + 1);
-        }
-        goto single_char;
-
-        case '\'':
-        {
-            char* Start = ParsePoint;
-
-            Lexer->IntNumber = ParseChar(ParsePoint + 1, &ParsePoint);
-
-            if(Lexer->IntNumber < 0)
-            {
-                return Tokenize(Lexer, TOKEN_parse_error, Start, Start);
-            }
-            if((ParsePoint == Lexer->EndOfFile) || (*ParsePoint != '\''))
-            {
-                return Tokenize(Lexer, TOKEN_parse_error, Start, ParsePoint);
-            }
-            return Tokenize(Lexer, TOKEN_char_number, Start, ParsePoint);
-        }
-        goto single_char;
-    }
-}
-
-static void PrintToken(lexer* Lexer)
-{
-    switch(Lexer->Token)
-    {
-        case TOKEN_id:
+static void PrintToken(lexer* Lexer)
+{
+    switch(Lexer->Token)
+    {
+        case TOKEN_id:
         {
             printf("%s", Lexer->String);
         } break;
@@ -595,10 +812,27 @@ static void PrintToken(lexer* Lexer)
         {
             printf("float");
         } break;
+        case TOKEN_i8:
+        case TOKEN_i16:
+        case TOKEN_i32:
+        case TOKEN_i64:
+        case TOKEN_u8:
+        case TOKEN_u16:
+        case TOKEN_u32:
+        case TOKEN_u64:
+        case TOKEN_f32:
+        case TOKEN_f64:
+        {
+            printf("%s", SizedTypeNames[Lexer->Token - TOKEN_i8]);
+        } break;
         case TOKEN_string:
         {
             printf("string");
         } break;
+        case TOKEN_arena:
+        {
+            printf("arena");
+        } break;
         case TOKEN_if:
         {
             printf("if");
@@ -615,6 +849,22 @@ static void PrintToken(lexer* Lexer)
         {
             printf("return");
         } break;
+        case TOKEN_struct:
+        {
+            printf("struct");
+        } break;
+        case TOKEN_bench:
+        {
+            printf("bench");
+        } break;
+        case TOKEN_match:
+        {
+            printf("match");
+        } break;
+        case TOKEN_case:
+        {
+            printf("case");
+        } break;
         case TOKEN_double_colon:
         {
             printf("::");
@@ -723,8 +973,13 @@ static void PrintToken(lexer* Lexer)
 //
 // TODO(rytis): Check for memory leaks. Even better - implement dynamic allocator myself for guaranteed memory management process-wise.
 
-#define MAX_STRING_COUNT 10000
+// Every distinct name and string literal of the program is kept, streamed declarations included, so these bound the
+// size of a program rather than the memory of a batch.
+#define MAX_STRING_COUNT (1 << 16)
+#define STRING_HASH_SLOT_COUNT (1 << 17) // Power of two above MAX_STRING_COUNT
+#define STRING_STORAGE_SIZE (1 << 22)
 
+// Strings are interned, so that a long running watch session re-parsing the same names doesn't keep growing the storage.
 struct string_storage
 {
     int32_t Length;
@@ -733,45 +988,85 @@ struct string_storage
 
     uint32_t StringCount;
     char* StringArray[MAX_STRING_COUNT];
+    uint32_t StringLengths[MAX_STRING_COUNT];
+    uint32_t HashSlots[STRING_HASH_SLOT_COUNT]; // Index + 1 into StringArray, 0 when empty.
+    platform_mutex Lock;
 };
 
-static void InitStringStorage(string_storage* StringStorage, const char* AllocatedSpace, int32_t StringStorageCapacity)
+// Forgets every string, which the ASTs parsed so far point into.
+static void ClearStringStorage(string_storage* StringStorage)
 {
     StringStorage->Length = 0;
-    StringStorage->Capacity = StringStorageCapacity;
-    StringStorage->Strings = (char*)AllocatedSpace;
-
     StringStorage->StringCount = 0;
     StringStorage->StringArray[0] = StringStorage->Strings;
+    memset(StringStorage->HashSlots, 0, sizeof(StringStorage->HashSlots));
 }
 
-static int32_t AddStringToStorage(string_storage* Storage, char* String, uint32_t StringLength)
+static void InitStringStorage(string_storage* StringStorage, const char* AllocatedSpace, int32_t StringStorageCapacity)
 {
-    Storage->StringArray[Storage->StringCount++] = &Storage->Strings[Storage->Length];
+    StringStorage->Capacity = StringStorageCapacity;
+    StringStorage->Strings = (char*)AllocatedSpace;
+    ClearStringStorage(StringStorage);
+    InitMutex(&StringStorage->Lock);
+}
 
-    for(uint32_t i = 0; i < StringLength; ++i)
+static uint64_t HashBytes(const char* Bytes, uint32_t Length)
+{
+    // FNV-1a
+    uint64_t Hash = 14695981039346656037ULL;
+    for(uint32_t i = 0; i < Length; ++i)
     {
-        if(Storage->Length <= Storage->Capacity)
-        {
-            Storage->Strings[Storage->Length++] = String[i];
-        }
-        else
+        Hash = (Hash ^ (uint8_t)Bytes[i]) * 1099511628211ULL;
+    }
+    return Hash;
+}
+
+// Returns the index of the string, or -1 when the storage is full, which the callers report.
+static int32_t InternString(string_storage* Storage, char* String, uint32_t StringLength)
+{
+    uint32_t Slot = (uint32_t)HashBytes(String, StringLength) & (STRING_HASH_SLOT_COUNT - 1);
+    while(Storage->HashSlots[Slot])
+    {
+        uint32_t Index = Storage->HashSlots[Slot] - 1;
+        if((Storage->StringLengths[Index] == StringLength) && (memcmp(Storage->StringArray[Index], String, StringLength) == 0))
         {
-            printf("Error: string storage capacity exceeded!\n");
-            return -1;
+            return (int32_t)Index;
         }
+        Slot = (Slot + 1) & (STRING_HASH_SLOT_COUNT - 1);
+    }
+    if((Storage->StringCount >= MAX_STRING_COUNT) || ((int32_t)StringLength > Storage->Capacity - Storage->Length))
+    {
+        return -1;
     }
 
+    Storage->StringArray[Storage->StringCount] = &Storage->Strings[Storage->Length];
+    Storage->StringLengths[Storage->StringCount] = StringLength;
+    Storage->HashSlots[Slot] = ++Storage->StringCount;
+
+    memcpy(&Storage->Strings[Storage->Length], String, StringLength);
+    Storage->Length += (int32_t)StringLength;
     return Storage->StringCount - 1;
 }
 
+// Parsing threads share the storage, so interning is serialized. The strings themselves never move.
+static int32_t AddStringToStorage(string_storage* Storage, char* String, uint32_t StringLength)
+{
+    LockMutex(&Storage->Lock);
+    int32_t Result = InternString(Storage, String, StringLength);
+    UnlockMutex(&Storage->Lock);
+    return Result;
+}
+
 #define MAX_PARAMETER_COUNT 10
 #define MAX_EXPRESSION_COUNT 30
+#define MAX_CASE_VALUE_COUNT 16
+#define MAX_FIELD_COUNT 32
 
 enum ast_type
 {
     AST_expr,
     AST_func,
+    AST_struct,
 };
 
 enum expr_type
@@ -785,10 +1080,32 @@ enum expr_type
     EXPR_paren,
     EXPR_binary,
     EXPR_call,
+    EXPR_index,
+    EXPR_field,
     EXPR_if,
     EXPR_for,
     EXPR_return,
     EXPR_inline,
+    EXPR_unary,
+    EXPR_bench,
+    EXPR_match,
+    EXPR_case,
+};
+
+enum array_kind
+{
+    ARRAY_none,
+    ARRAY_fixed,
+    ARRAY_slice,
+};
+
+struct type_spec
+{
+    // TOKEN_id for structs, which are looked up by name.
+    int32_t Type;
+    char* Name;
+    array_kind ArrayKind;
+    uint64_t ArrayLength;
 };
 
 struct char_expr
@@ -835,7 +1152,7 @@ struct expr
 
         struct var_expr
         {
-            int32_t Type;
+            type_spec Type;
             char* Name;
             expr* Expr;
         } VarExpr;
@@ -852,6 +1169,14 @@ struct expr
             expr* RHS;
         } BinaryExpr;
 
+        // -, !, ++ and -- before their operand, or ++ and -- after it.
+        struct unary_expr
+        {
+            int32_t Operator;
+            expr* Operand;
+            bool IsPostfix;
+        } UnaryExpr;
+
         struct call_expr
         {
             char* Name;
@@ -859,6 +1184,18 @@ struct expr
             expr* Arguments[MAX_PARAMETER_COUNT];
         } CallExpr;
 
+        struct index_expr
+        {
+            expr* Array;
+            expr* Index;
+        } IndexExpr;
+
+        struct field_expr
+        {
+            expr* Object;
+            char* Field;
+        } FieldExpr;
+
         struct if_expr
         {
             expr* Statement;
@@ -881,12 +1218,37 @@ struct expr
         {
             expr* Expression;
         } ReturnExpr;
+
+        // bench "Name" { ... }, whose body is timed over many iterations.
+        struct bench_expr
+        {
+            char* Name;
+            uint32_t ExpressionCount;
+            expr* Expressions[MAX_EXPRESSION_COUNT];
+        } BenchExpr;
+
+        // match Value { case 1, 2 { ... } else { ... } }, whose statements are its cases.
+        struct match_expr
+        {
+            expr* Value;
+            uint32_t CaseCount;
+            expr* Cases[MAX_EXPRESSION_COUNT];
+        } MatchExpr;
+
+        // A case of a match, taken when the value equals one of its literals. The else case has none.
+        struct case_expr
+        {
+            uint32_t ValueCount;
+            expr* Values[MAX_CASE_VALUE_COUNT];
+            uint32_t ExpressionCount;
+            expr* Expressions[MAX_EXPRESSION_COUNT];
+        } CaseExpr;
     };
 };
 
 struct func
 {
-    int32_t Type;
+    type_spec Type;
     char* Name;
     uint32_t ParameterCount;
     expr* Parameters[MAX_PARAMETER_COUNT];
@@ -894,6 +1256,15 @@ struct func
     expr* Expressions[MAX_EXPRESSION_COUNT];
 };
 
+struct struct_decl
+{
+    char* Name;
+    // #soa structs are stored as one array per field when put in an array.
+    bool IsSoa;
+    uint32_t FieldCount;
+    expr* Fields[MAX_FIELD_COUNT];
+};
+
 struct ast
 {
     ast_type AstType;
@@ -901,217 +1272,477 @@ struct ast
     {
         expr* Expr;
         func* Func;
+        struct_decl* Struct;
     };
 };
 
-static void FreeExpression(expr* Expression)
+// Stack of fixed-size elements for walking nested expressions without recursion. It starts in a buffer of the caller
+// and moves to the heap once it outgrows it, so nesting depth is only bounded by memory.
+struct work_stack
 {
-    if(!Expression)
-    {
-        return;
-    }
+    char* Elements;
+    uint32_t ElementSize;
+    uint32_t Count;
+    uint32_t Capacity;
+    bool IsOnHeap;
+};
 
-    switch(Expression->ExprType)
-    {
-        default:
-        {
-            fprintf(stderr, "Error: Unknown expression type.\n");
-        } // Fall through
-        case EXPR_char:
-        {
-        } // Fall through
-        case EXPR_int:
-        {
-        } // Fall through
-        case EXPR_real:
-        {
-        } // Fall through
-        case EXPR_string:
-        {
-        } // Fall through
-        case EXPR_id:
-        {
-        }
-        case EXPR_inline:
-        {
-            free(Expression);
-        } break;
-        case EXPR_var:
-        {
-            FreeExpression(Expression->VarExpr.Expr);
-            free(Expression);
-        } break;
-        case EXPR_paren:
-        {
-            FreeExpression(Expression->ParenExpr.InnerExpr);
-            free(Expression);
-        } break;
-        case EXPR_binary:
-        {
-            expr* LHS = Expression->BinaryExpr.LHS;
-            expr* RHS = Expression->BinaryExpr.RHS;
-            FreeExpression(LHS);
-            FreeExpression(RHS);
-            free(Expression);
-        } break;
-        case EXPR_call:
-        {
-            uint32_t ArgumentCount = Expression->CallExpr.ArgumentCount;
-            for(uint32_t i = 0; i < ArgumentCount; ++i)
-            {
-                FreeExpression(Expression->CallExpr.Arguments[i]);
-            }
-            free(Expression);
-        } break;
-        case EXPR_if:
-        {
-            uint32_t TrueCount = Expression->IfExpr.TrueExpressionCount;
-            uint32_t FalseCount = Expression->IfExpr.FalseExpressionCount;
-            for(uint32_t i = 0; i < TrueCount; ++i)
-            {
-                FreeExpression(Expression->IfExpr.TrueExpressions[i]);
-            }
-            for(uint32_t i = 0; i < FalseCount; ++i)
-            {
-                FreeExpression(Expression->IfExpr.FalseExpressions[i]);
-            }
-            FreeExpression(Expression->IfExpr.Statement);
-            free(Expression);
-        } break;
-        case EXPR_for:
-        {
-            FreeExpression(Expression->ForExpr.Definition);
-            FreeExpression(Expression->ForExpr.Condition);
-            FreeExpression(Expression->ForExpr.Action);
-            uint32_t ExprCount = Expression->ForExpr.ExpressionCount;
-            for(uint32_t i = 0; i < ExprCount; ++i)
-            {
-                FreeExpression(Expression->ForExpr.Expressions[i]);
-            }
-            free(Expression);
-        } break;
-        case EXPR_return:
-        {
-            FreeExpression(Expression->ReturnExpr.Expression);
-            free(Expression);
-        } break;
-    }
+static void InitWorkStack(work_stack* Stack, void* Buffer, uint32_t BufferSize, uint32_t ElementSize)
+{
+    Stack->Elements = (char*)Buffer;
+    Stack->ElementSize = ElementSize;
+    Stack->Count = 0;
+    Stack->Capacity = BufferSize / ElementSize;
+    Stack->IsOnHeap = false;
 }
 
-static void FreeFunction(func* Function)
+static void FreeWorkStack(work_stack* Stack)
 {
-    if(!Function)
+    if(Stack->IsOnHeap)
     {
-        // printf("Error: NULL pointer received when freeing statement.\n");
-        return;
+        Deallocate(Stack->Elements);
     }
+}
 
-    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
-    {
-        FreeExpression(Function->Parameters[i]);
-    }
-    for(uint32_t i = 0; i < Function->ExpressionCount; ++i)
+// Returns the new top element, which is only valid until the next push.
+static void* PushWork(work_stack* Stack)
+{
+    if(Stack->Count == Stack->Capacity)
     {
-        FreeExpression(Function->Expressions[i]);
+        uint32_t Capacity = 2 * Stack->Capacity;
+        char* Elements = (char*)Allocate(MEMORY_scratch, (size_t)Capacity * Stack->ElementSize);
+        memcpy(Elements, Stack->Elements, (size_t)Stack->Count * Stack->ElementSize);
+        FreeWorkStack(Stack);
+        Stack->Elements = Elements;
+        Stack->Capacity = Capacity;
+        Stack->IsOnHeap = true;
     }
-    free(Function);
+    return Stack->Elements + (size_t)Stack->Count++ * Stack->ElementSize;
 }
 
-static void FreeAst(ast* Ast)
+static void* PeekWork(work_stack* Stack)
 {
-    if(!Ast)
-    {
-        printf("Error: NULL pointer received when freeing AST.\n");
-        return;
-    }
+    return Stack->Count ? Stack->Elements + (size_t)(Stack->Count - 1) * Stack->ElementSize : NULL;
+}
 
-    switch(Ast->AstType)
+static void PopWork(work_stack* Stack)
+{
+    assert(Stack->Count > 0);
+    --Stack->Count;
+}
+
+static void PushExpr(work_stack* Stack, expr* Expression)
+{
+    *(expr**)PushWork(Stack) = Expression;
+}
+
+static expr* PopExpr(work_stack* Stack)
+{
+    expr* Result = *(expr**)PeekWork(Stack);
+    PopWork(Stack);
+    return Result;
+}
+
+static void FreeExpression(expr* Expression)
+{
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Expression);
+
+    while(Pending.Count)
     {
-        default:
+        Expression = PopExpr(&Pending);
+        if(!Expression)
         {
-        } break;
-        case AST_expr:
-        {
-            expr* Expression = Ast->Expr;
-            // free(Ast);
-            FreeExpression(Expression);
-        } break;
-        case AST_func:
+            continue;
+        }
+
+        switch(Expression->ExprType)
         {
-            func* Function = Ast->Func;
-            // free(Ast);
-            FreeFunction(Function);
-        } break;
+            default:
+            {
+                fprintf(stderr, "Error: Unknown expression type.\n");
+            } break;
+            case EXPR_char:
+            case EXPR_int:
+            case EXPR_real:
+            case EXPR_string:
+            case EXPR_id:
+            case EXPR_inline:
+            {
+            } break;
+            case EXPR_var:
+            {
+                PushExpr(&Pending, Expression->VarExpr.Expr);
+            } break;
+            case EXPR_paren:
+            {
+                PushExpr(&Pending, Expression->ParenExpr.InnerExpr);
+            } break;
+            case EXPR_binary:
+            {
+                PushExpr(&Pending, Expression->BinaryExpr.LHS);
+                PushExpr(&Pending, Expression->BinaryExpr.RHS);
+            } break;
+            case EXPR_unary:
+            {
+                PushExpr(&Pending, Expression->UnaryExpr.Operand);
+            } break;
+            case EXPR_call:
+            {
+                for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CallExpr.Arguments[i]);
+                }
+            } break;
+            case EXPR_index:
+            {
+                PushExpr(&Pending, Expression->IndexExpr.Array);
+                PushExpr(&Pending, Expression->IndexExpr.Index);
+            } break;
+            case EXPR_field:
+            {
+                PushExpr(&Pending, Expression->FieldExpr.Object);
+            } break;
+            case EXPR_if:
+            {
+                for(uint32_t i = 0; i < Expression->IfExpr.TrueExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->IfExpr.TrueExpressions[i]);
+                }
+                for(uint32_t i = 0; i < Expression->IfExpr.FalseExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->IfExpr.FalseExpressions[i]);
+                }
+                PushExpr(&Pending, Expression->IfExpr.Statement);
+            } break;
+            case EXPR_for:
+            {
+                PushExpr(&Pending, Expression->ForExpr.Definition);
+                PushExpr(&Pending, Expression->ForExpr.Condition);
+                PushExpr(&Pending, Expression->ForExpr.Action);
+                for(uint32_t i = 0; i < Expression->ForExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->ForExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_bench:
+            {
+                for(uint32_t i = 0; i < Expression->BenchExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->BenchExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_match:
+            {
+                PushExpr(&Pending, Expression->MatchExpr.Value);
+                for(uint32_t i = 0; i < Expression->MatchExpr.CaseCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->MatchExpr.Cases[i]);
+                }
+            } break;
+            case EXPR_case:
+            {
+                for(uint32_t i = 0; i < Expression->CaseExpr.ValueCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CaseExpr.Values[i]);
+                }
+                for(uint32_t i = 0; i < Expression->CaseExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CaseExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_return:
+            {
+                PushExpr(&Pending, Expression->ReturnExpr.Expression);
+            } break;
+        }
+        Deallocate(Expression);
     }
+    FreeWorkStack(&Pending);
 }
 
-static int32_t GetTokenPrecedence(int32_t Token)
+static void FreeFunction(func* Function)
 {
-    switch(Token)
+    if(!Function)
     {
-        default:
-        {
-            return -1;
-        } break;
-        case '=':
-        {
-            return 10;
-        } break;
-        case '+':
-        {
-            return 30;
-        } break;
-        case '-':
-        {
-            return 30;
-        } break;
-        case '*':
-        {
-            return 40;
-        } break;
-        case '/':
-        {
-            return 40;
-        } break;
-        case '%':
-        {
-            return 40;
-        } break;
-        case '<':
-        {
-            return 20;
-        } break;
-        case '>':
-        {
-            return 20;
-        } break;
-        case TOKEN_eq:
+        // printf("Error: NULL pointer received when freeing statement.\n");
+        return;
+    }
+
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        FreeExpression(Function->Parameters[i]);
+    }
+    for(uint32_t i = 0; i < Function->ExpressionCount; ++i)
+    {
+        FreeExpression(Function->Expressions[i]);
+    }
+    Deallocate(Function);
+}
+
+static void PushExprSlot(work_stack* Stack, expr** Slot)
+{
+    *(expr***)PushWork(Stack) = Slot;
+}
+
+// Deep copy, sharing the strings, which live in the string storage rather than in the tree.
+static expr* CopyExpression(expr* Expression)
+{
+    // Every slot still points at the original, which its copy replaces.
+    expr* Result = Expression;
+    expr** Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr**));
+    PushExprSlot(&Pending, &Result);
+
+    while(Pending.Count)
+    {
+        expr** Slot = *(expr***)PeekWork(&Pending);
+        PopWork(&Pending);
+        if(!*Slot)
         {
-            return 10;
-        } break;
-        case TOKEN_noteq:
+            continue;
+        }
+        expr* Copy = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+        *Copy = **Slot;
+        *Slot = Copy;
+
+        switch(Copy->ExprType)
         {
-            return 10;
-        } break;
-        case TOKEN_lesseq:
+            default:
+            {
+            } break;
+            case EXPR_var:
+            {
+                PushExprSlot(&Pending, &Copy->VarExpr.Expr);
+            } break;
+            case EXPR_paren:
+            {
+                PushExprSlot(&Pending, &Copy->ParenExpr.InnerExpr);
+            } break;
+            case EXPR_binary:
+            {
+                PushExprSlot(&Pending, &Copy->BinaryExpr.LHS);
+                PushExprSlot(&Pending, &Copy->BinaryExpr.RHS);
+            } break;
+            case EXPR_unary:
+            {
+                PushExprSlot(&Pending, &Copy->UnaryExpr.Operand);
+            } break;
+            case EXPR_call:
+            {
+                for(uint32_t i = 0; i < Copy->CallExpr.ArgumentCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->CallExpr.Arguments[i]);
+                }
+            } break;
+            case EXPR_index:
+            {
+                PushExprSlot(&Pending, &Copy->IndexExpr.Array);
+                PushExprSlot(&Pending, &Copy->IndexExpr.Index);
+            } break;
+            case EXPR_field:
+            {
+                PushExprSlot(&Pending, &Copy->FieldExpr.Object);
+            } break;
+            case EXPR_if:
+            {
+                PushExprSlot(&Pending, &Copy->IfExpr.Statement);
+                for(uint32_t i = 0; i < Copy->IfExpr.TrueExpressionCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->IfExpr.TrueExpressions[i]);
+                }
+                for(uint32_t i = 0; i < Copy->IfExpr.FalseExpressionCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->IfExpr.FalseExpressions[i]);
+                }
+            } break;
+            case EXPR_for:
+            {
+                PushExprSlot(&Pending, &Copy->ForExpr.Definition);
+                PushExprSlot(&Pending, &Copy->ForExpr.Condition);
+                PushExprSlot(&Pending, &Copy->ForExpr.Action);
+                for(uint32_t i = 0; i < Copy->ForExpr.ExpressionCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->ForExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_bench:
+            {
+                for(uint32_t i = 0; i < Copy->BenchExpr.ExpressionCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->BenchExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_match:
+            {
+                PushExprSlot(&Pending, &Copy->MatchExpr.Value);
+                for(uint32_t i = 0; i < Copy->MatchExpr.CaseCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->MatchExpr.Cases[i]);
+                }
+            } break;
+            case EXPR_case:
+            {
+                for(uint32_t i = 0; i < Copy->CaseExpr.ValueCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->CaseExpr.Values[i]);
+                }
+                for(uint32_t i = 0; i < Copy->CaseExpr.ExpressionCount; ++i)
+                {
+                    PushExprSlot(&Pending, &Copy->CaseExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_return:
+            {
+                PushExprSlot(&Pending, &Copy->ReturnExpr.Expression);
+            } break;
+        }
+    }
+    FreeWorkStack(&Pending);
+    return Result;
+}
+
+static func* CopyFunction(func* Function)
+{
+    if(!Function)
+    {
+        return NULL;
+    }
+
+    func* Result = (func*)Allocate(MEMORY_ast, sizeof(func));
+    *Result = *Function;
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        Result->Parameters[i] = CopyExpression(Function->Parameters[i]);
+    }
+    for(uint32_t i = 0; i < Function->ExpressionCount; ++i)
+    {
+        Result->Expressions[i] = CopyExpression(Function->Expressions[i]);
+    }
+    return Result;
+}
+
+static void FreeStruct(struct_decl* Struct)
+{
+    if(!Struct)
+    {
+        return;
+    }
+
+    for(uint32_t i = 0; i < Struct->FieldCount; ++i)
+    {
+        FreeExpression(Struct->Fields[i]);
+    }
+    Deallocate(Struct);
+}
+
+static void FreeAst(ast* Ast)
+{
+    if(!Ast)
+    {
+        printf("Error: NULL pointer received when freeing AST.\n");
+        return;
+    }
+
+    switch(Ast->AstType)
+    {
+        default:
         {
-            return 20;
         } break;
-        case TOKEN_moreeq:
+        case AST_expr:
         {
-            return 20;
+            expr* Expression = Ast->Expr;
+            // free(Ast);
+            FreeExpression(Expression);
         } break;
-        case TOKEN_andand:
+        case AST_func:
         {
-            return 40;
+            func* Function = Ast->Func;
+            // free(Ast);
+            FreeFunction(Function);
         } break;
-        case TOKEN_oror:
+        case AST_struct:
         {
-            return 30;
+            FreeStruct(Ast->Struct);
         } break;
     }
 }
 
+// Binary operators by token, tokens that aren't binary operators have precedence 0. The levels follow C, so the
+// generated code reads the same way as the tree. Prefix operators bind tighter than any binary one and postfix ++ and
+// -- tighter still, as they are applied to the operand right after it is parsed.
+struct operator_info
+{
+    int32_t Precedence;
+    bool IsRightAssociative;
+};
+
+struct operator_table
+{
+    operator_info Binary[TOKEN_count];
+};
+
+#define PREFIX_PRECEDENCE 80
+// Open parentheses wait on the operator stack below every operator.
+#define PAREN_PRECEDENCE -1
+// The translator walks parenthesized expressions, calls and indices recursively, so their combined depth is kept well
+// within a 1 MB stack.
+#define MAX_NESTING_DEPTH 256
+
+static constexpr void SetOperator(operator_table& Table, int32_t Token, int32_t Precedence, bool IsRightAssociative)
+{
+    Table.Binary[Token].Precedence = Precedence;
+    Table.Binary[Token].IsRightAssociative = IsRightAssociative;
+}
+
+static constexpr operator_table MakeOperatorTable()
+{
+    operator_table Table = {};
+    SetOperator(Table, '=', 10, true);
+    SetOperator(Table, TOKEN_pluseq, 10, true);
+    SetOperator(Table, TOKEN_minuseq, 10, true);
+    SetOperator(Table, TOKEN_muleq, 10, true);
+    SetOperator(Table, TOKEN_diveq, 10, true);
+    SetOperator(Table, TOKEN_modeq, 10, true);
+    SetOperator(Table, TOKEN_oror, 20, false);
+    SetOperator(Table, TOKEN_andand, 30, false);
+    SetOperator(Table, TOKEN_eq, 40, false);
+    SetOperator(Table, TOKEN_noteq, 40, false);
+    SetOperator(Table, '<', 50, false);
+    SetOperator(Table, '>', 50, false);
+    SetOperator(Table, TOKEN_lesseq, 50, false);
+    SetOperator(Table, TOKEN_moreeq, 50, false);
+    SetOperator(Table, '+', 60, false);
+    SetOperator(Table, '-', 60, false);
+    SetOperator(Table, '*', 70, false);
+    SetOperator(Table, '/', 70, false);
+    SetOperator(Table, '%', 70, false);
+    return Table;
+}
+
+static constexpr operator_table OperatorTable = MakeOperatorTable();
+static_assert(OperatorTable.Binary['*'].Precedence < PREFIX_PRECEDENCE, "Prefix operators must bind tightest.");
+
+static operator_info GetBinaryOperator(int32_t Token)
+{
+    operator_info None = {0, false};
+    return ((Token >= 0) && (Token < TOKEN_count)) ? OperatorTable.Binary[Token] : None;
+}
+
+static bool IsPrefixOperator(int32_t Token)
+{
+    return (Token == '-') || (Token == '!') || (Token == TOKEN_plusplus) || (Token == TOKEN_minusminus);
+}
+
+static bool IsAssignmentOperator(int32_t Operator)
+{
+    return (Operator == '=') || (Operator == TOKEN_pluseq) || (Operator == TOKEN_minuseq) || (Operator == TOKEN_muleq) ||
+           (Operator == TOKEN_diveq) || (Operator == TOKEN_modeq);
+}
+
 static void PrintLocationError(location* Location, char* String)
 {
     fprintf(stderr, "|%d:%d| error: %s\n", Location->LineNumber, Location->LineOffset, String);
@@ -1121,11 +1752,25 @@ static expr* ExpressionExpectedError(lexer* Lexer, expr* Expression, char* Strin
 {
     location Location;
     GetLocation(&Location, Lexer, Lexer->FirstChar);
-    PrintLocationError(&Location, strcat("expected ", String));
+    fprintf(stderr, "|%d:%d| error: expected %s\n", Location.LineNumber, Location.LineOffset, String);
     FreeExpression(Expression);
     return NULL;
 }
 
+// Interns the text of the current token. Returns NULL, after reporting where, once the storage is full.
+static char* GetTokenString(lexer* Lexer, string_storage* Storage)
+{
+    int32_t StringIndex = AddStringToStorage(Storage, Lexer->String, Lexer->StringLength);
+    if(StringIndex < 0)
+    {
+        location ErrorLocation;
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "too many strings");
+        return NULL;
+    }
+    return Storage->StringArray[StringIndex];
+}
+
 static int32_t PeekToken(lexer* Lexer)
 {
     char* ParsePoint = Lexer->ParsePoint;
@@ -1139,7 +1784,7 @@ static int32_t PeekToken(lexer* Lexer)
 
 static expr* ParseCharExpr(lexer* Lexer)
 {
-    expr* Result = (expr*)malloc(sizeof(expr));
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
     Result->ExprType = EXPR_char;
     Result->CharExpr.CharValue = (char)Lexer->IntNumber;
     GetToken(Lexer);
@@ -1148,7 +1793,7 @@ static expr* ParseCharExpr(lexer* Lexer)
 
 static expr* ParseIntExpr(lexer* Lexer)
 {
-    expr* Result = (expr*)malloc(sizeof(expr));
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
     Result->ExprType = EXPR_int;
     Result->IntExpr.IntValue = Lexer->IntNumber;
     GetToken(Lexer);
@@ -1157,7 +1802,7 @@ static expr* ParseIntExpr(lexer* Lexer)
 
 static expr* ParseRealExpr(lexer* Lexer)
 {
-    expr* Result = (expr*)malloc(sizeof(expr));
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
     Result->ExprType = EXPR_real;
     Result->RealExpr.RealValue = Lexer->RealNumber;
     GetToken(Lexer);
@@ -1166,52 +1811,175 @@ static expr* ParseRealExpr(lexer* Lexer)
 
 static expr* ParseStringExpr(lexer* Lexer, string_storage* Storage)
 {
-    expr* Result = (expr*)malloc(sizeof(expr));
+    char* String = GetTokenString(Lexer, Storage);
+    if(!String)
+    {
+        return NULL;
+    }
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
     Result->ExprType = EXPR_string;
-    int32_t StringIndex = AddStringToStorage(Storage, Lexer->String, Lexer->StringLength);
-    Result->StringExpr.String = Storage->StringArray[StringIndex];
+    Result->StringExpr.String = String;
     GetToken(Lexer);
     return Result;
 }
 
 static expr* ParseExpression(lexer* Lexer, string_storage* Storage);
 
-static expr* ParseIdExpr(lexer* Lexer, string_storage* Storage)
+// Parses an argument of a call or an index, which count towards MAX_NESTING_DEPTH like parentheses.
+static expr* ParseNestedExpression(lexer* Lexer, string_storage* Storage, char* TooDeepError)
 {
-    int32_t StringIndex = AddStringToStorage(Storage, Lexer->String, Lexer->StringLength);
-
-    GetToken(Lexer);
-
-    expr* Result = (expr*)malloc(sizeof(expr));
-
-    if((Lexer->Token != '(') && (Lexer->Token != ':'))
+    if(Lexer->NestingDepth == MAX_NESTING_DEPTH)
     {
-        Result->ExprType = EXPR_id;
-        Result->IdExpr.String = Storage->StringArray[StringIndex];
-        return Result;
+        location ErrorLocation;
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, TooDeepError);
+        return NULL;
+    }
+    ++Lexer->NestingDepth;
+    expr* Result = ParseExpression(Lexer, Storage);
+    --Lexer->NestingDepth;
+    return Result;
+}
+
+// Parses a type, optionally prefixed with an array part: [N]type for fixed arrays, []type for slices.
+// Any other name is taken to be a struct.
+static bool ParseType(lexer* Lexer, string_storage* Storage, type_spec* Type)
+{
+    Type->Name = NULL;
+    Type->ArrayKind = ARRAY_none;
+    Type->ArrayLength = 0;
+
+    if(Lexer->Token == '[')
+    {
+        GetToken(Lexer);
+        if(Lexer->Token == TOKEN_int_number)
+        {
+            if(Lexer->IntNumber == 0)
+            {
+                return false;
+            }
+            Type->ArrayKind = ARRAY_fixed;
+            Type->ArrayLength = Lexer->IntNumber;
+            GetToken(Lexer);
+        }
+        else
+        {
+            Type->ArrayKind = ARRAY_slice;
+        }
+
+        if(Lexer->Token != ']')
+        {
+            return false;
+        }
+        GetToken(Lexer);
+    }
+
+    if(Lexer->Token == TOKEN_id)
+    {
+        Type->Name = GetTokenString(Lexer, Storage);
+        if(!Type->Name)
+        {
+            return false;
+        }
+    }
+    else if(!IsType(Lexer->Token))
+    {
+        return false;
+    }
+    Type->Type = Lexer->Token;
+    GetToken(Lexer);
+    return true;
+}
+
+static expr* ParsePostfixExpr(lexer* Lexer, string_storage* Storage, expr* Base)
+{
+    while((Lexer->Token == '[') || (Lexer->Token == '.'))
+    {
+        if(Lexer->Token == '.')
+        {
+            GetToken(Lexer);
+            if(Lexer->Token != TOKEN_id)
+            {
+                return ExpressionExpectedError(Lexer, Base, "field name after .");
+            }
+
+            char* Field = GetTokenString(Lexer, Storage);
+            if(!Field)
+            {
+                FreeExpression(Base);
+                return NULL;
+            }
+            expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+            Result->ExprType = EXPR_field;
+            Result->FieldExpr.Object = Base;
+            Result->FieldExpr.Field = Field;
+            GetToken(Lexer);
+            Base = Result;
+            continue;
+        }
+
+        GetToken(Lexer);
+
+        expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+        Result->ExprType = EXPR_index;
+        Result->IndexExpr.Array = Base;
+        Result->IndexExpr.Index = ParseNestedExpression(Lexer, Storage, "indices nested too deeply");
+        if(!Result->IndexExpr.Index)
+        {
+            FreeExpression(Result);
+            return NULL;
+        }
+
+        if(Lexer->Token != ']')
+        {
+            return ExpressionExpectedError(Lexer, Result, "]");
+        }
+        GetToken(Lexer);
+        Base = Result;
+    }
+    return Base;
+}
+
+static expr* ParseIdExpr(lexer* Lexer, string_storage* Storage)
+{
+    char* Name = GetTokenString(Lexer, Storage);
+    if(!Name)
+    {
+        return NULL;
+    }
+
+    GetToken(Lexer);
+
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+
+    if((Lexer->Token != '(') && (Lexer->Token != ':'))
+    {
+        // Also covers '[' and '.', which are picked up as postfix operators.
+        Result->ExprType = EXPR_id;
+        Result->IdExpr.String = Name;
+        return ParsePostfixExpr(Lexer, Storage, Result);
     }
 
     switch(Lexer->Token)
     {
         default:
         {
-            free(Result);
+            Deallocate(Result);
             return NULL;
         } break;
         case ':':
         {
             Result->ExprType = EXPR_var;
-            Result->VarExpr.Name = Storage->StringArray[StringIndex];
+            Result->VarExpr.Name = Name;
+
+            Result->VarExpr.Expr = NULL;
 
             GetToken(Lexer);
-            if(!IsType(Lexer->Token))
+            if(!ParseType(Lexer, Storage, &Result->VarExpr.Type))
             {
                 return ExpressionExpectedError(Lexer, Result, "type");
             }
 
-            Result->VarExpr.Type = Lexer->Token;
-
-            GetToken(Lexer);
             if(Lexer->Token == ';')
             {
                 Result->VarExpr.Expr = NULL;
@@ -1227,15 +1995,23 @@ static expr* ParseIdExpr(lexer* Lexer, string_storage* Storage)
         case '(':
         {
             Result->ExprType = EXPR_call;
-            Result->CallExpr.Name = Storage->StringArray[StringIndex];
+            Result->CallExpr.Name = Name;
 
             Result->CallExpr.ArgumentCount = 0;
             GetToken(Lexer);
 
-            for(;;)
+            while(Lexer->Token != ')')
             {
                 uint32_t ArgumentCount = Result->CallExpr.ArgumentCount;
-                Result->CallExpr.Arguments[ArgumentCount] = ParseExpression(Lexer, Storage);
+                if(ArgumentCount == MAX_PARAMETER_COUNT)
+                {
+                    location ErrorLocation;
+                    GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+                    PrintLocationError(&ErrorLocation, "too many arguments");
+                    FreeExpression(Result);
+                    return NULL;
+                }
+                Result->CallExpr.Arguments[ArgumentCount] = ParseNestedExpression(Lexer, Storage, "calls nested too deeply");
                 if(!Result->CallExpr.Arguments[ArgumentCount])
                 {
                     FreeExpression(Result);
@@ -1255,37 +2031,18 @@ static expr* ParseIdExpr(lexer* Lexer, string_storage* Storage)
                 GetToken(Lexer);
             }
             GetToken(Lexer);
+            return ParsePostfixExpr(Lexer, Storage, Result);
         } break;
     }
     return Result;
 }
 
-static expr* ParseParenExpr(lexer* Lexer, string_storage* Storage)
-{
-    assert(Lexer->Token == '(');
-    GetToken(Lexer);
-    expr* Result = (expr*)malloc(sizeof(expr));
-    Result->ExprType = EXPR_paren;
-    Result->ParenExpr.InnerExpr = ParseExpression(Lexer, Storage);
-    if(!Result->ParenExpr.InnerExpr)
-    {
-        free(Result);
-        return NULL;
-    }
-
-    if(Lexer->Token != ')')
-    {
-        return ExpressionExpectedError(Lexer, Result, ")");
-    }
-    GetToken(Lexer);
-    return Result;
-}
-
-static expr* ParseIfExpr(lexer* Lexer, string_storage* Storage)
+// Parses an if up to and including the { of its body, which is left to ParseBlocks.
+static expr* ParseIfHeader(lexer* Lexer, string_storage* Storage)
 {
     GetToken(Lexer);
 
-    expr* Result = (expr*)malloc(sizeof(expr));
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
     Result->ExprType = EXPR_if;
     Result->IfExpr.TrueExpressionCount = 0;
     Result->IfExpr.FalseExpressionCount = 0;
@@ -1303,99 +2060,15 @@ static expr* ParseIfExpr(lexer* Lexer, string_storage* Storage)
     }
 
     GetToken(Lexer);
-    for(;;)
-    {
-        if(Lexer->Token == '}')
-        {
-            break;
-        }
-
-        uint32_t TrueCount = Result->IfExpr.TrueExpressionCount;
-
-        Result->IfExpr.TrueExpressions[TrueCount] = ParseExpression(Lexer, Storage);
-        if(!Result->IfExpr.TrueExpressions[TrueCount])
-        {
-            FreeExpression(Result);
-            return NULL;
-        }
-        int32_t ExprType = Result->IfExpr.TrueExpressions[TrueCount]->ExprType;
-        ++Result->IfExpr.TrueExpressionCount;
-
-        if((ExprType == EXPR_if) || (ExprType == EXPR_for))
-        {
-            if(Lexer->Token != '}')
-            {
-                return ExpressionExpectedError(Lexer, Result, "}");
-            }
-        }
-        else
-        {
-            if(Lexer->Token != ';')
-            {
-                return ExpressionExpectedError(Lexer, Result, ";");
-            }
-        }
-        GetToken(Lexer);
-    }
-
-    int32_t Token = PeekToken(Lexer);
-    if(Token != TOKEN_else)
-    {
-        return Result;
-    }
-
-    GetToken(Lexer);
-    GetToken(Lexer);
-    if(Lexer->Token != '{')
-    {
-        return ExpressionExpectedError(Lexer, Result, "{ after else statement");
-    }
-
-    GetToken(Lexer);
-
-    for(;;)
-    {
-        if(Lexer->Token == '}')
-        {
-            break;
-        }
-
-        uint32_t FalseCount = Result->IfExpr.FalseExpressionCount;
-
-        Result->IfExpr.FalseExpressions[FalseCount] = ParseExpression(Lexer, Storage);
-        if(!Result->IfExpr.FalseExpressions[FalseCount])
-        {
-            FreeExpression(Result);
-            return NULL;
-        }
-        int32_t ExprType = Result->IfExpr.FalseExpressions[FalseCount]->ExprType;
-        ++Result->IfExpr.FalseExpressionCount;
-
-        if((ExprType == EXPR_if) || (ExprType == EXPR_for))
-        {
-            if(Lexer->Token != '}')
-            {
-                return ExpressionExpectedError(Lexer, Result, "}");
-            }
-        }
-        else
-        {
-            if(Lexer->Token != ';')
-            {
-                return ExpressionExpectedError(Lexer, Result, ";");
-            }
-        }
-        GetToken(Lexer);
-    }
-
     return Result;
 }
 
-static expr* ParseForExpr(lexer* Lexer, string_storage* Storage)
+// Parses a for up to and including the { of its body, which is left to ParseBlocks.
+static expr* ParseForHeader(lexer* Lexer, string_storage* Storage)
 {
     GetToken(Lexer);
 
-    expr* Result = (expr*)malloc(sizeof(expr));
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
     Result->ExprType = EXPR_for;
     Result->ForExpr.Definition = NULL;
     Result->ForExpr.Condition = NULL;
@@ -1451,307 +2124,670 @@ static expr* ParseForExpr(lexer* Lexer, string_storage* Storage)
     }
 
     GetToken(Lexer);
-
-    for(;;)
-    {
-        if(Lexer->Token == '}')
-        {
-            break;
-        }
-
-        uint32_t ExprCount = Result->ForExpr.ExpressionCount;
-
-        Result->ForExpr.Expressions[ExprCount] = ParseExpression(Lexer, Storage);
-        if(!Result->ForExpr.Expressions[ExprCount])
-        {
-            FreeExpression(Result);
-            return NULL;
-        }
-        int32_t ExprType = Result->ForExpr.Expressions[ExprCount]->ExprType;
-        ++Result->ForExpr.ExpressionCount;
-
-        if((ExprType == EXPR_if) || (ExprType == EXPR_for))
-        {
-            if(Lexer->Token != '}')
-            {
-                return ExpressionExpectedError(Lexer, Result, "}");
-            }
-        }
-        else
-        {
-            if(Lexer->Token != ';')
-            {
-                return ExpressionExpectedError(Lexer, Result, ";");
-            }
-        }
-        GetToken(Lexer);
-    }
-
     return Result;
 }
 
-static expr* ParseReturnExpr(lexer* Lexer, string_storage* Storage)
+// Parses bench "Name" up to and including the { of its body, which is left to ParseBlocks.
+static expr* ParseBenchHeader(lexer* Lexer, string_storage* Storage)
 {
     GetToken(Lexer);
-    expr* Result = (expr*)malloc(sizeof(expr));
-    Result->ExprType = EXPR_return;
-    Result->ReturnExpr.Expression = ParseExpression(Lexer, Storage);
-    if(!Result->ReturnExpr.Expression)
+    if(Lexer->Token != TOKEN_string_text)
     {
-        FreeExpression(Result);
+        location ErrorLocation;
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected the name of the bench");
         return NULL;
     }
-    if(Lexer->Token != ';')
+
+    char* Name = GetTokenString(Lexer, Storage);
+    if(!Name)
     {
-        return ExpressionExpectedError(Lexer, Result, ";");
+        return NULL;
+    }
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    Result->ExprType = EXPR_bench;
+    Result->BenchExpr.Name = Name;
+    Result->BenchExpr.ExpressionCount = 0;
+
+    GetToken(Lexer);
+    if(Lexer->Token != '{')
+    {
+        return ExpressionExpectedError(Lexer, Result, "{ after bench name");
     }
+    GetToken(Lexer);
     return Result;
 }
 
-static expr* ParseInlineExpr(lexer* Lexer, string_storage* Storage)
+// Parses match Value up to and including the { opening its cases, which are left to ParseBlocks.
+static expr* ParseMatchHeader(lexer* Lexer, string_storage* Storage)
 {
-    location ErrorLocation;
-
     GetToken(Lexer);
 
-    if(Lexer->Token != TOKEN_string_text)
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    Result->ExprType = EXPR_match;
+    Result->MatchExpr.CaseCount = 0;
+    Result->MatchExpr.Value = ParseExpression(Lexer, Storage);
+    if(!Result->MatchExpr.Value)
     {
-        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-        PrintLocationError(&ErrorLocation, "expected \"");
+        FreeExpression(Result);
         return NULL;
     }
 
-    int32_t StringIndex = AddStringToStorage(Storage, Lexer->String, Lexer->StringLength);
-
+    if(Lexer->Token != '{')
+    {
+        return ExpressionExpectedError(Lexer, Result, "{ after match value");
+    }
     GetToken(Lexer);
-
-    expr* Result = (expr*)malloc(sizeof(expr));
-    Result->ExprType = EXPR_inline;
-    Result->InlineExpr.Text = Storage->StringArray[StringIndex];
     return Result;
 }
 
-static expr* ParsePrimaryExpression(lexer* Lexer, string_storage* Storage)
+// Parses case Value, Value... or else up to and including the { of its body, which is left to ParseBlocks.
+static expr* ParseCaseHeader(lexer* Lexer, string_storage* Storage)
 {
-    switch(Lexer->Token)
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    Result->ExprType = EXPR_case;
+    Result->CaseExpr.ValueCount = 0;
+    Result->CaseExpr.ExpressionCount = 0;
+
+    bool IsElse = (Lexer->Token == TOKEN_else);
+    GetToken(Lexer);
+    while(!IsElse)
     {
-        default:
+        if(Result->CaseExpr.ValueCount >= MAX_CASE_VALUE_COUNT)
         {
             location ErrorLocation;
             GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-            PrintLocationError(&ErrorLocation, "unknown token when expecting an expression");
+            PrintLocationError(&ErrorLocation, "too many values in case");
+            FreeExpression(Result);
             return NULL;
-        } break;
-        case TOKEN_char_number:
-        {
-            return ParseCharExpr(Lexer);
-        } break;
-        case TOKEN_int_number:
-        {
-            return ParseIntExpr(Lexer);
-        } break;
-        case TOKEN_real_number:
-        {
-            return ParseRealExpr(Lexer);
-        } break;
-        case TOKEN_string_text:
-        {
-            return ParseStringExpr(Lexer, Storage);
-        } break;
-        case TOKEN_id:
-        {
-            return ParseIdExpr(Lexer, Storage);
-        } break;
-        case '(':
-        {
-            return ParseParenExpr(Lexer, Storage);
-        } break;
-        case TOKEN_if:
+        }
+        expr* Value = ParseExpression(Lexer, Storage);
+        if(!Value)
         {
-            return ParseIfExpr(Lexer, Storage);
-        } break;
-        case TOKEN_for:
+            FreeExpression(Result);
+            return NULL;
+        }
+        Result->CaseExpr.Values[Result->CaseExpr.ValueCount++] = Value;
+        if(Lexer->Token != ',')
         {
-            return ParseForExpr(Lexer, Storage);
-        } break;
-        case TOKEN_return:
-        {
-            return ParseReturnExpr(Lexer, Storage);
-        } break;
-        case TOKEN_inline:
-        {
-            return ParseInlineExpr(Lexer, Storage);
-        } break;
+            break;
+        }
+        GetToken(Lexer);
+    }
+
+    if(Lexer->Token != '{')
+    {
+        return ExpressionExpectedError(Lexer, Result, IsElse ? "{ after else" : ", or { after case value");
+    }
+    GetToken(Lexer);
+    return Result;
+}
+
+// An if, for, bench, match or case whose body is being parsed.
+struct open_block
+{
+    expr* Statement;
+    bool IsElse;
+};
+
+static bool AddBlockStatement(open_block* Block, expr* Statement)
+{
+    uint32_t* Count;
+    expr** Statements;
+    if(Block->Statement->ExprType == EXPR_for)
+    {
+        Count = &Block->Statement->ForExpr.ExpressionCount;
+        Statements = Block->Statement->ForExpr.Expressions;
+    }
+    else if(Block->Statement->ExprType == EXPR_bench)
+    {
+        Count = &Block->Statement->BenchExpr.ExpressionCount;
+        Statements = Block->Statement->BenchExpr.Expressions;
+    }
+    else if(Block->Statement->ExprType == EXPR_match)
+    {
+        Count = &Block->Statement->MatchExpr.CaseCount;
+        Statements = Block->Statement->MatchExpr.Cases;
+    }
+    else if(Block->Statement->ExprType == EXPR_case)
+    {
+        Count = &Block->Statement->CaseExpr.ExpressionCount;
+        Statements = Block->Statement->CaseExpr.Expressions;
     }
+    else if(Block->IsElse)
+    {
+        Count = &Block->Statement->IfExpr.FalseExpressionCount;
+        Statements = Block->Statement->IfExpr.FalseExpressions;
+    }
+    else
+    {
+        Count = &Block->Statement->IfExpr.TrueExpressionCount;
+        Statements = Block->Statement->IfExpr.TrueExpressions;
+    }
+
+    if(*Count >= MAX_EXPRESSION_COUNT)
+    {
+        return false;
+    }
+    Statements[(*Count)++] = Statement;
+    return true;
 }
 
-static expr* ParseBinaryExpressionRHS(int32_t ExprPrecedence, lexer* Lexer, string_storage* Storage, expr* LHS)
+// Parses the bodies of an if, for, bench or match and of the ones nested in them in a single loop over the open blocks, instead of
+// recursing per nesting level. Statements are added to their block as soon as they start, so freeing Statement cleans
+// up after an error at any depth. Returns with the closing } as the current token, like the other statements' ;.
+static expr* ParseBlocks(lexer* Lexer, string_storage* Storage, expr* Statement)
 {
-    // TODO(rytis): Likely a memory leak here. CHECK!
+    open_block Buffer[16];
+    work_stack Blocks;
+    InitWorkStack(&Blocks, Buffer, sizeof(Buffer), sizeof(open_block));
+    open_block* Root = (open_block*)PushWork(&Blocks);
+    Root->Statement = Statement;
+    Root->IsElse = false;
+
+    expr* Result = Statement;
     for(;;)
     {
-        int32_t TokenPrecedence = GetTokenPrecedence(Lexer->Token);
-        if(TokenPrecedence < ExprPrecedence)
+        open_block* Block = (open_block*)PeekWork(&Blocks);
+        if(Lexer->Token == '}')
         {
-            return LHS;
-        }
+            if((Block->Statement->ExprType == EXPR_if) && !Block->IsElse && (PeekToken(Lexer) == TOKEN_else))
+            {
+                GetToken(Lexer);
+                GetToken(Lexer);
+                if(Lexer->Token != '{')
+                {
+                    Result = ExpressionExpectedError(Lexer, Statement, "{ after else statement");
+                    break;
+                }
+                GetToken(Lexer);
+                Block->IsElse = true;
+                continue;
+            }
 
-        int32_t Operator = Lexer->Token;
-        GetToken(Lexer);
+            PopWork(&Blocks);
+            if(Blocks.Count == 0)
+            {
+                break;
+            }
+            GetToken(Lexer);
+            continue;
+        }
 
-        expr* RHS = ParsePrimaryExpression(Lexer, Storage);
-        if(!RHS)
+        // The statements of a match are its cases, and cases only go there.
+        bool IsMatch = (Block->Statement->ExprType == EXPR_match);
+        bool IsCase = (Lexer->Token == TOKEN_case) || (IsMatch && (Lexer->Token == TOKEN_else));
+        if(IsMatch && !IsCase)
         {
-            FreeExpression(LHS);
-            FreeExpression(RHS);
-            return NULL;
+            Result = ExpressionExpectedError(Lexer, Statement, "case or else in match");
+            break;
+        }
+        if(IsCase && !IsMatch)
+        {
+            location ErrorLocation;
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "case outside of a match");
+            FreeExpression(Statement);
+            Result = NULL;
+            break;
         }
 
-        int32_t NextPrecedence = GetTokenPrecedence(Lexer->Token);
-        if(TokenPrecedence < NextPrecedence)
+        bool IsBlock = (Lexer->Token == TOKEN_if) || (Lexer->Token == TOKEN_for) || (Lexer->Token == TOKEN_bench) ||
+                       (Lexer->Token == TOKEN_match) || IsCase;
+        expr* Inner = NULL;
+        if(IsCase)
         {
-            expr* OldRHS = RHS;
-            RHS = ParseBinaryExpressionRHS(TokenPrecedence + 1, Lexer, Storage, OldRHS);
-            if(!RHS)
-            {
-                FreeExpression(OldRHS);
-                FreeExpression(LHS);
-                FreeExpression(RHS);
-                return NULL;
-            }
+            Inner = ParseCaseHeader(Lexer, Storage);
+        }
+        else if(Lexer->Token == TOKEN_match)
+        {
+            Inner = ParseMatchHeader(Lexer, Storage);
+        }
+        else if(Lexer->Token == TOKEN_if)
+        {
+            Inner = ParseIfHeader(Lexer, Storage);
+        }
+        else if(Lexer->Token == TOKEN_for)
+        {
+            Inner = ParseForHeader(Lexer, Storage);
+        }
+        else if(Lexer->Token == TOKEN_bench)
+        {
+            Inner = ParseBenchHeader(Lexer, Storage);
+        }
+        else
+        {
+            Inner = ParseExpression(Lexer, Storage);
+        }
+        if(!Inner)
+        {
+            FreeExpression(Statement);
+            Result = NULL;
+            break;
+        }
+        if(!AddBlockStatement(Block, Inner))
+        {
+            location ErrorLocation;
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "too many statements in block");
+            FreeExpression(Inner);
+            FreeExpression(Statement);
+            Result = NULL;
+            break;
         }
 
-        expr* OldLHS = LHS;
-        LHS = (expr*)malloc(sizeof(expr));
-        LHS->ExprType = EXPR_binary;
-        LHS->BinaryExpr.Operator = Operator;
-        LHS->BinaryExpr.LHS = OldLHS;
-        LHS->BinaryExpr.RHS = RHS;
+        if(IsBlock)
+        {
+            open_block* InnerBlock = (open_block*)PushWork(&Blocks);
+            InnerBlock->Statement = Inner;
+            InnerBlock->IsElse = false;
+            continue;
+        }
+        if(Lexer->Token != ';')
+        {
+            Result = ExpressionExpectedError(Lexer, Statement, ";");
+            break;
+        }
+        GetToken(Lexer);
     }
+
+    FreeWorkStack(&Blocks);
+    return Result;
 }
 
-static expr* ParseExpression(lexer* Lexer, string_storage* Storage)
+static expr* ParseIfExpr(lexer* Lexer, string_storage* Storage)
 {
-    expr* LHS = ParsePrimaryExpression(Lexer, Storage);
-    if(!LHS)
-    {
-        return NULL;
-    }
+    expr* Result = ParseIfHeader(Lexer, Storage);
+    return Result ? ParseBlocks(Lexer, Storage, Result) : NULL;
+}
+
+static expr* ParseForExpr(lexer* Lexer, string_storage* Storage)
+{
+    expr* Result = ParseForHeader(Lexer, Storage);
+    return Result ? ParseBlocks(Lexer, Storage, Result) : NULL;
+}
 
-    return ParseBinaryExpressionRHS(0, Lexer, Storage, LHS);
+static expr* ParseBenchExpr(lexer* Lexer, string_storage* Storage)
+{
+    expr* Result = ParseBenchHeader(Lexer, Storage);
+    return Result ? ParseBlocks(Lexer, Storage, Result) : NULL;
 }
 
-static expr* ParseFunctionDeclarationVariable(lexer* Lexer, string_storage* Storage)
+static expr* ParseMatchExpr(lexer* Lexer, string_storage* Storage)
 {
-    location ErrorLocation;
+    expr* Result = ParseMatchHeader(Lexer, Storage);
+    return Result ? ParseBlocks(Lexer, Storage, Result) : NULL;
+}
 
-    if(Lexer->Token != TOKEN_id)
+static expr* ParseReturnExpr(lexer* Lexer, string_storage* Storage)
+{
+    GetToken(Lexer);
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    Result->ExprType = EXPR_return;
+    Result->ReturnExpr.Expression = ParseExpression(Lexer, Storage);
+    if(!Result->ReturnExpr.Expression)
     {
-        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-        PrintLocationError(&ErrorLocation, "expected variable name");
+        FreeExpression(Result);
         return NULL;
     }
+    if(Lexer->Token != ';')
+    {
+        return ExpressionExpectedError(Lexer, Result, ";");
+    }
+    return Result;
+}
+
+static expr* ParseInlineExpr(lexer* Lexer, string_storage* Storage)
+{
+    location ErrorLocation;
 
-    uint32_t StringIndex = AddStringToStorage(Storage, Lexer->String, Lexer->StringLength);
-    
     GetToken(Lexer);
-    if(Lexer->Token != ':')
+
+    if(Lexer->Token != TOKEN_string_text)
     {
         GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-        PrintLocationError(&ErrorLocation, "expected :");
+        PrintLocationError(&ErrorLocation, "expected \"");
         return NULL;
     }
 
-    GetToken(Lexer);
-    if(!IsType(Lexer->Token))
+    char* Text = GetTokenString(Lexer, Storage);
+    if(!Text)
     {
-        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-        PrintLocationError(&ErrorLocation, "expected type");
         return NULL;
     }
 
-    expr* Result = (expr*)malloc(sizeof(expr));
-    Result->ExprType = EXPR_var;
-    Result->VarExpr.Type = Lexer->Token;
-    Result->VarExpr.Name = Storage->StringArray[StringIndex];
-    Result->VarExpr.Expr = NULL;
-
     GetToken(Lexer);
 
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    Result->ExprType = EXPR_inline;
+    Result->InlineExpr.Text = Text;
     return Result;
 }
 
-static func* ParseFunctionDeclaration(lexer* Lexer, string_storage* Storage)
+static expr* ParsePrimaryExpression(lexer* Lexer, string_storage* Storage)
 {
-    location ErrorLocation;
-
-    func* Result = (func*)malloc(sizeof(func));
-    Result->ParameterCount = 0;
-    Result->ExpressionCount = 0;
-
-    uint32_t StringIndex = AddStringToStorage(Storage, Lexer->String, Lexer->StringLength);
-    Result->Name = Storage->StringArray[StringIndex];
+    switch(Lexer->Token)
+    {
+        default:
+        {
+            location ErrorLocation;
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "unknown token when expecting an expression");
+            return NULL;
+        } break;
+        case TOKEN_case:
+        {
+            location ErrorLocation;
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "case outside of a match");
+            return NULL;
+        } break;
+        case TOKEN_char_number:
+        {
+            return ParseCharExpr(Lexer);
+        } break;
+        case TOKEN_int_number:
+        {
+            return ParseIntExpr(Lexer);
+        } break;
+        case TOKEN_real_number:
+        {
+            return ParseRealExpr(Lexer);
+        } break;
+        case TOKEN_string_text:
+        {
+            return ParseStringExpr(Lexer, Storage);
+        } break;
+        case TOKEN_id:
+        {
+            return ParseIdExpr(Lexer, Storage);
+        } break;
+        case TOKEN_if:
+        {
+            return ParseIfExpr(Lexer, Storage);
+        } break;
+        case TOKEN_for:
+        {
+            return ParseForExpr(Lexer, Storage);
+        } break;
+        case TOKEN_bench:
+        {
+            return ParseBenchExpr(Lexer, Storage);
+        } break;
+        case TOKEN_match:
+        {
+            return ParseMatchExpr(Lexer, Storage);
+        } break;
+        case TOKEN_return:
+        {
+            return ParseReturnExpr(Lexer, Storage);
+        } break;
+        case TOKEN_inline:
+        {
+            return ParseInlineExpr(Lexer, Storage);
+        } break;
+    }
+}
 
-    GetToken(Lexer); // Eat the name.
-    GetToken(Lexer); // Eat the double colon.
+static expr* MakeUnaryExpr(int32_t Operator, expr* Operand, bool IsPostfix)
+{
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    Result->ExprType = EXPR_unary;
+    Result->UnaryExpr.Operator = Operator;
+    Result->UnaryExpr.Operand = Operand;
+    Result->UnaryExpr.IsPostfix = IsPostfix;
+    return Result;
+}
 
-    if(Lexer->Token != '(')
+static int32_t GetPendingPrecedence(expr* Operator)
+{
+    if(Operator->ExprType == EXPR_paren)
     {
-        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-        PrintLocationError(&ErrorLocation, "expected (");
-        free(Result);
-        return NULL;
+        return PAREN_PRECEDENCE;
     }
+    return (Operator->ExprType == EXPR_unary) ? PREFIX_PRECEDENCE : GetBinaryOperator(Operator->BinaryExpr.Operator).Precedence;
+}
 
-    GetToken(Lexer);
-    if(Lexer->Token != ')')
+// Operator precedence parsing driven by OperatorTable over explicit stacks, in one pass without backtracking, so that
+// long operator chains are a flat loop. Operators are allocated as nodes when read and get their operands when applied.
+// Open parentheses wait on the operator stack too, so the parser doesn't recurse into them.
+static expr* ParseExpression(lexer* Lexer, string_storage* Storage)
+{
+    expr* OperandBuffer[16];
+    expr* OperatorBuffer[16];
+    work_stack Operands;
+    work_stack Operators;
+    InitWorkStack(&Operands, OperandBuffer, sizeof(OperandBuffer), sizeof(expr*));
+    InitWorkStack(&Operators, OperatorBuffer, sizeof(OperatorBuffer), sizeof(expr*));
+
+    expr* Result = NULL;
+    uint32_t OpenParenCount = 0;
+    bool IsFailed = false;
+    for(;;)
     {
-        for(;;)
+        // Prefix operators wait for their operand like binary ones, binding tighter than all of them.
+        while(IsPrefixOperator(Lexer->Token) || (Lexer->Token == '('))
         {
-            uint32_t ParamCount = Result->ParameterCount;
-            Result->Parameters[ParamCount] = ParseFunctionDeclarationVariable(Lexer, Storage);
-            if(!Result->Parameters[ParamCount])
+            if((Lexer->Token == '(') && (Lexer->NestingDepth == MAX_NESTING_DEPTH))
             {
-                FreeFunction(Result);
-                return NULL;
+                location ErrorLocation;
+                GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+                PrintLocationError(&ErrorLocation, "parentheses nested too deeply");
+                IsFailed = true;
+                break;
             }
-            ++Result->ParameterCount;
-
-            if(Lexer->Token == ')')
+            if(Lexer->Token == '(')
             {
-                break;
+                expr* Paren = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+                Paren->ExprType = EXPR_paren;
+                Paren->ParenExpr.InnerExpr = NULL;
+                PushExpr(&Operators, Paren);
+                ++OpenParenCount;
+                ++Lexer->NestingDepth;
             }
-
-            if(Lexer->Token != ',')
+            else
             {
-                GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-                PrintLocationError(&ErrorLocation, "expected , or )");
-                FreeFunction(Result);
-                return NULL;
+                PushExpr(&Operators, MakeUnaryExpr(Lexer->Token, NULL, false));
             }
             GetToken(Lexer);
         }
-    }
 
-    GetToken(Lexer);
-    if(Lexer->Token != TOKEN_arrow)
-    {
-        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-        PrintLocationError(&ErrorLocation, "expected ->");
-        FreeFunction(Result);
-        return NULL;
-    }
+        expr* Operand = IsFailed ? NULL : ParsePrimaryExpression(Lexer, Storage);
+        if(!Operand)
+        {
+            IsFailed = true;
+            break;
+        }
 
-    GetToken(Lexer);
-    if(!IsType(Lexer->Token))
-    {
-        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
-        PrintLocationError(&ErrorLocation, "expected type in function declaration");
-        FreeFunction(Result);
-        return NULL;
+        // A ) applies everything since its ( and makes the parenthesized expression the next operand.
+        operator_info Next;
+        for(;;)
+        {
+            while((Lexer->Token == TOKEN_plusplus) || (Lexer->Token == TOKEN_minusminus))
+            {
+                Operand = MakeUnaryExpr(Lexer->Token, Operand, true);
+                GetToken(Lexer);
+            }
+            PushExpr(&Operands, Operand);
+
+            // Pending operators binding tighter are applied first, as are equally tight ones unless right associative.
+            Next = GetBinaryOperator(Lexer->Token);
+            while(Operators.Count)
+            {
+                int32_t Precedence = GetPendingPrecedence(*(expr**)PeekWork(&Operators));
+                if((Precedence < Next.Precedence) || ((Precedence == Next.Precedence) && Next.IsRightAssociative))
+                {
+                    break;
+                }
+
+                expr* Operator = PopExpr(&Operators);
+                if(Operator->ExprType == EXPR_unary)
+                {
+                    Operator->UnaryExpr.Operand = PopExpr(&Operands);
+                }
+                else
+                {
+                    Operator->BinaryExpr.RHS = PopExpr(&Operands);
+                    Operator->BinaryExpr.LHS = PopExpr(&Operands);
+                }
+                PushExpr(&Operands, Operator);
+            }
+
+            if((Lexer->Token != ')') || (OpenParenCount == 0))
+            {
+                break;
+            }
+            Operand = PopExpr(&Operators);
+            Operand->ParenExpr.InnerExpr = PopExpr(&Operands);
+            --OpenParenCount;
+            --Lexer->NestingDepth;
+            GetToken(Lexer);
+        }
+        if(Next.Precedence == 0)
+        {
+            if(OpenParenCount)
+            {
+                ExpressionExpectedError(Lexer, NULL, ")");
+                IsFailed = true;
+                break;
+            }
+            Result = PopExpr(&Operands);
+            break;
+        }
+
+        expr* Operator = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+        Operator->ExprType = EXPR_binary;
+        Operator->BinaryExpr.Operator = Lexer->Token;
+        Operator->BinaryExpr.LHS = NULL;
+        Operator->BinaryExpr.RHS = NULL;
+        PushExpr(&Operators, Operator);
+        GetToken(Lexer);
+    }
+
+    if(IsFailed)
+    {
+        while(Operands.Count)
+        {
+            FreeExpression(PopExpr(&Operands));
+        }
+        while(Operators.Count)
+        {
+            FreeExpression(PopExpr(&Operators));
+        }
+    }
+    Lexer->NestingDepth -= OpenParenCount;
+    FreeWorkStack(&Operands);
+    FreeWorkStack(&Operators);
+    return Result;
+}
+
+static expr* ParseFunctionDeclarationVariable(lexer* Lexer, string_storage* Storage)
+{
+    location ErrorLocation;
+
+    if(Lexer->Token != TOKEN_id)
+    {
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected variable name");
+        return NULL;
+    }
+
+    char* Name = GetTokenString(Lexer, Storage);
+    if(!Name)
+    {
+        return NULL;
+    }
+
+    GetToken(Lexer);
+    if(Lexer->Token != ':')
+    {
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected :");
+        return NULL;
+    }
+
+    GetToken(Lexer);
+    type_spec Type;
+    if(!ParseType(Lexer, Storage, &Type))
+    {
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected type");
+        return NULL;
+    }
+
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    Result->ExprType = EXPR_var;
+    Result->VarExpr.Type = Type;
+    Result->VarExpr.Name = Name;
+    Result->VarExpr.Expr = NULL;
+
+    return Result;
+}
+
+static func* ParseFunctionDeclaration(lexer* Lexer, string_storage* Storage, char* Name)
+{
+    location ErrorLocation;
+
+    func* Result = (func*)Allocate(MEMORY_ast, sizeof(func));
+    Result->Name = Name;
+    Result->ParameterCount = 0;
+    Result->ExpressionCount = 0;
+
+    if(Lexer->Token != '(')
+    {
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected (");
+        Deallocate(Result);
+        return NULL;
+    }
+
+    GetToken(Lexer);
+    if(Lexer->Token != ')')
+    {
+        for(;;)
+        {
+            uint32_t ParamCount = Result->ParameterCount;
+            Result->Parameters[ParamCount] = ParseFunctionDeclarationVariable(Lexer, Storage);
+            if(!Result->Parameters[ParamCount])
+            {
+                FreeFunction(Result);
+                return NULL;
+            }
+            ++Result->ParameterCount;
+
+            if(Lexer->Token == ')')
+            {
+                break;
+            }
+
+            if(Lexer->Token != ',')
+            {
+                GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+                PrintLocationError(&ErrorLocation, "expected , or )");
+                FreeFunction(Result);
+                return NULL;
+            }
+            GetToken(Lexer);
+        }
+    }
+
+    GetToken(Lexer);
+    if(Lexer->Token != TOKEN_arrow)
+    {
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected ->");
+        FreeFunction(Result);
+        return NULL;
     }
-    Result->Type = Lexer->Token;
+
     GetToken(Lexer);
+    if(!ParseType(Lexer, Storage, &Result->Type) || (Result->Type.ArrayKind == ARRAY_fixed))
+    {
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected type in function declaration");
+        FreeFunction(Result);
+        return NULL;
+    }
 
     if(Lexer->Token == ';')
     {
@@ -1778,6 +2814,13 @@ static func* ParseFunctionDeclaration(lexer* Lexer, string_storage* Storage)
         }
 
         uint32_t ExprCount = Result->ExpressionCount;
+        if(ExprCount >= MAX_EXPRESSION_COUNT)
+        {
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "too many statements in block");
+            FreeFunction(Result);
+            return NULL;
+        }
 
         Result->Expressions[ExprCount] = ParseExpression(Lexer, Storage);
         if(!Result->Expressions[ExprCount])
@@ -1788,7 +2831,7 @@ static func* ParseFunctionDeclaration(lexer* Lexer, string_storage* Storage)
         int32_t ExprType = Result->Expressions[ExprCount]->ExprType;
         ++Result->ExpressionCount;
 
-        if((ExprType == EXPR_if) || (ExprType == EXPR_for))
+        if((ExprType == EXPR_if) || (ExprType == EXPR_for) || (ExprType == EXPR_bench) || (ExprType == EXPR_match))
         {
             if(Lexer->Token != '}')
             {
@@ -1814,6 +2857,71 @@ static func* ParseFunctionDeclaration(lexer* Lexer, string_storage* Storage)
     return Result;
 }
 
+// Name :: struct [#soa] { Field : type; ... }
+static struct_decl* ParseStructDeclaration(lexer* Lexer, string_storage* Storage, char* Name)
+{
+    location ErrorLocation;
+
+    struct_decl* Result = (struct_decl*)Allocate(MEMORY_ast, sizeof(struct_decl));
+    Result->Name = Name;
+    Result->IsSoa = false;
+    Result->FieldCount = 0;
+
+    GetToken(Lexer); // Eat the struct keyword.
+    if(Lexer->Token == '#')
+    {
+        GetToken(Lexer);
+        if((Lexer->Token != TOKEN_id) || (strcmp(Lexer->String, "soa") != 0))
+        {
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "unknown struct annotation");
+            FreeStruct(Result);
+            return NULL;
+        }
+        Result->IsSoa = true;
+        GetToken(Lexer);
+    }
+
+    if(Lexer->Token != '{')
+    {
+        GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+        PrintLocationError(&ErrorLocation, "expected { after struct");
+        FreeStruct(Result);
+        return NULL;
+    }
+    GetToken(Lexer);
+
+    while(Lexer->Token != '}')
+    {
+        if(Result->FieldCount >= MAX_FIELD_COUNT)
+        {
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "too many struct fields");
+            FreeStruct(Result);
+            return NULL;
+        }
+
+        expr* Field = ParseFunctionDeclarationVariable(Lexer, Storage);
+        if(!Field)
+        {
+            FreeStruct(Result);
+            return NULL;
+        }
+        Result->Fields[Result->FieldCount++] = Field;
+
+        if(Lexer->Token != ';')
+        {
+            GetLocation(&ErrorLocation, Lexer, Lexer->FirstChar);
+            PrintLocationError(&ErrorLocation, "expected ; after struct field");
+            FreeStruct(Result);
+            return NULL;
+        }
+        GetToken(Lexer);
+    }
+
+    return Result;
+}
+
 static int32_t Parse(ast* Ast, lexer* Lexer, string_storage* Storage)
 {
     if((Lexer->Token != TOKEN_id) && (Lexer->Token != TOKEN_inline))
@@ -1826,8 +2934,25 @@ static int32_t Parse(ast* Ast, lexer* Lexer, string_storage* Storage)
     {
         case TOKEN_double_colon:
         {
-            Ast->AstType = AST_func;
-            Ast->Func = ParseFunctionDeclaration(Lexer, Storage);
+            char* Name = GetTokenString(Lexer, Storage);
+            if(!Name)
+            {
+                return 0;
+            }
+
+            GetToken(Lexer); // Eat the name.
+            GetToken(Lexer); // Eat the double colon.
+
+            if(Lexer->Token == TOKEN_struct)
+            {
+                Ast->AstType = AST_struct;
+                Ast->Struct = ParseStructDeclaration(Lexer, Storage, Name);
+            }
+            else
+            {
+                Ast->AstType = AST_func;
+                Ast->Func = ParseFunctionDeclaration(Lexer, Storage, Name);
+            }
         } break;
         default:
         {
@@ -1845,471 +2970,8756 @@ static int32_t Parse(ast* Ast, lexer* Lexer, string_storage* Storage)
     return 1;
 }
 
-// --------------
-// --TRANSLATOR--
-// --------------
+// Hashes of the names that some code mentions, for telling the code that is still used from dead code. Hashes stand in for
+// the names, a collision only keeps dead code.
+struct name_set
+{
+    uint32_t Count;
+    uint32_t Capacity;
+    uint64_t* Hashes;
+};
 
-static void TranslateString(FILE* FileHandle, char* String)
+static void AddName(name_set* Names, const char* Name, uint32_t Length)
 {
-    char* CurrentChar = String;
-    while(*CurrentChar != '\0')
+    if(Names->Count == Names->Capacity)
     {
-        switch(*CurrentChar)
-        {
-            default:
-            {
-                fprintf(FileHandle, "%c", *CurrentChar);
-            } break;
-            case '\n':
-            {
-                fprintf(FileHandle, "\\n");
-            } break;
-            case '\r':
-            {
-                fprintf(FileHandle, "\\r");
-            } break;
-            case '\t':
-            {
-                fprintf(FileHandle, "\\t");
-            } break;
-            case '\f':
-            {
-                fprintf(FileHandle, "\\f");
-            } break;
-        }
-        ++CurrentChar;
+        Names->Capacity = Names->Capacity ? (2 * Names->Capacity) : 64;
+        Names->Hashes = (uint64_t*)Reallocate(MEMORY_scratch, Names->Hashes, sizeof(uint64_t) * Names->Capacity);
     }
+    Names->Hashes[Names->Count++] = HashBytes(Name, Length);
 }
 
-static int32_t TranslateType(FILE* FileHandle, int32_t Type)
+// Inline C is opaque, so every identifier in it counts as mentioned.
+static void AddInlineNames(name_set* Names, const char* Text)
 {
-    switch(Type)
+    while(*Text)
     {
-        default:
-        {
-            return 0;
-        } break;
-        case TOKEN_char:
-        {
-            fprintf(FileHandle, "char ");
-        } break;
-        case TOKEN_int:
-        {
-            fprintf(FileHandle, "int ");
-        } break;
-        case TOKEN_float:
+        if(GetCharKind(*Text) != CHAR_letter)
         {
-            fprintf(FileHandle, "float ");
-        } break;
-        case TOKEN_string:
+            // Skips the rest of a number, so that the suffix of 10ULL isn't taken for a name.
+            char_kind Kind = GetCharKind(*Text++);
+            while((Kind == CHAR_digit) && ((GetCharKind(*Text) == CHAR_letter) || (GetCharKind(*Text) == CHAR_digit)))
+            {
+                ++Text;
+            }
+            continue;
+        }
+
+        const char* Start = Text;
+        while((GetCharKind(*Text) == CHAR_letter) || (GetCharKind(*Text) == CHAR_digit))
         {
-            fprintf(FileHandle, "char* ");
-        } break;
+            ++Text;
+        }
+        AddName(Names, Start, (uint32_t)(Text - Start));
     }
-    return 1;
 }
 
-static int32_t TranslateOperator(FILE* FileHandle, int32_t Operator)
+// Adds the names of the variables read and the functions called in the expression and everything nested in it.
+static void AddExpressionNames(name_set* Names, expr* Expression)
 {
-    if(Operator < TOKEN_eof)
-    {
-        fprintf(FileHandle, "%c", (char)Operator);
-    }
-    else
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Expression);
+
+    while(Pending.Count)
     {
-        switch(Operator)
+        Expression = PopExpr(&Pending);
+        if(!Expression)
+        {
+            continue;
+        }
+
+        switch(Expression->ExprType)
         {
             default:
             {
-                return 0;
             } break;
-            case TOKEN_pluseq:
+            case EXPR_id:
             {
-                fprintf(FileHandle, "+=");
+                AddName(Names, Expression->IdExpr.String, (uint32_t)strlen(Expression->IdExpr.String));
             } break;
-            case TOKEN_minuseq:
+            case EXPR_inline:
             {
-                fprintf(FileHandle, "-=");
+                AddInlineNames(Names, Expression->InlineExpr.Text);
             } break;
-            case TOKEN_muleq:
+            case EXPR_var:
             {
-                fprintf(FileHandle, "*=");
+                PushExpr(&Pending, Expression->VarExpr.Expr);
             } break;
-            case TOKEN_diveq:
+            case EXPR_paren:
             {
-                fprintf(FileHandle, "/=");
+                PushExpr(&Pending, Expression->ParenExpr.InnerExpr);
             } break;
-            case TOKEN_modeq:
+            case EXPR_binary:
             {
-                fprintf(FileHandle, "%%=");
+                PushExpr(&Pending, Expression->BinaryExpr.LHS);
+                PushExpr(&Pending, Expression->BinaryExpr.RHS);
             } break;
-            case TOKEN_eq:
+            case EXPR_unary:
             {
-                fprintf(FileHandle, "==");
+                PushExpr(&Pending, Expression->UnaryExpr.Operand);
             } break;
-            case TOKEN_noteq:
+            case EXPR_call:
             {
-                fprintf(FileHandle, "!=");
-            } break;
-            case TOKEN_lesseq:
+                AddName(Names, Expression->CallExpr.Name, (uint32_t)strlen(Expression->CallExpr.Name));
+                for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CallExpr.Arguments[i]);
+                }
+            } break;
+            case EXPR_index:
+            {
+                PushExpr(&Pending, Expression->IndexExpr.Array);
+                PushExpr(&Pending, Expression->IndexExpr.Index);
+            } break;
+            case EXPR_field:
+            {
+                PushExpr(&Pending, Expression->FieldExpr.Object);
+            } break;
+            case EXPR_if:
+            {
+                PushExpr(&Pending, Expression->IfExpr.Statement);
+                for(uint32_t i = 0; i < Expression->IfExpr.TrueExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->IfExpr.TrueExpressions[i]);
+                }
+                for(uint32_t i = 0; i < Expression->IfExpr.FalseExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->IfExpr.FalseExpressions[i]);
+                }
+            } break;
+            case EXPR_for:
+            {
+                PushExpr(&Pending, Expression->ForExpr.Definition);
+                PushExpr(&Pending, Expression->ForExpr.Condition);
+                PushExpr(&Pending, Expression->ForExpr.Action);
+                for(uint32_t i = 0; i < Expression->ForExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->ForExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_bench:
             {
-                fprintf(FileHandle, "<=");
+                for(uint32_t i = 0; i < Expression->BenchExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->BenchExpr.Expressions[i]);
+                }
             } break;
-            case TOKEN_moreeq:
+            case EXPR_match:
             {
-                fprintf(FileHandle, ">=");
+                PushExpr(&Pending, Expression->MatchExpr.Value);
+                for(uint32_t i = 0; i < Expression->MatchExpr.CaseCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->MatchExpr.Cases[i]);
+                }
             } break;
-            case TOKEN_andand:
+            case EXPR_case:
             {
-                fprintf(FileHandle, "&&");
+                for(uint32_t i = 0; i < Expression->CaseExpr.ValueCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CaseExpr.Values[i]);
+                }
+                for(uint32_t i = 0; i < Expression->CaseExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CaseExpr.Expressions[i]);
+                }
             } break;
-            case TOKEN_oror:
+            case EXPR_return:
             {
-                fprintf(FileHandle, "||");
+                PushExpr(&Pending, Expression->ReturnExpr.Expression);
             } break;
         }
     }
-    return 1;
+    FreeWorkStack(&Pending);
 }
 
-static int32_t TranslateExpression(FILE* FileHandle, expr* Expression, bool IsParent)
+// Finds the byte range of the next top-level declaration without building its AST: a declaration ends with a ;
+// or with the } closing its body. Returns false at the end of input. When Names is given, it gets the names mentioned
+// in the declaration, the way AddExpressionNames would find them in its AST.
+static bool SkimDeclaration(lexer* Lexer, char** Start, char** End, name_set* Names)
 {
-    if(!Expression)
+    if(!GetToken(Lexer))
     {
-        return 0;
+        return false;
     }
 
-    switch(Expression->ExprType)
+    *Start = Lexer->FirstChar;
+    int32_t Depth = 0;
+    int32_t PreviousToken = 0;
+    for(;;)
     {
-        default:
+        if(Lexer->Token == '{')
         {
-            return 0;
-        } break;
-        case EXPR_char:
+            ++Depth;
+        }
+        else if((Lexer->Token == '}') && (--Depth <= 0))
         {
-            fprintf(FileHandle, "'%c'", Expression->CharExpr.CharValue);
-        } break;
-        case EXPR_int:
+            break;
+        }
+        else if(((Lexer->Token == ';') && (Depth == 0)) || (Lexer->Token == TOKEN_parse_error))
         {
-            fprintf(FileHandle, "%llu", Expression->IntExpr.IntValue);
-        } break;
-        case EXPR_real:
+            break;
+        }
+        else if(Names && (Lexer->Token == TOKEN_id))
         {
-            fprintf(FileHandle, "%ff", Expression->RealExpr.RealValue);
-        } break;
-        case EXPR_string:
+            AddName(Names, Lexer->String, (uint32_t)strlen(Lexer->String));
+        }
+        else if(Names && (Lexer->Token == TOKEN_string_text) && (PreviousToken == TOKEN_inline))
         {
-            fprintf(FileHandle, "\"");
-            TranslateString(FileHandle, Expression->StringExpr.String);
-            fprintf(FileHandle, "\"");
-        } break;
-        case EXPR_id:
+            AddInlineNames(Names, Lexer->String);
+        }
+        PreviousToken = Lexer->Token;
+
+        if(!GetToken(Lexer))
         {
-            fprintf(FileHandle, "%s", Expression->IdExpr.String);
-        } break;
-        case EXPR_var:
+            *End = Lexer->EndOfFile;
+            return true;
+        }
+    }
+    *End = Lexer->LastChar + 1;
+    return true;
+}
+
+// -------------
+// --DEAD CODE--
+// -------------
+// Statements that can't run, local variables that are never read and functions that main can't reach are dropped
+// before translation, so that the C compiler doesn't have to.
+
+struct statement_list
+{
+    expr** Statements;
+    uint32_t* Count;
+};
+
+static void PushStatementList(work_stack* Lists, expr** Statements, uint32_t* Count)
+{
+    statement_list* List = (statement_list*)PushWork(Lists);
+    List->Statements = Statements;
+    List->Count = Count;
+}
+
+// Pushes the bodies of the if, for and match statements in the list, and of the bench ones when IsBenchIncluded.
+static void PushNestedStatementLists(work_stack* Lists, statement_list List, bool IsBenchIncluded)
+{
+    for(uint32_t i = 0; i < *List.Count; ++i)
+    {
+        expr* Statement = List.Statements[i];
+        if(Statement->ExprType == EXPR_if)
         {
-            TranslateType(FileHandle, Expression->VarExpr.Type);
-            fprintf(FileHandle, "%s", Expression->VarExpr.Name);
-            if(Expression->VarExpr.Expr != NULL)
-            {
-                fprintf(FileHandle, "=");
-                if(!TranslateExpression(FileHandle, Expression->VarExpr.Expr, false))
-                {
-                    return 0;
-                }
-            }
-            if(IsParent)
+            PushStatementList(Lists, Statement->IfExpr.TrueExpressions, &Statement->IfExpr.TrueExpressionCount);
+            PushStatementList(Lists, Statement->IfExpr.FalseExpressions, &Statement->IfExpr.FalseExpressionCount);
+        }
+        else if(Statement->ExprType == EXPR_for)
+        {
+            PushStatementList(Lists, Statement->ForExpr.Expressions, &Statement->ForExpr.ExpressionCount);
+        }
+        else if((Statement->ExprType == EXPR_bench) && IsBenchIncluded)
+        {
+            PushStatementList(Lists, Statement->BenchExpr.Expressions, &Statement->BenchExpr.ExpressionCount);
+        }
+        else if(Statement->ExprType == EXPR_match)
+        {
+            for(uint32_t CaseIndex = 0; CaseIndex < Statement->MatchExpr.CaseCount; ++CaseIndex)
             {
-                fprintf(FileHandle, ";\n");
+                expr* Case = Statement->MatchExpr.Cases[CaseIndex];
+                PushStatementList(Lists, Case->CaseExpr.Expressions, &Case->CaseExpr.ExpressionCount);
             }
-        } break;
-        case EXPR_paren:
+        }
+    }
+}
+
+// Index of the else case of the match, -1 when it has none.
+static int32_t FindElseCase(expr* Match)
+{
+    for(uint32_t i = 0; i < Match->MatchExpr.CaseCount; ++i)
+    {
+        if(Match->MatchExpr.Cases[i]->CaseExpr.ValueCount == 0)
         {
-            fprintf(FileHandle, "(");
-            if(!TranslateExpression(FileHandle, Expression->ParenExpr.InnerExpr, false))
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+// Whether control never gets past the statement: a return, an if and else that both end in one, or a match with an
+// else whose cases all do.
+static bool IsTerminalStatement(expr* Statement)
+{
+    expr* Buffer[16];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Statement);
+
+    bool Result = true;
+    while(Result && Pending.Count)
+    {
+        Statement = PopExpr(&Pending);
+        if((Statement->ExprType == EXPR_if) && Statement->IfExpr.TrueExpressionCount && Statement->IfExpr.FalseExpressionCount)
+        {
+            PushExpr(&Pending, Statement->IfExpr.TrueExpressions[Statement->IfExpr.TrueExpressionCount - 1]);
+            PushExpr(&Pending, Statement->IfExpr.FalseExpressions[Statement->IfExpr.FalseExpressionCount - 1]);
+        }
+        else if((Statement->ExprType == EXPR_match) && (FindElseCase(Statement) >= 0))
+        {
+            for(uint32_t i = 0; Result && (i < Statement->MatchExpr.CaseCount); ++i)
             {
-                return 0;
+                expr* Case = Statement->MatchExpr.Cases[i];
+                Result = (Case->CaseExpr.ExpressionCount > 0);
+                if(Result)
+                {
+                    PushExpr(&Pending, Case->CaseExpr.Expressions[Case->CaseExpr.ExpressionCount - 1]);
+                }
             }
-            fprintf(FileHandle, ")");
-        } break;
-        case EXPR_binary:
+        }
+        else
+        {
+            Result = (Statement->ExprType == EXPR_return);
+        }
+    }
+    FreeWorkStack(&Pending);
+    return Result;
+}
+
+static bool IsOutputBuiltin(char* Name)
+{
+    return (strcmp(Name, "write_int") == 0) || (strcmp(Name, "write_float") == 0) || (strcmp(Name, "write_char") == 0) ||
+           (strcmp(Name, "write_str") == 0) || (strcmp(Name, "flush") == 0);
+}
+
+static bool IsIntrinsic(char* Name)
+{
+    return (strcmp(Name, "len") == 0) || (strcmp(Name, "slice") == 0) || (strcmp(Name, "alloc") == 0) || (strcmp(Name, "concat") == 0) ||
+           IsOutputBuiltin(Name);
+}
+
+static bool IsLenCall(expr* Expression)
+{
+    return (strcmp(Expression->CallExpr.Name, "len") == 0) && (Expression->CallExpr.ArgumentCount == 1);
+}
+
+// Whether dropping the expression can't change what the program does. Calls and indexing are kept for their effects
+// and bounds checks, except calls of the len intrinsic when IsLenPure, i.e. when no function is named len.
+static bool IsPureExpression(expr* Expression, bool IsLenPure)
+{
+    expr* Buffer[16];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Expression);
+
+    bool Result = true;
+    while(Result && Pending.Count)
+    {
+        Expression = PopExpr(&Pending);
+        if(!Expression)
+        {
+            continue;
+        }
+
+        switch(Expression->ExprType)
         {
-            if(!TranslateExpression(FileHandle, Expression->BinaryExpr.LHS, false))
+            default:
             {
-                return 0;
-            }
-            if(!TranslateOperator(FileHandle, Expression->BinaryExpr.Operator))
+                Result = false;
+            } break;
+            case EXPR_char:
+            case EXPR_int:
+            case EXPR_real:
+            case EXPR_string:
+            case EXPR_id:
             {
-                return 0;
-            }
-            if(!TranslateExpression(FileHandle, Expression->BinaryExpr.RHS, false))
+            } break;
+            case EXPR_paren:
             {
-                return 0;
-            }
-            if(IsParent)
+                PushExpr(&Pending, Expression->ParenExpr.InnerExpr);
+            } break;
+            case EXPR_binary:
             {
-                fprintf(FileHandle, ";\n");
-            }
-        } break;
-        case EXPR_call:
+                Result = !IsAssignmentOperator(Expression->BinaryExpr.Operator);
+                PushExpr(&Pending, Expression->BinaryExpr.LHS);
+                PushExpr(&Pending, Expression->BinaryExpr.RHS);
+            } break;
+            case EXPR_unary:
+            {
+                int32_t Operator = Expression->UnaryExpr.Operator;
+                Result = (Operator != TOKEN_plusplus) && (Operator != TOKEN_minusminus);
+                PushExpr(&Pending, Expression->UnaryExpr.Operand);
+            } break;
+            case EXPR_field:
+            {
+                PushExpr(&Pending, Expression->FieldExpr.Object);
+            } break;
+            case EXPR_call:
+            {
+                Result = IsLenPure && IsLenCall(Expression);
+                PushExpr(&Pending, Expression->CallExpr.ArgumentCount ? Expression->CallExpr.Arguments[0] : NULL);
+            } break;
+        }
+    }
+    FreeWorkStack(&Pending);
+    return Result;
+}
+
+static int CompareHashes(const void* A, const void* B)
+{
+    uint64_t HashA = *(const uint64_t*)A;
+    uint64_t HashB = *(const uint64_t*)B;
+    return (HashA < HashB) ? -1 : (HashA > HashB);
+}
+
+static void RemoveStatement(statement_list List, uint32_t Index)
+{
+    FreeExpression(List.Statements[Index]);
+    memmove(List.Statements + Index, List.Statements + Index + 1, sizeof(expr*) * (*List.Count - Index - 1));
+    --*List.Count;
+}
+
+// Drops the statements following a terminal one, then the local variables with pure initializers that nothing reads,
+// until no more of them go away: removing one can leave the variables its initializer read unused. Returns whether
+// anything was dropped.
+static bool EliminateDeadCode(func* Function)
+{
+    bool IsAnyRemoved = false;
+    statement_list Buffer[16];
+    work_stack Lists;
+    InitWorkStack(&Lists, Buffer, sizeof(Buffer), sizeof(statement_list));
+
+    // Every block comes after the one containing it, so going backwards trims inner blocks first and an if whose
+    // branches only return at the end of their trimmed statements counts as terminal.
+    statement_list AllBuffer[32];
+    work_stack AllLists;
+    InitWorkStack(&AllLists, AllBuffer, sizeof(AllBuffer), sizeof(statement_list));
+    PushStatementList(&Lists, Function->Expressions, &Function->ExpressionCount);
+    while(Lists.Count)
+    {
+        statement_list List = *(statement_list*)PeekWork(&Lists);
+        PopWork(&Lists);
+        *(statement_list*)PushWork(&AllLists) = List;
+        PushNestedStatementLists(&Lists, List, true);
+    }
+    for(uint32_t ListIndex = AllLists.Count; ListIndex > 0; --ListIndex)
+    {
+        statement_list List = ((statement_list*)AllLists.Elements)[ListIndex - 1];
+        for(uint32_t i = 0; i < *List.Count; ++i)
         {
-            fprintf(FileHandle, "%s(", Expression->CallExpr.Name);
-            for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+            if(IsTerminalStatement(List.Statements[i]))
             {
-                if(!TranslateExpression(FileHandle, Expression->CallExpr.Arguments[i], false))
+                while(*List.Count > i + 1)
                 {
-                    return 0;
+                    RemoveStatement(List, *List.Count - 1);
+                    IsAnyRemoved = true;
                 }
-                if(i != Expression->CallExpr.ArgumentCount - 1)
+            }
+        }
+    }
+    FreeWorkStack(&AllLists);
+
+    name_set Names = {};
+    for(bool IsChanged = true; IsChanged;)
+    {
+        IsChanged = false;
+        Names.Count = 0;
+        for(uint32_t i = 0; i < Function->ExpressionCount; ++i)
+        {
+            AddExpressionNames(&Names, Function->Expressions[i]);
+        }
+        if(Names.Count)
+        {
+            qsort(Names.Hashes, Names.Count, sizeof(uint64_t), CompareHashes);
+        }
+
+        PushStatementList(&Lists, Function->Expressions, &Function->ExpressionCount);
+        while(Lists.Count)
+        {
+            statement_list List = *(statement_list*)PeekWork(&Lists);
+            PopWork(&Lists);
+            for(uint32_t i = 0; i < *List.Count;)
+            {
+                expr* Statement = List.Statements[i];
+                if(Statement->ExprType == EXPR_var)
                 {
-                    fprintf(FileHandle, ", ");
+                    uint64_t Hash = HashBytes(Statement->VarExpr.Name, (uint32_t)strlen(Statement->VarExpr.Name));
+                    bool IsRead = Names.Count && bsearch(&Hash, Names.Hashes, Names.Count, sizeof(uint64_t), CompareHashes);
+                    if(!IsRead && IsPureExpression(Statement->VarExpr.Expr, false))
+                    {
+                        RemoveStatement(List, i);
+                        IsChanged = true;
+                        IsAnyRemoved = true;
+                        continue;
+                    }
                 }
+                ++i;
             }
-            if(IsParent)
+            // What a bench computes is its whole point, even when nothing reads it.
+            PushNestedStatementLists(&Lists, List, false);
+        }
+    }
+    Deallocate(Names.Hashes);
+    FreeWorkStack(&Lists);
+    return IsAnyRemoved;
+}
+
+// Top-level declarations with the names they mention. Functions are only kept when reachable from main through those
+// names, other declarations are always kept and so are roots. Without a main, nothing is dropped.
+struct reference_node
+{
+    bool IsFunction;
+    bool IsReachable;
+    uint64_t NameHash;
+    uint32_t FirstName;
+    uint32_t NameCount;
+};
+
+struct reference_graph
+{
+    uint32_t NodeCount;
+    uint32_t NodeCapacity;
+    reference_node* Nodes;
+    name_set Names;
+};
+
+// Starts the node of the next declaration, whose names are then added to Graph->Names.
+static void BeginReferenceNode(reference_graph* Graph, bool IsFunction, uint64_t NameHash)
+{
+    if(Graph->NodeCount == Graph->NodeCapacity)
+    {
+        Graph->NodeCapacity = Graph->NodeCapacity ? (2 * Graph->NodeCapacity) : 64;
+        Graph->Nodes = (reference_node*)Reallocate(MEMORY_scratch, Graph->Nodes, sizeof(reference_node) * Graph->NodeCapacity);
+    }
+    reference_node* Node = &Graph->Nodes[Graph->NodeCount++];
+    Node->IsFunction = IsFunction;
+    Node->IsReachable = false;
+    Node->NameHash = NameHash;
+    Node->FirstName = Graph->Names.Count;
+    Node->NameCount = 0;
+}
+
+static void EndReferenceNode(reference_graph* Graph)
+{
+    reference_node* Node = &Graph->Nodes[Graph->NodeCount - 1];
+    Node->NameCount = Graph->Names.Count - Node->FirstName;
+}
+
+static void FreeReferenceGraph(reference_graph* Graph)
+{
+    Deallocate(Graph->Nodes);
+    Deallocate(Graph->Names.Hashes);
+    memset(Graph, 0, sizeof(*Graph));
+}
+
+static void MarkReachableDeclarations(reference_graph* Graph)
+{
+    uint64_t MainHash = HashBytes("main", 4);
+    bool HasMain = false;
+    uint32_t FunctionCount = 0;
+    for(uint32_t i = 0; i < Graph->NodeCount; ++i)
+    {
+        reference_node* Node = &Graph->Nodes[i];
+        HasMain = HasMain || (Node->IsFunction && (Node->NameHash == MainHash));
+        FunctionCount += Node->IsFunction;
+        Node->IsReachable = !Node->IsFunction;
+    }
+    if(!HasMain)
+    {
+        for(uint32_t i = 0; i < Graph->NodeCount; ++i)
+        {
+            Graph->Nodes[i].IsReachable = true;
+        }
+        return;
+    }
+
+    // Functions by the hash of their name, a prototype and its definition share a hash and are reached together.
+    uint32_t SlotCount = 16;
+    while(SlotCount < 2 * FunctionCount)
+    {
+        SlotCount *= 2;
+    }
+    uint32_t* Slots = (uint32_t*)Allocate(MEMORY_scratch, sizeof(uint32_t) * SlotCount);
+    memset(Slots, 0, sizeof(uint32_t) * SlotCount);
+
+    uint32_t Buffer[64];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(uint32_t));
+    for(uint32_t i = 0; i < Graph->NodeCount; ++i)
+    {
+        reference_node* Node = &Graph->Nodes[i];
+        if(Node->IsFunction)
+        {
+            uint32_t Slot = (uint32_t)Node->NameHash & (SlotCount - 1);
+            while(Slots[Slot])
             {
-                fprintf(FileHandle, ");\n");
+                Slot = (Slot + 1) & (SlotCount - 1);
             }
-            else
+            Slots[Slot] = i + 1;
+            Node->IsReachable = (Node->NameHash == MainHash);
+        }
+        if(Node->IsReachable)
+        {
+            *(uint32_t*)PushWork(&Pending) = i;
+        }
+    }
+
+    while(Pending.Count)
+    {
+        reference_node* Node = &Graph->Nodes[*(uint32_t*)PeekWork(&Pending)];
+        PopWork(&Pending);
+        for(uint32_t i = 0; i < Node->NameCount; ++i)
+        {
+            uint64_t Hash = Graph->Names.Hashes[Node->FirstName + i];
+            for(uint32_t Slot = (uint32_t)Hash & (SlotCount - 1); Slots[Slot]; Slot = (Slot + 1) & (SlotCount - 1))
+            {
+                reference_node* Function = &Graph->Nodes[Slots[Slot] - 1];
+                if((Function->NameHash == Hash) && !Function->IsReachable)
+                {
+                    Function->IsReachable = true;
+                    *(uint32_t*)PushWork(&Pending) = Slots[Slot] - 1;
+                }
+            }
+        }
+    }
+    FreeWorkStack(&Pending);
+    Deallocate(Slots);
+}
+
+// --------------
+// --TRANSLATOR--
+// --------------
+
+#define RUNTIME_FILE_NAME "df_runtime.h"
+#define PRELUDE_FILE_NAME "df_prelude.h"
+#define MAX_INCLUDE_COUNT 128
+#define MAX_RUNTIME_INCLUDE_COUNT 4
+#define MAX_SYMBOL_COUNT 1024
+#define MAX_FUNCTION_COUNT 1024
+#define MAX_BOUNDS_FACT_COUNT 64
+#define MAX_ARENA_COUNT 32
+#define MAX_PROFILED_NAME_LENGTH 256
+#define MAX_STRUCT_COUNT 256
+#define STRING_INLINE_CAPACITY 16
+#define MIN_MATCH_TREE_VALUE_COUNT 4
+#define MATCH_SWITCH_DENSITY 4 // Matches whose values span more than this many per case value become a decision tree
+#define MIN_MATCH_TABLE_VALUE_COUNT 4
+#define MAX_MATCH_TABLE_LENGTH 256
+#define MAX_POOLED_STRING_COUNT 4096
+#define POOLED_STRING_SLOT_COUNT 8192 // Power of two above MAX_POOLED_STRING_COUNT
+
+enum runtime_flag
+{
+    RUNTIME_bounds_check = 1 << 0,
+    RUNTIME_string = 1 << 1,
+    RUNTIME_arena = 1 << 2,
+    RUNTIME_print = 1 << 3,
+    RUNTIME_output = 1 << 4,
+    RUNTIME_bench = 1 << 5,
+    RUNTIME_profile = 1 << 6,
+};
+
+struct symbol
+{
+    char* Name;
+    type_spec Type;
+    // Set for arena parameters, which are passed as pointers.
+    bool IsReference;
+    // Set for loop variables of at least 32 bits counting up from a literal, see TranslateForHeader.
+    bool IsNonNegative;
+};
+
+struct function_signature
+{
+    char* Name;
+    type_spec Type;
+    uint32_t ParameterCount;
+    type_spec ParameterTypes[MAX_PARAMETER_COUNT];
+};
+
+struct struct_info
+{
+    char* Name;
+    bool IsSoa;
+    uint32_t FieldCount;
+    char* FieldNames[MAX_FIELD_COUNT];
+    type_spec FieldTypes[MAX_FIELD_COUNT];
+};
+
+// Records that an index variable stays within [0, Bound), or within [0, len(ArrayName)) when ArrayName is set,
+// for the whole body of the loop that introduced it.
+struct bounds_fact
+{
+    char* IndexName;
+    char* ArrayName;
+    uint64_t Bound;
+};
+
+struct translator
+{
+    FILE* FileHandle;
+
+    // Runtime pieces referenced by the generated code, written out to RUNTIME_FILE_NAME at the end.
+    uint32_t RuntimeFlags;
+    uint32_t SliceTypeFlags;
+    uint32_t ArenaSliceTypeFlags;
+
+    uint32_t SymbolCount;
+    symbol Symbols[MAX_SYMBOL_COUNT];
+    // Symbols below it are globals while translating a function.
+    uint32_t GlobalSymbolCount;
+
+    uint32_t FunctionCount;
+    function_signature Functions[MAX_FUNCTION_COUNT];
+
+    uint32_t StructCount;
+    struct_info Structs[MAX_STRUCT_COUNT];
+
+    uint32_t BoundsFactCount;
+    bounds_fact BoundsFacts[MAX_BOUNDS_FACT_COUNT];
+
+    bool IsInFunction;
+    type_spec ReturnType;
+
+    // Type of real literals, TOKEN_float while a value stored into a single precision real is translated and TOKEN_f64
+    // otherwise, see TranslateValue.
+    int32_t RealLiteralType;
+
+    // Arenas declared in the enclosing scopes of the current function, released in reverse order.
+    uint32_t ArenaCount;
+    char* Arenas[MAX_ARENA_COUNT];
+
+    // Set while translating a function whose returns of calls to itself jump back to its start, see PrepareTailCalls.
+    // Its returns of X + Self(...) (or X * Self(...), after AccumulatorOperator) add X to DF_Accumulator instead.
+    func* TailFunction;
+    int32_t AccumulatorOperator;
+
+    // Set by --profile, see TranslateProfiledFunction.
+    bool IsProfiling;
+
+    // Numbers the temporaries and labels of matches not lowered to a switch, see TranslateMatchHeader.
+    uint32_t MatchCount;
+
+    // String literals and print texts, each written once as DF_Literal<Index>, see PoolString. The bytes are copied,
+    // as streamed declarations are freed before the pool is written out.
+    uint32_t PooledStringCount;
+    uint64_t PooledStringOffsets[MAX_POOLED_STRING_COUNT];
+    uint32_t PooledStringLengths[MAX_POOLED_STRING_COUNT];
+    uint32_t PooledStringSlots[POOLED_STRING_SLOT_COUNT]; // Index + 1, 0 when empty.
+    char* PooledBytes;
+    uint64_t PooledBytesLength;
+    uint64_t PooledBytesCapacity;
+
+    // Output of CheckFunction, whose translations are only made for their errors, and set while one runs so that
+    // nothing is pooled.
+    FILE* CheckFile;
+    bool IsChecking;
+
+    // <...> includes met in top-level inline C. Those met before any other inline C are moved to PRELUDE_FILE_NAME,
+    // repeated ones are dropped.
+    uint32_t IncludeCount;
+    char* Includes[MAX_INCLUDE_COUNT + MAX_RUNTIME_INCLUDE_COUNT];
+    bool IsInPrelude[MAX_INCLUDE_COUNT + MAX_RUNTIME_INCLUDE_COUNT];
+    bool IsPreludeClosed;
+};
+
+static type_spec MakeType(int32_t Type)
+{
+    type_spec Result = {};
+    Result.Type = Type;
+    Result.Name = NULL;
+    Result.ArrayKind = ARRAY_none;
+    return Result;
+}
+
+static void InitTranslator(translator* Translator, FILE* FileHandle)
+{
+    Translator->FileHandle = FileHandle;
+    Translator->RuntimeFlags = 0;
+    Translator->SliceTypeFlags = 0;
+    Translator->ArenaSliceTypeFlags = 0;
+    Translator->SymbolCount = 0;
+    Translator->GlobalSymbolCount = 0;
+    Translator->FunctionCount = 0;
+    Translator->StructCount = 0;
+    Translator->IncludeCount = 0;
+    Translator->IsPreludeClosed = false;
+    Translator->BoundsFactCount = 0;
+    Translator->IsInFunction = false;
+    Translator->ReturnType = MakeType(TOKEN_int);
+    Translator->RealLiteralType = TOKEN_f64;
+    Translator->ArenaCount = 0;
+    Translator->TailFunction = NULL;
+    Translator->AccumulatorOperator = 0;
+    Translator->IsProfiling = false;
+    Translator->MatchCount = 0;
+    Translator->PooledStringCount = 0;
+    memset(Translator->PooledStringSlots, 0, sizeof(Translator->PooledStringSlots));
+    Translator->PooledBytes = NULL;
+    Translator->PooledBytesLength = 0;
+    Translator->PooledBytesCapacity = 0;
+    Translator->CheckFile = NULL;
+    Translator->IsChecking = false;
+}
+
+static int32_t AddSymbol(translator* Translator, char* Name, type_spec* Type)
+{
+    if(Translator->SymbolCount >= MAX_SYMBOL_COUNT)
+    {
+        fprintf(stderr, "Error: symbol capacity exceeded!\n");
+        return 0;
+    }
+    symbol* Symbol = &Translator->Symbols[Translator->SymbolCount++];
+    Symbol->Name = Name;
+    Symbol->Type = *Type;
+    Symbol->IsReference = false;
+    Symbol->IsNonNegative = false;
+    return 1;
+}
+
+static symbol* FindSymbol(translator* Translator, char* Name)
+{
+    for(uint32_t i = Translator->SymbolCount; i > 0; --i)
+    {
+        if(strcmp(Translator->Symbols[i - 1].Name, Name) == 0)
+        {
+            return &Translator->Symbols[i - 1];
+        }
+    }
+    return NULL;
+}
+
+static function_signature* FindFunction(translator* Translator, char* Name)
+{
+    for(uint32_t i = 0; i < Translator->FunctionCount; ++i)
+    {
+        if(strcmp(Translator->Functions[i].Name, Name) == 0)
+        {
+            return &Translator->Functions[i];
+        }
+    }
+    return NULL;
+}
+
+static struct_info* FindStruct(translator* Translator, char* Name)
+{
+    for(uint32_t i = 0; i < Translator->StructCount; ++i)
+    {
+        if(strcmp(Translator->Structs[i].Name, Name) == 0)
+        {
+            return &Translator->Structs[i];
+        }
+    }
+    return NULL;
+}
+
+static int32_t FindField(struct_info* Struct, char* Name)
+{
+    for(uint32_t i = 0; i < Struct->FieldCount; ++i)
+    {
+        if(strcmp(Struct->FieldNames[i], Name) == 0)
+        {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+// Returns the struct when the type is an array of #soa structs.
+static struct_info* GetSoaStruct(translator* Translator, type_spec* Type)
+{
+    if((Type->ArrayKind == ARRAY_none) || (Type->Type != TOKEN_id))
+    {
+        return NULL;
+    }
+    struct_info* Struct = FindStruct(Translator, Type->Name);
+    return (Struct && Struct->IsSoa) ? Struct : NULL;
+}
+
+static const char* GetTypeName(int32_t Type)
+{
+    if((Type >= TOKEN_i8) && (Type <= TOKEN_f64))
+    {
+        return SizedTypeNames[Type - TOKEN_i8];
+    }
+    switch(Type)
+    {
+        default:
+        {
+            return "unknown";
+        } break;
+        case TOKEN_char:
+        {
+            return "char";
+        } break;
+        case TOKEN_int:
+        {
+            return "int";
+        } break;
+        case TOKEN_float:
+        {
+            return "float";
+        } break;
+        case TOKEN_string:
+        {
+            return "string";
+        } break;
+        case TOKEN_arena:
+        {
+            return "arena";
+        } break;
+    }
+}
+
+static void TranslateStringBytes(FILE* FileHandle, char* String, uint32_t Length)
+{
+    for(char* CurrentChar = String; CurrentChar < String + Length; ++CurrentChar)
+    {
+        switch(*CurrentChar)
+        {
+            default:
+            {
+                fprintf(FileHandle, "%c", *CurrentChar);
+            } break;
+            case '\n':
+            {
+                fprintf(FileHandle, "\\n");
+            } break;
+            case '\r':
+            {
+                fprintf(FileHandle, "\\r");
+            } break;
+            case '\t':
+            {
+                fprintf(FileHandle, "\\t");
+            } break;
+            case '\f':
+            {
+                fprintf(FileHandle, "\\f");
+            } break;
+            case '"':
+            {
+                fprintf(FileHandle, "\\\"");
+            } break;
+            case '\\':
+            {
+                fprintf(FileHandle, "\\\\");
+            } break;
+        }
+    }
+}
+
+static void TranslateString(FILE* FileHandle, char* String)
+{
+    TranslateStringBytes(FileHandle, String, (uint32_t)strlen(String));
+}
+
+// Returns the index of the pool entry holding the bytes, adding it when they are new, or -1 when the pool is full or
+// the translation is only a check.
+static int32_t PoolString(translator* Translator, const char* Bytes, uint32_t Length)
+{
+    if(Translator->IsChecking)
+    {
+        return -1;
+    }
+
+    uint32_t Slot = (uint32_t)HashBytes(Bytes, Length) & (POOLED_STRING_SLOT_COUNT - 1);
+    while(Translator->PooledStringSlots[Slot])
+    {
+        uint32_t Index = Translator->PooledStringSlots[Slot] - 1;
+        if((Translator->PooledStringLengths[Index] == Length) &&
+           (memcmp(Translator->PooledBytes + Translator->PooledStringOffsets[Index], Bytes, Length) == 0))
+        {
+            return (int32_t)Index;
+        }
+        Slot = (Slot + 1) & (POOLED_STRING_SLOT_COUNT - 1);
+    }
+    if(Translator->PooledStringCount >= MAX_POOLED_STRING_COUNT)
+    {
+        return -1;
+    }
+
+    if(Translator->PooledBytesLength + Length > Translator->PooledBytesCapacity)
+    {
+        uint64_t Capacity = Translator->PooledBytesCapacity ? Translator->PooledBytesCapacity : 4096;
+        while(Translator->PooledBytesLength + Length > Capacity)
+        {
+            Capacity *= 2;
+        }
+        Translator->PooledBytes = (char*)Reallocate(MEMORY_translator, Translator->PooledBytes, Capacity);
+        Translator->PooledBytesCapacity = Capacity;
+    }
+    memcpy(Translator->PooledBytes + Translator->PooledBytesLength, Bytes, Length);
+
+    uint32_t Index = Translator->PooledStringCount++;
+    Translator->PooledStringOffsets[Index] = Translator->PooledBytesLength;
+    Translator->PooledStringLengths[Index] = Length;
+    Translator->PooledStringSlots[Slot] = Index + 1;
+    Translator->PooledBytesLength += Length;
+    return (int32_t)Index;
+}
+
+// Writes the pool entry of the bytes, or the bytes as a C literal when they didn't fit in the pool.
+static void TranslatePooledString(translator* Translator, int32_t Index, const char* Bytes, uint32_t Length)
+{
+    if(Index < 0)
+    {
+        fprintf(Translator->FileHandle, "\"");
+        TranslateStringBytes(Translator->FileHandle, (char*)Bytes, Length);
+        fprintf(Translator->FileHandle, "\"");
+    }
+    else
+    {
+        fprintf(Translator->FileHandle, "DF_Literal%d", Index);
+    }
+}
+
+static void TranslatePooledLength(translator* Translator, int32_t Index, uint32_t Length)
+{
+    if(Index < 0)
+    {
+        fprintf(Translator->FileHandle, "%u", Length);
+    }
+    else
+    {
+        fprintf(Translator->FileHandle, "DF_LITERAL%d_LENGTH", Index);
+    }
+}
+
+// Indexed by Token - TOKEN_i8.
+static const char* SizedTypeCNames[] = {"int8_t", "int16_t", "int32_t", "int64_t", "uint8_t", "uint16_t", "uint32_t", "uint64_t", "float", "double"};
+
+static const char* GetCTypeName(int32_t Type)
+{
+    if((Type >= TOKEN_i8) && (Type <= TOKEN_f64))
+    {
+        return SizedTypeCNames[Type - TOKEN_i8];
+    }
+    switch(Type)
+    {
+        default:
+        {
+            return NULL;
+        } break;
+        case TOKEN_char:
+        {
+            return "char";
+        } break;
+        case TOKEN_int:
+        {
+            return "int";
+        } break;
+        case TOKEN_float:
+        {
+            return "float";
+        } break;
+        case TOKEN_string:
+        {
+            return "df_string";
+        } break;
+        case TOKEN_arena:
+        {
+            return "df_arena";
+        } break;
+    }
+}
+
+static int32_t TranslateType(FILE* FileHandle, int32_t Type)
+{
+    const char* Name = GetCTypeName(Type);
+    if(!Name)
+    {
+        return 0;
+    }
+    fprintf(FileHandle, "%s ", Name);
+    return 1;
+}
+
+// Spelling of the operators which aren't a single character.
+static const char* GetOperatorName(int32_t Operator)
+{
+    switch(Operator)
+    {
+        default:
+        {
+            return NULL;
+        } break;
+        case TOKEN_pluseq:
+        {
+            return "+=";
+        } break;
+        case TOKEN_minuseq:
+        {
+            return "-=";
+        } break;
+        case TOKEN_muleq:
+        {
+            return "*=";
+        } break;
+        case TOKEN_diveq:
+        {
+            return "/=";
+        } break;
+        case TOKEN_modeq:
+        {
+            return "%=";
+        } break;
+        case TOKEN_plusplus:
+        {
+            return "++";
+        } break;
+        case TOKEN_minusminus:
+        {
+            return "--";
+        } break;
+        case TOKEN_eq:
+        {
+            return "==";
+        } break;
+        case TOKEN_noteq:
+        {
+            return "!=";
+        } break;
+        case TOKEN_lesseq:
+        {
+            return "<=";
+        } break;
+        case TOKEN_moreeq:
+        {
+            return ">=";
+        } break;
+        case TOKEN_andand:
+        {
+            return "&&";
+        } break;
+        case TOKEN_oror:
+        {
+            return "||";
+        } break;
+    }
+}
+
+static int32_t TranslateOperator(FILE* FileHandle, int32_t Operator)
+{
+    if(Operator < TOKEN_eof)
+    {
+        fprintf(FileHandle, "%c", (char)Operator);
+    }
+    else
+    {
+        const char* Name = GetOperatorName(Operator);
+        if(!Name)
+        {
+            return 0;
+        }
+        fprintf(FileHandle, "%s", Name);
+    }
+    return 1;
+}
+
+// Prints the part of a declaration that goes before the name.
+// Slices of builtin types come from the runtime header, struct slices are declared next to their struct.
+static void TranslateSliceTypeName(translator* Translator, type_spec* Type)
+{
+    if(Type->Type == TOKEN_id)
+    {
+        fprintf(Translator->FileHandle, GetSoaStruct(Translator, Type) ? "df_soa_%s" : "df_slice_%s", Type->Name);
+    }
+    else
+    {
+        Translator->SliceTypeFlags |= 1 << (Type->Type - TOKEN_char);
+        fprintf(Translator->FileHandle, "df_slice_%s", GetTypeName(Type->Type));
+    }
+}
+
+static int32_t TranslateTypeSpec(translator* Translator, type_spec* Type)
+{
+    if(Type->Type == TOKEN_string)
+    {
+        Translator->RuntimeFlags |= RUNTIME_string;
+    }
+    if(Type->Type == TOKEN_arena)
+    {
+        Translator->RuntimeFlags |= RUNTIME_arena;
+    }
+    if((Type->Type == TOKEN_id) && !FindStruct(Translator, Type->Name))
+    {
+        fprintf(stderr, "Error: unknown type '%s'.\n", Type->Name);
+        return 0;
+    }
+
+    if(Type->ArrayKind == ARRAY_slice)
+    {
+        TranslateSliceTypeName(Translator, Type);
+        fprintf(Translator->FileHandle, " ");
+    }
+    else if(Type->Type == TOKEN_id)
+    {
+        fprintf(Translator->FileHandle, "%s ", Type->Name);
+    }
+    else
+    {
+        TranslateType(Translator->FileHandle, Type->Type);
+    }
+    return 1;
+}
+
+static int32_t TranslateDeclaration(translator* Translator, type_spec* Type, char* Name)
+{
+    struct_info* SoaStruct = GetSoaStruct(Translator, Type);
+    if(SoaStruct && (Type->ArrayKind == ARRAY_fixed))
+    {
+        // Stored as one array per field, of rows for array fields.
+        fprintf(Translator->FileHandle, "struct\n{\n");
+        for(uint32_t i = 0; i < SoaStruct->FieldCount; ++i)
+        {
+            type_spec* FieldType = &SoaStruct->FieldTypes[i];
+            type_spec ElementType = *FieldType;
+            ElementType.ArrayKind = (FieldType->ArrayKind == ARRAY_fixed) ? ARRAY_none : FieldType->ArrayKind;
+            if(!TranslateTypeSpec(Translator, &ElementType))
+            {
+                return 0;
+            }
+            fprintf(Translator->FileHandle, "%s[%llu]", SoaStruct->FieldNames[i], Type->ArrayLength);
+            if(FieldType->ArrayKind == ARRAY_fixed)
+            {
+                fprintf(Translator->FileHandle, "[%llu]", FieldType->ArrayLength);
+            }
+            fprintf(Translator->FileHandle, ";\n");
+        }
+        fprintf(Translator->FileHandle, "} %s", Name);
+        return 1;
+    }
+
+    if(!TranslateTypeSpec(Translator, Type))
+    {
+        return 0;
+    }
+    fprintf(Translator->FileHandle, "%s", Name);
+    if(Type->ArrayKind == ARRAY_fixed)
+    {
+        fprintf(Translator->FileHandle, "[%llu]", Type->ArrayLength);
+    }
+    return 1;
+}
+
+static expr* SkipParens(expr* Expression)
+{
+    while(Expression && (Expression->ExprType == EXPR_paren))
+    {
+        Expression = Expression->ParenExpr.InnerExpr;
+    }
+    return Expression;
+}
+
+static bool IsIdNamed(expr* Expression, char* Name)
+{
+    return Expression && (Expression->ExprType == EXPR_id) && (strcmp(Expression->IdExpr.String, Name) == 0);
+}
+
+// The id of the variable an assignment or increment writes, NULL for other expressions. Writing an element or a field
+// writes the variable holding it.
+static expr* GetWrittenVariable(expr* Expression)
+{
+    expr* Target = NULL;
+    if((Expression->ExprType == EXPR_binary) && IsAssignmentOperator(Expression->BinaryExpr.Operator))
+    {
+        Target = Expression->BinaryExpr.LHS;
+    }
+    else if((Expression->ExprType == EXPR_unary) &&
+            ((Expression->UnaryExpr.Operator == TOKEN_plusplus) || (Expression->UnaryExpr.Operator == TOKEN_minusminus)))
+    {
+        Target = Expression->UnaryExpr.Operand;
+    }
+    for(;;)
+    {
+        Target = SkipParens(Target);
+        if(Target && (Target->ExprType == EXPR_index))
+        {
+            Target = Target->IndexExpr.Array;
+        }
+        else if(Target && (Target->ExprType == EXPR_field))
+        {
+            Target = Target->FieldExpr.Object;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return (Target && (Target->ExprType == EXPR_id)) ? Target : NULL;
+}
+
+// Pushes the expressions directly below this one, bodies included.
+static void PushChildExpressions(work_stack* Pending, expr* Expression)
+{
+    switch(Expression->ExprType)
+    {
+        default:
+        {
+        } break;
+        case EXPR_var:
+        {
+            PushExpr(Pending, Expression->VarExpr.Expr);
+        } break;
+        case EXPR_paren:
+        {
+            PushExpr(Pending, Expression->ParenExpr.InnerExpr);
+        } break;
+        case EXPR_binary:
+        {
+            PushExpr(Pending, Expression->BinaryExpr.LHS);
+            PushExpr(Pending, Expression->BinaryExpr.RHS);
+        } break;
+        case EXPR_unary:
+        {
+            PushExpr(Pending, Expression->UnaryExpr.Operand);
+        } break;
+        case EXPR_call:
+        {
+            for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+            {
+                PushExpr(Pending, Expression->CallExpr.Arguments[i]);
+            }
+        } break;
+        case EXPR_index:
+        {
+            PushExpr(Pending, Expression->IndexExpr.Array);
+            PushExpr(Pending, Expression->IndexExpr.Index);
+        } break;
+        case EXPR_field:
+        {
+            PushExpr(Pending, Expression->FieldExpr.Object);
+        } break;
+        case EXPR_if:
+        {
+            PushExpr(Pending, Expression->IfExpr.Statement);
+            for(uint32_t i = 0; i < Expression->IfExpr.TrueExpressionCount; ++i)
+            {
+                PushExpr(Pending, Expression->IfExpr.TrueExpressions[i]);
+            }
+            for(uint32_t i = 0; i < Expression->IfExpr.FalseExpressionCount; ++i)
+            {
+                PushExpr(Pending, Expression->IfExpr.FalseExpressions[i]);
+            }
+        } break;
+        case EXPR_for:
+        {
+            PushExpr(Pending, Expression->ForExpr.Definition);
+            PushExpr(Pending, Expression->ForExpr.Condition);
+            PushExpr(Pending, Expression->ForExpr.Action);
+            for(uint32_t i = 0; i < Expression->ForExpr.ExpressionCount; ++i)
+            {
+                PushExpr(Pending, Expression->ForExpr.Expressions[i]);
+            }
+        } break;
+        case EXPR_bench:
+        {
+            for(uint32_t i = 0; i < Expression->BenchExpr.ExpressionCount; ++i)
+            {
+                PushExpr(Pending, Expression->BenchExpr.Expressions[i]);
+            }
+        } break;
+        case EXPR_match:
+        {
+            PushExpr(Pending, Expression->MatchExpr.Value);
+            for(uint32_t i = 0; i < Expression->MatchExpr.CaseCount; ++i)
+            {
+                PushExpr(Pending, Expression->MatchExpr.Cases[i]);
+            }
+        } break;
+        case EXPR_case:
+        {
+            for(uint32_t i = 0; i < Expression->CaseExpr.ValueCount; ++i)
+            {
+                PushExpr(Pending, Expression->CaseExpr.Values[i]);
+            }
+            for(uint32_t i = 0; i < Expression->CaseExpr.ExpressionCount; ++i)
+            {
+                PushExpr(Pending, Expression->CaseExpr.Expressions[i]);
+            }
+        } break;
+        case EXPR_return:
+        {
+            PushExpr(Pending, Expression->ReturnExpr.Expression);
+        } break;
+    }
+}
+
+static bool IsSmallIntLiteral(expr* Expression)
+{
+    return Expression && (Expression->ExprType == EXPR_int) && (Expression->IntExpr.IntValue <= INT32_MAX);
+}
+
+// Conservatively checks whether the expression can change the value of the named variable, including by
+// redeclaring it. Inline C is opaque, so any inline block mentioning the name counts as an assignment.
+static bool AssignsVariable(expr* Expression, char* Name)
+{
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Expression);
+
+    bool Result = false;
+    while(!Result && Pending.Count)
+    {
+        Expression = PopExpr(&Pending);
+        if(!Expression)
+        {
+            continue;
+        }
+
+        switch(Expression->ExprType)
+        {
+            default:
+            {
+            } break;
+            case EXPR_var:
+            {
+                Result = (strcmp(Expression->VarExpr.Name, Name) == 0);
+                PushExpr(&Pending, Expression->VarExpr.Expr);
+            } break;
+            case EXPR_paren:
+            {
+                PushExpr(&Pending, Expression->ParenExpr.InnerExpr);
+            } break;
+            case EXPR_binary:
+            {
+                Result = IsAssignmentOperator(Expression->BinaryExpr.Operator) && IsIdNamed(Expression->BinaryExpr.LHS, Name);
+                PushExpr(&Pending, Expression->BinaryExpr.LHS);
+                PushExpr(&Pending, Expression->BinaryExpr.RHS);
+            } break;
+            case EXPR_unary:
+            {
+                int32_t Operator = Expression->UnaryExpr.Operator;
+                Result = ((Operator == TOKEN_plusplus) || (Operator == TOKEN_minusminus)) && IsIdNamed(Expression->UnaryExpr.Operand, Name);
+                PushExpr(&Pending, Expression->UnaryExpr.Operand);
+            } break;
+            case EXPR_call:
+            {
+                for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CallExpr.Arguments[i]);
+                }
+            } break;
+            case EXPR_index:
+            {
+                PushExpr(&Pending, Expression->IndexExpr.Array);
+                PushExpr(&Pending, Expression->IndexExpr.Index);
+            } break;
+            case EXPR_field:
+            {
+                PushExpr(&Pending, Expression->FieldExpr.Object);
+            } break;
+            case EXPR_if:
+            {
+                PushExpr(&Pending, Expression->IfExpr.Statement);
+                for(uint32_t i = 0; i < Expression->IfExpr.TrueExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->IfExpr.TrueExpressions[i]);
+                }
+                for(uint32_t i = 0; i < Expression->IfExpr.FalseExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->IfExpr.FalseExpressions[i]);
+                }
+            } break;
+            case EXPR_for:
+            {
+                PushExpr(&Pending, Expression->ForExpr.Definition);
+                PushExpr(&Pending, Expression->ForExpr.Condition);
+                PushExpr(&Pending, Expression->ForExpr.Action);
+                for(uint32_t i = 0; i < Expression->ForExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->ForExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_bench:
+            {
+                for(uint32_t i = 0; i < Expression->BenchExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->BenchExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_match:
+            {
+                PushExpr(&Pending, Expression->MatchExpr.Value);
+                for(uint32_t i = 0; i < Expression->MatchExpr.CaseCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->MatchExpr.Cases[i]);
+                }
+            } break;
+            case EXPR_case:
+            {
+                for(uint32_t i = 0; i < Expression->CaseExpr.ValueCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CaseExpr.Values[i]);
+                }
+                for(uint32_t i = 0; i < Expression->CaseExpr.ExpressionCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CaseExpr.Expressions[i]);
+                }
+            } break;
+            case EXPR_return:
+            {
+                PushExpr(&Pending, Expression->ReturnExpr.Expression);
+            } break;
+            case EXPR_inline:
+            {
+                Result = (strstr(Expression->InlineExpr.Text, Name) != NULL);
+            } break;
+        }
+    }
+    FreeWorkStack(&Pending);
+    return Result;
+}
+
+// i = i + <literal>, i += <literal>, i++ or ++i.
+static bool IsLoopStep(expr* Action, char* IndexName)
+{
+    if(Action->ExprType == EXPR_unary)
+    {
+        return (Action->UnaryExpr.Operator == TOKEN_plusplus) && IsIdNamed(Action->UnaryExpr.Operand, IndexName);
+    }
+    if((Action->ExprType != EXPR_binary) || !IsIdNamed(Action->BinaryExpr.LHS, IndexName))
+    {
+        return false;
+    }
+
+    expr* Step = Action->BinaryExpr.RHS;
+    if(Action->BinaryExpr.Operator == TOKEN_pluseq)
+    {
+        return IsSmallIntLiteral(Step);
+    }
+    return (Action->BinaryExpr.Operator == '=') && (Step->ExprType == EXPR_binary) && (Step->BinaryExpr.Operator == '+') &&
+           ((IsIdNamed(Step->BinaryExpr.LHS, IndexName) && IsSmallIntLiteral(Step->BinaryExpr.RHS)) ||
+            (IsIdNamed(Step->BinaryExpr.RHS, IndexName) && IsSmallIntLiteral(Step->BinaryExpr.LHS)));
+}
+
+// Whether the expression calls anything that could assign a global: a function of the program, a C function or inline
+// C. Only the intrinsics are known not to.
+static bool CallsUnknownFunction(translator* Translator, expr* Expression)
+{
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Expression);
+    bool Result = false;
+    while(!Result && Pending.Count)
+    {
+        Expression = PopExpr(&Pending);
+        if(Expression)
+        {
+            Result = (Expression->ExprType == EXPR_inline) ||
+                     ((Expression->ExprType == EXPR_call) && (FindFunction(Translator, Expression->CallExpr.Name) || !IsIntrinsic(Expression->CallExpr.Name)));
+            PushChildExpressions(&Pending, Expression);
+        }
+    }
+    FreeWorkStack(&Pending);
+    return Result;
+}
+
+// Recognises loops of the form
+//     for i : int = <literal>; i < <literal or len(A)>; <step, see IsLoopStep>
+// whose body never touches i (or A), and records that i can index A without a bounds check inside the body. A global
+// A could also be assigned by a function the body calls, so then the body can't call any, see CallsUnknownFunction.
+static int32_t PushLoopBoundsFact(translator* Translator, expr* Loop)
+{
+    expr* Definition = Loop->ForExpr.Definition;
+    expr* Condition = Loop->ForExpr.Condition;
+    expr* Action = Loop->ForExpr.Action;
+    if(!Definition || !Condition || !Action || (Translator->BoundsFactCount >= MAX_BOUNDS_FACT_COUNT))
+    {
+        return 0;
+    }
+
+    if((Definition->ExprType != EXPR_var) || (Definition->VarExpr.Type.ArrayKind != ARRAY_none) ||
+       (Definition->VarExpr.Type.Type != TOKEN_int) || !IsSmallIntLiteral(Definition->VarExpr.Expr))
+    {
+        return 0;
+    }
+    char* IndexName = Definition->VarExpr.Name;
+
+    if(!IsLoopStep(Action, IndexName))
+    {
+        return 0;
+    }
+
+    if((Condition->ExprType != EXPR_binary) || !IsIdNamed(Condition->BinaryExpr.LHS, IndexName))
+    {
+        return 0;
+    }
+    bounds_fact Fact = {};
+    Fact.IndexName = IndexName;
+    expr* Limit = Condition->BinaryExpr.RHS;
+    if((Condition->BinaryExpr.Operator == '<') && IsSmallIntLiteral(Limit))
+    {
+        Fact.Bound = Limit->IntExpr.IntValue;
+    }
+    else if((Condition->BinaryExpr.Operator == TOKEN_lesseq) && IsSmallIntLiteral(Limit))
+    {
+        Fact.Bound = Limit->IntExpr.IntValue + 1;
+    }
+    else if((Condition->BinaryExpr.Operator == '<') && (Limit->ExprType == EXPR_call) && (strcmp(Limit->CallExpr.Name, "len") == 0) &&
+            (Limit->CallExpr.ArgumentCount == 1) && (Limit->CallExpr.Arguments[0]->ExprType == EXPR_id) && !FindFunction(Translator, "len"))
+    {
+        Fact.ArrayName = Limit->CallExpr.Arguments[0]->IdExpr.String;
+    }
+    else
+    {
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < Loop->ForExpr.ExpressionCount; ++i)
+    {
+        expr* BodyExpression = Loop->ForExpr.Expressions[i];
+        if(AssignsVariable(BodyExpression, IndexName) || (Fact.ArrayName && AssignsVariable(BodyExpression, Fact.ArrayName)))
+        {
+            return 0;
+        }
+    }
+
+    symbol* Array = Fact.ArrayName ? FindSymbol(Translator, Fact.ArrayName) : NULL;
+    if(Array && ((uint32_t)(Array - Translator->Symbols) < Translator->GlobalSymbolCount))
+    {
+        for(uint32_t i = 0; i < Loop->ForExpr.ExpressionCount; ++i)
+        {
+            if(CallsUnknownFunction(Translator, Loop->ForExpr.Expressions[i]))
+            {
+                return 0;
+            }
+        }
+    }
+
+    Translator->BoundsFacts[Translator->BoundsFactCount++] = Fact;
+    return 1;
+}
+
+// ArrayName is NULL for arrays reached through fields, which only benefit from constant indices.
+static bool IsIndexInBounds(translator* Translator, char* ArrayName, type_spec* Type, expr* Index)
+{
+    if(Index->ExprType == EXPR_int)
+    {
+        return (Type->ArrayKind == ARRAY_fixed) && (Index->IntExpr.IntValue < Type->ArrayLength);
+    }
+    if(Index->ExprType != EXPR_id)
+    {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < Translator->BoundsFactCount; ++i)
+    {
+        bounds_fact* Fact = &Translator->BoundsFacts[i];
+        if(strcmp(Fact->IndexName, Index->IdExpr.String) != 0)
+        {
+            continue;
+        }
+        if(Fact->ArrayName)
+        {
+            if(ArrayName && (strcmp(Fact->ArrayName, ArrayName) == 0))
+            {
+                return true;
+            }
+        }
+        else if((Type->ArrayKind == ARRAY_fixed) && (Fact->Bound <= Type->ArrayLength))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool IsComparisonOperator(int32_t Operator)
+{
+    return (Operator == '<') || (Operator == '>') || (Operator == TOKEN_eq) || (Operator == TOKEN_noteq) || (Operator == TOKEN_lesseq) ||
+           (Operator == TOKEN_moreeq) || (Operator == TOKEN_andand) || (Operator == TOKEN_oror);
+}
+
+static bool IsStringType(type_spec* Type)
+{
+    return (Type->ArrayKind == ARRAY_none) && (Type->Type == TOKEN_string);
+}
+
+static bool IsIntegerType(type_spec* Type)
+{
+    return (Type->ArrayKind == ARRAY_none) && ((Type->Type == TOKEN_char) || (Type->Type == TOKEN_int) || ((Type->Type >= TOKEN_i8) && (Type->Type <= TOKEN_u64)));
+}
+
+static bool IsRealType(type_spec* Type)
+{
+    return (Type->ArrayKind == ARRAY_none) && ((Type->Type == TOKEN_float) || (Type->Type == TOKEN_f32) || (Type->Type == TOKEN_f64));
+}
+
+// The integer variable of a loop whose action adds a literal to it, see IsLoopStep, and whose condition and body
+// leave it alone, or NULL.
+static expr* GetInductionDefinition(expr* Loop)
+{
+    expr* Definition = Loop->ForExpr.Definition;
+    if(!Definition || !Loop->ForExpr.Action || (Definition->ExprType != EXPR_var) || !IsIntegerType(&Definition->VarExpr.Type) ||
+       !Definition->VarExpr.Expr)
+    {
+        return NULL;
+    }
+
+    char* Name = Definition->VarExpr.Name;
+    if(!IsLoopStep(Loop->ForExpr.Action, Name) || (Loop->ForExpr.Condition && AssignsVariable(Loop->ForExpr.Condition, Name)))
+    {
+        return NULL;
+    }
+    for(uint32_t i = 0; i < Loop->ForExpr.ExpressionCount; ++i)
+    {
+        if(AssignsVariable(Loop->ForExpr.Expressions[i], Name))
+        {
+            return NULL;
+        }
+    }
+    return Definition;
+}
+
+// The literal added by an action accepted by IsLoopStep.
+static uint64_t GetLoopStep(expr* Action)
+{
+    if(Action->ExprType == EXPR_unary)
+    {
+        return 1;
+    }
+    expr* Step = Action->BinaryExpr.RHS;
+    if(Action->BinaryExpr.Operator == TOKEN_pluseq)
+    {
+        return Step->IntExpr.IntValue;
+    }
+    return (Step->BinaryExpr.LHS->ExprType == EXPR_int) ? Step->BinaryExpr.LHS->IntExpr.IntValue : Step->BinaryExpr.RHS->IntExpr.IntValue;
+}
+
+static uint32_t GetTypeSize(int32_t Type)
+{
+    switch(Type)
+    {
+        default:
+        {
+            return 4;
+        } break;
+        case TOKEN_char:
+        case TOKEN_i8:
+        case TOKEN_u8:
+        {
+            return 1;
+        } break;
+        case TOKEN_i16:
+        case TOKEN_u16:
+        {
+            return 2;
+        } break;
+        case TOKEN_i64:
+        case TOKEN_u64:
+        case TOKEN_f64:
+        {
+            return 8;
+        } break;
+    }
+}
+
+// Largest value an integer literal may have to be stored into the type.
+static uint64_t GetIntegerMax(int32_t Type)
+{
+    switch(Type)
+    {
+        default:
+        {
+            return INT32_MAX;
+        } break;
+        case TOKEN_char:
+        case TOKEN_i8:
+        {
+            return INT8_MAX;
+        } break;
+        case TOKEN_u8:
+        {
+            return UINT8_MAX;
+        } break;
+        case TOKEN_i16:
+        {
+            return INT16_MAX;
+        } break;
+        case TOKEN_u16:
+        {
+            return UINT16_MAX;
+        } break;
+        case TOKEN_u32:
+        {
+            return UINT32_MAX;
+        } break;
+        case TOKEN_i64:
+        {
+            return INT64_MAX;
+        } break;
+        case TOKEN_u64:
+        {
+            return UINT64_MAX;
+        } break;
+    }
+}
+
+// Mirrors C's usual arithmetic conversions: everything narrower than int is promoted to int.
+static int32_t GetArithmeticType(int32_t LHS, int32_t RHS)
+{
+    static const int32_t Ranks[] = {TOKEN_int, TOKEN_u32, TOKEN_i64, TOKEN_u64, TOKEN_float, TOKEN_f64};
+    uint32_t Rank = 0;
+    for(uint32_t i = 0; i < sizeof(Ranks) / sizeof(Ranks[0]); ++i)
+    {
+        if((Ranks[i] == LHS) || (Ranks[i] == RHS) || ((Ranks[i] == TOKEN_float) && ((LHS == TOKEN_f32) || (RHS == TOKEN_f32))))
+        {
+            Rank = i;
+        }
+    }
+    return Ranks[Rank];
+}
+
+// 2^63, which only fits into an i64 once negated.
+#define INT64_MIN_MAGNITUDE 9223372036854775808ULL
+
+static bool IsInt64MinMagnitude(expr* Expression)
+{
+    return (Expression->ExprType == EXPR_int) && (Expression->IntExpr.IntValue == INT64_MIN_MAGNITUDE);
+}
+
+static int32_t GetIntegerLiteralType(uint64_t Value)
+{
+    return (Value <= INT32_MAX) ? TOKEN_int : ((Value <= INT64_MAX) ? TOKEN_i64 : TOKEN_u64);
+}
+
+// Works out the static type of an expression. Returns false when the translator can't see it, e.g. for results
+// of C functions or variables declared in inline C.
+static bool GetExpressionType(translator* Translator, expr* Expression, type_spec* Type)
+{
+    switch(Expression->ExprType)
+    {
+        default:
+        {
+            return false;
+        } break;
+        case EXPR_char:
+        {
+            *Type = MakeType(TOKEN_char);
+        } break;
+        case EXPR_int:
+        {
+            *Type = MakeType(GetIntegerLiteralType(Expression->IntExpr.IntValue));
+        } break;
+        case EXPR_real:
+        {
+            *Type = MakeType(Translator->RealLiteralType);
+        } break;
+        case EXPR_string:
+        {
+            *Type = MakeType(TOKEN_string);
+        } break;
+        case EXPR_id:
+        {
+            symbol* Symbol = FindSymbol(Translator, Expression->IdExpr.String);
+            if(!Symbol)
+            {
+                return false;
+            }
+            *Type = Symbol->Type;
+        } break;
+        case EXPR_var:
+        {
+            *Type = Expression->VarExpr.Type;
+        } break;
+        case EXPR_paren:
+        {
+            return GetExpressionType(Translator, Expression->ParenExpr.InnerExpr, Type);
+        } break;
+        case EXPR_index:
+        {
+            type_spec ArrayType;
+            if(!GetExpressionType(Translator, Expression->IndexExpr.Array, &ArrayType))
+            {
+                return false;
+            }
+            if(ArrayType.ArrayKind != ARRAY_none)
+            {
+                *Type = ArrayType;
+                Type->ArrayKind = ARRAY_none;
+                Type->ArrayLength = 0;
+            }
+            else if(ArrayType.Type == TOKEN_string)
+            {
+                *Type = MakeType(TOKEN_char);
+            }
+            else
+            {
+                return false;
+            }
+        } break;
+        case EXPR_field:
+        {
+            type_spec ObjectType;
+            if(!GetExpressionType(Translator, Expression->FieldExpr.Object, &ObjectType) || (ObjectType.Type != TOKEN_id) ||
+               (ObjectType.ArrayKind != ARRAY_none))
+            {
+                return false;
+            }
+            struct_info* Struct = FindStruct(Translator, ObjectType.Name);
+            int32_t Field = Struct ? FindField(Struct, Expression->FieldExpr.Field) : -1;
+            if(Field < 0)
+            {
+                return false;
+            }
+            *Type = Struct->FieldTypes[Field];
+        } break;
+        case EXPR_call:
+        {
+            function_signature* Signature = FindFunction(Translator, Expression->CallExpr.Name);
+            if(Signature)
+            {
+                *Type = Signature->Type;
+            }
+            else if(strcmp(Expression->CallExpr.Name, "len") == 0)
+            {
+                *Type = MakeType(TOKEN_int);
+            }
+            else if((strcmp(Expression->CallExpr.Name, "slice") == 0) || (strcmp(Expression->CallExpr.Name, "concat") == 0))
+            {
+                *Type = MakeType(TOKEN_string);
+            }
+            else
+            {
+                return false;
+            }
+        } break;
+        case EXPR_binary:
+        {
+            // Left-leaning chains such as A + B + C are walked down to their first operand, then folded back up.
+            expr* Buffer[16];
+            work_stack Chain;
+            InitWorkStack(&Chain, Buffer, sizeof(Buffer), sizeof(expr*));
+            expr* Operand = Expression;
+            while(Operand->ExprType == EXPR_binary)
+            {
+                if(IsAssignmentOperator(Operand->BinaryExpr.Operator))
+                {
+                    Operand = Operand->BinaryExpr.LHS;
+                }
+                else if(IsComparisonOperator(Operand->BinaryExpr.Operator))
+                {
+                    break;
+                }
+                else
+                {
+                    PushExpr(&Chain, Operand);
+                    Operand = Operand->BinaryExpr.LHS;
+                }
+            }
+
+            bool Result = true;
+            if(Operand->ExprType == EXPR_binary)
+            {
+                *Type = MakeType(TOKEN_int);
+            }
+            else
+            {
+                Result = GetExpressionType(Translator, Operand, Type);
+            }
+            while(Result && Chain.Count)
+            {
+                type_spec RHSType;
+                Result = (IsIntegerType(Type) || IsRealType(Type)) && GetExpressionType(Translator, PopExpr(&Chain)->BinaryExpr.RHS, &RHSType) &&
+                         (IsIntegerType(&RHSType) || IsRealType(&RHSType));
+                if(Result)
+                {
+                    *Type = MakeType(GetArithmeticType(Type->Type, RHSType.Type));
+                }
+            }
+            FreeWorkStack(&Chain);
+            return Result;
+        } break;
+        case EXPR_unary:
+        {
+            int32_t Operator = Expression->UnaryExpr.Operator;
+            if(!GetExpressionType(Translator, Expression->UnaryExpr.Operand, Type) || (!IsIntegerType(Type) && !IsRealType(Type)))
+            {
+                return false;
+            }
+            if(Operator == '!')
+            {
+                *Type = MakeType(TOKEN_int);
+            }
+            else if((Operator == '-') && IsInt64MinMagnitude(Expression->UnaryExpr.Operand))
+            {
+                *Type = MakeType(TOKEN_i64);
+            }
+            else if(Operator == '-')
+            {
+                *Type = MakeType(GetArithmeticType(Type->Type, Type->Type));
+            }
+        } break;
+    }
+    return true;
+}
+
+// == and != between strings compare their contents.
+static bool IsStringComparison(translator* Translator, expr* Expression, type_spec* LHSType, type_spec* RHSType)
+{
+    int32_t Operator = Expression->BinaryExpr.Operator;
+    return ((Operator == TOKEN_eq) || (Operator == TOKEN_noteq)) && GetExpressionType(Translator, Expression->BinaryExpr.LHS, LHSType) &&
+           IsStringType(LHSType) && GetExpressionType(Translator, Expression->BinaryExpr.RHS, RHSType) && IsStringType(RHSType);
+}
+
+static void TranslateStringLiteral(translator* Translator, char* String, bool IsInitializer)
+{
+    Translator->RuntimeFlags |= RUNTIME_string;
+
+    uint32_t Length = (uint32_t)strlen(String);
+    if(!IsInitializer)
+    {
+        fprintf(Translator->FileHandle, "(df_string)");
+    }
+    // Short strings are copied into the value itself, longer ones point at their pool entry.
+    if(Length < STRING_INLINE_CAPACITY)
+    {
+        fprintf(Translator->FileHandle, "{.Length = %u, .Inline = \"", Length);
+        TranslateString(Translator->FileHandle, String);
+        fprintf(Translator->FileHandle, "\"}");
+        return;
+    }
+    int32_t Index = PoolString(Translator, String, Length);
+    fprintf(Translator->FileHandle, "{.Length = ");
+    TranslatePooledLength(Translator, Index, Length);
+    fprintf(Translator->FileHandle, ", .Data = ");
+    TranslatePooledString(Translator, Index, String, Length);
+    fprintf(Translator->FileHandle, "}");
+}
+
+// Fixed arrays convert implicitly to slices when assigned or passed to a slice.
+static int32_t TranslateSliceConversion(translator* Translator, type_spec* Target, expr* Value, bool IsInitializer)
+{
+    if((Target->ArrayKind != ARRAY_slice) || !Value || (Value->ExprType != EXPR_id))
+    {
+        return 0;
+    }
+    symbol* Source = FindSymbol(Translator, Value->IdExpr.String);
+    if(!Source || (Source->Type.ArrayKind != ARRAY_fixed))
+    {
+        return 0;
+    }
+
+    if(!IsInitializer)
+    {
+        fprintf(Translator->FileHandle, "(");
+        TranslateSliceTypeName(Translator, Target);
+        fprintf(Translator->FileHandle, ")");
+    }
+
+    struct_info* SoaStruct = GetSoaStruct(Translator, &Source->Type);
+    if(SoaStruct)
+    {
+        fprintf(Translator->FileHandle, "{");
+        for(uint32_t i = 0; i < SoaStruct->FieldCount; ++i)
+        {
+            fprintf(Translator->FileHandle, "%s.%s, ", Source->Name, SoaStruct->FieldNames[i]);
+        }
+        fprintf(Translator->FileHandle, "%llu}", Source->Type.ArrayLength);
+    }
+    else
+    {
+        fprintf(Translator->FileHandle, "{%s, %llu}", Source->Name, Source->Type.ArrayLength);
+    }
+    return 1;
+}
+
+static int32_t TranslateExpression(translator* Translator, expr* Expression, bool IsParent);
+
+static int32_t TranslateAllocation(translator* Translator, type_spec* Target, expr* Expression);
+
+// Translates a value stored into something of the target type, applying the implicit conversions.
+static void TranslateIntegerLiteral(FILE* FileHandle, uint64_t Value)
+{
+    int32_t Type = GetIntegerLiteralType(Value);
+    fprintf(FileHandle, "%llu%s", Value, (Type == TOKEN_int) ? "" : ((Type == TOKEN_i64) ? "LL" : "ULL"));
+}
+
+// Hexadecimal floats round-trip exactly, decimal output would round.
+static void TranslateRealLiteral(FILE* FileHandle, double Value, bool IsSingle)
+{
+    if(IsSingle)
+    {
+        fprintf(FileHandle, "%af", (double)(float)Value);
+    }
+    else
+    {
+        fprintf(FileHandle, "%a", Value);
+    }
+}
+
+// Stores of numbers into other numeric types convert implicitly like in C. Literals are checked to fit, and
+// narrowing conversions are spelled out so that the generated C compiles without conversion warnings.
+static int32_t TranslateNumericValue(translator* Translator, type_spec* Target, expr* Value, bool* Translated)
+{
+    *Translated = false;
+    FILE* FileHandle = Translator->FileHandle;
+    if(Value->ExprType == EXPR_int)
+    {
+        if(IsIntegerType(Target) && (Value->IntExpr.IntValue > GetIntegerMax(Target->Type)))
+        {
+            fprintf(stderr, "Error: %llu doesn't fit into %s.\n", Value->IntExpr.IntValue, GetTypeName(Target->Type));
+            return 0;
+        }
+        return 1;
+    }
+    if((Value->ExprType == EXPR_real) && IsRealType(Target))
+    {
+        double RealValue = Value->RealExpr.RealValue;
+        bool IsSingle = (Target->Type != TOKEN_f64);
+        if(IsSingle && (RealValue > 3.4028234663852886e38))
+        {
+            fprintf(stderr, "Error: %g doesn't fit into %s.\n", RealValue, GetTypeName(Target->Type));
+            return 0;
+        }
+        TranslateRealLiteral(FileHandle, RealValue, IsSingle);
+        *Translated = true;
+        return 1;
+    }
+
+    type_spec ValueType;
+    if(!GetExpressionType(Translator, Value, &ValueType) || (!IsIntegerType(&ValueType) && !IsRealType(&ValueType)))
+    {
+        return 1;
+    }
+    uint32_t TargetSize = GetTypeSize(Target->Type);
+    uint32_t ValueSize = GetTypeSize(ValueType.Type);
+    bool IsNarrowing = (TargetSize < ValueSize) || (IsIntegerType(Target) && IsRealType(&ValueType)) ||
+                       (IsRealType(Target) && IsIntegerType(&ValueType) && (TargetSize <= ValueSize));
+    if(IsNarrowing)
+    {
+        fprintf(FileHandle, "(%s)(", GetCTypeName(Target->Type));
+        if(!TranslateExpression(Translator, Value, false))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ")");
+        *Translated = true;
+    }
+    return 1;
+}
+
+static int32_t TranslateStoredValue(translator* Translator, type_spec* Target, expr* Value, bool IsInitializer)
+{
+    if(Target && (IsIntegerType(Target) || IsRealType(Target)))
+    {
+        bool Translated;
+        if(!TranslateNumericValue(Translator, Target, Value, &Translated))
+        {
+            return 0;
+        }
+        if(Translated)
+        {
+            return 1;
+        }
+    }
+    if(Target)
+    {
+        if(TranslateSliceConversion(Translator, Target, Value, IsInitializer))
+        {
+            return 1;
+        }
+        if(IsStringType(Target) && (Value->ExprType == EXPR_string))
+        {
+            TranslateStringLiteral(Translator, Value->StringExpr.String, IsInitializer);
+            return 1;
+        }
+        if((Value->ExprType == EXPR_call) && (strcmp(Value->CallExpr.Name, "alloc") == 0) && !FindFunction(Translator, "alloc"))
+        {
+            return TranslateAllocation(Translator, Target, Value);
+        }
+    }
+    return TranslateExpression(Translator, Value, false);
+}
+
+// Real literals in a value stored into a number take the precision of the target, single precision ones would
+// otherwise widen the arithmetic around them to double.
+static int32_t TranslateValue(translator* Translator, type_spec* Target, expr* Value, bool IsInitializer)
+{
+    int32_t RealLiteralType = Translator->RealLiteralType;
+    if(Target && (IsIntegerType(Target) || IsRealType(Target)))
+    {
+        Translator->RealLiteralType = (IsRealType(Target) && (Target->Type != TOKEN_f64)) ? TOKEN_float : TOKEN_f64;
+    }
+    int32_t Result = TranslateStoredValue(Translator, Target, Value, IsInitializer);
+    Translator->RealLiteralType = RealLiteralType;
+    return Result;
+}
+
+static int32_t TranslateLength(translator* Translator, expr* Expression)
+{
+    type_spec Type;
+    expr* Argument = (Expression->CallExpr.ArgumentCount == 1) ? Expression->CallExpr.Arguments[0] : NULL;
+    if(!Argument || !GetExpressionType(Translator, Argument, &Type) || (!IsStringType(&Type) && (Type.ArrayKind == ARRAY_none)))
+    {
+        fprintf(stderr, "Error: len expects an array or a string.\n");
+        return 0;
+    }
+
+    FILE* FileHandle = Translator->FileHandle;
+    if(Type.ArrayKind == ARRAY_fixed)
+    {
+        fprintf(FileHandle, "%llu", Type.ArrayLength);
+    }
+    else if(Argument->ExprType == EXPR_string)
+    {
+        fprintf(FileHandle, "%llu", (uint64_t)strlen(Argument->StringExpr.String));
+    }
+    else if(Argument->ExprType == EXPR_id)
+    {
+        fprintf(FileHandle, "((int)%s.Length)", Argument->IdExpr.String);
+    }
+    else
+    {
+        fprintf(FileHandle, "((int)(");
+        if(!TranslateExpression(Translator, Argument, false))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ").Length)");
+    }
+    return 1;
+}
+
+// slice(S, Start, End) views characters [Start, End) of a string without copying them.
+static int32_t TranslateSlice(translator* Translator, expr* Expression)
+{
+    type_spec StringType = MakeType(TOKEN_string);
+    type_spec Type;
+    if((Expression->CallExpr.ArgumentCount != 3) || !GetExpressionType(Translator, Expression->CallExpr.Arguments[0], &Type) ||
+       !IsStringType(&Type))
+    {
+        fprintf(stderr, "Error: slice expects a string and two indices.\n");
+        return 0;
+    }
+
+    Translator->RuntimeFlags |= RUNTIME_string;
+    fprintf(Translator->FileHandle, "DF_StringSlice(");
+    if(!TranslateValue(Translator, &StringType, Expression->CallExpr.Arguments[0], false))
+    {
+        return 0;
+    }
+    for(uint32_t i = 1; i < 3; ++i)
+    {
+        fprintf(Translator->FileHandle, ", ");
+        if(!TranslateExpression(Translator, Expression->CallExpr.Arguments[i], false))
+        {
+            return 0;
+        }
+    }
+    fprintf(Translator->FileHandle, ")");
+    return 1;
+}
+
+// Arenas are passed by pointer, so locals need their address taken while parameters already are one.
+static int32_t TranslateArenaReference(translator* Translator, expr* Argument)
+{
+    symbol* Symbol = (Argument->ExprType == EXPR_id) ? FindSymbol(Translator, Argument->IdExpr.String) : NULL;
+    if(!Symbol || (Symbol->Type.Type != TOKEN_arena) || (Symbol->Type.ArrayKind != ARRAY_none))
+    {
+        fprintf(stderr, "Error: expected an arena variable.\n");
+        return 0;
+    }
+    fprintf(Translator->FileHandle, Symbol->IsReference ? "%s" : "&%s", Symbol->Name);
+    return 1;
+}
+
+// alloc(Arena, Count) bumps Count elements of the destination slice's type off the arena.
+static int32_t TranslateAllocation(translator* Translator, type_spec* Target, expr* Expression)
+{
+    if((Expression->CallExpr.ArgumentCount != 2) || !Target || (Target->ArrayKind != ARRAY_slice))
+    {
+        fprintf(stderr, "Error: alloc expects an arena and a count, and must be stored into a slice.\n");
+        return 0;
+    }
+    if((Target->Type == TOKEN_id) || (Target->Type == TOKEN_arena))
+    {
+        fprintf(stderr, "Error: alloc only supports slices of char, int, float and string.\n");
+        return 0;
+    }
+
+    Translator->RuntimeFlags |= RUNTIME_arena;
+    Translator->SliceTypeFlags |= 1 << (Target->Type - TOKEN_char);
+    Translator->ArenaSliceTypeFlags |= 1 << (Target->Type - TOKEN_char);
+    fprintf(Translator->FileHandle, "DF_ArenaPushSlice_%s(", GetTypeName(Target->Type));
+    if(!TranslateArenaReference(Translator, Expression->CallExpr.Arguments[0]))
+    {
+        return 0;
+    }
+    fprintf(Translator->FileHandle, ", ");
+    if(!TranslateExpression(Translator, Expression->CallExpr.Arguments[1], false))
+    {
+        return 0;
+    }
+    fprintf(Translator->FileHandle, ")");
+    return 1;
+}
+
+// concat(Arena, A, B) builds a new string, long results are stored in the arena.
+static int32_t TranslateConcat(translator* Translator, expr* Expression)
+{
+    type_spec StringType = MakeType(TOKEN_string);
+    if(Expression->CallExpr.ArgumentCount != 3)
+    {
+        fprintf(stderr, "Error: concat expects an arena and two strings.\n");
+        return 0;
+    }
+
+    Translator->RuntimeFlags |= RUNTIME_arena | RUNTIME_string;
+    fprintf(Translator->FileHandle, "DF_StringConcat(");
+    if(!TranslateArenaReference(Translator, Expression->CallExpr.Arguments[0]))
+    {
+        return 0;
+    }
+    for(uint32_t i = 1; i < 3; ++i)
+    {
+        fprintf(Translator->FileHandle, ", ");
+        if(!TranslateValue(Translator, &StringType, Expression->CallExpr.Arguments[i], false))
+        {
+            return 0;
+        }
+    }
+    fprintf(Translator->FileHandle, ")");
+    return 1;
+}
+
+#define MAX_PRINT_SEGMENT_COUNT (2 * MAX_PARAMETER_COUNT + 1)
+
+// A run of literal text of a format string, or one %d, %i, %c or %s with its argument.
+struct print_segment
+{
+    char* Text;
+    uint32_t Length;
+    char Conversion;
+    expr* Argument;
+};
+
+// Types which printf's %d and %c take as an int.
+static bool IsPromotedToInt(type_spec* Type)
+{
+    int32_t Token = Type->Type;
+    return IsIntegerType(Type) && ((Token == TOKEN_char) || (Token == TOKEN_int) || (Token == TOKEN_i8) || (Token == TOKEN_i16) ||
+                                   (Token == TOKEN_i32) || (Token == TOKEN_u8) || (Token == TOKEN_u16));
+}
+
+static bool AddPrintText(print_segment* Segments, uint32_t* SegmentCount, char* Text, uint32_t Length)
+{
+    if(*SegmentCount == MAX_PRINT_SEGMENT_COUNT)
+    {
+        return false;
+    }
+    print_segment* Segment = &Segments[(*SegmentCount)++];
+    Segment->Text = Text;
+    Segment->Length = Length;
+    Segment->Conversion = 0;
+    Segment->Argument = NULL;
+    return true;
+}
+
+// Splits a literal format into text and conversions, when every conversion is one the specialized output can write
+// exactly like printf does. Flags, widths and the other conversions keep the call as it is.
+static bool GetPrintSegments(translator* Translator, char* Format, expr** Arguments, uint32_t ArgumentCount, print_segment* Segments,
+                             uint32_t* SegmentCount)
+{
+    *SegmentCount = 0;
+    uint32_t ArgumentIndex = 0;
+    char* Text = Format;
+    char* At = Format;
+    for(;;)
+    {
+        if((*At != '%') && (*At != '\0'))
+        {
+            ++At;
+            continue;
+        }
+        if((At > Text) && !AddPrintText(Segments, SegmentCount, Text, (uint32_t)(At - Text)))
+        {
+            return false;
+        }
+        if(*At == '\0')
+        {
+            break;
+        }
+
+        char Conversion = At[1];
+        if(Conversion == '%')
+        {
+            Text = At + 1;
+            At += 2;
+            continue;
+        }
+        if(((Conversion != 'd') && (Conversion != 'i') && (Conversion != 'c') && (Conversion != 's')) || (ArgumentIndex == ArgumentCount))
+        {
+            return false;
+        }
+
+        expr* Argument = Arguments[ArgumentIndex++];
+        type_spec Type;
+        if((Conversion == 's') && (Argument->ExprType == EXPR_string))
+        {
+            // Literal strings become part of the text.
+            if(!AddPrintText(Segments, SegmentCount, Argument->StringExpr.String, (uint32_t)strlen(Argument->StringExpr.String)))
+            {
+                return false;
+            }
+        }
+        else if(!GetExpressionType(Translator, Argument, &Type) || ((Conversion == 's') ? !IsStringType(&Type) : !IsPromotedToInt(&Type)) ||
+                !AddPrintText(Segments, SegmentCount, NULL, 0))
+        {
+            return false;
+        }
+        else
+        {
+            Segments[*SegmentCount - 1].Conversion = Conversion;
+            Segments[*SegmentCount - 1].Argument = Argument;
+        }
+        Text = At + 2;
+        At += 2;
+    }
+    return ArgumentIndex == ArgumentCount;
+}
+
+// Writes a run of text segments with a single call.
+static void TranslatePrintText(translator* Translator, const char* Stream, print_segment* Segments, uint32_t SegmentCount)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    uint32_t Length = 0;
+    for(uint32_t i = 0; i < SegmentCount; ++i)
+    {
+        Length += Segments[i].Length;
+    }
+    if(Length == 0)
+    {
+        return;
+    }
+    if(Length == 1)
+    {
+        char Character = 0;
+        for(uint32_t i = 0; i < SegmentCount; ++i)
+        {
+            Character = Segments[i].Length ? Segments[i].Text[0] : Character;
+        }
+        fprintf(FileHandle, (strcmp(Stream, "stdout") == 0) ? "putchar('" : "fputc('");
+        if(Character == '\'')
+        {
+            fprintf(FileHandle, "\\'");
+        }
+        else
+        {
+            TranslateStringBytes(FileHandle, &Character, 1);
+        }
+        fprintf(FileHandle, (strcmp(Stream, "stdout") == 0) ? "');\n" : "', %s);\n", Stream);
+        return;
+    }
+
+    // The segments are joined, so that the same text printed in several places is pooled once.
+    char* Text = (char*)Allocate(MEMORY_scratch, Length);
+    uint32_t TextLength = 0;
+    for(uint32_t i = 0; i < SegmentCount; ++i)
+    {
+        memcpy(Text + TextLength, Segments[i].Text, Segments[i].Length);
+        TextLength += Segments[i].Length;
+    }
+    int32_t Index = PoolString(Translator, Text, Length);
+    fprintf(FileHandle, "fwrite(");
+    TranslatePooledString(Translator, Index, Text, Length);
+    fprintf(FileHandle, ", 1, ");
+    TranslatePooledLength(Translator, Index, Length);
+    fprintf(FileHandle, ", %s);\n", Stream);
+    Deallocate(Text);
+}
+
+// printf and fprintf statements with a literal format are written as the calls they boil down to, so that formats
+// aren't parsed at run time: text goes to fwrite or putchar, %d and %s to DF_WriteInt and DF_WriteString. Returns -1
+// when the call doesn't qualify and nothing was written.
+static int32_t TranslatePrint(translator* Translator, expr* Expression)
+{
+    char* Name = Expression->CallExpr.Name;
+    uint32_t FormatIndex = (strcmp(Name, "fprintf") == 0) ? 1 : 0;
+    if(((FormatIndex == 0) && (strcmp(Name, "printf") != 0)) || (Expression->CallExpr.ArgumentCount <= FormatIndex) ||
+       (Expression->CallExpr.Arguments[FormatIndex]->ExprType != EXPR_string))
+    {
+        return -1;
+    }
+
+    // The stream is named once per segment, so it has to be a plain name.
+    const char* Stream = "stdout";
+    if(FormatIndex)
+    {
+        expr* StreamExpr = Expression->CallExpr.Arguments[0];
+        if(StreamExpr->ExprType != EXPR_id)
+        {
+            return -1;
+        }
+        Stream = StreamExpr->IdExpr.String;
+    }
+
+    print_segment Segments[MAX_PRINT_SEGMENT_COUNT];
+    uint32_t SegmentCount;
+    if(!GetPrintSegments(Translator, Expression->CallExpr.Arguments[FormatIndex]->StringExpr.String, Expression->CallExpr.Arguments + FormatIndex + 1,
+                         Expression->CallExpr.ArgumentCount - FormatIndex - 1, Segments, &SegmentCount))
+    {
+        return -1;
+    }
+
+    // printf evaluates all of its arguments before writing anything, so arguments which could have effects or fail are
+    // evaluated into temporaries first. They go last first, the order MSVC and GCC evaluate the arguments of the call in.
+    FILE* FileHandle = Translator->FileHandle;
+    bool HasTemporaries = false;
+    for(uint32_t i = SegmentCount; i-- > 0;)
+    {
+        expr* Argument = Segments[i].Argument;
+        if(Argument && (Argument->ExprType != EXPR_id) && (Argument->ExprType != EXPR_int) && (Argument->ExprType != EXPR_char))
+        {
+            if(!HasTemporaries)
+            {
+                fprintf(FileHandle, "{\n");
+                HasTemporaries = true;
+            }
+            fprintf(FileHandle, (Segments[i].Conversion == 's') ? "df_string DF_Argument%u=" : "int DF_Argument%u=", i);
+            if(!TranslateExpression(Translator, Argument, false))
+            {
+                return 0;
+            }
+            fprintf(FileHandle, ";\n");
+            Segments[i].Argument = NULL;
+        }
+    }
+
+    Translator->RuntimeFlags |= RUNTIME_print;
+    uint32_t TextStart = 0;
+    for(uint32_t i = 0; i <= SegmentCount; ++i)
+    {
+        if((i < SegmentCount) && !Segments[i].Conversion)
+        {
+            continue;
+        }
+        if(i > TextStart)
+        {
+            TranslatePrintText(Translator, Stream, Segments + TextStart, i - TextStart);
+        }
+        TextStart = i + 1;
+        if(i == SegmentCount)
+        {
+            break;
+        }
+
+        char Conversion = Segments[i].Conversion;
+        if(Conversion == 's')
+        {
+            Translator->RuntimeFlags |= RUNTIME_string;
+            fprintf(FileHandle, "DF_WriteString(%s, ", Stream);
+        }
+        else if(Conversion == 'c')
+        {
+            fprintf(FileHandle, (strcmp(Stream, "stdout") == 0) ? "putchar(" : "fputc(");
+        }
+        else
+        {
+            fprintf(FileHandle, "DF_WriteInt(%s, ", Stream);
+        }
+        if(!Segments[i].Argument)
+        {
+            fprintf(FileHandle, "DF_Argument%u", i);
+        }
+        else if(!TranslateExpression(Translator, Segments[i].Argument, false))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ((Conversion == 'c') && (strcmp(Stream, "stdout") != 0)) ? ", %s);\n" : ");\n", Stream);
+    }
+    if(HasTemporaries)
+    {
+        fprintf(FileHandle, "}\n");
+    }
+    return 1;
+}
+
+// write_int(X), write_float(X), write_char(C) and write_str(S) append to the buffered standard output, flush() empties it.
+static int32_t TranslateOutput(translator* Translator, expr* Expression)
+{
+    char* Name = Expression->CallExpr.Name;
+    FILE* FileHandle = Translator->FileHandle;
+    Translator->RuntimeFlags |= RUNTIME_output;
+    if(strcmp(Name, "flush") == 0)
+    {
+        if(Expression->CallExpr.ArgumentCount != 0)
+        {
+            fprintf(stderr, "Error: flush takes no arguments.\n");
+            return 0;
+        }
+        fprintf(FileHandle, "DF_Flush()");
+        return 1;
+    }
+
+    expr* Argument = (Expression->CallExpr.ArgumentCount == 1) ? Expression->CallExpr.Arguments[0] : NULL;
+    if(!Argument)
+    {
+        fprintf(stderr, "Error: %s expects one argument.\n", Name);
+        return 0;
+    }
+
+    // Values of inline C have no known type, they are taken as what the builtin expects.
+    type_spec Type;
+    bool HasType = GetExpressionType(Translator, Argument, &Type);
+    if((strcmp(Name, "write_str") == 0) && (Argument->ExprType == EXPR_string))
+    {
+        uint32_t Length = (uint32_t)strlen(Argument->StringExpr.String);
+        int32_t Index = PoolString(Translator, Argument->StringExpr.String, Length);
+        fprintf(FileHandle, "DF_OutputBytes(");
+        TranslatePooledString(Translator, Index, Argument->StringExpr.String, Length);
+        fprintf(FileHandle, ", ");
+        TranslatePooledLength(Translator, Index, Length);
+        fprintf(FileHandle, ")");
+        return 1;
+    }
+    else if(strcmp(Name, "write_str") == 0)
+    {
+        if(HasType && !IsStringType(&Type))
+        {
+            fprintf(stderr, "Error: write_str expects a string.\n");
+            return 0;
+        }
+        Translator->RuntimeFlags |= HasType ? RUNTIME_string : 0;
+        fprintf(FileHandle, HasType ? "DF_OutputString(" : "DF_OutputCString(");
+    }
+    else if(strcmp(Name, "write_float") == 0)
+    {
+        if(HasType && !IsRealType(&Type) && !IsIntegerType(&Type))
+        {
+            fprintf(stderr, "Error: write_float expects a number.\n");
+            return 0;
+        }
+        fprintf(FileHandle, "DF_OutputFloat(");
+    }
+    else
+    {
+        if(HasType && !IsIntegerType(&Type))
+        {
+            fprintf(stderr, "Error: %s expects an integer.\n", Name);
+            return 0;
+        }
+        bool IsUnsigned = HasType && ((Type.Type == TOKEN_u32) || (Type.Type == TOKEN_u64));
+        fprintf(FileHandle, (strcmp(Name, "write_char") == 0) ? "DF_OutputChar(" : IsUnsigned ? "DF_OutputUnsigned(" : "DF_OutputInt(");
+    }
+
+    if(!TranslateExpression(Translator, Argument, false))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, ")");
+    return 1;
+}
+
+static int32_t TranslateIntrinsic(translator* Translator, expr* Expression)
+{
+    char* Name = Expression->CallExpr.Name;
+    if(strcmp(Name, "len") == 0)
+    {
+        return TranslateLength(Translator, Expression);
+    }
+    if(strcmp(Name, "slice") == 0)
+    {
+        return TranslateSlice(Translator, Expression);
+    }
+    if(strcmp(Name, "alloc") == 0)
+    {
+        return TranslateAllocation(Translator, NULL, Expression);
+    }
+    if(strcmp(Name, "concat") == 0)
+    {
+        return TranslateConcat(Translator, Expression);
+    }
+    if(IsOutputBuiltin(Name))
+    {
+        return TranslateOutput(Translator, Expression);
+    }
+    return 0;
+}
+
+static void TranslateArenaReleases(translator* Translator, uint32_t FirstArena)
+{
+    for(uint32_t i = Translator->ArenaCount; i > FirstArena; --i)
+    {
+        fprintf(Translator->FileHandle, "DF_ArenaRelease(&%s);\n", Translator->Arenas[i - 1]);
+    }
+}
+
+// Writes the head of a loop up to the { of its body, adding the loop variable and its bounds facts.
+static int32_t TranslateForHeader(translator* Translator, expr* Expression)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    if(Expression->ForExpr.Condition && !Expression->ForExpr.Definition && !Expression->ForExpr.Action)
+    {
+        fprintf(FileHandle, "while(");
+        if(!TranslateExpression(Translator, Expression->ForExpr.Condition, false))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        fprintf(FileHandle, "for(");
+        if(Expression->ForExpr.Definition)
+        {
+            if(!TranslateExpression(Translator, Expression->ForExpr.Definition, false))
+            {
+                return 0;
+            }
+            // Narrow loop variables wrap around to negative values, where int ones would overflow, which C leaves undefined.
+            expr* Definition = GetInductionDefinition(Expression);
+            if(Definition && IsSmallIntLiteral(Definition->VarExpr.Expr) && (GetTypeSize(Definition->VarExpr.Type.Type) >= 4))
+            {
+                Translator->Symbols[Translator->SymbolCount - 1].IsNonNegative = true;
+            }
+        }
+        fprintf(FileHandle, ";");
+
+        if(Expression->ForExpr.Condition)
+        {
+            if(!TranslateExpression(Translator, Expression->ForExpr.Condition, false))
+            {
+                return 0;
+            }
+        }
+        fprintf(FileHandle, ";");
+
+        if(Expression->ForExpr.Action)
+        {
+            if(!TranslateExpression(Translator, Expression->ForExpr.Action, false))
+            {
+                return 0;
+            }
+        }
+        PushLoopBoundsFact(Translator, Expression);
+    }
+    fprintf(FileHandle, ")\n{\n");
+    return 1;
+}
+
+// Escapes each variable of the bench body once, the ones it reads when !IsWritten and the ones it writes or declares
+// otherwise. Variables the symbols don't know, being out of scope, and arenas are left out.
+static void TranslateBenchEscapes(translator* Translator, expr* Bench, bool IsWritten)
+{
+    name_set Escaped = {};
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Bench);
+    while(Pending.Count)
+    {
+        expr* Expression = PopExpr(&Pending);
+        if(!Expression)
+        {
+            continue;
+        }
+        PushChildExpressions(&Pending, Expression);
+
+        char* Name = NULL;
+        if(!IsWritten)
+        {
+            Name = (Expression->ExprType == EXPR_id) ? Expression->IdExpr.String : NULL;
+        }
+        else if(Expression->ExprType == EXPR_var)
+        {
+            Name = Expression->VarExpr.Name;
+        }
+        else if(GetWrittenVariable(Expression))
+        {
+            Name = GetWrittenVariable(Expression)->IdExpr.String;
+        }
+        symbol* Symbol = Name ? FindSymbol(Translator, Name) : NULL;
+        if(!Symbol || (Symbol->Type.Type == TOKEN_arena))
+        {
+            continue;
+        }
+
+        uint64_t Hash = HashBytes(Name, (uint32_t)strlen(Name));
+        bool IsNew = true;
+        for(uint32_t i = 0; IsNew && (i < Escaped.Count); ++i)
+        {
+            IsNew = (Escaped.Hashes[i] != Hash);
+        }
+        if(IsNew)
+        {
+            AddName(&Escaped, Name, (uint32_t)strlen(Name));
+            fprintf(Translator->FileHandle, "DF_BenchEscape(&%s);\n", Name);
+        }
+    }
+    FreeWorkStack(&Pending);
+    Deallocate(Escaped.Hashes);
+}
+
+// A bench runs its body in the loop of the runtime harness, see RuntimeBench, inside a block of its own holding the
+// harness state. The variables the body reads escape at the start of every iteration, so that the C compiler can't
+// fold the work into a constant or hoist it out of the loop. Returning from the body would skip the report, so it
+// isn't allowed.
+static int32_t TranslateBenchHeader(translator* Translator, expr* Bench)
+{
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Bench);
+    bool HasReturn = false;
+    while(!HasReturn && Pending.Count)
+    {
+        expr* Expression = PopExpr(&Pending);
+        if(Expression)
+        {
+            HasReturn = (Expression->ExprType == EXPR_return);
+            PushChildExpressions(&Pending, Expression);
+        }
+    }
+    FreeWorkStack(&Pending);
+    if(HasReturn)
+    {
+        fprintf(stderr, "Error: bench \"%s\" can't return.\n", Bench->BenchExpr.Name);
+        return 0;
+    }
+
+    FILE* FileHandle = Translator->FileHandle;
+    Translator->RuntimeFlags |= RUNTIME_bench;
+    fprintf(FileHandle, "{\ndf_bench DF_Bench;\nDF_BenchBegin(&DF_Bench, \"");
+    TranslateString(FileHandle, Bench->BenchExpr.Name);
+    fprintf(FileHandle, "\");\nwhile(DF_BenchNext(&DF_Bench))\n{\n");
+    TranslateBenchEscapes(Translator, Bench, false);
+    return 1;
+}
+
+// Ends an iteration of the bench, while the variables of the body are still in scope. What it writes escapes, so that
+// the C compiler can't drop the work.
+static void TranslateBenchFooter(translator* Translator, expr* Bench)
+{
+    TranslateBenchEscapes(Translator, Bench, true);
+    fprintf(Translator->FileHandle, "DF_BenchBarrier();\n}\nDF_BenchEnd(&DF_Bench);\n");
+}
+
+// A case value of a match, with a key ordered like the values whether the type is signed or not.
+struct match_value
+{
+    uint64_t Key;
+    expr* Value;
+    uint32_t Case;
+};
+
+static int CompareMatchValues(const void* A, const void* B)
+{
+    uint64_t KeyA = ((const match_value*)A)->Key;
+    uint64_t KeyB = ((const match_value*)B)->Key;
+    return (KeyA < KeyB) ? -1 : (KeyA > KeyB);
+}
+
+// Case values are int and char literals, possibly negated. Bits holds the value in two's complement.
+static bool GetCaseValue(expr* Expression, uint64_t* Bits, bool* IsNegative)
+{
+    *IsNegative = false;
+    if(Expression->ExprType == EXPR_int)
+    {
+        *Bits = Expression->IntExpr.IntValue;
+        return true;
+    }
+    if(Expression->ExprType == EXPR_char)
+    {
+        *Bits = (uint64_t)(int64_t)Expression->CharExpr.CharValue;
+        *IsNegative = (Expression->CharExpr.CharValue < 0);
+        return true;
+    }
+    if((Expression->ExprType == EXPR_unary) && (Expression->UnaryExpr.Operator == '-') && !Expression->UnaryExpr.IsPostfix &&
+       (Expression->UnaryExpr.Operand->ExprType == EXPR_int))
+    {
+        *Bits = 0 - Expression->UnaryExpr.Operand->IntExpr.IntValue;
+        *IsNegative = (*Bits != 0);
+        return true;
+    }
+    return false;
+}
+
+// Collects the case values of the match sorted by key, checking that each is a literal fitting the type of the
+// matched value and appears once, and that there is at most one else.
+static int32_t GetMatchValues(translator* Translator, expr* Match, type_spec* Type, match_value* Values, uint32_t* ValueCount)
+{
+    if(!GetExpressionType(Translator, Match->MatchExpr.Value, Type) || !IsIntegerType(Type))
+    {
+        fprintf(stderr, "Error: match expects an integer or char value.\n");
+        return 0;
+    }
+
+    bool IsUnsigned = (Type->Type >= TOKEN_u8) && (Type->Type <= TOKEN_u64);
+    uint64_t Max = GetIntegerMax(Type->Type);
+    uint32_t ElseCount = 0;
+    *ValueCount = 0;
+    for(uint32_t CaseIndex = 0; CaseIndex < Match->MatchExpr.CaseCount; ++CaseIndex)
+    {
+        expr* Case = Match->MatchExpr.Cases[CaseIndex];
+        ElseCount += (Case->CaseExpr.ValueCount == 0);
+        for(uint32_t i = 0; i < Case->CaseExpr.ValueCount; ++i)
+        {
+            uint64_t Bits;
+            bool IsNegative;
+            if(!GetCaseValue(Case->CaseExpr.Values[i], &Bits, &IsNegative))
+            {
+                fprintf(stderr, "Error: case values must be int or char literals.\n");
+                return 0;
+            }
+            uint64_t Magnitude = IsNegative ? 0 - Bits : Bits;
+            if(IsNegative ? (IsUnsigned || (Magnitude - 1 > Max)) : (Magnitude > Max))
+            {
+                fprintf(stderr, "Error: case value %s%llu doesn't fit into %s.\n", IsNegative ? "-" : "", Magnitude, GetTypeName(Type->Type));
+                return 0;
+            }
+
+            match_value* Value = &Values[(*ValueCount)++];
+            Value->Key = IsUnsigned ? Bits : (Bits ^ (1ULL << 63));
+            Value->Value = Case->CaseExpr.Values[i];
+            Value->Case = CaseIndex;
+        }
+    }
+    if(ElseCount > 1)
+    {
+        fprintf(stderr, "Error: match has more than one else.\n");
+        return 0;
+    }
+
+    qsort(Values, *ValueCount, sizeof(match_value), CompareMatchValues);
+    for(uint32_t i = 1; i < *ValueCount; ++i)
+    {
+        if(Values[i].Key == Values[i - 1].Key)
+        {
+            uint64_t Bits = IsUnsigned ? Values[i].Key : (Values[i].Key ^ (1ULL << 63));
+            bool IsNegative = !IsUnsigned && ((int64_t)Bits < 0);
+            fprintf(stderr, "Error: case value %s%llu appears more than once in the match.\n", IsNegative ? "-" : "", IsNegative ? 0 - Bits : Bits);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static bool IsCaseTerminal(expr* Case)
+{
+    return Case->CaseExpr.ExpressionCount && IsTerminalStatement(Case->CaseExpr.Expressions[Case->CaseExpr.ExpressionCount - 1]);
+}
+
+// Whether control can get past the match, which needs the end label of a decision tree.
+static bool IsMatchEndReached(expr* Match)
+{
+    bool Result = (FindElseCase(Match) < 0);
+    for(uint32_t i = 0; !Result && (i < Match->MatchExpr.CaseCount); ++i)
+    {
+        Result = !IsCaseTerminal(Match->MatchExpr.Cases[i]);
+    }
+    return Result;
+}
+
+// Small dense matches whose cases only return a literal, or only assign one to the same variable, become a lookup
+// into a constant array. Returns -1 when the match doesn't qualify and nothing was written.
+static int32_t TranslateMatchTable(translator* Translator, expr* Match, match_value* Values, uint32_t ValueCount)
+{
+    int32_t ElseCase = FindElseCase(Match);
+    uint64_t Length = ValueCount ? Values[ValueCount - 1].Key - Values[0].Key + 1 : 0;
+    if((ElseCase < 0) || (ValueCount < MIN_MATCH_TABLE_VALUE_COUNT) || (Length > MAX_MATCH_TABLE_LENGTH) || (Length > 2 * ValueCount))
+    {
+        return -1;
+    }
+
+    // The first case tells which of the two it is.
+    char* Target = NULL;
+    expr* Results[MAX_EXPRESSION_COUNT];
+    for(uint32_t i = 0; i < Match->MatchExpr.CaseCount; ++i)
+    {
+        expr* Case = Match->MatchExpr.Cases[i];
+        expr* Statement = (Case->CaseExpr.ExpressionCount == 1) ? Case->CaseExpr.Expressions[0] : NULL;
+        bool IsAssignment = Statement && (Statement->ExprType == EXPR_binary) && (Statement->BinaryExpr.Operator == '=') &&
+                            (Statement->BinaryExpr.LHS->ExprType == EXPR_id);
+        Target = ((i == 0) && IsAssignment) ? Statement->BinaryExpr.LHS->IdExpr.String : Target;
+        if(Target ? (!IsAssignment || (strcmp(Statement->BinaryExpr.LHS->IdExpr.String, Target) != 0)) :
+                    (!Statement || (Statement->ExprType != EXPR_return)))
+        {
+            return -1;
+        }
+
+        uint64_t Bits;
+        bool IsNegative;
+        Results[i] = Target ? Statement->BinaryExpr.RHS : Statement->ReturnExpr.Expression;
+        if(!GetCaseValue(Results[i], &Bits, &IsNegative))
+        {
+            return -1;
+        }
+    }
+
+    // Returns are left to the usual path when arenas are released or the function jumps back to its start.
+    type_spec Type = Translator->ReturnType;
+    if(Target)
+    {
+        symbol* Symbol = FindSymbol(Translator, Target);
+        if(!Symbol)
+        {
+            return -1;
+        }
+        Type = Symbol->Type;
+    }
+    else if(Translator->TailFunction || Translator->ArenaCount)
+    {
+        return -1;
+    }
+    if(!IsIntegerType(&Type))
+    {
+        return -1;
+    }
+
+    expr* Slots[MAX_MATCH_TABLE_LENGTH];
+    for(uint64_t i = 0; i < Length; ++i)
+    {
+        Slots[i] = Results[ElseCase];
+    }
+    for(uint32_t i = 0; i < ValueCount; ++i)
+    {
+        Slots[Values[i].Key - Values[0].Key] = Results[Values[i].Case];
+    }
+
+    FILE* FileHandle = Translator->FileHandle;
+    uint32_t Label = Translator->MatchCount++;
+    fprintf(FileHandle, "{\nstatic const %s DF_Match%u_Table[%llu] = {", GetCTypeName(Type.Type), Label, Length);
+    for(uint64_t i = 0; i < Length; ++i)
+    {
+        fprintf(FileHandle, i ? ", " : "");
+        if(!TranslateValue(Translator, &Type, Slots[i], true))
+        {
+            return 0;
+        }
+    }
+    fprintf(FileHandle, "};\nuint64_t DF_Match%u = (uint64_t)(", Label);
+    if(!TranslateExpression(Translator, Match->MatchExpr.Value, false))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, ") - (uint64_t)(");
+    TranslateExpression(Translator, Values[0].Value, false);
+    fprintf(FileHandle, ");\n");
+    if(Target)
+    {
+        fprintf(FileHandle, "%s = ", Target);
+    }
+    else
+    {
+        fprintf(FileHandle, "return ");
+    }
+    fprintf(FileHandle, "(DF_Match%u < %llu) ? DF_Match%u_Table[DF_Match%u] : ", Label, Length, Label, Label);
+    if(!TranslateValue(Translator, &Type, Results[ElseCase], false))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, ";\n}\n");
+    return 1;
+}
+
+// A run of sorted case values of a decision tree, or the end of the if holding the lower half of a split when Count is 0.
+struct match_range
+{
+    uint32_t First;
+    uint32_t Count;
+};
+
+// Binary search over the sorted values, comparing a few of them at the leaves and jumping to the label of the case
+// matched, or to the else (the end when there is none) after a miss.
+static void TranslateMatchTree(translator* Translator, expr* Match, match_value* Values, uint32_t ValueCount, uint32_t Label)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    int32_t ElseCase = FindElseCase(Match);
+    match_range Buffer[32];
+    work_stack Ranges;
+    InitWorkStack(&Ranges, Buffer, sizeof(Buffer), sizeof(match_range));
+    match_range* Root = (match_range*)PushWork(&Ranges);
+    Root->First = 0;
+    Root->Count = ValueCount;
+    while(Ranges.Count)
+    {
+        match_range Range = *(match_range*)PeekWork(&Ranges);
+        PopWork(&Ranges);
+        if(Range.Count == 0)
+        {
+            fprintf(FileHandle, "}\n");
+            continue;
+        }
+        if(Range.Count < MIN_MATCH_TREE_VALUE_COUNT)
+        {
+            for(uint32_t i = Range.First; i < Range.First + Range.Count; ++i)
+            {
+                fprintf(FileHandle, "if(DF_Match%u == ", Label);
+                TranslateExpression(Translator, Values[i].Value, false);
+                fprintf(FileHandle, ") goto DF_Match%u_Case%u;\n", Label, Values[i].Case);
+            }
+            if(ElseCase >= 0)
+            {
+                fprintf(FileHandle, "goto DF_Match%u_Case%d;\n", Label, ElseCase);
+            }
+            else
+            {
+                fprintf(FileHandle, "goto DF_Match%u_End;\n", Label);
+            }
+            continue;
+        }
+
+        uint32_t Half = Range.Count / 2;
+        fprintf(FileHandle, "if(DF_Match%u < ", Label);
+        TranslateExpression(Translator, Values[Range.First + Half].Value, false);
+        fprintf(FileHandle, ")\n{\n");
+        match_range* Upper = (match_range*)PushWork(&Ranges);
+        Upper->First = Range.First + Half;
+        Upper->Count = Range.Count - Half;
+        match_range* End = (match_range*)PushWork(&Ranges);
+        End->First = 0;
+        End->Count = 0;
+        match_range* Lower = (match_range*)PushWork(&Ranges);
+        Lower->First = Range.First;
+        Lower->Count = Half;
+    }
+    FreeWorkStack(&Ranges);
+}
+
+// Lowers a match by how its values are spread: into a lookup table (see TranslateMatchTable), into a C switch when
+// they are dense enough for the C compiler to build a jump table, or else into a decision tree over a temporary
+// holding the value, whose leaves jump to labels on the case bodies. Sets Label to the number of the tree's labels,
+// -1 for a switch. Returns -1 when the whole match was written as a table, 1 when the cases are left to TranslateBlock.
+static int32_t TranslateMatchHeader(translator* Translator, expr* Match, int32_t* Label)
+{
+    type_spec Type;
+    match_value Values[MAX_EXPRESSION_COUNT * MAX_CASE_VALUE_COUNT];
+    uint32_t ValueCount;
+    if(!GetMatchValues(Translator, Match, &Type, Values, &ValueCount))
+    {
+        return 0;
+    }
+
+    int32_t TableResult = TranslateMatchTable(Translator, Match, Values, ValueCount);
+    if(TableResult >= 0)
+    {
+        return TableResult ? -1 : 0;
+    }
+
+    FILE* FileHandle = Translator->FileHandle;
+    bool IsSparse = (ValueCount >= MIN_MATCH_TREE_VALUE_COUNT) &&
+                    ((Values[ValueCount - 1].Key - Values[0].Key) / MATCH_SWITCH_DENSITY >= ValueCount);
+    if(!IsSparse)
+    {
+        *Label = -1;
+        fprintf(FileHandle, "switch(");
+        if(!TranslateExpression(Translator, Match->MatchExpr.Value, false))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ")\n{\n");
+        return 1;
+    }
+
+    *Label = (int32_t)Translator->MatchCount++;
+    fprintf(FileHandle, "{\n%s DF_Match%d = ", GetCTypeName(Type.Type), *Label);
+    if(!TranslateExpression(Translator, Match->MatchExpr.Value, false))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, ";\n");
+    TranslateMatchTree(Translator, Match, Values, ValueCount, (uint32_t)*Label);
+    return 1;
+}
+
+static void TranslateCaseLabels(translator* Translator, expr* Case, int32_t Label, uint32_t CaseIndex)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    if(Label >= 0)
+    {
+        fprintf(FileHandle, "DF_Match%d_Case%u:\n", Label, CaseIndex);
+        return;
+    }
+    if(Case->CaseExpr.ValueCount == 0)
+    {
+        fprintf(FileHandle, "default:\n");
+    }
+    for(uint32_t i = 0; i < Case->CaseExpr.ValueCount; ++i)
+    {
+        fprintf(FileHandle, "case ");
+        TranslateExpression(Translator, Case->CaseExpr.Values[i], false);
+        fprintf(FileHandle, ":\n");
+    }
+}
+
+// A block whose statements are being translated, with the scope to restore when it ends.
+struct translated_block
+{
+    expr* Statement; // The if, for, bench, match or case owning the block, NULL for the outermost one
+    expr** Expressions;
+    uint32_t ExpressionCount;
+    uint32_t Next;
+    bool IsElse;
+    // Number of the labels of a match lowered to a decision tree and of its cases, -1 for a switch.
+    int32_t MatchLabel;
+    uint32_t SymbolCount;
+    uint32_t ArenaCount;
+    // Scope of a for, which also holds its loop variable.
+    uint32_t LoopSymbolCount;
+    uint32_t BoundsFactCount;
+};
+
+static void OpenTranslatedBlock(translator* Translator, work_stack* Blocks, expr* Statement, expr** Expressions, uint32_t ExpressionCount,
+                                uint32_t LoopSymbolCount, uint32_t BoundsFactCount)
+{
+    translated_block* Block = (translated_block*)PushWork(Blocks);
+    Block->Statement = Statement;
+    Block->Expressions = Expressions;
+    Block->ExpressionCount = ExpressionCount;
+    Block->Next = 0;
+    Block->IsElse = false;
+    Block->MatchLabel = -1;
+    Block->SymbolCount = Translator->SymbolCount;
+    Block->ArenaCount = Translator->ArenaCount;
+    Block->LoopSymbolCount = LoopSymbolCount;
+    Block->BoundsFactCount = BoundsFactCount;
+}
+
+// Translates the statements of the block and of the bodies nested in it in a single loop over the open blocks,
+// instead of recursing per nesting level. The statements of a match block are its cases.
+static int32_t TranslateBlock(translator* Translator, expr** Expressions, uint32_t ExpressionCount)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    translated_block Buffer[16];
+    work_stack Blocks;
+    InitWorkStack(&Blocks, Buffer, sizeof(Buffer), sizeof(translated_block));
+    OpenTranslatedBlock(Translator, &Blocks, NULL, Expressions, ExpressionCount, Translator->SymbolCount, Translator->BoundsFactCount);
+
+    int32_t Result = 1;
+    while(Blocks.Count)
+    {
+        translated_block* Block = (translated_block*)PeekWork(&Blocks);
+        if(Block->Next < Block->ExpressionCount)
+        {
+            expr* Statement = Block->Expressions[Block->Next++];
+            if(Statement && (Statement->ExprType == EXPR_case) && Block->Statement && (Block->Statement->ExprType == EXPR_match))
+            {
+                int32_t MatchLabel = Block->MatchLabel;
+                TranslateCaseLabels(Translator, Statement, MatchLabel, Block->Next - 1);
+                fprintf(FileHandle, "{\n");
+                OpenTranslatedBlock(Translator, &Blocks, Statement, Statement->CaseExpr.Expressions, Statement->CaseExpr.ExpressionCount,
+                                    Translator->SymbolCount, Translator->BoundsFactCount);
+                ((translated_block*)PeekWork(&Blocks))->MatchLabel = MatchLabel;
+            }
+            else if(Statement && (Statement->ExprType == EXPR_match))
+            {
+                int32_t MatchLabel = -1;
+                int32_t MatchResult = TranslateMatchHeader(Translator, Statement, &MatchLabel);
+                if(MatchResult == 0)
+                {
+                    Result = 0;
+                    break;
+                }
+                if(MatchResult > 0)
+                {
+                    OpenTranslatedBlock(Translator, &Blocks, Statement, Statement->MatchExpr.Cases, Statement->MatchExpr.CaseCount,
+                                        Translator->SymbolCount, Translator->BoundsFactCount);
+                    ((translated_block*)PeekWork(&Blocks))->MatchLabel = MatchLabel;
+                }
+            }
+            else if(Statement && (Statement->ExprType == EXPR_if))
+            {
+                fprintf(FileHandle, "if(");
+                if(!TranslateExpression(Translator, Statement->IfExpr.Statement, false))
+                {
+                    Result = 0;
+                    break;
+                }
+                fprintf(FileHandle, ")\n{\n");
+                OpenTranslatedBlock(Translator, &Blocks, Statement, Statement->IfExpr.TrueExpressions, Statement->IfExpr.TrueExpressionCount,
+                                    Translator->SymbolCount, Translator->BoundsFactCount);
+            }
+            else if(Statement && (Statement->ExprType == EXPR_bench))
+            {
+                if(!TranslateBenchHeader(Translator, Statement))
+                {
+                    Result = 0;
+                    break;
+                }
+                OpenTranslatedBlock(Translator, &Blocks, Statement, Statement->BenchExpr.Expressions, Statement->BenchExpr.ExpressionCount,
+                                    Translator->SymbolCount, Translator->BoundsFactCount);
+            }
+            else if(Statement && (Statement->ExprType == EXPR_for))
+            {
+                uint32_t LoopSymbolCount = Translator->SymbolCount;
+                uint32_t BoundsFactCount = Translator->BoundsFactCount;
+                if(!TranslateForHeader(Translator, Statement))
+                {
+                    Result = 0;
+                    break;
+                }
+                OpenTranslatedBlock(Translator, &Blocks, Statement, Statement->ForExpr.Expressions, Statement->ForExpr.ExpressionCount,
+                                    LoopSymbolCount, BoundsFactCount);
+            }
+            else if(!TranslateExpression(Translator, Statement, true))
+            {
+                Result = 0;
+                break;
+            }
+            continue;
+        }
+
+        // Arenas die with their scope. A trailing return has released them already.
+        if((Block->ExpressionCount == 0) || (Block->Expressions[Block->ExpressionCount - 1]->ExprType != EXPR_return))
+        {
+            TranslateArenaReleases(Translator, Block->ArenaCount);
+        }
+        if(Block->Statement && (Block->Statement->ExprType == EXPR_bench))
+        {
+            TranslateBenchFooter(Translator, Block->Statement);
+        }
+        Translator->SymbolCount = Block->SymbolCount;
+        Translator->ArenaCount = Block->ArenaCount;
+        if(!Block->Statement)
+        {
+            PopWork(&Blocks);
+            continue;
+        }
+
+        if((Block->Statement->ExprType == EXPR_match) && (Block->MatchLabel >= 0) && IsMatchEndReached(Block->Statement))
+        {
+            fprintf(FileHandle, "DF_Match%d_End:;\n", Block->MatchLabel);
+        }
+        fprintf(FileHandle, "}\n");
+        if((Block->Statement->ExprType == EXPR_case) && !IsCaseTerminal(Block->Statement))
+        {
+            if(Block->MatchLabel >= 0)
+            {
+                fprintf(FileHandle, "goto DF_Match%d_End;\n", Block->MatchLabel);
+            }
+            else
+            {
+                fprintf(FileHandle, "break;\n");
+            }
+        }
+        if((Block->Statement->ExprType == EXPR_if) && !Block->IsElse && (Block->Statement->IfExpr.FalseExpressionCount > 0))
+        {
+            fprintf(FileHandle, "else\n{\n");
+            Block->Expressions = Block->Statement->IfExpr.FalseExpressions;
+            Block->ExpressionCount = Block->Statement->IfExpr.FalseExpressionCount;
+            Block->Next = 0;
+            Block->IsElse = true;
+            continue;
+        }
+        Translator->SymbolCount = Block->LoopSymbolCount;
+        Translator->BoundsFactCount = Block->BoundsFactCount;
+        PopWork(&Blocks);
+    }
+
+    if(!Result)
+    {
+        translated_block* Outermost = (translated_block*)Blocks.Elements;
+        Translator->SymbolCount = Outermost->SymbolCount;
+        Translator->ArenaCount = Outermost->ArenaCount;
+        Translator->BoundsFactCount = Outermost->BoundsFactCount;
+    }
+    FreeWorkStack(&Blocks);
+    return Result;
+}
+
+// Name : arena = BlockSize; declares an arena owned by the enclosing scope.
+static int32_t TranslateArenaDeclaration(translator* Translator, expr* Expression, bool IsParent)
+{
+    char* Name = Expression->VarExpr.Name;
+    if((Expression->VarExpr.Type.ArrayKind != ARRAY_none) || !Translator->IsInFunction || !IsParent ||
+       (Translator->ArenaCount >= MAX_ARENA_COUNT))
+    {
+        fprintf(stderr, "Error: arena '%s' must be a single local variable.\n", Name);
+        return 0;
+    }
+
+    TranslateType(Translator->FileHandle, TOKEN_arena);
+    Translator->RuntimeFlags |= RUNTIME_arena;
+    fprintf(Translator->FileHandle, "%s=DF_ArenaCreate(", Name);
+    if(Expression->VarExpr.Expr)
+    {
+        if(!TranslateExpression(Translator, Expression->VarExpr.Expr, false))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        fprintf(Translator->FileHandle, "0");
+    }
+    fprintf(Translator->FileHandle, ");\n");
+
+    Translator->Arenas[Translator->ArenaCount++] = Name;
+    return AddSymbol(Translator, Name, &Expression->VarExpr.Type);
+}
+
+// Paths without calls, which can be translated twice when a slice's length is needed next to its data.
+static bool IsPlainPath(expr* Expression)
+{
+    switch(Expression->ExprType)
+    {
+        default:
+        {
+            return false;
+        } break;
+        case EXPR_id:
+        {
+            return true;
+        } break;
+        case EXPR_paren:
+        {
+            return IsPlainPath(Expression->ParenExpr.InnerExpr);
+        } break;
+        case EXPR_field:
+        {
+            return IsPlainPath(Expression->FieldExpr.Object);
+        } break;
+        case EXPR_index:
+        {
+            expr* Index = Expression->IndexExpr.Index;
+            return IsPlainPath(Expression->IndexExpr.Array) && ((Index->ExprType == EXPR_id) || (Index->ExprType == EXPR_int));
+        } break;
+    }
+}
+
+// Writes the index of an element of Array, of type Type, checking its bounds unless they are known to hold.
+static int32_t TranslateCheckedIndex(translator* Translator, expr* Array, type_spec* Type, expr* Index)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    char* ArrayName = (Array->ExprType == EXPR_id) ? Array->IdExpr.String : NULL;
+    if(IsIndexInBounds(Translator, ArrayName, Type, Index))
+    {
+        return TranslateExpression(Translator, Index, false);
+    }
+
+    Translator->RuntimeFlags |= RUNTIME_bounds_check;
+    fprintf(FileHandle, "DF_BoundsCheck(");
+    if(!TranslateExpression(Translator, Index, false))
+    {
+        return 0;
+    }
+    if(Type->ArrayKind == ARRAY_fixed)
+    {
+        fprintf(FileHandle, ", %llu)", Type->ArrayLength);
+        return 1;
+    }
+    fprintf(FileHandle, ", ");
+    if(!TranslateExpression(Translator, Array, false))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, ".Length)");
+    return 1;
+}
+
+static bool IsSoaElement(translator* Translator, expr* Expression)
+{
+    type_spec ArrayType;
+    return Expression && (Expression->ExprType == EXPR_index) && GetExpressionType(Translator, Expression->IndexExpr.Array, &ArrayType) &&
+           GetSoaStruct(Translator, &ArrayType);
+}
+
+// Starts a call to the DF_SoaLoad_ or DF_SoaStore_ helper of a whole element of a #soa array (see TranslateStruct),
+// with the field arrays and the index, leaving it open for the value stored.
+static int32_t TranslateSoaElement(translator* Translator, expr* Element, const char* Helper)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    expr* Array = Element->IndexExpr.Array;
+    type_spec Type;
+    struct_info* SoaStruct = GetExpressionType(Translator, Array, &Type) ? GetSoaStruct(Translator, &Type) : NULL;
+    if(!SoaStruct)
+    {
+        fprintf(stderr, "Error: indexing a value of unknown type.\n");
+        return 0;
+    }
+    // The array is written once per field.
+    if(!IsPlainPath(Array))
+    {
+        fprintf(stderr, "Error: whole elements of #soa arrays can only be accessed through variables and fields.\n");
+        return 0;
+    }
+
+    fprintf(FileHandle, "%s%s(", Helper, SoaStruct->Name);
+    for(uint32_t i = 0; i < SoaStruct->FieldCount; ++i)
+    {
+        if(!TranslateExpression(Translator, Array, false))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ".%s, ", SoaStruct->FieldNames[i]);
+    }
+    return TranslateCheckedIndex(Translator, Array, &Type, Element->IndexExpr.Index);
+}
+
+// SoaField is set when the element is a #soa struct accessed through one of its fields, A[i].X then becomes A.X[i].
+// Whole elements of #soa arrays are gathered from their fields instead.
+static int32_t TranslateIndex(translator* Translator, expr* Expression, char* SoaField)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    expr* Array = Expression->IndexExpr.Array;
+    expr* Index = Expression->IndexExpr.Index;
+
+    type_spec Type;
+    if(!GetExpressionType(Translator, Array, &Type))
+    {
+        fprintf(stderr, "Error: indexing a value of unknown type.\n");
+        return 0;
+    }
+    bool IsString = IsStringType(&Type);
+    if(!IsString && (Type.ArrayKind == ARRAY_none))
+    {
+        fprintf(stderr, "Error: indexing a value which is not an array.\n");
+        return 0;
+    }
+    if(!SoaField && GetSoaStruct(Translator, &Type))
+    {
+        if(!TranslateSoaElement(Translator, Expression, "DF_SoaLoad_"))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ")");
+        return 1;
+    }
+    if((Type.ArrayKind != ARRAY_fixed) && !IsPlainPath(Array))
+    {
+        fprintf(stderr, "Error: slices and strings can only be indexed through variables and fields.\n");
+        return 0;
+    }
+
+    if(IsString)
+    {
+        Translator->RuntimeFlags |= RUNTIME_string;
+        fprintf(FileHandle, "DF_STRING_BYTES(");
+    }
+    if(!TranslateExpression(Translator, Array, false))
+    {
+        return 0;
+    }
+    if(IsString)
+    {
+        fprintf(FileHandle, ")[");
+    }
+    else if(SoaField)
+    {
+        fprintf(FileHandle, ".%s[", SoaField);
+    }
+    else
+    {
+        fprintf(FileHandle, (Type.ArrayKind == ARRAY_slice) ? ".Data[" : "[");
+    }
+    if(!TranslateCheckedIndex(Translator, Array, &Type, Index))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, "]");
+    return 1;
+}
+
+static char* SkipBlanks(char* At)
+{
+    while((*At == ' ') || (*At == '\t') || (*At == '\r') || (*At == '\f'))
+    {
+        ++At;
+    }
+    return At;
+}
+
+// Returns true when the include doesn't need to stay where it was written. The headers of the runtime always go into
+// the prelude, in slots kept free for them.
+static bool AddInclude(translator* Translator, const char* Header, uint32_t Length, bool IsRuntime)
+{
+    for(uint32_t i = 0; i < Translator->IncludeCount; ++i)
+    {
+        if((strlen(Translator->Includes[i]) == Length) && (strncmp(Translator->Includes[i], Header, Length) == 0))
+        {
+            Translator->IsInPrelude[i] = Translator->IsInPrelude[i] || IsRuntime;
+            return true;
+        }
+    }
+    if(Translator->IncludeCount >= (IsRuntime ? MAX_INCLUDE_COUNT + MAX_RUNTIME_INCLUDE_COUNT : MAX_INCLUDE_COUNT))
+    {
+        return false;
+    }
+
+    char* Include = (char*)Allocate(MEMORY_translator, Length + 1);
+    memcpy(Include, Header, Length);
+    Include[Length] = '\0';
+    bool IsInPrelude = IsRuntime || !Translator->IsPreludeClosed;
+    Translator->IsInPrelude[Translator->IncludeCount] = IsInPrelude;
+    Translator->Includes[Translator->IncludeCount++] = Include;
+    return IsInPrelude;
+}
+
+// Top-level system includes are pulled out of inline C line by line, unless they sit inside a conditional block.
+// Once other inline C was seen they stay in place, since it may define macros the headers depend on.
+static void TranslateInline(translator* Translator, char* Text)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    bool IsAnyKept = false;
+    int32_t ConditionalDepth = 0;
+    char* Line = Text;
+    while(*Line != '\0')
+    {
+        char* LineEnd = Line;
+        while((*LineEnd != '\0') && (*LineEnd != '\n'))
+        {
+            ++LineEnd;
+        }
+
+        bool IsKept = true;
+        char* Directive = SkipBlanks(Line);
+        if(*Directive == '#')
+        {
+            char* Keyword = SkipBlanks(Directive + 1);
+            if(strncmp(Keyword, "if", 2) == 0)
+            {
+                ++ConditionalDepth;
+            }
+            else if(strncmp(Keyword, "endif", 5) == 0)
+            {
+                --ConditionalDepth;
+            }
+            else if((strncmp(Keyword, "include", 7) == 0) && !Translator->IsInFunction && (ConditionalDepth == 0))
+            {
+                char* Header = SkipBlanks(Keyword + 7);
+                char* HeaderEnd = Header;
+                while((HeaderEnd < LineEnd) && (*HeaderEnd != '>'))
+                {
+                    ++HeaderEnd;
+                }
+                if((*Header == '<') && (HeaderEnd < LineEnd))
+                {
+                    IsKept = !AddInclude(Translator, Header, (uint32_t)(HeaderEnd + 1 - Header), false);
+                }
+            }
+        }
+
+        if(IsKept)
+        {
+            if(!Translator->IsInFunction && (SkipBlanks(Line) != LineEnd))
+            {
+                Translator->IsPreludeClosed = true;
+            }
+            for(char* CurrentChar = Line; CurrentChar < LineEnd; ++CurrentChar)
+            {
+                if((*CurrentChar != '\r') && (*CurrentChar != '\t') && (*CurrentChar != '\f'))
+                {
+                    fprintf(FileHandle, "%c", *CurrentChar);
+                }
+            }
+            fprintf(FileHandle, "\n");
+            IsAnyKept = true;
+        }
+        Line = (*LineEnd == '\n') ? LineEnd + 1 : LineEnd;
+    }
+    if(!IsAnyKept && (*Text == '\0'))
+    {
+        fprintf(FileHandle, "\n");
+    }
+}
+
+static int32_t TranslateField(translator* Translator, expr* Expression)
+{
+    expr* Object = Expression->FieldExpr.Object;
+    char* Field = Expression->FieldExpr.Field;
+
+    type_spec ArrayType;
+    if((Object->ExprType == EXPR_index) && GetExpressionType(Translator, Object->IndexExpr.Array, &ArrayType) &&
+       GetSoaStruct(Translator, &ArrayType))
+    {
+        if(FindField(GetSoaStruct(Translator, &ArrayType), Field) < 0)
+        {
+            fprintf(stderr, "Error: struct '%s' has no field '%s'.\n", ArrayType.Name, Field);
+            return 0;
+        }
+        return TranslateIndex(Translator, Object, Field);
+    }
+
+    type_spec ObjectType;
+    if(!GetExpressionType(Translator, Object, &ObjectType) || (ObjectType.Type != TOKEN_id) || (ObjectType.ArrayKind != ARRAY_none))
+    {
+        fprintf(stderr, "Error: accessing field '%s' of something that isn't a struct.\n", Field);
+        return 0;
+    }
+    struct_info* Struct = FindStruct(Translator, ObjectType.Name);
+    if(!Struct || (FindField(Struct, Field) < 0))
+    {
+        fprintf(stderr, "Error: struct '%s' has no field '%s'.\n", ObjectType.Name, Field);
+        return 0;
+    }
+
+    if(!TranslateExpression(Translator, Object, false))
+    {
+        return 0;
+    }
+    fprintf(Translator->FileHandle, ".%s", Field);
+    return 1;
+}
+
+static bool IsSelfCall(func* Function, expr* Expression)
+{
+    Expression = SkipParens(Expression);
+    return Expression && (Expression->ExprType == EXPR_call) && (strcmp(Expression->CallExpr.Name, Function->Name) == 0) &&
+           (Expression->CallExpr.ArgumentCount == Function->ParameterCount);
+}
+
+// The operand of X op Self(...) or Self(...) op X, or NULL.
+static expr* GetAccumulatedOperand(func* Function, expr* Expression, int32_t Operator)
+{
+    Expression = SkipParens(Expression);
+    if(!Operator || !Expression || (Expression->ExprType != EXPR_binary) || (Expression->BinaryExpr.Operator != Operator))
+    {
+        return NULL;
+    }
+    if(IsSelfCall(Function, Expression->BinaryExpr.RHS))
+    {
+        return Expression->BinaryExpr.LHS;
+    }
+    return IsSelfCall(Function, Expression->BinaryExpr.LHS) ? Expression->BinaryExpr.RHS : NULL;
+}
+
+// Writes a return of the function set up by PrepareTailCalls: a call to itself becomes new parameter values and a jump
+// back to DF_TailCall, with the other operand of an accumulating return added to DF_Accumulator first, and other
+// values are returned combined with DF_Accumulator. Returns -1 when the return is written as usual.
+static int32_t TranslateTailReturn(translator* Translator, expr* Value)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    func* Function = Translator->TailFunction;
+    int32_t Operator = Translator->AccumulatorOperator;
+    expr* Accumulated = GetAccumulatedOperand(Function, Value, Operator);
+    expr* Call = NULL;
+    if(!Value)
+    {
+        return -1;
+    }
+    if(Accumulated)
+    {
+        expr* Binary = SkipParens(Value);
+        Call = (Accumulated == Binary->BinaryExpr.LHS) ? Binary->BinaryExpr.RHS : Binary->BinaryExpr.LHS;
+    }
+    else if(IsSelfCall(Function, Value))
+    {
+        Call = Value;
+    }
+    else if(!Operator)
+    {
+        return -1;
+    }
+    else
+    {
+        fprintf(FileHandle, "return DF_Accumulator%c(", (char)Operator);
+        if(!TranslateValue(Translator, &Translator->ReturnType, Value, false))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ");\n");
+        return 1;
+    }
+
+    fprintf(FileHandle, "{\n");
+    if(Accumulated)
+    {
+        fprintf(FileHandle, "DF_Accumulator=DF_Accumulator%c(", (char)Operator);
+        if(!TranslateValue(Translator, &Translator->ReturnType, Accumulated, false))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ");\n");
+    }
+
+    // Arguments may read any parameter, so all of them are computed before the first one changes.
+    Call = SkipParens(Call);
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        expr* Parameter = Function->Parameters[i];
+        if(IsIdNamed(SkipParens(Call->CallExpr.Arguments[i]), Parameter->VarExpr.Name))
+        {
+            continue;
+        }
+        char Name[32];
+        snprintf(Name, sizeof(Name), "DF_Tail%u", i);
+        if(!TranslateDeclaration(Translator, &Parameter->VarExpr.Type, Name))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, "=");
+        if(!TranslateValue(Translator, &Parameter->VarExpr.Type, Call->CallExpr.Arguments[i], true))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ";\n");
+    }
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        expr* Parameter = Function->Parameters[i];
+        if(!IsIdNamed(SkipParens(Call->CallExpr.Arguments[i]), Parameter->VarExpr.Name))
+        {
+            fprintf(FileHandle, "%s=DF_Tail%u;\n", Parameter->VarExpr.Name, i);
+        }
+    }
+    fprintf(FileHandle, "goto DF_TailCall;\n}\n");
+    return 1;
+}
+
+// Integer expressions that can't be negative: unsigned ones, and sums, products and quotients of literals, len and
+// loop variables counting up from a literal. Signed overflow is undefined already, so sums can be taken not to wrap.
+static bool IsNonNegativeExpression(translator* Translator, expr* Expression)
+{
+    type_spec Type;
+    if(!GetExpressionType(Translator, Expression, &Type) || !IsIntegerType(&Type))
+    {
+        return false;
+    }
+    if((Type.Type == TOKEN_u32) || (Type.Type == TOKEN_u64))
+    {
+        return true;
+    }
+
+    expr* Buffer[16];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Expression);
+    bool Result = true;
+    while(Result && Pending.Count)
+    {
+        Expression = SkipParens(PopExpr(&Pending));
+        switch(Expression->ExprType)
+        {
+            default:
+            {
+                Result = false;
+            } break;
+            case EXPR_int:
+            {
+            } break;
+            case EXPR_id:
+            {
+                symbol* Symbol = FindSymbol(Translator, Expression->IdExpr.String);
+                Result = Symbol && Symbol->IsNonNegative;
+            } break;
+            case EXPR_call:
+            {
+                Result = IsLenCall(Expression) && !FindFunction(Translator, "len");
+            } break;
+            case EXPR_binary:
+            {
+                int32_t Operator = Expression->BinaryExpr.Operator;
+                Result = (Operator == '+') || (Operator == '*') || (Operator == '/') || (Operator == '%');
+                PushExpr(&Pending, Expression->BinaryExpr.LHS);
+                PushExpr(&Pending, Expression->BinaryExpr.RHS);
+            } break;
+        }
+    }
+    FreeWorkStack(&Pending);
+    return Result;
+}
+
+// X / 2^k and X % 2^k are X >> k and X & (2^k - 1) when X is a non-negative integer, which C compilers can't assume
+// of signed X. Returns k, or -1 when the division stays.
+static int32_t GetDivisionShift(translator* Translator, expr* Binary)
+{
+    int32_t Operator = Binary->BinaryExpr.Operator;
+    expr* Divisor = Binary->BinaryExpr.RHS;
+    if(((Operator != '/') && (Operator != '%')) || (Divisor->ExprType != EXPR_int) || (Divisor->IntExpr.IntValue == 0) ||
+       (Divisor->IntExpr.IntValue > (1u << 30)) || (Divisor->IntExpr.IntValue & (Divisor->IntExpr.IntValue - 1)) ||
+       !IsNonNegativeExpression(Translator, Binary->BinaryExpr.LHS))
+    {
+        return -1;
+    }
+    int32_t Shift = 0;
+    while((1ull << Shift) < Divisor->IntExpr.IntValue)
+    {
+        ++Shift;
+    }
+    return Shift;
+}
+
+static int32_t TranslateExpression(translator* Translator, expr* Expression, bool IsParent)
+{
+    if(!Expression)
+    {
+        return 0;
+    }
+
+    FILE* FileHandle = Translator->FileHandle;
+    switch(Expression->ExprType)
+    {
+        default:
+        {
+            return 0;
+        } break;
+        case EXPR_char:
+        {
+            char CharValue = Expression->CharExpr.CharValue;
+            if(CharValue == '\'')
+            {
+                fprintf(FileHandle, "'\\''");
+            }
+            else
+            {
+                fprintf(FileHandle, "'");
+                TranslateStringBytes(FileHandle, &CharValue, 1);
+                fprintf(FileHandle, "'");
+            }
+        } break;
+        case EXPR_int:
+        {
+            TranslateIntegerLiteral(FileHandle, Expression->IntExpr.IntValue);
+        } break;
+        case EXPR_real:
+        {
+            TranslateRealLiteral(FileHandle, Expression->RealExpr.RealValue, Translator->RealLiteralType != TOKEN_f64);
+        } break;
+        case EXPR_string:
+        {
+            // Like C literals they have type char*, so that they can still be passed to C functions taking one.
+            char* String = Expression->StringExpr.String;
+            uint32_t Length = (uint32_t)strlen(String);
+            int32_t Index = PoolString(Translator, String, Length);
+            fprintf(FileHandle, (Index < 0) ? "" : "(char*)");
+            TranslatePooledString(Translator, Index, String, Length);
+        } break;
+        case EXPR_id:
+        {
+            fprintf(FileHandle, "%s", Expression->IdExpr.String);
+        } break;
+        case EXPR_var:
+        {
+            type_spec* Type = &Expression->VarExpr.Type;
+            if((Type->ArrayKind == ARRAY_fixed) && Expression->VarExpr.Expr)
+            {
+                fprintf(stderr, "Error: fixed array '%s' cannot have an initializer.\n", Expression->VarExpr.Name);
+                return 0;
+            }
+            if(Type->Type == TOKEN_arena)
+            {
+                if(!TranslateArenaDeclaration(Translator, Expression, IsParent))
+                {
+                    return 0;
+                }
+                break;
+            }
+
+            if(!TranslateDeclaration(Translator, Type, Expression->VarExpr.Name))
+            {
+                return 0;
+            }
+            if(Expression->VarExpr.Expr != NULL)
+            {
+                fprintf(FileHandle, "=");
+                if(!TranslateValue(Translator, Type, Expression->VarExpr.Expr, true))
+                {
+                    return 0;
+                }
+            }
+            if(!AddSymbol(Translator, Expression->VarExpr.Name, Type))
+            {
+                return 0;
+            }
+            if(IsParent)
+            {
+                fprintf(FileHandle, ";\n");
+            }
+        } break;
+        case EXPR_paren:
+        {
+            fprintf(FileHandle, "(");
+            if(!TranslateExpression(Translator, Expression->ParenExpr.InnerExpr, false))
+            {
+                return 0;
+            }
+            fprintf(FileHandle, ")");
+        } break;
+        case EXPR_binary:
+        {
+            type_spec LHSType;
+            type_spec RHSType;
+            if(IsStringComparison(Translator, Expression, &LHSType, &RHSType))
+            {
+                // Compares lengths first, contents only when they match.
+                Translator->RuntimeFlags |= RUNTIME_string;
+                fprintf(FileHandle, (Expression->BinaryExpr.Operator == TOKEN_noteq) ? "!DF_StringEquals(" : "DF_StringEquals(");
+                if(!TranslateValue(Translator, &LHSType, Expression->BinaryExpr.LHS, false))
+                {
+                    return 0;
+                }
+                fprintf(FileHandle, ", ");
+                if(!TranslateValue(Translator, &RHSType, Expression->BinaryExpr.RHS, false))
+                {
+                    return 0;
+                }
+                fprintf(FileHandle, IsParent ? ");\n" : ")");
+                break;
+            }
+
+            // Whole elements of #soa arrays are scattered to their fields.
+            expr* Target = SkipParens(Expression->BinaryExpr.LHS);
+            if(IsAssignmentOperator(Expression->BinaryExpr.Operator) && IsSoaElement(Translator, Target))
+            {
+                if(Expression->BinaryExpr.Operator != '=')
+                {
+                    fprintf(stderr, "Error: whole elements of #soa arrays can only be assigned with '='.\n");
+                    return 0;
+                }
+                if(!GetExpressionType(Translator, Target, &LHSType) || !TranslateSoaElement(Translator, Target, "DF_SoaStore_"))
+                {
+                    return 0;
+                }
+                fprintf(FileHandle, ", ");
+                if(!TranslateValue(Translator, &LHSType, Expression->BinaryExpr.RHS, false))
+                {
+                    return 0;
+                }
+                fprintf(FileHandle, IsParent ? ");\n" : ")");
+                break;
+            }
+
+            // Left-leaning chains such as A + B + C are walked down to their first operand, which is written first,
+            // then the operators and right operands are written on the way back up.
+            expr* Buffer[16];
+            work_stack Chain;
+            InitWorkStack(&Chain, Buffer, sizeof(Buffer), sizeof(expr*));
+            expr* Operand = Expression;
+            do
+            {
+                PushExpr(&Chain, Operand);
+                Operand = Operand->BinaryExpr.LHS;
+            } while(Operand && (Operand->ExprType == EXPR_binary) && !IsStringComparison(Translator, Operand, &LHSType, &RHSType));
+
+            // Shifts and masks bind looser than the operators around them, so they are parenthesized from the start.
+            for(uint32_t i = 0; i < Chain.Count; ++i)
+            {
+                if(GetDivisionShift(Translator, ((expr**)Chain.Elements)[i]) >= 0)
+                {
+                    fprintf(FileHandle, "(");
+                }
+            }
+
+            int32_t Result = TranslateExpression(Translator, Operand, false);
+            while(Result && Chain.Count)
+            {
+                expr* Binary = PopExpr(&Chain);
+                int32_t Operator = Binary->BinaryExpr.Operator;
+                int32_t Shift = GetDivisionShift(Translator, Binary);
+                if(Shift >= 0)
+                {
+                    if(Operator == '/')
+                    {
+                        fprintf(FileHandle, ">>%d)", Shift);
+                    }
+                    else
+                    {
+                        fprintf(FileHandle, "&%llu)", (unsigned long long)(Binary->BinaryExpr.RHS->IntExpr.IntValue - 1));
+                    }
+                    continue;
+                }
+                bool HasLHSType = (Operator == '=') && GetExpressionType(Translator, Binary->BinaryExpr.LHS, &LHSType);
+                if(HasLHSType && (LHSType.Type == TOKEN_arena))
+                {
+                    fprintf(stderr, "Error: arenas can't be assigned.\n");
+                    Result = 0;
+                }
+                else
+                {
+                    // Compound assignments only pass on the precision of the variable to the real literals of their value.
+                    int32_t RealLiteralType = Translator->RealLiteralType;
+                    if(IsAssignmentOperator(Operator) && (Operator != '=') && GetExpressionType(Translator, Binary->BinaryExpr.LHS, &LHSType) &&
+                       IsRealType(&LHSType))
+                    {
+                        Translator->RealLiteralType = (LHSType.Type != TOKEN_f64) ? TOKEN_float : TOKEN_f64;
+                    }
+                    Result = TranslateOperator(FileHandle, Operator) && TranslateValue(Translator, HasLHSType ? &LHSType : NULL, Binary->BinaryExpr.RHS, false);
+                    Translator->RealLiteralType = RealLiteralType;
+                }
+            }
+            FreeWorkStack(&Chain);
+            if(!Result)
+            {
+                return 0;
+            }
+            if(IsParent)
+            {
+                fprintf(FileHandle, ";\n");
+            }
+        } break;
+        case EXPR_unary:
+        {
+            type_spec OperandType;
+            int32_t Operator = Expression->UnaryExpr.Operator;
+            if(GetExpressionType(Translator, Expression->UnaryExpr.Operand, &OperandType) && !IsIntegerType(&OperandType) && !IsRealType(&OperandType))
+            {
+                fprintf(stderr, "Error: unary operators only apply to numbers.\n");
+                return 0;
+            }
+
+            // -2^63 is spelled without negating an unsigned literal, which compilers warn about.
+            if((Operator == '-') && !Expression->UnaryExpr.IsPostfix && IsInt64MinMagnitude(Expression->UnaryExpr.Operand))
+            {
+                fprintf(FileHandle, IsParent ? "(-9223372036854775807LL-1);\n" : "(-9223372036854775807LL-1)");
+                break;
+            }
+
+            // Prefix operators are parenthesized so that - -A doesn't come out as --A.
+            bool IsParenthesized = !Expression->UnaryExpr.IsPostfix && !IsParent;
+            if(IsParenthesized)
+            {
+                fprintf(FileHandle, "(");
+            }
+            if(!Expression->UnaryExpr.IsPostfix && !TranslateOperator(FileHandle, Operator))
+            {
+                return 0;
+            }
+            if(!TranslateExpression(Translator, Expression->UnaryExpr.Operand, false))
+            {
+                return 0;
+            }
+            if(Expression->UnaryExpr.IsPostfix && !TranslateOperator(FileHandle, Operator))
+            {
+                return 0;
+            }
+            if(IsParenthesized)
+            {
+                fprintf(FileHandle, ")");
+            }
+            if(IsParent)
+            {
+                fprintf(FileHandle, ";\n");
+            }
+        } break;
+        case EXPR_call:
+        {
+            function_signature* Signature = FindFunction(Translator, Expression->CallExpr.Name);
+            if(!Signature && IsParent)
+            {
+                int32_t PrintResult = TranslatePrint(Translator, Expression);
+                if(PrintResult == 0)
+                {
+                    return 0;
+                }
+                if(PrintResult > 0)
+                {
+                    break;
+                }
+            }
+            if(!Signature && IsIntrinsic(Expression->CallExpr.Name))
+            {
+                if(!TranslateIntrinsic(Translator, Expression))
+                {
+                    return 0;
+                }
+                if(IsParent)
+                {
+                    fprintf(FileHandle, ";\n");
+                }
+                break;
+            }
+
+            fprintf(FileHandle, "%s(", Expression->CallExpr.Name);
+            for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+            {
+                expr* Argument = Expression->CallExpr.Arguments[i];
+                type_spec ArgumentType;
+                if(Signature)
+                {
+                    type_spec* ParameterType = (i < Signature->ParameterCount) ? &Signature->ParameterTypes[i] : NULL;
+                    if(ParameterType && (ParameterType->Type == TOKEN_arena))
+                    {
+                        if(!TranslateArenaReference(Translator, Argument))
+                        {
+                            return 0;
+                        }
+                    }
+                    else if(!TranslateValue(Translator, ParameterType, Argument, false))
+                    {
+                        return 0;
+                    }
+                }
+                else if((Argument->ExprType == EXPR_string) && (strstr(Expression->CallExpr.Name, "printf") || strstr(Expression->CallExpr.Name, "scanf")))
+                {
+                    // Formats aren't pooled, so that the C compiler still checks them against the arguments.
+                    fprintf(FileHandle, "\"");
+                    TranslateString(FileHandle, Argument->StringExpr.String);
+                    fprintf(FileHandle, "\"");
+                }
+                else if((Argument->ExprType != EXPR_string) && GetExpressionType(Translator, Argument, &ArgumentType) && IsStringType(&ArgumentType))
+                {
+                    // C functions get a NUL-terminated char pointer.
+                    fprintf(FileHandle, "DF_StringCStr(");
+                    if(!TranslateExpression(Translator, Argument, false))
+                    {
+                        return 0;
+                    }
+                    fprintf(FileHandle, ")");
+                }
+                else if(!TranslateExpression(Translator, Argument, false))
+                {
+                    return 0;
+                }
+                if(i != Expression->CallExpr.ArgumentCount - 1)
+                {
+                    fprintf(FileHandle, ", ");
+                }
+            }
+            if(IsParent)
+            {
+                fprintf(FileHandle, ");\n");
+            }
+            else
+            {
+                fprintf(FileHandle, ")");
+            }
+        } break;
+        case EXPR_index:
+        {
+            if(!TranslateIndex(Translator, Expression, NULL))
+            {
+                return 0;
+            }
+            if(IsParent)
+            {
+                fprintf(FileHandle, ";\n");
+            }
+        } break;
+        case EXPR_field:
+        {
+            if(!TranslateField(Translator, Expression))
+            {
+                return 0;
+            }
+            if(IsParent)
+            {
+                fprintf(FileHandle, ";\n");
+            }
+        } break;
+        case EXPR_if:
+        case EXPR_for:
+        case EXPR_bench:
+        case EXPR_match:
+        {
+            if(!TranslateBlock(Translator, &Expression, 1))
+            {
+                return 0;
+            }
+        } break;
+        case EXPR_return:
+        {
+            int32_t TailResult = Translator->TailFunction ? TranslateTailReturn(Translator, Expression->ReturnExpr.Expression) : -1;
+            if(TailResult >= 0)
+            {
+                if(TailResult == 0)
+                {
+                    return 0;
+                }
+                break;
+            }
+            if(Translator->ArenaCount == 0)
+            {
+                fprintf(FileHandle, "return ");
+                if(!TranslateValue(Translator, &Translator->ReturnType, Expression->ReturnExpr.Expression, false))
+                {
+                    return 0;
+                }
+                fprintf(FileHandle, ";\n");
+                break;
+            }
+
+            // The value is computed before the arenas it may read from are released.
+            fprintf(FileHandle, "{\n");
+            if(!TranslateDeclaration(Translator, &Translator->ReturnType, "DF_Result"))
+            {
+                return 0;
+            }
+            fprintf(FileHandle, "=");
+            if(!TranslateValue(Translator, &Translator->ReturnType, Expression->ReturnExpr.Expression, true))
+            {
+                return 0;
+            }
+            fprintf(FileHandle, ";\n");
+            TranslateArenaReleases(Translator, 0);
+            fprintf(FileHandle, "return DF_Result;\n}\n");
+        } break;
+        case EXPR_inline:
+        {
+            TranslateInline(Translator, Expression->InlineExpr.Text);
+        } break;
+    }
+    return 1;
+}
+
+// ----------------------------------
+// Common subexpression elimination
+//
+// Within a block, a binary expression or len call with no side effects that is evaluated again while none of the
+// variables it reads can have changed is computed once, into a DF_Common temporary declared before the statement
+// using it first. Variables change through assignments, ++, -- and declarations, and for globals also through calls
+// to functions; inline C may change anything. Bodies of ifs and fors are blocks of their own, the headers of fors are
+// evaluated repeatedly and so are left alone, as are the right operands of && and ||, which may not be evaluated.
+//
+// The expressions of a statement are summarized bottom-up first, each node with its hash, whether it is pure and the
+// range of the names it reads, and earlier entries are found through a hash table. Every read of a name is indexed,
+// so that a write only makes the entries around the reads of its names unavailable, with the entries containing
+// them. Writes in nested blocks are met as statements of their own and reach the entries of every open block.
+//
+// The pass lowers the copy of the function Translate makes, the parsed one is left as written.
+
+#define MAX_TEMPORARY_COUNT 256
+
+enum temporary_kind
+{
+    TEMPORARY_common,    // DF_CommonN, see HoistCommonExpressions
+    TEMPORARY_induction, // DF_InductionN, see ReduceLoopStrength
+    TEMPORARY_kind_count,
+};
+
+// An expression of the statement being searched, summarized after its children. The nodes of a subtree are
+// contiguous and end with its root, and so are the reads of names in it, see common_pass::Names.
+struct common_node
+{
+    expr* Expression;
+    uint64_t Hash;
+    uint32_t Size;
+    uint32_t FirstName;
+    uint32_t NameCount;
+    bool IsPure;
+    bool ReadsGlobals;
+};
+
+struct common_node_visit
+{
+    expr* Expression;
+    uint32_t FirstNode;
+    uint32_t FirstName;
+    // Whether the children were pushed, the node being summarized on its second visit.
+    bool IsExpanded;
+};
+
+// A read of a variable or function name by the statements searched so far.
+struct common_name
+{
+    uint64_t Hash;
+    // Earlier read of the same name, or -1.
+    int32_t Previous;
+    // Innermost entry containing the read, or -1.
+    int32_t Common;
+};
+
+// The reads of a name, chained from the last one. Those up to LastWritten already made their entries unavailable.
+struct common_name_slot
+{
+    bool IsUsed;
+    uint64_t Hash;
+    int32_t Last;
+    int32_t LastWritten;
+};
+
+struct common_expr
+{
+    expr* Expression;
+    uint64_t Hash;
+    uint32_t Statement;
+    // Order in which the expressions are left by the walk, inner ones before those containing them.
+    uint32_t Finish;
+    // Entry containing this one, or -1. Whatever makes an entry unavailable also does so to the entries containing it.
+    int32_t Parent;
+    // Earlier entry of the same hash bucket, or -1.
+    int32_t NextInBucket;
+    // Last use, the earlier ones being chained by common_use::Previous, or -1.
+    int32_t LastUse;
+    uint32_t UseCount;
+    bool IsAvailable;
+    bool HasType;
+    bool ReadsGlobals;
+    type_spec Type;
+};
+
+struct common_use
+{
+    int32_t Previous;
+    expr* Expression;
+};
+
+struct common_visit
+{
+    uint32_t Node;
+    // Entry containing the node, or -1.
+    int32_t Parent;
+    // Entry left when the visit finishes, or -1 when the visit starts.
+    int32_t FinishedCommon;
+};
+
+struct common_block
+{
+    statement_list List;
+    uint32_t Next;
+    uint32_t SymbolCount;
+    uint32_t FirstCommon;
+    uint32_t FirstUse;
+    uint32_t FirstName;
+};
+
+struct common_pass
+{
+    translator* Translator;
+    uint32_t FirstLocalSymbol;
+    uint32_t NextNames[TEMPORARY_kind_count];
+    uint32_t FinishCount;
+    bool IsLenPure;
+    // Entries before FirstAvailable are unavailable since inline C ran, the ones reading globals before
+    // FirstAvailableGlobalReader since a function was called.
+    uint32_t FirstAvailable;
+    uint32_t FirstAvailableGlobalReader;
+    work_stack Commons;
+    work_stack Uses;
+    work_stack Nodes;
+    // Reads of names by the statements of the open blocks, in order, indexed by name in NameSlots.
+    work_stack Names;
+    uint32_t NameSlotCount;
+    uint32_t NameSlotCapacity;
+    common_name_slot* NameSlots;
+    // Last entry of every hash bucket.
+    uint32_t BucketCount;
+    int32_t* Buckets;
+};
+
+static char* GetTemporaryName(temporary_kind Kind, uint32_t Index)
+{
+    static const char* Prefixes[TEMPORARY_kind_count] = {"DF_Common", "DF_Induction"};
+    static char Names[TEMPORARY_kind_count][MAX_TEMPORARY_COUNT][24];
+    if(!Names[Kind][Index][0])
+    {
+        snprintf(Names[Kind][Index], sizeof(Names[Kind][Index]), "%s%u", Prefixes[Kind], Index);
+    }
+    return Names[Kind][Index];
+}
+
+// New temporaries are numbered after the ones the function already mentions, e.g. in inline C. FunctionNames is
+// sorted.
+static uint32_t GetFirstFreeTemporary(name_set* FunctionNames, temporary_kind Kind)
+{
+    uint32_t Result = 0;
+    for(uint32_t i = 0; (i < MAX_TEMPORARY_COUNT) && FunctionNames->Count; ++i)
+    {
+        char* Name = GetTemporaryName(Kind, i);
+        uint64_t Hash = HashBytes(Name, (uint32_t)strlen(Name));
+        if(bsearch(&Hash, FunctionNames->Hashes, FunctionNames->Count, sizeof(uint64_t), CompareHashes))
+        {
+            Result = i + 1;
+        }
+    }
+    return Result;
+}
+
+// Compares two pure expressions, see IsPureExpression, ignoring parentheses.
+static bool IsSameExpression(expr* A, expr* B)
+{
+    expr* Buffer[16];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, A);
+    PushExpr(&Pending, B);
+
+    bool Result = true;
+    while(Result && Pending.Count)
+    {
+        B = SkipParens(PopExpr(&Pending));
+        A = SkipParens(PopExpr(&Pending));
+        if(!A || !B)
+        {
+            Result = (A == B);
+            continue;
+        }
+        if(A->ExprType != B->ExprType)
+        {
+            Result = false;
+            continue;
+        }
+
+        switch(A->ExprType)
+        {
+            default:
+            {
+                Result = false;
+            } break;
+            case EXPR_char:
+            {
+                Result = (A->CharExpr.CharValue == B->CharExpr.CharValue);
+            } break;
+            case EXPR_int:
+            {
+                Result = (A->IntExpr.IntValue == B->IntExpr.IntValue);
+            } break;
+            case EXPR_real:
+            {
+                Result = (memcmp(&A->RealExpr.RealValue, &B->RealExpr.RealValue, sizeof(double)) == 0);
+            } break;
+            case EXPR_string:
+            {
+                Result = (strcmp(A->StringExpr.String, B->StringExpr.String) == 0);
+            } break;
+            case EXPR_id:
+            {
+                Result = (strcmp(A->IdExpr.String, B->IdExpr.String) == 0);
+            } break;
+            case EXPR_binary:
+            {
+                Result = (A->BinaryExpr.Operator == B->BinaryExpr.Operator);
+                PushExpr(&Pending, A->BinaryExpr.LHS);
+                PushExpr(&Pending, B->BinaryExpr.LHS);
+                PushExpr(&Pending, A->BinaryExpr.RHS);
+                PushExpr(&Pending, B->BinaryExpr.RHS);
+            } break;
+            case EXPR_unary:
+            {
+                Result = (A->UnaryExpr.Operator == B->UnaryExpr.Operator) && (A->UnaryExpr.IsPostfix == B->UnaryExpr.IsPostfix);
+                PushExpr(&Pending, A->UnaryExpr.Operand);
+                PushExpr(&Pending, B->UnaryExpr.Operand);
+            } break;
+            case EXPR_field:
+            {
+                Result = (strcmp(A->FieldExpr.Field, B->FieldExpr.Field) == 0);
+                PushExpr(&Pending, A->FieldExpr.Object);
+                PushExpr(&Pending, B->FieldExpr.Object);
+            } break;
+            case EXPR_call:
+            {
+                Result = (strcmp(A->CallExpr.Name, B->CallExpr.Name) == 0) && (A->CallExpr.ArgumentCount == B->CallExpr.ArgumentCount);
+                for(uint32_t i = 0; Result && (i < A->CallExpr.ArgumentCount); ++i)
+                {
+                    PushExpr(&Pending, A->CallExpr.Arguments[i]);
+                    PushExpr(&Pending, B->CallExpr.Arguments[i]);
+                }
+            } break;
+        }
+    }
+    FreeWorkStack(&Pending);
+    return Result;
+}
+
+// Adds the names of the variables the statement may write, and tells whether it calls functions, including ones
+// named like intrinsics, or runs inline C. The statements of its blocks are left out, they are met on their own.
+static void AddWrittenNames(translator* Translator, name_set* Names, expr* Statement, bool* HasCall, bool* HasInline)
+{
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Statement);
+
+    while(Pending.Count)
+    {
+        expr* Expression = PopExpr(&Pending);
+        if(!Expression)
+        {
+            continue;
+        }
+
+        expr* Target = GetWrittenVariable(Expression);
+        if(Target)
+        {
+            AddName(Names, Target->IdExpr.String, (uint32_t)strlen(Target->IdExpr.String));
+        }
+
+        switch(Expression->ExprType)
+        {
+            default:
+            {
+            } break;
+            case EXPR_var:
+            {
+                AddName(Names, Expression->VarExpr.Name, (uint32_t)strlen(Expression->VarExpr.Name));
+                PushExpr(&Pending, Expression->VarExpr.Expr);
+            } break;
+            case EXPR_inline:
+            {
+                *HasInline = true;
+            } break;
+            case EXPR_paren:
+            {
+                PushExpr(&Pending, Expression->ParenExpr.InnerExpr);
+            } break;
+            case EXPR_binary:
+            {
+                PushExpr(&Pending, Expression->BinaryExpr.LHS);
+                PushExpr(&Pending, Expression->BinaryExpr.RHS);
+            } break;
+            case EXPR_unary:
+            {
+                PushExpr(&Pending, Expression->UnaryExpr.Operand);
+            } break;
+            case EXPR_call:
+            {
+                *HasCall = *HasCall || !IsIntrinsic(Expression->CallExpr.Name) || FindFunction(Translator, Expression->CallExpr.Name);
+                for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+                {
+                    PushExpr(&Pending, Expression->CallExpr.Arguments[i]);
+                }
+            } break;
+            case EXPR_index:
+            {
+                PushExpr(&Pending, Expression->IndexExpr.Array);
+                PushExpr(&Pending, Expression->IndexExpr.Index);
+            } break;
+            case EXPR_field:
+            {
+                PushExpr(&Pending, Expression->FieldExpr.Object);
+            } break;
+            case EXPR_if:
+            {
+                PushExpr(&Pending, Expression->IfExpr.Statement);
+            } break;
+            case EXPR_for:
+            {
+                PushExpr(&Pending, Expression->ForExpr.Definition);
+                PushExpr(&Pending, Expression->ForExpr.Condition);
+                PushExpr(&Pending, Expression->ForExpr.Action);
+            } break;
+            case EXPR_match:
+            {
+                PushExpr(&Pending, Expression->MatchExpr.Value);
+            } break;
+            case EXPR_return:
+            {
+                PushExpr(&Pending, Expression->ReturnExpr.Expression);
+            } break;
+        }
+    }
+    FreeWorkStack(&Pending);
+}
+
+static common_expr* GetCommon(common_pass* Pass, uint32_t Index)
+{
+    return (common_expr*)Pass->Commons.Elements + Index;
+}
+
+static common_node* GetCommonNode(common_pass* Pass, uint32_t Index)
+{
+    return (common_node*)Pass->Nodes.Elements + Index;
+}
+
+static common_name* GetCommonName(common_pass* Pass, uint32_t Index)
+{
+    return (common_name*)Pass->Names.Elements + Index;
+}
+
+static common_use* GetCommonUse(common_pass* Pass, uint32_t Index)
+{
+    return (common_use*)Pass->Uses.Elements + Index;
+}
+
+static uint64_t MixHash(uint64_t Hash, uint64_t Value)
+{
+    return (Hash ^ Value) * 1099511628211ULL;
+}
+
+// Index into a power of two table, the high bits folded in as the low ones of the hashes mix less.
+static uint32_t GetHashSlot(uint64_t Hash, uint32_t Capacity)
+{
+    return (uint32_t)(Hash ^ (Hash >> 32)) & (Capacity - 1);
+}
+
+// Finds the reads of a name, adding the name when it wasn't read yet.
+static common_name_slot* GetCommonNameSlot(common_pass* Pass, uint64_t Hash)
+{
+    if(2 * (Pass->NameSlotCount + 1) > Pass->NameSlotCapacity)
+    {
+        uint32_t Capacity = Pass->NameSlotCapacity ? (2 * Pass->NameSlotCapacity) : 64;
+        common_name_slot* Slots = (common_name_slot*)Allocate(MEMORY_scratch, sizeof(common_name_slot) * Capacity);
+        memset(Slots, 0, sizeof(common_name_slot) * Capacity);
+        for(uint32_t i = 0; i < Pass->NameSlotCapacity; ++i)
+        {
+            common_name_slot* Slot = &Pass->NameSlots[i];
+            uint32_t Index = GetHashSlot(Slot->Hash, Capacity);
+            while(Slot->IsUsed && Slots[Index].IsUsed)
+            {
+                Index = (Index + 1) & (Capacity - 1);
+            }
+            if(Slot->IsUsed)
+            {
+                Slots[Index] = *Slot;
+            }
+        }
+        Deallocate(Pass->NameSlots);
+        Pass->NameSlots = Slots;
+        Pass->NameSlotCapacity = Capacity;
+    }
+
+    uint32_t Index = GetHashSlot(Hash, Pass->NameSlotCapacity);
+    while(Pass->NameSlots[Index].IsUsed && (Pass->NameSlots[Index].Hash != Hash))
+    {
+        Index = (Index + 1) & (Pass->NameSlotCapacity - 1);
+    }
+    common_name_slot* Slot = &Pass->NameSlots[Index];
+    if(!Slot->IsUsed)
+    {
+        Slot->IsUsed = true;
+        Slot->Hash = Hash;
+        Slot->Last = -1;
+        Slot->LastWritten = -1;
+        ++Pass->NameSlotCount;
+    }
+    return Slot;
+}
+
+static void AddCommonName(common_pass* Pass, char* Name)
+{
+    uint64_t Hash = HashBytes(Name, (uint32_t)strlen(Name));
+    common_name_slot* Slot = GetCommonNameSlot(Pass, Hash);
+    common_name* Read = (common_name*)PushWork(&Pass->Names);
+    Read->Hash = Hash;
+    Read->Previous = Slot->Last;
+    Read->Common = -1;
+    Slot->Last = (int32_t)Pass->Names.Count - 1;
+}
+
+// Records the innermost entry containing the reads of names from FirstName on.
+static void SetNameCommon(common_pass* Pass, uint32_t FirstName, uint32_t NameCount, int32_t Common)
+{
+    for(uint32_t i = 0; i < NameCount; ++i)
+    {
+        GetCommonName(Pass, FirstName + i)->Common = Common;
+    }
+}
+
+// The expressions evaluated along with this one, in order.
+static uint32_t GetCommonChildren(expr* Expression, expr** Children)
+{
+    uint32_t ChildCount = 0;
+    switch(Expression->ExprType)
+    {
+        default:
+        {
+        } break;
+        case EXPR_var:
+        {
+            Children[ChildCount++] = Expression->VarExpr.Expr;
+        } break;
+        case EXPR_paren:
+        {
+            Children[ChildCount++] = Expression->ParenExpr.InnerExpr;
+        } break;
+        case EXPR_binary:
+        {
+            Children[ChildCount++] = Expression->BinaryExpr.LHS;
+            Children[ChildCount++] = Expression->BinaryExpr.RHS;
+        } break;
+        case EXPR_unary:
+        {
+            Children[ChildCount++] = Expression->UnaryExpr.Operand;
+        } break;
+        case EXPR_call:
+        {
+            for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+            {
+                Children[ChildCount++] = Expression->CallExpr.Arguments[i];
+            }
+        } break;
+        case EXPR_index:
+        {
+            Children[ChildCount++] = Expression->IndexExpr.Array;
+            Children[ChildCount++] = Expression->IndexExpr.Index;
+        } break;
+        case EXPR_field:
+        {
+            Children[ChildCount++] = Expression->FieldExpr.Object;
+        } break;
+        case EXPR_return:
+        {
+            Children[ChildCount++] = Expression->ReturnExpr.Expression;
+        } break;
+    }
+    return ChildCount;
+}
+
+// Summarizes the expression and the ones below it into Pass->Nodes, each after its children, adding the names they
+// read to Pass->Names. Purity follows IsPureExpression, and the hash ignores parentheses like IsSameExpression.
+static void SummarizeCommonNodes(common_pass* Pass, expr* Expression)
+{
+    translator* Translator = Pass->Translator;
+    Pass->Nodes.Count = 0;
+    common_node_visit Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(common_node_visit));
+    common_node_visit* First = (common_node_visit*)PushWork(&Pending);
+    First->Expression = Expression;
+    First->IsExpanded = false;
+
+    while(Pending.Count)
+    {
+        common_node_visit Visit = *(common_node_visit*)PeekWork(&Pending);
+        PopWork(&Pending);
+        Expression = Visit.Expression;
+        if(!Expression)
+        {
+            continue;
+        }
+
+        if(!Visit.IsExpanded)
+        {
+            common_node_visit* Expanded = (common_node_visit*)PushWork(&Pending);
+            Expanded->Expression = Expression;
+            Expanded->FirstNode = Pass->Nodes.Count;
+            Expanded->FirstName = Pass->Names.Count;
+            Expanded->IsExpanded = true;
+            if(Expression->ExprType == EXPR_id)
+            {
+                AddCommonName(Pass, Expression->IdExpr.String);
+            }
+            else if(Expression->ExprType == EXPR_call)
+            {
+                AddCommonName(Pass, Expression->CallExpr.Name);
+            }
+
+            // Pushed backwards so that they are summarized left to right.
+            expr* Children[MAX_PARAMETER_COUNT + 1];
+            for(uint32_t i = GetCommonChildren(Expression, Children); i > 0; --i)
+            {
+                common_node_visit* Child = (common_node_visit*)PushWork(&Pending);
+                Child->Expression = Children[i - 1];
+                Child->IsExpanded = false;
+            }
+            continue;
+        }
+
+        uint64_t Value = 0;
+        bool IsPure = true;
+        bool ReadsGlobals = false;
+        switch(Expression->ExprType)
+        {
+            default:
+            {
+                IsPure = false;
+            } break;
+            case EXPR_paren:
+            {
+            } break;
+            case EXPR_char:
+            {
+                Value = (uint8_t)Expression->CharExpr.CharValue;
+            } break;
+            case EXPR_int:
+            {
+                Value = Expression->IntExpr.IntValue;
+            } break;
+            case EXPR_real:
+            {
+                memcpy(&Value, &Expression->RealExpr.RealValue, sizeof(Value));
+            } break;
+            case EXPR_string:
+            {
+                Value = HashBytes(Expression->StringExpr.String, (uint32_t)strlen(Expression->StringExpr.String));
+            } break;
+            case EXPR_id:
+            {
+                // Variables of inline C aren't symbols and count as globals.
+                Value = GetCommonName(Pass, Visit.FirstName)->Hash;
+                symbol* Symbol = FindSymbol(Translator, Expression->IdExpr.String);
+                ReadsGlobals = !Symbol || ((uint32_t)(Symbol - Translator->Symbols) < Pass->FirstLocalSymbol);
+            } break;
+            case EXPR_binary:
+            {
+                Value = (uint64_t)Expression->BinaryExpr.Operator;
+                IsPure = !IsAssignmentOperator(Expression->BinaryExpr.Operator);
+            } break;
+            case EXPR_unary:
+            {
+                int32_t Operator = Expression->UnaryExpr.Operator;
+                Value = 2 * (uint64_t)Operator + Expression->UnaryExpr.IsPostfix;
+                IsPure = (Operator != TOKEN_plusplus) && (Operator != TOKEN_minusminus);
+            } break;
+            case EXPR_field:
+            {
+                Value = HashBytes(Expression->FieldExpr.Field, (uint32_t)strlen(Expression->FieldExpr.Field));
+            } break;
+            case EXPR_call:
+            {
+                Value = GetCommonName(Pass, Visit.FirstName)->Hash + Expression->CallExpr.ArgumentCount;
+                IsPure = Pass->IsLenPure && IsLenCall(Expression);
+            } break;
+        }
+
+        // The children are met from the last one, stepping over their subtrees.
+        bool IsParen = (Expression->ExprType == EXPR_paren);
+        uint64_t Hash = MixHash(MixHash(14695981039346656037ULL, (uint64_t)Expression->ExprType + 1), Value);
+        for(uint32_t Child = Pass->Nodes.Count; Child > Visit.FirstNode; Child -= GetCommonNode(Pass, Child - 1)->Size)
+        {
+            common_node* ChildNode = GetCommonNode(Pass, Child - 1);
+            Hash = IsParen ? ChildNode->Hash : MixHash(Hash, ChildNode->Hash);
+            IsPure = IsPure && ChildNode->IsPure;
+            ReadsGlobals = ReadsGlobals || ChildNode->ReadsGlobals;
+        }
+
+        common_node* Node = (common_node*)PushWork(&Pass->Nodes);
+        Node->Expression = Expression;
+        Node->Hash = Hash;
+        Node->Size = Pass->Nodes.Count - Visit.FirstNode;
+        Node->FirstName = Visit.FirstName;
+        Node->NameCount = Pass->Names.Count - Visit.FirstName;
+        Node->IsPure = IsPure;
+        Node->ReadsGlobals = ReadsGlobals;
+    }
+    FreeWorkStack(&Pending);
+}
+
+// Binary expressions and len calls without side effects that read at least one variable, the others are constants
+// the C compiler folds anyway.
+static bool IsCommonCandidate(common_node* Node)
+{
+    expr_type Type = Node->Expression->ExprType;
+    return ((Type == EXPR_binary) || (Type == EXPR_call)) && Node->IsPure && (Node->NameCount > (uint32_t)(Type == EXPR_call));
+}
+
+static bool IsCommonAvailable(common_pass* Pass, uint32_t Index)
+{
+    common_expr* Common = GetCommon(Pass, Index);
+    return Common->IsAvailable && (Index >= Pass->FirstAvailable) && (!Common->ReadsGlobals || (Index >= Pass->FirstAvailableGlobalReader));
+}
+
+static void InsertCommonBucket(common_pass* Pass, uint32_t Index)
+{
+    common_expr* Common = GetCommon(Pass, Index);
+    int32_t* Bucket = &Pass->Buckets[GetHashSlot(Common->Hash, Pass->BucketCount)];
+    Common->NextInBucket = *Bucket;
+    *Bucket = (int32_t)Index;
+}
+
+// Rebuilds the hash table, every bucket chaining its entries from the last.
+static void ResizeCommonBuckets(common_pass* Pass, uint32_t BucketCount)
+{
+    Deallocate(Pass->Buckets);
+    Pass->BucketCount = BucketCount;
+    Pass->Buckets = (int32_t*)Allocate(MEMORY_scratch, sizeof(int32_t) * BucketCount);
+    memset(Pass->Buckets, 0xff, sizeof(int32_t) * BucketCount);
+    for(uint32_t i = 0; i < Pass->Commons.Count; ++i)
+    {
+        InsertCommonBucket(Pass, i);
+    }
+}
+
+// Creates the entry of an expression met for the first time.
+static uint32_t AddCommon(common_pass* Pass, common_node* Node, int32_t Parent, uint32_t Statement)
+{
+    if(Pass->Commons.Count >= 2 * Pass->BucketCount)
+    {
+        ResizeCommonBuckets(Pass, 2 * Pass->BucketCount);
+    }
+    common_expr* Common = (common_expr*)PushWork(&Pass->Commons);
+    memset(Common, 0, sizeof(*Common));
+    Common->Expression = Node->Expression;
+    Common->Hash = Node->Hash;
+    Common->Statement = Statement;
+    Common->Parent = Parent;
+    Common->LastUse = -1;
+    Common->IsAvailable = true;
+    Common->ReadsGlobals = Node->ReadsGlobals;
+    InsertCommonBucket(Pass, Pass->Commons.Count - 1);
+    return Pass->Commons.Count - 1;
+}
+
+static void AddCommonUse(common_pass* Pass, uint32_t Index, expr* Expression)
+{
+    common_expr* Common = GetCommon(Pass, Index);
+    common_use* Use = (common_use*)PushWork(&Pass->Uses);
+    Use->Previous = Common->LastUse;
+    Use->Expression = Expression;
+    Common->LastUse = (int32_t)Pass->Uses.Count - 1;
+
+    // Typed at its first use, with the symbols in scope at its own statement: declaring a name it reads since would
+    // have made it unavailable.
+    if(!Common->UseCount++)
+    {
+        translator* Translator = Pass->Translator;
+        Common->HasType = GetExpressionType(Translator, Common->Expression, &Common->Type) && (IsIntegerType(&Common->Type) || IsRealType(&Common->Type));
+    }
+}
+
+// Walks the parts of a statement evaluated once each time the statement runs, matching its candidates against the
+// expressions still available in the block. A match isn't walked further, its parts are covered by the match.
+static void FindCommonExpressions(common_pass* Pass, common_block* Block, expr* Statement)
+{
+    expr* Root = Statement;
+    if(Statement->ExprType == EXPR_if)
+    {
+        Root = Statement->IfExpr.Statement;
+    }
+    else if(Statement->ExprType == EXPR_match)
+    {
+        Root = Statement->MatchExpr.Value;
+    }
+    else if(Statement->ExprType == EXPR_for)
+    {
+        Root = NULL;
+    }
+    SummarizeCommonNodes(Pass, Root);
+
+    common_visit Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(common_visit));
+    if(Pass->Nodes.Count)
+    {
+        common_visit* Visit = (common_visit*)PushWork(&Pending);
+        Visit->Node = Pass->Nodes.Count - 1;
+        Visit->Parent = -1;
+        Visit->FinishedCommon = -1;
+    }
+
+    while(Pending.Count)
+    {
+        common_visit Visit = *(common_visit*)PeekWork(&Pending);
+        PopWork(&Pending);
+        if(Visit.FinishedCommon >= 0)
+        {
+            GetCommon(Pass, (uint32_t)Visit.FinishedCommon)->Finish = Pass->FinishCount++;
+            continue;
+        }
+
+        common_node* Node = GetCommonNode(Pass, Visit.Node);
+        expr* Expression = Node->Expression;
+        int32_t Parent = Visit.Parent;
+        if(IsCommonCandidate(Node))
+        {
+            int32_t Match = -1;
+            for(int32_t i = Pass->Buckets[GetHashSlot(Node->Hash, Pass->BucketCount)]; (Match < 0) && (i >= (int32_t)Block->FirstCommon);
+                i = GetCommon(Pass, (uint32_t)i)->NextInBucket)
+            {
+                common_expr* Common = GetCommon(Pass, (uint32_t)i);
+                if(IsCommonAvailable(Pass, (uint32_t)i) && (Common->Hash == Node->Hash) && IsSameExpression(Common->Expression, Expression))
+                {
+                    Match = i;
+                }
+            }
+            if(Match >= 0)
+            {
+                AddCommonUse(Pass, (uint32_t)Match, Expression);
+                SetNameCommon(Pass, Node->FirstName, Node->NameCount, Parent);
+                continue;
+            }
+
+            Parent = (int32_t)AddCommon(Pass, Node, Visit.Parent, Block->Next);
+            common_visit* Finish = (common_visit*)PushWork(&Pending);
+            Finish->Node = Visit.Node;
+            Finish->Parent = Visit.Parent;
+            Finish->FinishedCommon = Parent;
+        }
+
+        // The variable or function a node names is its first read.
+        if((Expression->ExprType == EXPR_id) || (Expression->ExprType == EXPR_call))
+        {
+            SetNameCommon(Pass, Node->FirstName, 1, Parent);
+        }
+
+        // The children are met from the last one, and so pushed to be visited left to right. The right operand of &&
+        // and || isn't walked, its reads only count for the entries containing it.
+        bool IsShortCircuit = (Expression->ExprType == EXPR_binary) &&
+                              ((Expression->BinaryExpr.Operator == TOKEN_andand) || (Expression->BinaryExpr.Operator == TOKEN_oror));
+        for(uint32_t Child = Visit.Node; Child > Visit.Node + 1 - Node->Size; Child -= GetCommonNode(Pass, Child - 1)->Size)
+        {
+            common_node* ChildNode = GetCommonNode(Pass, Child - 1);
+            if(IsShortCircuit && (Child == Visit.Node))
+            {
+                SetNameCommon(Pass, ChildNode->FirstName, ChildNode->NameCount, Parent);
+                continue;
+            }
+            common_visit* ChildVisit = (common_visit*)PushWork(&Pending);
+            ChildVisit->Node = Child - 1;
+            ChildVisit->Parent = Parent;
+            ChildVisit->FinishedCommon = -1;
+        }
+    }
+    FreeWorkStack(&Pending);
+}
+
+// After a statement ran, the expressions reading what it may have written are no longer available, in any open block.
+static void InvalidateCommonExpressions(common_pass* Pass, expr* Statement)
+{
+    name_set Written = {};
+    bool HasCall = false;
+    bool HasInline = false;
+    AddWrittenNames(Pass->Translator, &Written, Statement, &HasCall, &HasInline);
+    if(HasInline)
+    {
+        Pass->FirstAvailable = Pass->Commons.Count;
+    }
+    if(HasCall)
+    {
+        Pass->FirstAvailableGlobalReader = Pass->Commons.Count;
+    }
+
+    // Reads up to LastWritten were met by an earlier write, their entries stay unavailable.
+    for(uint32_t i = 0; i < Written.Count; ++i)
+    {
+        common_name_slot* Slot = GetCommonNameSlot(Pass, Written.Hashes[i]);
+        for(int32_t Read = Slot->Last; Read != Slot->LastWritten; Read = GetCommonName(Pass, (uint32_t)Read)->Previous)
+        {
+            int32_t Index = GetCommonName(Pass, (uint32_t)Read)->Common;
+            while((Index >= 0) && IsCommonAvailable(Pass, (uint32_t)Index))
+            {
+                GetCommon(Pass, (uint32_t)Index)->IsAvailable = false;
+                Index = GetCommon(Pass, (uint32_t)Index)->Parent;
+            }
+        }
+        Slot->LastWritten = Slot->Last;
+    }
+    Deallocate(Written.Hashes);
+}
+
+static int CompareCommonFinish(const void* A, const void* B)
+{
+    const common_expr* CommonA = *(const common_expr* const*)A;
+    const common_expr* CommonB = *(const common_expr* const*)B;
+    if(CommonA->Statement != CommonB->Statement)
+    {
+        return (CommonA->Statement < CommonB->Statement) ? -1 : 1;
+    }
+    return (CommonA->Finish < CommonB->Finish) ? -1 : (CommonA->Finish > CommonB->Finish);
+}
+
+// Declares a temporary for every expression of the block met more than once, in statement order and with inner
+// expressions first, so that each temporary only uses those declared before it.
+static void HoistCommonExpressions(common_pass* Pass, common_block* Block)
+{
+    uint32_t CommonCount = Pass->Commons.Count - Block->FirstCommon;
+    common_expr** Commons = (common_expr**)Allocate(MEMORY_scratch, sizeof(common_expr*) * (CommonCount + 1));
+    uint32_t HoistCount = 0;
+    for(uint32_t i = Block->FirstCommon; i < Pass->Commons.Count; ++i)
+    {
+        common_expr* Common = GetCommon(Pass, i);
+        if(Common->UseCount && Common->HasType)
+        {
+            Commons[HoistCount++] = Common;
+        }
+    }
+    qsort(Commons, HoistCount, sizeof(common_expr*), CompareCommonFinish);
+
+    statement_list List = Block->List;
+    uint32_t Inserted = 0;
+    for(uint32_t i = 0; (i < HoistCount) && (*List.Count < MAX_EXPRESSION_COUNT) && (Pass->NextNames[TEMPORARY_common] < MAX_TEMPORARY_COUNT); ++i)
+    {
+        common_expr* Common = Commons[i];
+        char* Name = GetTemporaryName(TEMPORARY_common, Pass->NextNames[TEMPORARY_common]++);
+
+        expr* Value = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+        *Value = *Common->Expression;
+        Common->Expression->ExprType = EXPR_id;
+        Common->Expression->IdExpr.String = Name;
+
+        expr* Definition = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+        memset(Definition, 0, sizeof(*Definition));
+        Definition->ExprType = EXPR_var;
+        Definition->VarExpr.Type = Common->Type;
+        Definition->VarExpr.Name = Name;
+        Definition->VarExpr.Expr = Value;
+        uint32_t Position = Common->Statement + Inserted++;
+        memmove(List.Statements + Position + 1, List.Statements + Position, sizeof(expr*) * (*List.Count - Position));
+        List.Statements[Position] = Definition;
+        ++*List.Count;
+
+        for(int32_t UseIndex = Common->LastUse; UseIndex >= 0; UseIndex = GetCommonUse(Pass, (uint32_t)UseIndex)->Previous)
+        {
+            common_use* Use = GetCommonUse(Pass, (uint32_t)UseIndex);
+            expr* Replaced = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+            *Replaced = *Use->Expression;
+            Use->Expression->ExprType = EXPR_id;
+            Use->Expression->IdExpr.String = Name;
+            FreeExpression(Replaced);
+        }
+    }
+    Deallocate(Commons);
+}
+
+static void OpenCommonBlock(common_pass* Pass, work_stack* Blocks, expr** Statements, uint32_t* Count)
+{
+    common_block* Block = (common_block*)PushWork(Blocks);
+    Block->List.Statements = Statements;
+    Block->List.Count = Count;
+    Block->Next = 0;
+    Block->SymbolCount = Pass->Translator->SymbolCount;
+    Block->FirstCommon = Pass->Commons.Count;
+    Block->FirstUse = Pass->Uses.Count;
+    Block->FirstName = Pass->Names.Count;
+}
+
+// Hoists the temporaries of the block, then forgets its entries and the reads of its statements. Both were added
+// last, so every one removed is the last of its hash bucket or of the reads of its name.
+static void CloseCommonBlock(common_pass* Pass, common_block* Block)
+{
+    HoistCommonExpressions(Pass, Block);
+    for(uint32_t i = Pass->Commons.Count; i > Block->FirstCommon; --i)
+    {
+        common_expr* Common = GetCommon(Pass, i - 1);
+        Pass->Buckets[GetHashSlot(Common->Hash, Pass->BucketCount)] = Common->NextInBucket;
+    }
+    for(uint32_t i = Pass->Names.Count; i > Block->FirstName; --i)
+    {
+        common_name* Read = GetCommonName(Pass, i - 1);
+        common_name_slot* Slot = GetCommonNameSlot(Pass, Read->Hash);
+        Slot->Last = Read->Previous;
+        if(Slot->LastWritten == (int32_t)(i - 1))
+        {
+            Slot->LastWritten = Read->Previous;
+        }
+    }
+
+    Pass->Commons.Count = Block->FirstCommon;
+    Pass->Uses.Count = Block->FirstUse;
+    Pass->Names.Count = Block->FirstName;
+    Pass->FirstAvailable = (Pass->FirstAvailable < Block->FirstCommon) ? Pass->FirstAvailable : Block->FirstCommon;
+    Pass->FirstAvailableGlobalReader =
+        (Pass->FirstAvailableGlobalReader < Block->FirstCommon) ? Pass->FirstAvailableGlobalReader : Block->FirstCommon;
+}
+
+// ----------------------------------
+// Induction variables
+//
+// In a loop stepping its variable i by a literal, a product i * S whose factor S is the same in every iteration grows
+// by Step * S each time round. Such products read a DF_Induction variable instead, set to Start * S before the loop and
+// advanced at the end of its body, which the loop can't leave early from. Body variables only copying it are replaced
+// by it.
+
+static expr* MakeExpr(expr_type Type)
+{
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    memset(Result, 0, sizeof(*Result));
+    Result->ExprType = Type;
+    return Result;
+}
+
+static expr* MakeIdExpr(char* Name)
+{
+    expr* Result = MakeExpr(EXPR_id);
+    Result->IdExpr.String = Name;
+    return Result;
+}
+
+static expr* MakeIntExpr(uint64_t Value)
+{
+    expr* Result = MakeExpr(EXPR_int);
+    Result->IntExpr.IntValue = Value;
+    return Result;
+}
+
+static expr* MakeBinaryExpr(int32_t Operator, expr* LHS, expr* RHS)
+{
+    expr* Result = MakeExpr(EXPR_binary);
+    Result->BinaryExpr.Operator = Operator;
+    Result->BinaryExpr.LHS = LHS;
+    Result->BinaryExpr.RHS = RHS;
+    return Result;
+}
+
+// Literals, and local integer variables that nothing in the loop changes. Globals are left out, as calls can change
+// them.
+static bool IsLoopInvariantFactor(translator* Translator, expr* Loop, expr* Factor, uint32_t FirstLocalSymbol, type_spec* Type)
+{
+    if(IsSmallIntLiteral(Factor))
+    {
+        *Type = MakeType(GetIntegerLiteralType(Factor->IntExpr.IntValue));
+        return true;
+    }
+    if(Factor->ExprType != EXPR_id)
+    {
+        return false;
+    }
+
+    char* Name = Factor->IdExpr.String;
+    symbol* Symbol = FindSymbol(Translator, Name);
+    if(!Symbol || ((uint32_t)(Symbol - Translator->Symbols) < FirstLocalSymbol) || Symbol->IsReference || !IsIntegerType(&Symbol->Type) ||
+       AssignsVariable(Loop->ForExpr.Definition, Name) || (Loop->ForExpr.Condition && AssignsVariable(Loop->ForExpr.Condition, Name)) ||
+       AssignsVariable(Loop->ForExpr.Action, Name))
+    {
+        return false;
+    }
+    for(uint32_t i = 0; i < Loop->ForExpr.ExpressionCount; ++i)
+    {
+        if(AssignsVariable(Loop->ForExpr.Expressions[i], Name))
+        {
+            return false;
+        }
+    }
+    *Type = Symbol->Type;
+    return true;
+}
+
+// The factor of i in a product i * F or F * i, or NULL.
+static expr* GetInductionFactor(expr* Expression, char* IndexName)
+{
+    if((Expression->ExprType != EXPR_binary) || (Expression->BinaryExpr.Operator != '*'))
+    {
+        return NULL;
+    }
+    expr* LHS = SkipParens(Expression->BinaryExpr.LHS);
+    expr* RHS = SkipParens(Expression->BinaryExpr.RHS);
+    return IsIdNamed(LHS, IndexName) ? RHS : (IsIdNamed(RHS, IndexName) ? LHS : NULL);
+}
+
+// Replaces the reads of a variable, in statements where it can't be shadowed.
+static void RenameVariable(expr* Statement, char* Name, char* NewName)
+{
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    PushExpr(&Pending, Statement);
+    while(Pending.Count)
+    {
+        expr* Expression = PopExpr(&Pending);
+        if(Expression && IsIdNamed(Expression, Name))
+        {
+            Expression->IdExpr.String = NewName;
+        }
+        else if(Expression)
+        {
+            PushChildExpressions(&Pending, Expression);
+        }
+    }
+    FreeWorkStack(&Pending);
+}
+
+// Drops body variables declared as a plain copy of the induction variable and never changed, reading it instead.
+static void RemoveDerivedInductionVariables(expr* Loop, char* Name, type_spec* Type)
+{
+    statement_list Body = {Loop->ForExpr.Expressions, &Loop->ForExpr.ExpressionCount};
+    for(uint32_t i = 0; i < *Body.Count;)
+    {
+        expr* Statement = Body.Statements[i];
+        type_spec* CopyType = &Statement->VarExpr.Type;
+        bool IsCopy = (Statement->ExprType == EXPR_var) && IsIdNamed(SkipParens(Statement->VarExpr.Expr), Name) &&
+                      (CopyType->Type == Type->Type) && (CopyType->ArrayKind == ARRAY_none);
+        for(uint32_t Later = i + 1; IsCopy && (Later < *Body.Count); ++Later)
+        {
+            IsCopy = !AssignsVariable(Body.Statements[Later], Statement->VarExpr.Name);
+        }
+        if(!IsCopy)
+        {
+            ++i;
+            continue;
+        }
+
+        for(uint32_t Later = i + 1; Later < *Body.Count; ++Later)
+        {
+            RenameVariable(Body.Statements[Later], Statement->VarExpr.Name, Name);
+        }
+        RemoveStatement(Body, i);
+    }
+}
+
+// Gives the products of the loop at List.Statements[Index] with one invariant factor an induction variable, declared
+// just before the loop. Returns whether it did, the loop then being at Index + 1, with possibly more factors to go.
+static bool ReduceLoopStrength(translator* Translator, statement_list List, uint32_t Index, uint32_t FirstLocalSymbol, uint32_t* NextName)
+{
+    expr* Loop = List.Statements[Index];
+    expr* Definition = GetInductionDefinition(Loop);
+    if(!Definition || (*List.Count >= MAX_EXPRESSION_COUNT) || (Loop->ForExpr.ExpressionCount >= MAX_EXPRESSION_COUNT) ||
+       (*NextName >= MAX_TEMPORARY_COUNT))
+    {
+        return false;
+    }
+
+    // Start is evaluated again before the loop, so it has to be a literal or a variable of the loop variable's type.
+    char* IndexName = Definition->VarExpr.Name;
+    type_spec* IndexType = &Definition->VarExpr.Type;
+    expr* Start = Definition->VarExpr.Expr;
+    symbol* StartSymbol = (Start->ExprType == EXPR_id) ? FindSymbol(Translator, Start->IdExpr.String) : NULL;
+    if(!IsSmallIntLiteral(Start) && !(StartSymbol && (StartSymbol->Type.Type == IndexType->Type) && (StartSymbol->Type.ArrayKind == ARRAY_none)))
+    {
+        return false;
+    }
+
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    expr* ProductBuffer[16];
+    work_stack Products;
+    InitWorkStack(&Products, ProductBuffer, sizeof(ProductBuffer), sizeof(expr*));
+    PushExpr(&Pending, Loop->ForExpr.Condition);
+    for(uint32_t i = 0; i < Loop->ForExpr.ExpressionCount; ++i)
+    {
+        PushExpr(&Pending, Loop->ForExpr.Expressions[i]);
+    }
+
+    expr* Factor = NULL;
+    type_spec FactorType = {};
+    while(Pending.Count)
+    {
+        expr* Expression = PopExpr(&Pending);
+        if(!Expression)
+        {
+            continue;
+        }
+        expr* ProductFactor = GetInductionFactor(Expression, IndexName);
+        if(ProductFactor && !Factor && IsLoopInvariantFactor(Translator, Loop, ProductFactor, FirstLocalSymbol, &FactorType))
+        {
+            Factor = ProductFactor;
+        }
+        if(ProductFactor && Factor && IsSameExpression(ProductFactor, Factor))
+        {
+            PushExpr(&Products, Expression);
+            continue;
+        }
+        PushChildExpressions(&Pending, Expression);
+    }
+    FreeWorkStack(&Pending);
+
+    // Literal factors are folded, and have to stay literals of the same size.
+    uint64_t Step = GetLoopStep(Loop->ForExpr.Action);
+    bool IsFolded = Factor && (Factor->ExprType == EXPR_int);
+    if(!Factor || (IsFolded && ((Step * Factor->IntExpr.IntValue > INT32_MAX) ||
+                                (IsSmallIntLiteral(Start) && (Start->IntExpr.IntValue * Factor->IntExpr.IntValue > INT32_MAX)))))
+    {
+        FreeWorkStack(&Products);
+        return false;
+    }
+
+    // Narrow loop variables wrap around where the running sum doesn't, and so do unsigned ones whose products are wider.
+    int32_t ProductType = GetArithmeticType(IndexType->Type, FactorType.Type);
+    bool IsUnsigned = (IndexType->Type >= TOKEN_u8) && (IndexType->Type <= TOKEN_u64);
+    if((GetTypeSize(IndexType->Type) < 4) || (IsUnsigned && (ProductType != IndexType->Type)))
+    {
+        FreeWorkStack(&Products);
+        return false;
+    }
+
+    char* Name = GetTemporaryName(TEMPORARY_induction, (*NextName)++);
+    expr* Initial = NULL;
+    if(IsSmallIntLiteral(Start) && (IsFolded || (Start->IntExpr.IntValue == 0)))
+    {
+        Initial = MakeIntExpr(IsFolded ? Start->IntExpr.IntValue * Factor->IntExpr.IntValue : 0);
+    }
+    else
+    {
+        expr* StartCopy = MakeExpr(Start->ExprType);
+        *StartCopy = *Start;
+        Initial = MakeBinaryExpr('*', StartCopy, IsFolded ? MakeIntExpr(Factor->IntExpr.IntValue) : MakeIdExpr(Factor->IdExpr.String));
+    }
+    expr* Increment = NULL;
+    if(IsFolded)
+    {
+        Increment = MakeIntExpr(Step * Factor->IntExpr.IntValue);
+    }
+    else
+    {
+        Increment = (Step == 1) ? MakeIdExpr(Factor->IdExpr.String) : MakeBinaryExpr('*', MakeIntExpr(Step), MakeIdExpr(Factor->IdExpr.String));
+    }
+
+    expr* Declaration = MakeExpr(EXPR_var);
+    Declaration->VarExpr.Type = MakeType(ProductType);
+    Declaration->VarExpr.Name = Name;
+    Declaration->VarExpr.Expr = Initial;
+    memmove(List.Statements + Index + 1, List.Statements + Index, sizeof(expr*) * (*List.Count - Index));
+    List.Statements[Index] = Declaration;
+    ++*List.Count;
+
+    // Factors are leaves, so the replaced products are freed whole.
+    for(uint32_t i = 0; i < Products.Count; ++i)
+    {
+        expr* Product = ((expr**)Products.Elements)[i];
+        expr* Replaced = MakeExpr(EXPR_binary);
+        *Replaced = *Product;
+        Product->ExprType = EXPR_id;
+        Product->IdExpr.String = Name;
+        FreeExpression(Replaced);
+    }
+    FreeWorkStack(&Products);
+
+    // A body ending in a return never reaches the next iteration.
+    statement_list Body = {Loop->ForExpr.Expressions, &Loop->ForExpr.ExpressionCount};
+    if((*Body.Count == 0) || !IsTerminalStatement(Body.Statements[*Body.Count - 1]))
+    {
+        Body.Statements[(*Body.Count)++] = MakeBinaryExpr(TOKEN_pluseq, MakeIdExpr(Name), Increment);
+    }
+    else
+    {
+        FreeExpression(Increment);
+    }
+    RemoveDerivedInductionVariables(Loop, Name, &Declaration->VarExpr.Type);
+    return true;
+}
+
+// Runs over the function with the parameters in scope, tracking the scopes of its blocks like TranslateBlock so that
+// the temporaries get the types the expressions have where they are declared. Loops get their induction variables
+// before their own block is searched for common subexpressions.
+static void OptimizeBlocks(translator* Translator, func* Function, uint32_t FirstLocalSymbol)
+{
+    common_pass Pass = {};
+    Pass.Translator = Translator;
+    Pass.FirstLocalSymbol = FirstLocalSymbol;
+    Pass.IsLenPure = !FindFunction(Translator, "len");
+    common_expr CommonBuffer[32];
+    InitWorkStack(&Pass.Commons, CommonBuffer, sizeof(CommonBuffer), sizeof(common_expr));
+    common_use UseBuffer[32];
+    InitWorkStack(&Pass.Uses, UseBuffer, sizeof(UseBuffer), sizeof(common_use));
+    common_node NodeBuffer[32];
+    InitWorkStack(&Pass.Nodes, NodeBuffer, sizeof(NodeBuffer), sizeof(common_node));
+    common_name NameBuffer[64];
+    InitWorkStack(&Pass.Names, NameBuffer, sizeof(NameBuffer), sizeof(common_name));
+    ResizeCommonBuckets(&Pass, 64);
+
+    name_set FunctionNames = {};
+    for(uint32_t i = 0; i < Function->ExpressionCount; ++i)
+    {
+        AddExpressionNames(&FunctionNames, Function->Expressions[i]);
+    }
+    if(FunctionNames.Count)
+    {
+        qsort(FunctionNames.Hashes, FunctionNames.Count, sizeof(uint64_t), CompareHashes);
+    }
+    for(uint32_t Kind = 0; Kind < TEMPORARY_kind_count; ++Kind)
+    {
+        Pass.NextNames[Kind] = GetFirstFreeTemporary(&FunctionNames, (temporary_kind)Kind);
+    }
+    Deallocate(FunctionNames.Hashes);
+
+    uint32_t SymbolCount = Translator->SymbolCount;
+    common_block Buffer[16];
+    work_stack Blocks;
+    InitWorkStack(&Blocks, Buffer, sizeof(Buffer), sizeof(common_block));
+    OpenCommonBlock(&Pass, &Blocks, Function->Expressions, &Function->ExpressionCount);
+    bool IsScoped = true;
+    while(IsScoped && Blocks.Count)
+    {
+        common_block* Block = (common_block*)PeekWork(&Blocks);
+        if(Block->Next == *Block->List.Count)
+        {
+            CloseCommonBlock(&Pass, Block);
+            Translator->SymbolCount = Block->SymbolCount;
+            PopWork(&Blocks);
+            continue;
+        }
+
+        // The declaration of the induction variable goes through the pass like any other statement, and the loop is
+        // met again for its remaining products.
+        expr* Statement = Block->List.Statements[Block->Next];
+        if((Statement->ExprType == EXPR_for) &&
+           ReduceLoopStrength(Translator, Block->List, Block->Next, FirstLocalSymbol, &Pass.NextNames[TEMPORARY_induction]))
+        {
+            continue;
+        }
+        FindCommonExpressions(&Pass, Block, Statement);
+        InvalidateCommonExpressions(&Pass, Statement);
+        ++Block->Next;
+
+        // The symbol table is shared with the translator, a full one is left for it to report.
+        if(Statement->ExprType == EXPR_var)
+        {
+            IsScoped = (Translator->SymbolCount < MAX_SYMBOL_COUNT) && AddSymbol(Translator, Statement->VarExpr.Name, &Statement->VarExpr.Type);
+        }
+        else if(Statement->ExprType == EXPR_if)
+        {
+            OpenCommonBlock(&Pass, &Blocks, Statement->IfExpr.FalseExpressions, &Statement->IfExpr.FalseExpressionCount);
+            OpenCommonBlock(&Pass, &Blocks, Statement->IfExpr.TrueExpressions, &Statement->IfExpr.TrueExpressionCount);
+        }
+        else if(Statement->ExprType == EXPR_bench)
+        {
+            OpenCommonBlock(&Pass, &Blocks, Statement->BenchExpr.Expressions, &Statement->BenchExpr.ExpressionCount);
+        }
+        else if(Statement->ExprType == EXPR_match)
+        {
+            for(uint32_t i = Statement->MatchExpr.CaseCount; i > 0; --i)
+            {
+                expr* Case = Statement->MatchExpr.Cases[i - 1];
+                OpenCommonBlock(&Pass, &Blocks, Case->CaseExpr.Expressions, &Case->CaseExpr.ExpressionCount);
+            }
+        }
+        else if(Statement->ExprType == EXPR_for)
+        {
+            OpenCommonBlock(&Pass, &Blocks, Statement->ForExpr.Expressions, &Statement->ForExpr.ExpressionCount);
+            expr* Definition = Statement->ForExpr.Definition;
+            if(Definition && (Definition->ExprType == EXPR_var))
+            {
+                IsScoped = (Translator->SymbolCount < MAX_SYMBOL_COUNT) && AddSymbol(Translator, Definition->VarExpr.Name, &Definition->VarExpr.Type);
+            }
+        }
+    }
+
+    Translator->SymbolCount = SymbolCount;
+    FreeWorkStack(&Blocks);
+    FreeWorkStack(&Pass.Commons);
+    FreeWorkStack(&Pass.Uses);
+    FreeWorkStack(&Pass.Nodes);
+    FreeWorkStack(&Pass.Names);
+    Deallocate(Pass.NameSlots);
+    Deallocate(Pass.Buckets);
+}
+
+// Makes the signature known to calls, and lowers #soa array parameters to views of their field arrays.
+static void RegisterFunction(translator* Translator, func* Function)
+{
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        type_spec* ParameterType = &Function->Parameters[i]->VarExpr.Type;
+        if((ParameterType->ArrayKind == ARRAY_fixed) && GetSoaStruct(Translator, ParameterType))
+        {
+            ParameterType->ArrayKind = ARRAY_slice;
+            ParameterType->ArrayLength = 0;
+        }
+    }
+
+    function_signature* Signature = FindFunction(Translator, Function->Name);
+    if(!Signature && (Translator->FunctionCount < MAX_FUNCTION_COUNT))
+    {
+        Signature = &Translator->Functions[Translator->FunctionCount++];
+    }
+    if(Signature)
+    {
+        Signature->Name = Function->Name;
+        Signature->Type = Function->Type;
+        Signature->ParameterCount = Function->ParameterCount;
+        for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+        {
+            Signature->ParameterTypes[i] = Function->Parameters[i]->VarExpr.Type;
+        }
+    }
+}
+
+// Writes the return type, name and parameters up to the closing parenthesis, adding the parameters as symbols.
+static int32_t TranslateFunctionSignature(translator* Translator, func* Function)
+{
+    if((Function->Type.Type == TOKEN_arena) || ((Function->Type.ArrayKind != ARRAY_none) && (Function->Type.Type == TOKEN_string)))
+    {
+        fprintf(stderr, "Error: function '%s' can't return that type.\n", Function->Name);
+        return 0;
+    }
+
+    FILE* FileHandle = Translator->FileHandle;
+    if(!TranslateTypeSpec(Translator, &Function->Type))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, "%s(", Function->Name);
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        expr* Parameter = Function->Parameters[i];
+        if(Parameter->VarExpr.Type.Type == TOKEN_arena)
+        {
+            if(Parameter->VarExpr.Type.ArrayKind != ARRAY_none)
+            {
+                fprintf(stderr, "Error: arena parameter '%s' can't be an array.\n", Parameter->VarExpr.Name);
+                return 0;
+            }
+            Translator->RuntimeFlags |= RUNTIME_arena;
+            fprintf(FileHandle, "df_arena* %s", Parameter->VarExpr.Name);
+            if(!AddSymbol(Translator, Parameter->VarExpr.Name, &Parameter->VarExpr.Type))
+            {
+                return 0;
+            }
+            Translator->Symbols[Translator->SymbolCount - 1].IsReference = true;
+        }
+        else if(!TranslateExpression(Translator, Parameter, false))
+        {
+            return 0;
+        }
+        if(i != (Function->ParameterCount - 1))
+        {
+            fprintf(FileHandle, ",");
+        }
+    }
+    fprintf(FileHandle, ")");
+    return 1;
+}
+
+// Turns self tail calls into jumps when every return of the function can be rewritten: parameters have to be
+// assignable and not shadowed, and arenas, which a call would keep alive, rule it out. For integer results, returns
+// accumulating into a call to the function, X + Self(...) or X * Self(...), are tail calls too, all with the operator
+// of the first one found; those with the other operator stay calls.
+static void PrepareTailCalls(translator* Translator, func* Function)
+{
+    Translator->TailFunction = NULL;
+    Translator->AccumulatorOperator = 0;
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        type_spec* Type = &Function->Parameters[i]->VarExpr.Type;
+        if((Type->Type == TOKEN_arena) || (Type->ArrayKind == ARRAY_fixed))
+        {
+            return;
+        }
+    }
+
+    expr* Buffer[32];
+    work_stack Pending;
+    InitWorkStack(&Pending, Buffer, sizeof(Buffer), sizeof(expr*));
+    for(uint32_t i = 0; i < Function->ExpressionCount; ++i)
+    {
+        PushExpr(&Pending, Function->Expressions[i]);
+    }
+
+    bool HasTailCall = false;
+    bool IsPossible = true;
+    int32_t Operator = 0;
+    while(IsPossible && Pending.Count)
+    {
+        expr* Expression = PopExpr(&Pending);
+        if(!Expression)
+        {
+            continue;
+        }
+        if(Expression->ExprType == EXPR_var)
+        {
+            IsPossible = (Expression->VarExpr.Type.Type != TOKEN_arena);
+            for(uint32_t i = 0; IsPossible && (i < Function->ParameterCount); ++i)
+            {
+                IsPossible = (strcmp(Expression->VarExpr.Name, Function->Parameters[i]->VarExpr.Name) != 0);
+            }
+        }
+        else if((Expression->ExprType == EXPR_return) && Expression->ReturnExpr.Expression)
+        {
+            expr* Value = SkipParens(Expression->ReturnExpr.Expression);
+            if(!Operator && IsIntegerType(&Function->Type) && (Value->ExprType == EXPR_binary) &&
+               ((Value->BinaryExpr.Operator == '+') || (Value->BinaryExpr.Operator == '*')) &&
+               GetAccumulatedOperand(Function, Value, Value->BinaryExpr.Operator))
+            {
+                Operator = Value->BinaryExpr.Operator;
+            }
+            HasTailCall = HasTailCall || IsSelfCall(Function, Value) || GetAccumulatedOperand(Function, Value, Operator);
+        }
+        PushChildExpressions(&Pending, Expression);
+    }
+    FreeWorkStack(&Pending);
+
+    if(IsPossible && HasTailCall)
+    {
+        Translator->TailFunction = Function;
+        Translator->AccumulatorOperator = Operator;
+    }
+}
+
+// The wrapper of a function translated as DF_Profiled_Name, timing each call to it. Returns in the body and its jumps
+// for tail calls stay as they are, and its calls to itself go through the wrapper like any other.
+static int32_t TranslateProfiledFunction(translator* Translator, func* Function)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    uint32_t SymbolCount = Translator->SymbolCount;
+    if(!TranslateFunctionSignature(Translator, Function))
+    {
+        return 0;
+    }
+    Translator->SymbolCount = SymbolCount;
+
+    fprintf(FileHandle, "\n{\nDF_ProfileEnter(&DF_Profile_%s);\n", Function->Name);
+    if(!TranslateDeclaration(Translator, &Function->Type, "DF_Result"))
+    {
+        return 0;
+    }
+    fprintf(FileHandle, "=DF_Profiled_%s(", Function->Name);
+    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    {
+        fprintf(FileHandle, (i > 0) ? ",%s" : "%s", Function->Parameters[i]->VarExpr.Name);
+    }
+    fprintf(FileHandle, ");\nDF_ProfileExit(&DF_Profile_%s);\nreturn DF_Result;\n}\n", Function->Name);
+    return 1;
+}
+
+static int32_t TranslateFunction(translator* Translator, func* Function)
+{
+    if(!Function)
+    {
+        return 0;
+    }
+
+    // Registered before the body so that recursive calls see the signature.
+    RegisterFunction(Translator, Function);
+
+    FILE* FileHandle = Translator->FileHandle;
+    uint32_t SymbolCount = Translator->SymbolCount;
+    Translator->GlobalSymbolCount = SymbolCount;
+    Translator->IsInFunction = true;
+    Translator->ReturnType = Function->Type;
+    Translator->ArenaCount = 0;
+
+    // A profiled body is renamed for its wrapper, declared first for the calls to the function in the body.
+    char* Name = Function->Name;
+    char ProfiledName[MAX_PROFILED_NAME_LENGTH];
+    bool IsProfiled = Translator->IsProfiling && (Function->ExpressionCount > 0);
+    if(IsProfiled)
+    {
+        Translator->RuntimeFlags |= RUNTIME_profile;
+        if(snprintf(ProfiledName, sizeof(ProfiledName), "DF_Profiled_%s", Name) >= (int)sizeof(ProfiledName))
+        {
+            fprintf(stderr, "Error: function name '%s' is too long to profile.\n", Name);
+            return 0;
+        }
+        fprintf(FileHandle, "static df_profile_function DF_Profile_%s = {\"%s\", 0, 0, 0, 0, 0};\n", Name, Name);
+        if(!TranslateFunctionSignature(Translator, Function))
+        {
+            return 0;
+        }
+        Translator->SymbolCount = SymbolCount;
+        fprintf(FileHandle, ";\nstatic ");
+        Function->Name = ProfiledName;
+    }
+    int32_t IsSignatureTranslated = TranslateFunctionSignature(Translator, Function);
+    Function->Name = Name;
+    if(!IsSignatureTranslated)
+    {
+        return 0;
+    }
+    OptimizeBlocks(Translator, Function, SymbolCount);
+    if(Function->ExpressionCount <= 0)
+    {
+        fprintf(FileHandle, ";");
+    }
+    else
+    {
+        fprintf(FileHandle, "\n{\n");
+        PrepareTailCalls(Translator, Function);
+        if(Translator->TailFunction)
+        {
+            if(Translator->AccumulatorOperator)
+            {
+                if(!TranslateDeclaration(Translator, &Function->Type, "DF_Accumulator"))
+                {
+                    return 0;
+                }
+                fprintf(FileHandle, "=%d;\n", (Translator->AccumulatorOperator == '*') ? 1 : 0);
+            }
+            fprintf(FileHandle, "DF_TailCall:;\n");
+        }
+        int32_t Result = TranslateBlock(Translator, Function->Expressions, Function->ExpressionCount);
+        Translator->TailFunction = NULL;
+        if(!Result)
+        {
+            return 0;
+        }
+        fprintf(FileHandle, "}");
+    }
+    fprintf(FileHandle, "\n");
+
+    Translator->SymbolCount = SymbolCount;
+    if(IsProfiled && !TranslateProfiledFunction(Translator, Function))
+    {
+        return 0;
+    }
+    Translator->IsInFunction = false;
+    return 1;
+}
+
+// Declares a pointer to the elements of a field of a #soa struct, to its rows for an array field.
+static int32_t TranslateSoaFieldPointer(translator* Translator, type_spec* FieldType, const char* Name)
+{
+    type_spec ElementType = *FieldType;
+    ElementType.ArrayKind = (FieldType->ArrayKind == ARRAY_fixed) ? ARRAY_none : FieldType->ArrayKind;
+    if(!TranslateTypeSpec(Translator, &ElementType))
+    {
+        return 0;
+    }
+    if(FieldType->ArrayKind == ARRAY_fixed)
+    {
+        fprintf(Translator->FileHandle, "(*%s)[%llu]", Name, FieldType->ArrayLength);
+    }
+    else
+    {
+        fprintf(Translator->FileHandle, "*%s", Name);
+    }
+    return 1;
+}
+
+// Whole elements of #soa arrays are gathered from the field arrays by DF_SoaLoad_<Name> and scattered back by
+// DF_SoaStore_<Name>, which returns the element stored. They are inline so that unused ones aren't warned about.
+static int32_t TranslateSoaHelpers(translator* Translator, struct_info* Struct)
+{
+    FILE* FileHandle = Translator->FileHandle;
+    for(uint32_t IsStore = 0; IsStore < 2; ++IsStore)
+    {
+        fprintf(FileHandle, "static inline %s DF_Soa%s_%s(", Struct->Name, IsStore ? "Store" : "Load", Struct->Name);
+        for(uint32_t i = 0; i < Struct->FieldCount; ++i)
+        {
+            char Name[32];
+            snprintf(Name, sizeof(Name), "Field%u", i);
+            if(!TranslateSoaFieldPointer(Translator, &Struct->FieldTypes[i], Name))
+            {
+                return 0;
+            }
+            fprintf(FileHandle, ", ");
+        }
+        fprintf(FileHandle, IsStore ? "int64_t Index, %s Element)\n{\n" : "int64_t Index)\n{\n%s Element;\n", Struct->Name);
+
+        for(uint32_t i = 0; i < Struct->FieldCount; ++i)
+        {
+            char* Name = Struct->FieldNames[i];
+            if(Struct->FieldTypes[i].ArrayKind == ARRAY_fixed)
+            {
+                fprintf(FileHandle, "for(int64_t i = 0; i < %llu; ++i)\n{\n", Struct->FieldTypes[i].ArrayLength);
+                if(IsStore)
+                {
+                    fprintf(FileHandle, "Field%u[Index][i] = Element.%s[i];\n}\n", i, Name);
+                }
+                else
+                {
+                    fprintf(FileHandle, "Element.%s[i] = Field%u[Index][i];\n}\n", Name, i);
+                }
+            }
+            else if(IsStore)
+            {
+                fprintf(FileHandle, "Field%u[Index] = Element.%s;\n", i, Name);
+            }
+            else
+            {
+                fprintf(FileHandle, "Element.%s = Field%u[Index];\n", Name, i);
+            }
+        }
+        fprintf(FileHandle, "return Element;\n}\n");
+    }
+    return 1;
+}
+
+static int32_t TranslateStruct(translator* Translator, struct_decl* Struct)
+{
+    if(!Struct)
+    {
+        return 0;
+    }
+    if(FindStruct(Translator, Struct->Name) || (Translator->StructCount >= MAX_STRUCT_COUNT))
+    {
+        fprintf(stderr, "Error: struct '%s' declared twice.\n", Struct->Name);
+        return 0;
+    }
+
+    FILE* FileHandle = Translator->FileHandle;
+    struct_info* Info = &Translator->Structs[Translator->StructCount];
+    Info->Name = Struct->Name;
+    Info->IsSoa = Struct->IsSoa;
+    Info->FieldCount = Struct->FieldCount;
+
+    fprintf(FileHandle, "typedef struct %s\n{\n", Struct->Name);
+    for(uint32_t i = 0; i < Struct->FieldCount; ++i)
+    {
+        type_spec* FieldType = &Struct->Fields[i]->VarExpr.Type;
+        // Arrays of #soa structs would need a layout of their own inside the field arrays of another.
+        if((FieldType->Type == TOKEN_arena) || (Struct->IsSoa && GetSoaStruct(Translator, FieldType)))
+        {
+            fprintf(stderr, "Error: field '%s' of struct '%s' can't have that type.\n", Struct->Fields[i]->VarExpr.Name, Struct->Name);
+            return 0;
+        }
+        if(!TranslateDeclaration(Translator, FieldType, Struct->Fields[i]->VarExpr.Name))
+        {
+            return 0;
+        }
+        fprintf(FileHandle, ";\n");
+
+        Info->FieldNames[i] = Struct->Fields[i]->VarExpr.Name;
+        Info->FieldTypes[i] = *FieldType;
+    }
+    fprintf(FileHandle, "} %s;\n", Struct->Name);
+
+    if(Struct->IsSoa)
+    {
+        fprintf(FileHandle, "typedef struct df_soa_%s\n{\n", Struct->Name);
+        for(uint32_t i = 0; i < Struct->FieldCount; ++i)
+        {
+            TranslateSoaFieldPointer(Translator, &Info->FieldTypes[i], Info->FieldNames[i]);
+            fprintf(FileHandle, ";\n");
+        }
+        fprintf(FileHandle, "int64_t Length;\n} df_soa_%s;\n", Struct->Name);
+        if(!TranslateSoaHelpers(Translator, Info))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        fprintf(FileHandle, "typedef struct df_slice_%s\n{\n%s* Data;\nint64_t Length;\n} df_slice_%s;\n", Struct->Name, Struct->Name, Struct->Name);
+    }
+
+    ++Translator->StructCount;
+    return 1;
+}
+
+// Translates the function into Translator->CheckFile only for the errors it has, leaving the translator as it was. Code
+// that isn't emitted, dropped statements and unreachable functions, is checked this way like the rest.
+static int32_t CheckFunction(translator* Translator, func* Function)
+{
+    if(!Translator->CheckFile)
+    {
+        Translator->CheckFile = tmpfile();
+        if(!Translator->CheckFile)
+        {
+            fprintf(stderr, "Error: could not create a temporary file.\n");
+            return 0;
+        }
+    }
+    rewind(Translator->CheckFile);
+
+    // Functions only add their signature and numbered names to what outlives them.
+    FILE* FileHandle = Translator->FileHandle;
+    uint32_t RuntimeFlags = Translator->RuntimeFlags;
+    uint32_t SliceTypeFlags = Translator->SliceTypeFlags;
+    uint32_t ArenaSliceTypeFlags = Translator->ArenaSliceTypeFlags;
+    uint32_t SymbolCount = Translator->SymbolCount;
+    uint32_t FunctionCount = Translator->FunctionCount;
+    uint32_t MatchCount = Translator->MatchCount;
+    function_signature* Signature = Function ? FindFunction(Translator, Function->Name) : NULL;
+    function_signature SavedSignature = {};
+    if(Signature)
+    {
+        SavedSignature = *Signature;
+    }
+
+    Translator->FileHandle = Translator->CheckFile;
+    Translator->IsChecking = true;
+    func* Copy = CopyFunction(Function);
+    int32_t Result = TranslateFunction(Translator, Copy);
+    FreeFunction(Copy);
+
+    Translator->FileHandle = FileHandle;
+    Translator->RuntimeFlags = RuntimeFlags;
+    Translator->SliceTypeFlags = SliceTypeFlags;
+    Translator->ArenaSliceTypeFlags = ArenaSliceTypeFlags;
+    Translator->SymbolCount = SymbolCount;
+    Translator->FunctionCount = FunctionCount;
+    Translator->MatchCount = MatchCount;
+    if(Signature)
+    {
+        *Signature = SavedSignature;
+    }
+    Translator->BoundsFactCount = 0;
+    Translator->IsInFunction = false;
+    Translator->TailFunction = NULL;
+    Translator->IsChecking = false;
+    return Result;
+}
+
+static int32_t Translate(translator* Translator, ast* Ast)
+{
+    uint32_t SymbolCount = Translator->SymbolCount;
+    int32_t Result = 0;
+
+    switch(Ast->AstType)
+    {
+        default:
+        {
+        } break;
+        case AST_expr:
+        {
+            expr* Expression = Ast->Expr;
+            Result = TranslateExpression(Translator, Expression, true);
+        } break;
+        case AST_func:
+        {
+            // The passes lower the body in place, so they get a copy, and the parsed function is still as written
+            // when --watch translates it again. Code they drop is checked by translating the function as written first.
+            func* Function = CopyFunction(Ast->Func);
+            if(Function && EliminateDeadCode(Function) && !CheckFunction(Translator, Ast->Func))
+            {
+                FreeFunction(Function);
+                break;
+            }
+            Result = TranslateFunction(Translator, Function);
+            FreeFunction(Function);
+        } break;
+        case AST_struct:
+        {
+            Result = TranslateStruct(Translator, Ast->Struct);
+        } break;
+    }
+
+    // A failed item may leave its scope behind, only globals survive a top-level item.
+    if(!Result)
+    {
+        Translator->SymbolCount = SymbolCount;
+    }
+    Translator->BoundsFactCount = 0;
+    Translator->IsInFunction = false;
+    return Result;
+}
+
+// Functions main can't reach aren't emitted, but are still checked for errors.
+static int32_t TranslateReachable(translator* Translator, ast* Ast, bool IsUnreachable)
+{
+    if(!IsUnreachable)
+    {
+        return Translate(Translator, Ast);
+    }
+    if((Ast->AstType == AST_func) && Ast->Func && (Ast->Func->ExpressionCount > 0))
+    {
+        return CheckFunction(Translator, Ast->Func);
+    }
+    return 1;
+}
+
+static const char* RuntimeBoundsCheck =
+    "static int64_t DF_BoundsCheck(int64_t Index, int64_t Length)\n"
+    "{\n"
+    "    if((uint64_t)Index >= (uint64_t)Length)\n"
+    "    {\n"
+    "        fflush(stdout);\n"
+    "        fprintf(stderr, \"Error: index %lld out of bounds [0, %lld).\\n\", (long long)Index, (long long)Length);\n"
+    "        abort();\n"
+    "    }\n"
+    "    return Index;\n"
+    "}\n";
+
+static const char* RuntimeString =
+    "// Strings shorter than DF_STRING_INLINE_CAPACITY live inline and are NUL-terminated, longer ones point at\n"
+    "// storage they don't own.\n"
+    "typedef struct df_string\n"
+    "{\n"
+    "    int64_t Length;\n"
+    "    union\n"
+    "    {\n"
+    "        const char* Data;\n"
+    "        char Inline[DF_STRING_INLINE_CAPACITY];\n"
+    "    };\n"
+    "} df_string;\n"
+    "\n"
+    "#define DF_STRING_BYTES(String) (((String).Length < DF_STRING_INLINE_CAPACITY) ? (String).Inline : (String).Data)\n"
+    "\n"
+    "static int DF_StringEquals(df_string A, df_string B)\n"
+    "{\n"
+    "    if(A.Length != B.Length)\n"
+    "    {\n"
+    "        return 0;\n"
+    "    }\n"
+    "    return memcmp(DF_STRING_BYTES(A), DF_STRING_BYTES(B), (size_t)A.Length) == 0;\n"
+    "}\n"
+    "\n"
+    "static df_string DF_StringSlice(df_string String, int64_t Start, int64_t End)\n"
+    "{\n"
+    "    if((Start < 0) || (Start > End) || (End > String.Length))\n"
+    "    {\n"
+    "        fflush(stdout);\n"
+    "        fprintf(stderr, \"Error: slice [%lld, %lld) out of bounds [0, %lld).\\n\", (long long)Start, (long long)End, (long long)String.Length);\n"
+    "        abort();\n"
+    "    }\n"
+    "\n"
+    "    df_string Result;\n"
+    "    const char* Bytes = DF_STRING_BYTES(String) + Start;\n"
+    "    Result.Length = End - Start;\n"
+    "    if(Result.Length < DF_STRING_INLINE_CAPACITY)\n"
+    "    {\n"
+    "        memcpy(Result.Inline, Bytes, (size_t)Result.Length);\n"
+    "        Result.Inline[Result.Length] = '\\0';\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        Result.Data = Bytes;\n"
+    "    }\n"
+    "    return Result;\n"
+    "}\n"
+    "\n"
+    "// Long strings that still end in a terminator are passed through, everything else is copied into one of a few\n"
+    "// rotating scratch buffers.\n"
+    "static const char* DF_StringCStr(df_string String)\n"
+    "{\n"
+    "    static char* Scratch[DF_STRING_SCRATCH_COUNT];\n"
+    "    static int64_t ScratchCapacity[DF_STRING_SCRATCH_COUNT];\n"
+    "    static int ScratchIndex;\n"
+    "\n"
+    "    if((String.Length >= DF_STRING_INLINE_CAPACITY) && (String.Data[String.Length] == '\\0'))\n"
+    "    {\n"
+    "        return String.Data;\n"
+    "    }\n"
+    "\n"
+    "    int Slot = ScratchIndex;\n"
+    "    ScratchIndex = (ScratchIndex + 1) % DF_STRING_SCRATCH_COUNT;\n"
+    "    if(ScratchCapacity[Slot] <= String.Length)\n"
+    "    {\n"
+    "        free(Scratch[Slot]);\n"
+    "        Scratch[Slot] = (char*)malloc((size_t)String.Length + 1);\n"
+    "        ScratchCapacity[Slot] = String.Length + 1;\n"
+    "    }\n"
+    "    memcpy(Scratch[Slot], DF_STRING_BYTES(String), (size_t)String.Length);\n"
+    "    Scratch[Slot][String.Length] = '\\0';\n"
+    "    return Scratch[Slot];\n"
+    "}\n";
+
+static const char* RuntimeArena =
+    "// Arena memory comes in blocks chained newest first, the bytes follow each block header.\n"
+    "typedef struct df_arena_block\n"
+    "{\n"
+    "    struct df_arena_block* Previous;\n"
+    "    size_t Capacity;\n"
+    "    size_t Used;\n"
+    "} df_arena_block;\n"
+    "\n"
+    "typedef struct df_arena\n"
+    "{\n"
+    "    df_arena_block* Current;\n"
+    "    size_t BlockSize;\n"
+    "} df_arena;\n"
+    "\n"
+    "static df_arena DF_ArenaCreate(int64_t BlockSize)\n"
+    "{\n"
+    "    df_arena Result;\n"
+    "    Result.Current = NULL;\n"
+    "    Result.BlockSize = (BlockSize > 0) ? (size_t)BlockSize : DF_ARENA_DEFAULT_BLOCK_SIZE;\n"
+    "    return Result;\n"
+    "}\n"
+    "\n"
+    "static void* DF_ArenaPushBlock(df_arena* Arena, size_t Size, size_t Alignment)\n"
+    "{\n"
+    "    size_t Capacity = (Size + Alignment > Arena->BlockSize) ? Size + Alignment : Arena->BlockSize;\n"
+    "    df_arena_block* Block = (df_arena_block*)malloc(sizeof(df_arena_block) + Capacity);\n"
+    "    if(!Block)\n"
+    "    {\n"
+    "        fflush(stdout);\n"
+    "        fprintf(stderr, \"Error: arena out of memory.\\n\");\n"
+    "        abort();\n"
+    "    }\n"
+    "    Block->Previous = Arena->Current;\n"
+    "    Block->Capacity = Capacity;\n"
+    "    Block->Used = 0;\n"
+    "    Arena->Current = Block;\n"
+    "\n"
+    "    char* Base = (char*)(Block + 1);\n"
+    "    uintptr_t Address = ((uintptr_t)Base + Alignment - 1) & ~(uintptr_t)(Alignment - 1);\n"
+    "    Block->Used = (size_t)(Address - (uintptr_t)Base) + Size;\n"
+    "    return (void*)Address;\n"
+    "}\n"
+    "\n"
+    "static void* DF_ArenaPush(df_arena* Arena, size_t Size, size_t Alignment)\n"
+    "{\n"
+    "    df_arena_block* Block = Arena->Current;\n"
+    "    if(Block)\n"
+    "    {\n"
+    "        char* Base = (char*)(Block + 1);\n"
+    "        uintptr_t Address = ((uintptr_t)(Base + Block->Used) + Alignment - 1) & ~(uintptr_t)(Alignment - 1);\n"
+    "        size_t End = (size_t)(Address - (uintptr_t)Base) + Size;\n"
+    "        if(End <= Block->Capacity)\n"
+    "        {\n"
+    "            Block->Used = End;\n"
+    "            return (void*)Address;\n"
+    "        }\n"
+    "    }\n"
+    "    return DF_ArenaPushBlock(Arena, Size, Alignment);\n"
+    "}\n"
+    "\n"
+    "static void DF_ArenaRelease(df_arena* Arena)\n"
+    "{\n"
+    "    df_arena_block* Block = Arena->Current;\n"
+    "    while(Block)\n"
+    "    {\n"
+    "        df_arena_block* Previous = Block->Previous;\n"
+    "        free(Block);\n"
+    "        Block = Previous;\n"
+    "    }\n"
+    "    Arena->Current = NULL;\n"
+    "}\n";
+
+static const char* RuntimePrint =
+    "// Specialized printf output, digits are produced backwards into a buffer written at once.\n"
+    "static void DF_WriteInt(FILE* Stream, long long Value)\n"
+    "{\n"
+    "    char Buffer[24];\n"
+    "    char* End = Buffer + sizeof(Buffer);\n"
+    "    char* Start = End;\n"
+    "    unsigned long long Magnitude = (Value < 0) ? 0ULL - (unsigned long long)Value : (unsigned long long)Value;\n"
+    "    do\n"
+    "    {\n"
+    "        *--Start = (char)('0' + Magnitude % 10);\n"
+    "        Magnitude /= 10;\n"
+    "    } while(Magnitude);\n"
+    "    if(Value < 0)\n"
+    "    {\n"
+    "        *--Start = '-';\n"
+    "    }\n"
+    "    fwrite(Start, 1, (size_t)(End - Start), Stream);\n"
+    "}\n";
+
+static const char* RuntimePrintString =
+    "static void DF_WriteString(FILE* Stream, df_string String)\n"
+    "{\n"
+    "    fwrite(DF_STRING_BYTES(String), 1, (size_t)String.Length, Stream);\n"
+    "}\n";
+
+static const char* RuntimeOutput =
+    "// Standard output of the write_ builtins, buffered apart from stdio so that writes don't lock or parse formats. It\n"
+    "// goes to stdout when full, on flush() and at exit.\n"
+    "typedef struct df_writer\n"
+    "{\n"
+    "    size_t Used;\n"
+    "    int IsFlushedAtExit;\n"
+    "    char Buffer[DF_WRITER_CAPACITY];\n"
+    "} df_writer;\n"
+    "\n"
+    "// Defined once next to the translated code, as every unit of a split build includes the runtime.\n"
+    "extern df_writer DF_Output;\n"
+    "\n"
+    "static const char DF_DigitPairs[] = \"0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849\"\n"
+    "                                   \"5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899\";\n"
+    "\n"
+    "static void DF_Flush(void)\n"
+    "{\n"
+    "    fwrite(DF_Output.Buffer, 1, DF_Output.Used, stdout);\n"
+    "    DF_Output.Used = 0;\n"
+    "    fflush(stdout);\n"
+    "}\n"
+    "\n"
+    "// Returns room for Size bytes, Size being at most DF_WRITER_CAPACITY.\n"
+    "static char* DF_OutputReserve(size_t Size)\n"
+    "{\n"
+    "    if(!DF_Output.IsFlushedAtExit)\n"
+    "    {\n"
+    "        atexit(DF_Flush);\n"
+    "        DF_Output.IsFlushedAtExit = 1;\n"
+    "    }\n"
+    "    if(DF_Output.Used + Size > DF_WRITER_CAPACITY)\n"
+    "    {\n"
+    "        fwrite(DF_Output.Buffer, 1, DF_Output.Used, stdout);\n"
+    "        DF_Output.Used = 0;\n"
+    "    }\n"
+    "    return DF_Output.Buffer + DF_Output.Used;\n"
+    "}\n"
+    "\n"
+    "static void DF_OutputBytes(const char* Bytes, size_t Length)\n"
+    "{\n"
+    "    if(Length > DF_WRITER_CAPACITY)\n"
+    "    {\n"
+    "        DF_OutputReserve(DF_WRITER_CAPACITY);\n"
+    "        fwrite(DF_Output.Buffer, 1, DF_Output.Used, stdout);\n"
+    "        DF_Output.Used = 0;\n"
+    "        fwrite(Bytes, 1, Length, stdout);\n"
+    "        return;\n"
+    "    }\n"
+    "    memcpy(DF_OutputReserve(Length), Bytes, Length);\n"
+    "    DF_Output.Used += Length;\n"
+    "}\n"
+    "\n"
+    "static void DF_OutputCString(const char* String)\n"
+    "{\n"
+    "    DF_OutputBytes(String, strlen(String));\n"
+    "}\n"
+    "\n"
+    "static void DF_OutputChar(char Character)\n"
+    "{\n"
+    "    *DF_OutputReserve(1) = Character;\n"
+    "    ++DF_Output.Used;\n"
+    "}\n"
+    "\n"
+    "// Digits are produced two at a time, backwards from the end of the number.\n"
+    "static void DF_OutputUnsigned(unsigned long long Value)\n"
+    "{\n"
+    "    char Digits[20];\n"
+    "    char* Start = Digits + sizeof(Digits);\n"
+    "    while(Value >= 100)\n"
+    "    {\n"
+    "        const char* Pair = DF_DigitPairs + 2 * (Value % 100);\n"
+    "        Value /= 100;\n"
+    "        *--Start = Pair[1];\n"
+    "        *--Start = Pair[0];\n"
+    "    }\n"
+    "    if(Value >= 10)\n"
+    "    {\n"
+    "        *--Start = DF_DigitPairs[2 * Value + 1];\n"
+    "        *--Start = DF_DigitPairs[2 * Value];\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        *--Start = (char)('0' + Value);\n"
+    "    }\n"
+    "    DF_OutputBytes(Start, (size_t)(Digits + sizeof(Digits) - Start));\n"
+    "}\n"
+    "\n"
+    "static void DF_OutputInt(long long Value)\n"
+    "{\n"
+    "    if(Value < 0)\n"
+    "    {\n"
+    "        DF_OutputChar('-');\n"
+    "        DF_OutputUnsigned(0ULL - (unsigned long long)Value);\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        DF_OutputUnsigned((unsigned long long)Value);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "// Six decimals, rounded. Values beyond the range of 64-bit integers, infinities and NaNs go through snprintf.\n"
+    "static void DF_OutputFloat(double Value)\n"
+    "{\n"
+    "    if(!((Value > -9.0e18) && (Value < 9.0e18)))\n"
+    "    {\n"
+    "        char Text[512];\n"
+    "        int Length = snprintf(Text, sizeof(Text), \"%f\", Value);\n"
+    "        DF_OutputBytes(Text, (Length > 0) ? (size_t)Length : 0);\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    unsigned long long Bits;\n"
+    "    memcpy(&Bits, &Value, sizeof(Bits));\n"
+    "    if(Bits >> 63)\n"
+    "    {\n"
+    "        DF_OutputChar('-');\n"
+    "        Value = -Value;\n"
+    "    }\n"
+    "    unsigned long long Whole = (unsigned long long)Value;\n"
+    "\n"
+    "    // Part is exact, and so is its product with 1e6 below, which is rounded to nearest, ties to even, like printf.\n"
+    "    // Parts under 2^-21 give less than 0.477. The others are Mantissa / 2^Shift, Shift being 53 to 73, and their\n"
+    "    // product is High * 2^32 plus the low half of Low.\n"
+    "    double Part = Value - (double)Whole;\n"
+    "    unsigned long long Fraction = 0;\n"
+    "    if(Part >= 1.0 / 2097152.0)\n"
+    "    {\n"
+    "        unsigned long long PartBits;\n"
+    "        memcpy(&PartBits, &Part, sizeof(PartBits));\n"
+    "        unsigned long long Mantissa = (PartBits & 0xFFFFFFFFFFFFFULL) | (1ULL << 52);\n"
+    "        int Shift = 1075 - (int)(PartBits >> 52);\n"
+    "        unsigned long long Low = (Mantissa & 0xFFFFFFFFULL) * 1000000ULL;\n"
+    "        unsigned long long High = (Mantissa >> 32) * 1000000ULL + (Low >> 32);\n"
+    "        unsigned long long Rest = High & ((1ULL << (Shift - 32)) - 1);\n"
+    "        unsigned long long Half = 1ULL << (Shift - 33);\n"
+    "        Fraction = High >> (Shift - 32);\n"
+    "        if((Rest > Half) || ((Rest == Half) && ((Low & 0xFFFFFFFFULL) || (Fraction & 1))))\n"
+    "        {\n"
+    "            ++Fraction;\n"
+    "        }\n"
+    "    }\n"
+    "    if(Fraction >= 1000000)\n"
+    "    {\n"
+    "        ++Whole;\n"
+    "        Fraction -= 1000000;\n"
+    "    }\n"
+    "    DF_OutputUnsigned(Whole);\n"
+    "\n"
+    "    char Decimals[7] = {'.', '0', '0', '0', '0', '0', '0'};\n"
+    "    for(int i = 6; i > 0; --i)\n"
+    "    {\n"
+    "        Decimals[i] = (char)('0' + Fraction % 10);\n"
+    "        Fraction /= 10;\n"
+    "    }\n"
+    "    DF_OutputBytes(Decimals, sizeof(Decimals));\n"
+    "}\n";
+
+static const char* RuntimeOutputString =
+    "static void DF_OutputString(df_string String)\n"
+    "{\n"
+    "    DF_OutputBytes(DF_STRING_BYTES(String), (size_t)String.Length);\n"
+    "}\n";
+
+static const char* RuntimeArenaString =
+    "static df_string DF_StringConcat(df_arena* Arena, df_string A, df_string B)\n"
+    "{\n"
+    "    df_string Result;\n"
+    "    Result.Length = A.Length + B.Length;\n"
+    "    char* Bytes = Result.Inline;\n"
+    "    if(Result.Length >= DF_STRING_INLINE_CAPACITY)\n"
+    "    {\n"
+    "        Bytes = (char*)DF_ArenaPush(Arena, (size_t)Result.Length + 1, 1);\n"
+    "    }\n"
+    "    memcpy(Bytes, DF_STRING_BYTES(A), (size_t)A.Length);\n"
+    "    memcpy(Bytes + A.Length, DF_STRING_BYTES(B), (size_t)B.Length);\n"
+    "    Bytes[Result.Length] = '\\0';\n"
+    "    if(Result.Length >= DF_STRING_INLINE_CAPACITY)\n"
+    "    {\n"
+    "        Result.Data = Bytes;\n"
+    "    }\n"
+    "    return Result;\n"
+    "}\n";
+
+static const char* RuntimeClock =
+    "// Nanoseconds of the monotonic clock.\n"
+    "static unsigned long long DF_Clock(void)\n"
+    "{\n"
+    "#if defined(_WIN32)\n"
+    "    LARGE_INTEGER Frequency;\n"
+    "    LARGE_INTEGER Counter;\n"
+    "    QueryPerformanceFrequency(&Frequency);\n"
+    "    QueryPerformanceCounter(&Counter);\n"
+    "    return (unsigned long long)((double)Counter.QuadPart * 1e9 / (double)Frequency.QuadPart);\n"
+    "#else\n"
+    "    struct timespec Time;\n"
+    "    clock_gettime(CLOCK_MONOTONIC, &Time);\n"
+    "    return (unsigned long long)Time.tv_sec * 1000000000ULL + (unsigned long long)Time.tv_nsec;\n"
+    "#endif\n"
+    "}\n";
+
+static const char* RuntimeProfile =
+    "// Function profile of --profile builds. Every translated function is wrapped between DF_ProfileEnter and\n"
+    "// DF_ProfileExit on its df_profile_function, which joins DF_Profile.Functions on its first call. Time is counted in\n"
+    "// ticks of the cycle counter where there is one, converted with the clock at exit. Frames deeper than\n"
+    "// DF_PROFILE_STACK_SIZE are only counted as calls.\n"
+    "#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))\n"
+    "#include <x86intrin.h>\n"
+    "#define DF_ProfileTicks() __rdtsc()\n"
+    "#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))\n"
+    "#include <intrin.h>\n"
+    "#define DF_ProfileTicks() __rdtsc()\n"
+    "#else\n"
+    "#define DF_ProfileTicks() DF_Clock()\n"
+    "#endif\n"
+    "\n"
+    "typedef struct df_profile_function\n"
+    "{\n"
+    "    const char* Name;\n"
+    "    unsigned long long Calls;\n"
+    "    unsigned long long Inclusive;\n"
+    "    unsigned long long Exclusive;\n"
+    "    // Frames of the function being run, inclusive time only counts the outermost of recursive calls.\n"
+    "    unsigned Depth;\n"
+    "    struct df_profile_function* Next;\n"
+    "} df_profile_function;\n"
+    "\n"
+    "typedef struct df_profile_frame\n"
+    "{\n"
+    "    df_profile_function* Function;\n"
+    "    unsigned long long Start;\n"
+    "    unsigned long long Children;\n"
+    "} df_profile_frame;\n"
+    "\n"
+    "typedef struct df_profile\n"
+    "{\n"
+    "    df_profile_function* Functions;\n"
+    "    unsigned Depth;\n"
+    "    unsigned long long StartTicks;\n"
+    "    unsigned long long StartTime;\n"
+    "    df_profile_frame Frames[DF_PROFILE_STACK_SIZE];\n"
+    "} df_profile;\n"
+    "\n"
+    "// Defined once next to the translated code, as every unit of a split build includes the runtime.\n"
+    "extern df_profile DF_Profile;\n"
+    "\n"
+    "static int DF_ProfileCompare(const void* A, const void* B)\n"
+    "{\n"
+    "    unsigned long long X = (*(df_profile_function* const*)A)->Exclusive;\n"
+    "    unsigned long long Y = (*(df_profile_function* const*)B)->Exclusive;\n"
+    "    return (X < Y) - (X > Y);\n"
+    "}\n"
+    "\n"
+    "// Prints the flat profile on stderr, sorted by self time.\n"
+    "static void DF_ProfileReport(void)\n"
+    "{\n"
+    "    unsigned long long Ticks = DF_ProfileTicks() - DF_Profile.StartTicks;\n"
+    "    double Milliseconds = Ticks ? (double)(DF_Clock() - DF_Profile.StartTime) / (1e6 * (double)Ticks) : 0.0;\n"
+    "\n"
+    "    size_t Count = 0;\n"
+    "    unsigned long long Total = 0;\n"
+    "    for(df_profile_function* Function = DF_Profile.Functions; Function; Function = Function->Next)\n"
+    "    {\n"
+    "        ++Count;\n"
+    "        Total += Function->Exclusive;\n"
+    "    }\n"
+    "    df_profile_function** Functions = (df_profile_function**)malloc(Count * sizeof(df_profile_function*));\n"
+    "    if(!Functions)\n"
+    "    {\n"
+    "        return;\n"
+    "    }\n"
+    "    Count = 0;\n"
+    "    for(df_profile_function* Function = DF_Profile.Functions; Function; Function = Function->Next)\n"
+    "    {\n"
+    "        Functions[Count++] = Function;\n"
+    "    }\n"
+    "    qsort(Functions, Count, sizeof(df_profile_function*), DF_ProfileCompare);\n"
+    "\n"
+    "    fprintf(stderr, \"%12s %7s %12s %14s  %s\\n\", \"self ms\", \"self %\", \"total ms\", \"calls\", \"function\");\n"
+    "    for(size_t i = 0; i < Count; ++i)\n"
+    "    {\n"
+    "        df_profile_function* Function = Functions[i];\n"
+    "        fprintf(stderr, \"%12.3f %6.2f%% %12.3f %14llu  %s\\n\", (double)Function->Exclusive * Milliseconds,\n"
+    "                Total ? 100.0 * (double)Function->Exclusive / (double)Total : 0.0, (double)Function->Inclusive * Milliseconds,\n"
+    "                Function->Calls, Function->Name);\n"
+    "    }\n"
+    "    free(Functions);\n"
+    "}\n"
+    "\n"
+    "static void DF_ProfileEnter(df_profile_function* Function)\n"
+    "{\n"
+    "    if(!Function->Calls)\n"
+    "    {\n"
+    "        if(!DF_Profile.Functions)\n"
+    "        {\n"
+    "            DF_Profile.StartTime = DF_Clock();\n"
+    "            DF_Profile.StartTicks = DF_ProfileTicks();\n"
+    "            atexit(DF_ProfileReport);\n"
+    "        }\n"
+    "        Function->Next = DF_Profile.Functions;\n"
+    "        DF_Profile.Functions = Function;\n"
+    "    }\n"
+    "    ++Function->Calls;\n"
+    "    ++Function->Depth;\n"
+    "    if(DF_Profile.Depth < DF_PROFILE_STACK_SIZE)\n"
+    "    {\n"
+    "        df_profile_frame* Frame = &DF_Profile.Frames[DF_Profile.Depth];\n"
+    "        Frame->Function = Function;\n"
+    "        Frame->Children = 0;\n"
+    "        Frame->Start = DF_ProfileTicks();\n"
+    "    }\n"
+    "    ++DF_Profile.Depth;\n"
+    "}\n"
+    "\n"
+    "static void DF_ProfileExit(df_profile_function* Function)\n"
+    "{\n"
+    "    unsigned long long End = DF_ProfileTicks();\n"
+    "    --Function->Depth;\n"
+    "    --DF_Profile.Depth;\n"
+    "    if(DF_Profile.Depth < DF_PROFILE_STACK_SIZE)\n"
+    "    {\n"
+    "        df_profile_frame* Frame = &DF_Profile.Frames[DF_Profile.Depth];\n"
+    "        unsigned long long Elapsed = End - Frame->Start;\n"
+    "        Function->Exclusive += Elapsed - Frame->Children;\n"
+    "        if(!Function->Depth)\n"
+    "        {\n"
+    "            Function->Inclusive += Elapsed;\n"
+    "        }\n"
+    "        if(DF_Profile.Depth > 0)\n"
+    "        {\n"
+    "            DF_Profile.Frames[DF_Profile.Depth - 1].Children += Elapsed;\n"
+    "        }\n"
+    "    }\n"
+    "}\n";
+
+static const char* RuntimeBench =
+    "// Harness of bench blocks. After a warm-up whose batches double until one lasts DF_BENCH_BATCH_NS, the body runs in\n"
+    "// batches sized to last about as long, each giving a sample of nanoseconds per iteration.\n"
+    "typedef struct df_bench\n"
+    "{\n"
+    "    const char* Name;\n"
+    "    unsigned long long BatchSize;\n"
+    "    unsigned long long Remaining;\n"
+    "    unsigned long long Start;\n"
+    "    unsigned long long WarmupStart;\n"
+    "    unsigned long long SampleStart;\n"
+    "    int IsWarm;\n"
+    "    int SampleCount;\n"
+    "    double Samples[DF_BENCH_SAMPLE_COUNT];\n"
+    "} df_bench;\n"
+    "\n"
+    "#if defined(__GNUC__) || defined(__clang__)\n"
+    "// Makes the compiler assume the pointed-to memory is read and written, so that work stored there can't be dropped.\n"
+    "#define DF_BenchEscape(Pointer) __asm__ volatile(\"\" : : \"g\"((void*)(Pointer)) : \"memory\")\n"
+    "#define DF_BenchBarrier() __asm__ volatile(\"\" : : : \"memory\")\n"
+    "#else\n"
+    "#include <intrin.h>\n"
+    "static void* volatile DF_BenchSink;\n"
+    "#define DF_BenchEscape(Pointer) (DF_BenchSink = (void*)(Pointer), _ReadWriteBarrier())\n"
+    "#define DF_BenchBarrier() _ReadWriteBarrier()\n"
+    "#endif\n"
+    "\n"
+    "static void DF_BenchBegin(df_bench* Bench, const char* Name)\n"
+    "{\n"
+    "    Bench->Name = Name;\n"
+    "    Bench->BatchSize = 1;\n"
+    "    Bench->Remaining = 1;\n"
+    "    Bench->IsWarm = 0;\n"
+    "    Bench->SampleCount = 0;\n"
+    "    Bench->Start = DF_Clock();\n"
+    "    Bench->WarmupStart = Bench->Start;\n"
+    "    Bench->SampleStart = Bench->Start;\n"
+    "}\n"
+    "\n"
+    "// Called before every iteration, returns 0 once the samples are taken. Bodies too slow for DF_BENCH_SAMPLE_COUNT\n"
+    "// samples within DF_BENCH_TIME_NS stop after DF_BENCH_MIN_SAMPLE_COUNT.\n"
+    "static int DF_BenchNext(df_bench* Bench)\n"
+    "{\n"
+    "    if(Bench->Remaining)\n"
+    "    {\n"
+    "        --Bench->Remaining;\n"
+    "        return 1;\n"
+    "    }\n"
+    "\n"
+    "    unsigned long long Now = DF_Clock();\n"
+    "    unsigned long long Elapsed = Now - Bench->Start;\n"
+    "    if(!Bench->IsWarm)\n"
+    "    {\n"
+    "        if(Now - Bench->WarmupStart < DF_BENCH_WARMUP_NS)\n"
+    "        {\n"
+    "            if(Elapsed < DF_BENCH_BATCH_NS)\n"
+    "            {\n"
+    "                Bench->BatchSize *= 2;\n"
+    "            }\n"
+    "        }\n"
+    "        else\n"
+    "        {\n"
+    "            double PerIteration = (double)Elapsed / (double)Bench->BatchSize;\n"
+    "            double BatchSize = (double)DF_BENCH_BATCH_NS / ((PerIteration > 1.0) ? PerIteration : 1.0);\n"
+    "            Bench->BatchSize = (BatchSize > 1.0) ? (unsigned long long)BatchSize : 1;\n"
+    "            Bench->IsWarm = 1;\n"
+    "            Bench->SampleStart = Now;\n"
+    "        }\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        Bench->Samples[Bench->SampleCount++] = (double)Elapsed / (double)Bench->BatchSize;\n"
+    "        if((Bench->SampleCount == DF_BENCH_SAMPLE_COUNT) ||\n"
+    "           ((Bench->SampleCount >= DF_BENCH_MIN_SAMPLE_COUNT) && (Now - Bench->SampleStart >= DF_BENCH_TIME_NS)))\n"
+    "        {\n"
+    "            return 0;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    Bench->Remaining = Bench->BatchSize - 1;\n"
+    "    Bench->Start = DF_Clock();\n"
+    "    return 1;\n"
+    "}\n"
+    "\n"
+    "static int DF_BenchCompare(const void* A, const void* B)\n"
+    "{\n"
+    "    double X = *(const double*)A;\n"
+    "    double Y = *(const double*)B;\n"
+    "    return (X > Y) - (X < Y);\n"
+    "}\n"
+    "\n"
+    "// Prints min, median and 99th percentile of the samples, as a line of JSON when the environment has DF_BENCH=json.\n"
+    "static void DF_BenchEnd(df_bench* Bench)\n"
+    "{\n"
+    "    int Count = Bench->SampleCount;\n"
+    "    qsort(Bench->Samples, (size_t)Count, sizeof(double), DF_BenchCompare);\n"
+    "    double Min = Bench->Samples[0];\n"
+    "    double Median = Bench->Samples[Count / 2];\n"
+    "    double P99 = Bench->Samples[(99 * Count + 99) / 100 - 1];\n"
+    "\n"
+    "#if defined(DF_WRITER_CAPACITY)\n"
+    "    DF_Flush();\n"
+    "#endif\n"
+    "    const char* Format = getenv(\"DF_BENCH\");\n"
+    "    if(Format && (strcmp(Format, \"json\") == 0))\n"
+    "    {\n"
+    "        printf(\"{\\\"name\\\":\\\"\");\n"
+    "        for(const char* Character = Bench->Name; *Character; ++Character)\n"
+    "        {\n"
+    "            if((*Character == '\"') || (*Character == '\\\\'))\n"
+    "            {\n"
+    "                printf(\"\\\\%c\", *Character);\n"
+    "            }\n"
+    "            else if((unsigned char)*Character < 0x20)\n"
+    "            {\n"
+    "                printf(\"\\\\u%04x\", (unsigned)*Character);\n"
+    "            }\n"
+    "            else\n"
+    "            {\n"
+    "                putchar(*Character);\n"
+    "            }\n"
+    "        }\n"
+    "        printf(\"\\\",\\\"min_ns\\\":%.3f,\\\"median_ns\\\":%.3f,\\\"p99_ns\\\":%.3f,\\\"samples\\\":%d,\\\"batch\\\":%llu}\\n\", Min, Median, P99, Count,\n"
+    "               Bench->BatchSize);\n"
+    "    }\n"
+    "    else\n"
+    "    {\n"
+    "        printf(\"bench %s: min %.3f ns, median %.3f ns, p99 %.3f ns (%d samples of %llu iterations)\\n\", Bench->Name, Min, Median,\n"
+    "               P99, Count, Bench->BatchSize);\n"
+    "    }\n"
+    "    fflush(stdout);\n"
+    "}\n";
+
+// The system headers needed by the runtime pieces the generated code referenced, at most MAX_RUNTIME_INCLUDE_COUNT.
+static uint32_t GetRuntimeIncludes(translator* Translator, const char** Headers)
+{
+    uint32_t Count = 0;
+    Headers[Count++] = "<stdint.h>";
+    if(Translator->RuntimeFlags & (RUNTIME_bounds_check | RUNTIME_string | RUNTIME_arena | RUNTIME_print | RUNTIME_output | RUNTIME_bench | RUNTIME_profile))
+    {
+        Headers[Count++] = "<stdio.h>";
+        Headers[Count++] = "<stdlib.h>";
+    }
+    if(Translator->RuntimeFlags & (RUNTIME_string | RUNTIME_output | RUNTIME_bench))
+    {
+        Headers[Count++] = "<string.h>";
+    }
+    return Count;
+}
+
+// Writes the includes of the runtime header, or of the prelude, which lists the runtime headers together with the ones
+// of the program through AddInclude, so that each is written once.
+static void WriteRuntimeIncludes(translator* Translator, FILE* FileHandle, bool IsPrelude)
+{
+    // clock_gettime is POSIX, which strict C modes hide unless asked for before the first system header.
+    if(Translator->RuntimeFlags & (RUNTIME_bench | RUNTIME_profile))
+    {
+        fprintf(FileHandle, "#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)\n#define _POSIX_C_SOURCE 199309L\n#endif\n");
+    }
+    const char* Headers[MAX_RUNTIME_INCLUDE_COUNT];
+    uint32_t HeaderCount = GetRuntimeIncludes(Translator, Headers);
+    for(uint32_t i = 0; i < HeaderCount; ++i)
+    {
+        if(IsPrelude)
+        {
+            AddInclude(Translator, Headers[i], (uint32_t)strlen(Headers[i]), true);
+        }
+        else
+        {
+            fprintf(FileHandle, "#include %s\n", Headers[i]);
+        }
+    }
+    for(uint32_t i = 0; IsPrelude && (i < Translator->IncludeCount); ++i)
+    {
+        if(Translator->IsInPrelude[i])
+        {
+            fprintf(FileHandle, "#include %s\n", Translator->Includes[i]);
+        }
+    }
+    if(Translator->RuntimeFlags & (RUNTIME_bench | RUNTIME_profile))
+    {
+        fprintf(FileHandle, "#if defined(_WIN32)\n#ifndef WIN32_LEAN_AND_MEAN\n#define WIN32_LEAN_AND_MEAN\n#endif\n#include <windows.h>\n#else\n#include <time.h>\n#endif\n");
+    }
+}
+
+// All system headers of the program in one place, so that they can be precompiled once.
+static int32_t WritePrelude(translator* Translator, FILE* FileHandle)
+{
+    fprintf(FileHandle, "#ifndef DF_PRELUDE_H\n#define DF_PRELUDE_H\n\n");
+    WriteRuntimeIncludes(Translator, FileHandle, true);
+    fprintf(FileHandle, "\n#endif\n");
+    return 1;
+}
+
+static int32_t WriteRuntime(translator* Translator, FILE* FileHandle)
+{
+    fprintf(FileHandle, "#ifndef DF_RUNTIME_H\n#define DF_RUNTIME_H\n\n");
+    WriteRuntimeIncludes(Translator, FileHandle, false);
+    fprintf(FileHandle, "\n");
+
+    if(Translator->RuntimeFlags & RUNTIME_string)
+    {
+        fprintf(FileHandle, "#define DF_STRING_INLINE_CAPACITY %d\n#define DF_STRING_SCRATCH_COUNT 4\n\n%s\n", STRING_INLINE_CAPACITY, RuntimeString);
+    }
+    if(Translator->RuntimeFlags & RUNTIME_arena)
+    {
+        fprintf(FileHandle, "#define DF_ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)\n\n%s\n", RuntimeArena);
+        if(Translator->RuntimeFlags & RUNTIME_string)
+        {
+            fprintf(FileHandle, "%s\n", RuntimeArenaString);
+        }
+    }
+
+    for(int32_t Type = TOKEN_char; Type <= TOKEN_string; ++Type)
+    {
+        if(Translator->SliceTypeFlags & (1 << (Type - TOKEN_char)))
+        {
+            fprintf(FileHandle, "typedef struct df_slice_%s\n{\n    %s* Data;\n    int64_t Length;\n} df_slice_%s;\n\n",
+                    GetTypeName(Type), GetCTypeName(Type), GetTypeName(Type));
+        }
+    }
+
+    for(int32_t Type = TOKEN_char; Type <= TOKEN_string; ++Type)
+    {
+        if(Translator->ArenaSliceTypeFlags & (1 << (Type - TOKEN_char)))
+        {
+            const char* Name = GetTypeName(Type);
+            const char* CName = GetCTypeName(Type);
+            fprintf(FileHandle,
+                    "static df_slice_%s DF_ArenaPushSlice_%s(df_arena* Arena, int64_t Count)\n"
+                    "{\n"
+                    "    df_slice_%s Result;\n"
+                    "    Result.Data = (%s*)DF_ArenaPush(Arena, sizeof(%s) * (size_t)((Count > 0) ? Count : 0), (sizeof(%s) < 16) ? sizeof(%s) : 16);\n"
+                    "    Result.Length = (Count > 0) ? Count : 0;\n"
+                    "    return Result;\n"
+                    "}\n\n", Name, Name, Name, CName, CName, CName, CName);
+        }
+    }
+
+    if(Translator->RuntimeFlags & RUNTIME_print)
+    {
+        fprintf(FileHandle, "%s\n", RuntimePrint);
+        if(Translator->RuntimeFlags & RUNTIME_string)
+        {
+            fprintf(FileHandle, "%s\n", RuntimePrintString);
+        }
+    }
+    if(Translator->RuntimeFlags & RUNTIME_output)
+    {
+        fprintf(FileHandle, "#define DF_WRITER_CAPACITY (64 * 1024)\n\n%s\n", RuntimeOutput);
+        if(Translator->RuntimeFlags & RUNTIME_string)
+        {
+            fprintf(FileHandle, "%s\n", RuntimeOutputString);
+        }
+    }
+    if(Translator->RuntimeFlags & (RUNTIME_bench | RUNTIME_profile))
+    {
+        fprintf(FileHandle, "%s\n", RuntimeClock);
+    }
+    if(Translator->RuntimeFlags & RUNTIME_profile)
+    {
+        fprintf(FileHandle, "#define DF_PROFILE_STACK_SIZE 1024\n\n%s\n", RuntimeProfile);
+    }
+    if(Translator->RuntimeFlags & RUNTIME_bench)
+    {
+        fprintf(FileHandle,
+                "#define DF_BENCH_WARMUP_NS 50000000ULL\n#define DF_BENCH_BATCH_NS 1000000ULL\n#define DF_BENCH_TIME_NS 1000000000ULL\n"
+                "#define DF_BENCH_SAMPLE_COUNT 100\n#define DF_BENCH_MIN_SAMPLE_COUNT 10\n\n%s\n", RuntimeBench);
+    }
+    if(Translator->RuntimeFlags & RUNTIME_bounds_check)
+    {
+        fprintf(FileHandle, "%s\n", RuntimeBoundsCheck);
+    }
+
+    // The pooled strings are defined once, see WriteStringPool.
+    for(uint32_t i = 0; i < Translator->PooledStringCount; ++i)
+    {
+        fprintf(FileHandle, "#define DF_LITERAL%u_LENGTH %u\nextern const char DF_Literal%u[%u];\n", i, Translator->PooledStringLengths[i], i,
+                Translator->PooledStringLengths[i] + 1);
+    }
+    fprintf(FileHandle, Translator->PooledStringCount ? "\n#endif\n" : "#endif\n");
+    return 1;
+}
+
+static void WriteStringPool(translator* Translator, FILE* FileHandle)
+{
+    for(uint32_t i = 0; i < Translator->PooledStringCount; ++i)
+    {
+        fprintf(FileHandle, "%sconst char DF_Literal%u[%u] = \"", i ? "" : "\n", i, Translator->PooledStringLengths[i] + 1);
+        TranslateStringBytes(FileHandle, Translator->PooledBytes + Translator->PooledStringOffsets[i], Translator->PooledStringLengths[i]);
+        fprintf(FileHandle, "\";\n");
+    }
+}
+
+// -----------
+// --SOURCES--
+// -----------
+
+#define MAX_SOURCE_FILE_COUNT 64
+// Declarations are located by 32-bit offsets.
+#define MAX_SOURCE_FILE_SIZE (1u << 30)
+#define LEXER_STORAGE_SIZE 0x10000
+#define RESULT_FILE_NAME "result.c"
+#define SPLIT_HEADER_FILE_NAME "result.h"
+#define SPLIT_UNIT_FILE_NAME "result_%u.c"
+#define SPLIT_MAKEFILE_NAME "result.mk"
+#define MAX_SPLIT_COUNT 64
+#define PRELUDE_SOURCE_FILE_NAME "df_prelude.c"
+#define MAX_PARSE_THREAD_COUNT 16
+#define MIN_PARSE_BYTES_PER_THREAD (32 * 1024)
+#define PARSE_BATCH_SIZE 256
+
+struct declaration
+{
+    uint32_t Offset;
+    uint32_t Length;
+    uint64_t Hash;
+    bool HasAst;
+    // Set for functions that main can't reach, which are only checked for errors.
+    bool IsUnreachable;
+    ast Ast;
+};
+
+// Source text is kept split into top-level declarations, so that a reload only re-parses the ones that changed.
+struct source_file
+{
+    char* Name;
+    char* Text;
+    uint32_t DeclarationCount;
+    uint32_t DeclarationCapacity;
+    declaration* Declarations;
+
+    // .dfa inputs are mapped instead, their ASTs use the strings of the mapping.
+    bool IsAstFile;
+    df_ast_mapping Mapping;
+};
+
+struct options
+{
+    bool IsWatching;
+    bool IsPrecompilingPrelude;
+    bool IsReportingMemory;
+    // Wraps every function with the counters of RuntimeProfile.
+    bool IsProfiling;
+    char* AstFileName;
+    // Number of units written by --split, 0 for a single RESULT_FILE_NAME.
+    uint32_t SplitCount;
+};
+
+// The buffer is sized from the file, and the file is refused rather than cut when it is larger than
+// MAX_SOURCE_FILE_SIZE.
+static char* ReadEntireFile(const char* FileName, uint32_t* Length)
+{
+    FILE* FileHandle = fopen(FileName, "rb");
+    if(!FileHandle)
+    {
+        return NULL;
+    }
+    fseek(FileHandle, 0, SEEK_END);
+    long FileSize = ftell(FileHandle);
+    fseek(FileHandle, 0, SEEK_SET);
+    if((FileSize < 0) || ((unsigned long)FileSize > MAX_SOURCE_FILE_SIZE))
+    {
+        fprintf(stderr, "Error: %s is too large, sources can have at most %u bytes.\n", FileName, MAX_SOURCE_FILE_SIZE);
+        fclose(FileHandle);
+        return NULL;
+    }
+
+    char* Text = (char*)Allocate(MEMORY_input, (size_t)FileSize + LEXER_PADDING);
+    size_t ReadLength = fread(Text, 1, (size_t)FileSize, FileHandle);
+    fclose(FileHandle);
+
+    memset(Text + ReadLength, 0, LEXER_PADDING);
+    *Length = (uint32_t)ReadLength;
+    return Text;
+}
+
+static declaration* PushDeclaration(declaration** Declarations, uint32_t* Capacity, uint32_t* Count)
+{
+    if(*Count == *Capacity)
+    {
+        *Capacity = *Capacity ? (2 * *Capacity) : 64;
+        *Declarations = (declaration*)Reallocate(MEMORY_ast, *Declarations, sizeof(declaration) * *Capacity);
+    }
+    declaration* Result = &(*Declarations)[(*Count)++];
+    memset(Result, 0, sizeof(declaration));
+    return Result;
+}
+
+// -------------
+// --AST FILES--
+// -------------
+// Writing and loading of the binary AST format described in df_ast.h.
+
+static_assert(((int)EXPR_char == (int)DF_AST_EXPR_char) && ((int)EXPR_int == (int)DF_AST_EXPR_int) && ((int)EXPR_real == (int)DF_AST_EXPR_real) &&
+              ((int)EXPR_string == (int)DF_AST_EXPR_string) && ((int)EXPR_id == (int)DF_AST_EXPR_id) && ((int)EXPR_var == (int)DF_AST_EXPR_var) &&
+              ((int)EXPR_paren == (int)DF_AST_EXPR_paren) && ((int)EXPR_binary == (int)DF_AST_EXPR_binary) && ((int)EXPR_call == (int)DF_AST_EXPR_call) &&
+              ((int)EXPR_index == (int)DF_AST_EXPR_index) && ((int)EXPR_field == (int)DF_AST_EXPR_field) && ((int)EXPR_if == (int)DF_AST_EXPR_if) &&
+              ((int)EXPR_for == (int)DF_AST_EXPR_for) && ((int)EXPR_return == (int)DF_AST_EXPR_return) && ((int)EXPR_inline == (int)DF_AST_EXPR_inline) &&
+              ((int)EXPR_unary == (int)DF_AST_EXPR_unary) && ((int)EXPR_bench == (int)DF_AST_EXPR_bench) &&
+              ((int)EXPR_match == (int)DF_AST_EXPR_match) && ((int)EXPR_case == (int)DF_AST_EXPR_case),
+              "Expression kinds of df_ast.h must match expr_type.");
+static_assert(((int)AST_expr == (int)DF_AST_DECLARATION_expr) && ((int)AST_func == (int)DF_AST_DECLARATION_func) && ((int)AST_struct == (int)DF_AST_DECLARATION_struct),
+              "Declaration kinds of df_ast.h must match ast_type.");
+static_assert(((int)ARRAY_none == (int)DF_AST_ARRAY_none) && ((int)ARRAY_fixed == (int)DF_AST_ARRAY_fixed) && ((int)ARRAY_slice == (int)DF_AST_ARRAY_slice),
+              "Array kinds of df_ast.h must match array_kind.");
+
+#define MAX_AST_FILE_DEPTH 1024
+
+struct ast_string_fixup
+{
+    uint32_t Position;
+    uint32_t StringOffset;
+};
+
+// Records are appended to one growing buffer and referred to by position until the image is complete.
+struct ast_writer
+{
+    char* Buffer;
+    uint32_t Length;
+    uint32_t Capacity;
+
+    string_storage* Strings;
+    bool IsOutOfStrings;
+    uint32_t FixupCount;
+    uint32_t FixupCapacity;
+    ast_string_fixup* Fixups;
+};
+
+#define AST_RECORD(Writer, Type, Position) ((Type*)((Writer)->Buffer + (Position)))
+
+static uint32_t PushAstRecord(ast_writer* Writer, uint32_t Size)
+{
+    uint32_t Position = (Writer->Length + 7) & ~7u;
+    if(Position + Size > Writer->Capacity)
+    {
+        Writer->Capacity = 2 * (Position + Size);
+        Writer->Buffer = (char*)Reallocate(MEMORY_output, Writer->Buffer, Writer->Capacity);
+    }
+    memset(Writer->Buffer + Writer->Length, 0, Position + Size - Writer->Length);
+    Writer->Length = Position + Size;
+    return Position;
+}
+
+static void SetAstOffset(ast_writer* Writer, uint32_t FieldPosition, uint32_t TargetPosition)
+{
+    *(int32_t*)(Writer->Buffer + FieldPosition) = TargetPosition ? (int32_t)(TargetPosition - FieldPosition) : 0;
+}
+
+// The string section goes after the records, so string offsets are patched in once its position is known.
+static void SetAstString(ast_writer* Writer, uint32_t FieldPosition, const char* String)
+{
+    if(!String)
+    {
+        return;
+    }
+    int32_t Index = AddStringToStorage(Writer->Strings, (char*)String, (uint32_t)strlen(String) + 1);
+    if(Index < 0)
+    {
+        Writer->IsOutOfStrings = true;
+        return;
+    }
+    if(Writer->FixupCount == Writer->FixupCapacity)
+    {
+        Writer->FixupCapacity = Writer->FixupCapacity ? 2 * Writer->FixupCapacity : 256;
+        Writer->Fixups = (ast_string_fixup*)Reallocate(MEMORY_output, Writer->Fixups, sizeof(ast_string_fixup) * Writer->FixupCapacity);
+    }
+    ast_string_fixup* Fixup = &Writer->Fixups[Writer->FixupCount++];
+    Fixup->Position = FieldPosition;
+    Fixup->StringOffset = (uint32_t)(Writer->Strings->StringArray[Index] - Writer->Strings->Strings);
+}
+
+static void SetAstType(ast_writer* Writer, uint32_t Position, type_spec* Type)
+{
+    df_ast_type* Record = AST_RECORD(Writer, df_ast_type, Position);
+    Record->ArrayKind = (uint32_t)Type->ArrayKind;
+    Record->ArrayLength = Type->ArrayLength;
+    SetAstString(Writer, Position + offsetof(df_ast_type, Name), (Type->Type == TOKEN_id) ? Type->Name : GetTypeName(Type->Type));
+}
+
+static uint32_t WriteAstOffsets(ast_writer* Writer, uint32_t* Targets, uint32_t Count)
+{
+    if(Count == 0)
+    {
+        return 0;
+    }
+    uint32_t Position = PushAstRecord(Writer, Count * sizeof(int32_t));
+    for(uint32_t i = 0; i < Count; ++i)
+    {
+        SetAstOffset(Writer, Position + i * sizeof(int32_t), Targets[i]);
+    }
+    return Position;
+}
+
+static uint32_t PackAstOperator(int32_t Operator)
+{
+    if(Operator < TOKEN_eof)
+    {
+        return (uint32_t)Operator;
+    }
+    const char* Name = GetOperatorName(Operator);
+    return Name ? ((uint32_t)(uint8_t)Name[0] | ((uint32_t)(uint8_t)Name[1] << 8)) : 0;
+}
+
+static int32_t UnpackAstOperator(uint32_t Operator)
+{
+    if(Operator < TOKEN_eof)
+    {
+        return (int32_t)Operator;
+    }
+    for(int32_t Token = TOKEN_eof; Token < TOKEN_count; ++Token)
+    {
+        if(GetOperatorName(Token) && (PackAstOperator(Token) == Operator))
+        {
+            return Token;
+        }
+    }
+    return 0;
+}
+
+// Children are written before their parent, so a record only ever points backwards.
+static uint32_t WriteAstExpression(ast_writer* Writer, expr* Expression)
+{
+    if(!Expression)
+    {
+        return 0;
+    }
+
+    uint32_t Children[2 * MAX_EXPRESSION_COUNT + 1];
+    uint32_t ChildCount = 0;
+    uint32_t Split = 0;
+    uint32_t Operator = 0;
+    uint64_t Value = 0;
+    const char* Name = NULL;
+    switch(Expression->ExprType)
+    {
+        default:
+        {
+        } break;
+        case EXPR_char:
+        {
+            Value = (uint8_t)Expression->CharExpr.CharValue;
+        } break;
+        case EXPR_int:
+        {
+            Value = Expression->IntExpr.IntValue;
+        } break;
+        case EXPR_real:
+        {
+            memcpy(&Value, &Expression->RealExpr.RealValue, sizeof(Value));
+        } break;
+        case EXPR_string:
+        {
+            Name = Expression->StringExpr.String;
+        } break;
+        case EXPR_id:
+        {
+            Name = Expression->IdExpr.String;
+        } break;
+        case EXPR_inline:
+        {
+            Name = Expression->InlineExpr.Text;
+        } break;
+        case EXPR_var:
+        {
+            Name = Expression->VarExpr.Name;
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->VarExpr.Expr);
+        } break;
+        case EXPR_paren:
+        {
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->ParenExpr.InnerExpr);
+        } break;
+        case EXPR_binary:
+        {
+            Operator = PackAstOperator(Expression->BinaryExpr.Operator);
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->BinaryExpr.LHS);
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->BinaryExpr.RHS);
+        } break;
+        case EXPR_unary:
+        {
+            Operator = PackAstOperator(Expression->UnaryExpr.Operator);
+            Value = Expression->UnaryExpr.IsPostfix;
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->UnaryExpr.Operand);
+        } break;
+        case EXPR_call:
+        {
+            Name = Expression->CallExpr.Name;
+            for(uint32_t i = 0; i < Expression->CallExpr.ArgumentCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->CallExpr.Arguments[i]);
+            }
+        } break;
+        case EXPR_index:
+        {
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->IndexExpr.Array);
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->IndexExpr.Index);
+        } break;
+        case EXPR_field:
+        {
+            Name = Expression->FieldExpr.Field;
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->FieldExpr.Object);
+        } break;
+        case EXPR_if:
+        {
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->IfExpr.Statement);
+            Split = Expression->IfExpr.TrueExpressionCount;
+            for(uint32_t i = 0; i < Expression->IfExpr.TrueExpressionCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->IfExpr.TrueExpressions[i]);
+            }
+            for(uint32_t i = 0; i < Expression->IfExpr.FalseExpressionCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->IfExpr.FalseExpressions[i]);
+            }
+        } break;
+        case EXPR_for:
+        {
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->ForExpr.Definition);
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->ForExpr.Condition);
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->ForExpr.Action);
+            for(uint32_t i = 0; i < Expression->ForExpr.ExpressionCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->ForExpr.Expressions[i]);
+            }
+        } break;
+        case EXPR_return:
+        {
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->ReturnExpr.Expression);
+        } break;
+        case EXPR_bench:
+        {
+            Name = Expression->BenchExpr.Name;
+            for(uint32_t i = 0; i < Expression->BenchExpr.ExpressionCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->BenchExpr.Expressions[i]);
+            }
+        } break;
+        case EXPR_match:
+        {
+            Children[ChildCount++] = WriteAstExpression(Writer, Expression->MatchExpr.Value);
+            for(uint32_t i = 0; i < Expression->MatchExpr.CaseCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->MatchExpr.Cases[i]);
+            }
+        } break;
+        case EXPR_case:
+        {
+            Split = Expression->CaseExpr.ValueCount;
+            for(uint32_t i = 0; i < Expression->CaseExpr.ValueCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->CaseExpr.Values[i]);
+            }
+            for(uint32_t i = 0; i < Expression->CaseExpr.ExpressionCount; ++i)
+            {
+                Children[ChildCount++] = WriteAstExpression(Writer, Expression->CaseExpr.Expressions[i]);
+            }
+        } break;
+    }
+
+    uint32_t ChildrenPosition = WriteAstOffsets(Writer, Children, ChildCount);
+    uint32_t Position = PushAstRecord(Writer, sizeof(df_ast_expr));
+    df_ast_expr* Record = AST_RECORD(Writer, df_ast_expr, Position);
+    Record->Kind = (uint32_t)Expression->ExprType;
+    Record->Operator = Operator;
+    Record->Value = Value;
+    Record->ChildCount = ChildCount;
+    Record->Split = Split;
+    SetAstString(Writer, Position + offsetof(df_ast_expr, Name), Name);
+    SetAstOffset(Writer, Position + offsetof(df_ast_expr, Children), ChildrenPosition);
+    if(Expression->ExprType == EXPR_var)
+    {
+        SetAstType(Writer, Position + offsetof(df_ast_expr, Type), &Expression->VarExpr.Type);
+    }
+    return Position;
+}
+
+static uint32_t WriteAstExpressions(ast_writer* Writer, expr** Expressions, uint32_t Count)
+{
+    uint32_t Positions[MAX_EXPRESSION_COUNT + MAX_FIELD_COUNT];
+    for(uint32_t i = 0; i < Count; ++i)
+    {
+        Positions[i] = WriteAstExpression(Writer, Expressions[i]);
+    }
+    return WriteAstOffsets(Writer, Positions, Count);
+}
+
+static uint32_t WriteAstDeclaration(ast_writer* Writer, ast* Ast)
+{
+    switch(Ast->AstType)
+    {
+        default:
+        {
+            return 0;
+        } break;
+        case AST_expr:
+        {
+            return WriteAstExpression(Writer, Ast->Expr);
+        } break;
+        case AST_func:
+        {
+            func* Function = Ast->Func;
+            if(!Function)
+            {
+                return 0;
+            }
+            uint32_t Parameters = WriteAstExpressions(Writer, Function->Parameters, Function->ParameterCount);
+            uint32_t Expressions = WriteAstExpressions(Writer, Function->Expressions, Function->ExpressionCount);
+            uint32_t Position = PushAstRecord(Writer, sizeof(df_ast_func));
+            df_ast_func* Record = AST_RECORD(Writer, df_ast_func, Position);
+            Record->ParameterCount = Function->ParameterCount;
+            Record->ExpressionCount = Function->ExpressionCount;
+            SetAstType(Writer, Position + offsetof(df_ast_func, Type), &Function->Type);
+            SetAstString(Writer, Position + offsetof(df_ast_func, Name), Function->Name);
+            SetAstOffset(Writer, Position + offsetof(df_ast_func, Parameters), Parameters);
+            SetAstOffset(Writer, Position + offsetof(df_ast_func, Expressions), Expressions);
+            return Position;
+        } break;
+        case AST_struct:
+        {
+            struct_decl* Struct = Ast->Struct;
+            if(!Struct)
+            {
+                return 0;
+            }
+            uint32_t Fields = WriteAstExpressions(Writer, Struct->Fields, Struct->FieldCount);
+            uint32_t Position = PushAstRecord(Writer, sizeof(df_ast_struct));
+            df_ast_struct* Record = AST_RECORD(Writer, df_ast_struct, Position);
+            Record->IsSoa = Struct->IsSoa;
+            Record->FieldCount = Struct->FieldCount;
+            SetAstString(Writer, Position + offsetof(df_ast_struct, Name), Struct->Name);
+            SetAstOffset(Writer, Position + offsetof(df_ast_struct, Fields), Fields);
+            return Position;
+        } break;
+    }
+}
+
+static int32_t WriteAstFile(source_file** Files, uint32_t FileCount, const char* FileName)
+{
+    ast_writer Writer = {};
+    Writer.Strings = (string_storage*)Allocate(MEMORY_output, sizeof(string_storage));
+    InitStringStorage(Writer.Strings, (char*)Allocate(MEMORY_output, STRING_STORAGE_SIZE), STRING_STORAGE_SIZE);
+    PushAstRecord(&Writer, sizeof(df_ast_header));
+
+    uint32_t DeclarationCount = 0;
+    for(uint32_t i = 0; i < FileCount; ++i)
+    {
+        DeclarationCount += Files[i]->DeclarationCount;
+    }
+    uint32_t* Kinds = (uint32_t*)Allocate(MEMORY_output, sizeof(uint32_t) * (DeclarationCount + 1));
+    uint32_t* Nodes = (uint32_t*)Allocate(MEMORY_output, sizeof(uint32_t) * (DeclarationCount + 1));
+    DeclarationCount = 0;
+    for(uint32_t FileIndex = 0; FileIndex < FileCount; ++FileIndex)
+    {
+        source_file* File = Files[FileIndex];
+        for(uint32_t i = 0; i < File->DeclarationCount; ++i)
+        {
+            uint32_t Node = File->Declarations[i].HasAst ? WriteAstDeclaration(&Writer, &File->Declarations[i].Ast) : 0;
+            if(Node)
+            {
+                Kinds[DeclarationCount] = (uint32_t)File->Declarations[i].Ast.AstType;
+                Nodes[DeclarationCount++] = Node;
+            }
+        }
+    }
+
+    uint32_t Declarations = PushAstRecord(&Writer, DeclarationCount * sizeof(df_ast_declaration));
+    for(uint32_t i = 0; i < DeclarationCount; ++i)
+    {
+        uint32_t Position = Declarations + i * sizeof(df_ast_declaration);
+        AST_RECORD(&Writer, df_ast_declaration, Position)->Kind = Kinds[i];
+        SetAstOffset(&Writer, Position + offsetof(df_ast_declaration, Node), Nodes[i]);
+    }
+
+    uint32_t Strings = PushAstRecord(&Writer, (uint32_t)Writer.Strings->Length);
+    memcpy(Writer.Buffer + Strings, Writer.Strings->Strings, (size_t)Writer.Strings->Length);
+    for(uint32_t i = 0; i < Writer.FixupCount; ++i)
+    {
+        SetAstOffset(&Writer, Writer.Fixups[i].Position, Strings + Writer.Fixups[i].StringOffset);
+    }
+
+    df_ast_header* Header = AST_RECORD(&Writer, df_ast_header, 0);
+    memcpy(Header->Magic, DF_AST_MAGIC, 4);
+    Header->Version = DF_AST_VERSION;
+    Header->Size = Writer.Length;
+    Header->DeclarationCount = DeclarationCount;
+    Header->StringsSize = (uint32_t)Writer.Strings->Length;
+    SetAstOffset(&Writer, offsetof(df_ast_header, Declarations), DeclarationCount ? Declarations : 0);
+    SetAstOffset(&Writer, offsetof(df_ast_header, Strings), Strings);
+
+    if(Writer.IsOutOfStrings)
+    {
+        fprintf(stderr, "Error: too many strings for %s.\n", FileName);
+    }
+    FILE* FileHandle = Writer.IsOutOfStrings ? NULL : fopen(FileName, "wb");
+    int32_t Result = FileHandle && (fwrite(Writer.Buffer, 1, Writer.Length, FileHandle) == Writer.Length);
+    if(FileHandle)
+    {
+        fclose(FileHandle);
+    }
+
+    Deallocate(Kinds);
+    Deallocate(Nodes);
+    Deallocate(Writer.Buffer);
+    Deallocate(Writer.Fixups);
+    Deallocate(Writer.Strings->Strings);
+    Deallocate(Writer.Strings);
+    return Result;
+}
+
+// Offsets are checked against the mapping, since the file may come from anywhere.
+struct ast_reader
+{
+    const char* Base;
+    uint64_t Size;
+    const char* Strings;
+    uint64_t StringsSize;
+    bool IsValid;
+};
+
+static const void* ReadAstOffset(ast_reader* Reader, const int32_t* Offset, uint64_t Size, uint32_t Alignment)
+{
+    const char* Target = (const char*)DF_AstResolve(Offset);
+    if(Target && ((Target < Reader->Base) || ((uint64_t)(Target - Reader->Base) + Size > Reader->Size) ||
+                  ((uint64_t)(Target - Reader->Base) % Alignment)))
+    {
+        Reader->IsValid = false;
+        return NULL;
+    }
+    return Target;
+}
+
+// Every string of the format is required, so a missing one makes the file invalid as well, and so does one outside the
+// string section.
+static char* ReadAstString(ast_reader* Reader, const int32_t* Offset)
+{
+    const char* String = (const char*)ReadAstOffset(Reader, Offset, 1, 1);
+    if(!String || (String < Reader->Strings) || ((uint64_t)(String - Reader->Strings) >= Reader->StringsSize) ||
+       !memchr(String, '\0', (size_t)(Reader->StringsSize - (uint64_t)(String - Reader->Strings))))
+    {
+        Reader->IsValid = false;
+        return NULL;
+    }
+    return (char*)String;
+}
+
+// Arrays are none exactly when they are empty, so a lost count or offset makes the file invalid rather than shorter.
+static void CheckAstArray(ast_reader* Reader, const int32_t* Array, uint32_t Count)
+{
+    if((*Array != 0) != (Count != 0))
+    {
+        Reader->IsValid = false;
+    }
+}
+
+static const df_ast_expr* ReadAstElement(ast_reader* Reader, const int32_t* Array, uint32_t Count, uint32_t Index)
+{
+    const int32_t* Elements = (const int32_t*)ReadAstOffset(Reader, Array, (uint64_t)Count * sizeof(int32_t), 4);
+    return Elements ? (const df_ast_expr*)ReadAstOffset(Reader, &Elements[Index], sizeof(df_ast_expr), 8) : NULL;
+}
+
+static void ReadAstType(ast_reader* Reader, const df_ast_type* Record, type_spec* Type)
+{
+    char* Name = ReadAstString(Reader, &Record->Name);
+    *Type = MakeType(TOKEN_id);
+    Type->Name = Name;
+    for(int32_t Token = TOKEN_char; Name && (Token <= TOKEN_arena); ++Token)
+    {
+        if(strcmp(GetTypeName(Token), Name) == 0)
+        {
+            Type->Type = Token;
+            Type->Name = NULL;
+        }
+    }
+    if(!Name || (Record->ArrayKind > ARRAY_slice))
+    {
+        Reader->IsValid = false;
+        return;
+    }
+    Type->ArrayKind = (array_kind)Record->ArrayKind;
+    Type->ArrayLength = Record->ArrayLength;
+}
+
+static expr* ReadAstExpression(ast_reader* Reader, const df_ast_expr* Record, uint32_t Depth)
+{
+    if(!Record || !Reader->IsValid)
+    {
+        return NULL;
+    }
+    // Offsets could form a cycle in a damaged file.
+    if(Depth > MAX_AST_FILE_DEPTH)
+    {
+        Reader->IsValid = false;
+        return NULL;
+    }
+
+    expr* Result = (expr*)Allocate(MEMORY_ast, sizeof(expr));
+    memset(Result, 0, sizeof(expr));
+    Result->ExprType = (expr_type)Record->Kind;
+    uint32_t ChildCount = Record->ChildCount;
+    CheckAstArray(Reader, &Record->Children, ChildCount);
+    expr* Children[2 * MAX_EXPRESSION_COUNT + 1] = {};
+    if(ChildCount > sizeof(Children) / sizeof(Children[0]))
+    {
+        Reader->IsValid = false;
+        ChildCount = 0;
+    }
+    for(uint32_t i = 0; i < ChildCount; ++i)
+    {
+        Children[i] = ReadAstExpression(Reader, ReadAstElement(Reader, &Record->Children, ChildCount, i), Depth + 1);
+    }
+
+    uint32_t ExpectedChildCount = 0;
+    switch(Record->Kind)
+    {
+        default:
+        {
+            Result->ExprType = EXPR_int;
+            Reader->IsValid = false;
+        } break;
+        case EXPR_char:
+        {
+            Result->CharExpr.CharValue = (char)Record->Value;
+        } break;
+        case EXPR_int:
+        {
+            Result->IntExpr.IntValue = Record->Value;
+        } break;
+        case EXPR_real:
+        {
+            memcpy(&Result->RealExpr.RealValue, &Record->Value, sizeof(double));
+        } break;
+        case EXPR_string:
+        {
+            Result->StringExpr.String = ReadAstString(Reader, &Record->Name);
+        } break;
+        case EXPR_id:
+        {
+            Result->IdExpr.String = ReadAstString(Reader, &Record->Name);
+        } break;
+        case EXPR_inline:
+        {
+            Result->InlineExpr.Text = ReadAstString(Reader, &Record->Name);
+        } break;
+        case EXPR_var:
+        {
+            ExpectedChildCount = 1;
+            ReadAstType(Reader, &Record->Type, &Result->VarExpr.Type);
+            Result->VarExpr.Name = ReadAstString(Reader, &Record->Name);
+            Result->VarExpr.Expr = Children[0];
+        } break;
+        case EXPR_paren:
+        {
+            ExpectedChildCount = 1;
+            Result->ParenExpr.InnerExpr = Children[0];
+        } break;
+        case EXPR_binary:
+        {
+            ExpectedChildCount = 2;
+            Result->BinaryExpr.Operator = UnpackAstOperator(Record->Operator);
+            Result->BinaryExpr.LHS = Children[0];
+            Result->BinaryExpr.RHS = Children[1];
+        } break;
+        case EXPR_unary:
+        {
+            Result->UnaryExpr.Operator = UnpackAstOperator(Record->Operator);
+            Result->UnaryExpr.IsPostfix = (Record->Value != 0);
+            Result->UnaryExpr.Operand = Children[0];
+            if(!IsPrefixOperator(Result->UnaryExpr.Operator))
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            ExpectedChildCount = 1;
+        } break;
+        case EXPR_call:
+        {
+            if(ChildCount > MAX_PARAMETER_COUNT)
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            ExpectedChildCount = ChildCount;
+            Result->CallExpr.Name = ReadAstString(Reader, &Record->Name);
+            Result->CallExpr.ArgumentCount = ChildCount;
+            memcpy(Result->CallExpr.Arguments, Children, sizeof(expr*) * ChildCount);
+        } break;
+        case EXPR_index:
+        {
+            ExpectedChildCount = 2;
+            Result->IndexExpr.Array = Children[0];
+            Result->IndexExpr.Index = Children[1];
+        } break;
+        case EXPR_field:
+        {
+            ExpectedChildCount = 1;
+            Result->FieldExpr.Field = ReadAstString(Reader, &Record->Name);
+            Result->FieldExpr.Object = Children[0];
+        } break;
+        case EXPR_if:
+        {
+            uint32_t TrueCount = Record->Split;
+            if((ChildCount < 1 + TrueCount) || (TrueCount > MAX_EXPRESSION_COUNT) || (ChildCount - 1 - TrueCount > MAX_EXPRESSION_COUNT))
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            ExpectedChildCount = ChildCount;
+            Result->IfExpr.Statement = Children[0];
+            Result->IfExpr.TrueExpressionCount = TrueCount;
+            memcpy(Result->IfExpr.TrueExpressions, Children + 1, sizeof(expr*) * TrueCount);
+            Result->IfExpr.FalseExpressionCount = ChildCount - 1 - TrueCount;
+            memcpy(Result->IfExpr.FalseExpressions, Children + 1 + TrueCount, sizeof(expr*) * (ChildCount - 1 - TrueCount));
+        } break;
+        case EXPR_for:
+        {
+            if((ChildCount < 3) || (ChildCount - 3 > MAX_EXPRESSION_COUNT))
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            ExpectedChildCount = ChildCount;
+            Result->ForExpr.Definition = Children[0];
+            Result->ForExpr.Condition = Children[1];
+            Result->ForExpr.Action = Children[2];
+            Result->ForExpr.ExpressionCount = ChildCount - 3;
+            memcpy(Result->ForExpr.Expressions, Children + 3, sizeof(expr*) * (ChildCount - 3));
+        } break;
+        case EXPR_return:
+        {
+            ExpectedChildCount = 1;
+            Result->ReturnExpr.Expression = Children[0];
+        } break;
+        case EXPR_bench:
+        {
+            Result->BenchExpr.Name = ReadAstString(Reader, &Record->Name);
+            if(!Result->BenchExpr.Name || (ChildCount > MAX_EXPRESSION_COUNT))
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            ExpectedChildCount = ChildCount;
+            Result->BenchExpr.ExpressionCount = ChildCount;
+            memcpy(Result->BenchExpr.Expressions, Children, sizeof(expr*) * ChildCount);
+        } break;
+        case EXPR_match:
+        {
+            if((ChildCount < 1) || (ChildCount - 1 > MAX_EXPRESSION_COUNT))
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            // Only cases go in a match.
+            bool IsValid = true;
+            for(uint32_t i = 1; i < ChildCount; ++i)
+            {
+                IsValid = IsValid && Children[i] && (Children[i]->ExprType == EXPR_case);
+            }
+            if(!IsValid)
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            ExpectedChildCount = ChildCount;
+            Result->MatchExpr.Value = Children[0];
+            Result->MatchExpr.CaseCount = ChildCount - 1;
+            memcpy(Result->MatchExpr.Cases, Children + 1, sizeof(expr*) * (ChildCount - 1));
+        } break;
+        case EXPR_case:
+        {
+            uint32_t ValueCount = Record->Split;
+            if((ValueCount > ChildCount) || (ValueCount > MAX_CASE_VALUE_COUNT) || (ChildCount - ValueCount > MAX_EXPRESSION_COUNT))
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            ExpectedChildCount = ChildCount;
+            Result->CaseExpr.ValueCount = ValueCount;
+            memcpy(Result->CaseExpr.Values, Children, sizeof(expr*) * ValueCount);
+            Result->CaseExpr.ExpressionCount = ChildCount - ValueCount;
+            memcpy(Result->CaseExpr.Expressions, Children + ValueCount, sizeof(expr*) * (ChildCount - ValueCount));
+        } break;
+    }
+
+    // Only the initializer of a variable and the header of a for may be missing.
+    uint32_t OptionalChildCount = (Record->Kind == EXPR_var) ? 1 : ((Record->Kind == EXPR_for) ? 3 : 0);
+    bool HasRequiredChildren = true;
+    for(uint32_t i = OptionalChildCount; i < ChildCount; ++i)
+    {
+        HasRequiredChildren = HasRequiredChildren && Children[i];
+    }
+
+    // Children which didn't find a place in the expression are dropped with it.
+    if(!HasRequiredChildren || (ExpectedChildCount != ChildCount) || !Reader->IsValid)
+    {
+        Reader->IsValid = false;
+        for(uint32_t i = 0; i < ChildCount; ++i)
+        {
+            FreeExpression(Children[i]);
+        }
+        Result->ExprType = EXPR_int;
+    }
+    return Result;
+}
+
+// Parameters and fields are variable declarations.
+static bool ReadAstVariables(ast_reader* Reader, const int32_t* Array, uint32_t Count, uint32_t MaxCount, expr** Variables)
+{
+    CheckAstArray(Reader, Array, Count);
+    if(Count > MaxCount)
+    {
+        Reader->IsValid = false;
+        return false;
+    }
+    for(uint32_t i = 0; i < Count; ++i)
+    {
+        Variables[i] = ReadAstExpression(Reader, ReadAstElement(Reader, Array, Count, i), 0);
+        if(!Variables[i] || (Variables[i]->ExprType != EXPR_var))
+        {
+            Reader->IsValid = false;
+        }
+    }
+    return Reader->IsValid;
+}
+
+static bool ReadAstDeclaration(ast_reader* Reader, const df_ast_declaration* Record, ast* Ast)
+{
+    *Ast = {};
+    switch(Record->Kind)
+    {
+        default:
+        {
+            Reader->IsValid = false;
+        } break;
+        case AST_expr:
+        {
+            Ast->AstType = AST_expr;
+            Ast->Expr = ReadAstExpression(Reader, (const df_ast_expr*)ReadAstOffset(Reader, &Record->Node, sizeof(df_ast_expr), 8), 0);
+            Reader->IsValid = Reader->IsValid && Ast->Expr;
+        } break;
+        case AST_func:
+        {
+            const df_ast_func* FuncRecord = (const df_ast_func*)ReadAstOffset(Reader, &Record->Node, sizeof(df_ast_func), 8);
+            if(!FuncRecord)
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            func* Function = (func*)Allocate(MEMORY_ast, sizeof(func));
+            memset(Function, 0, sizeof(func));
+            Ast->AstType = AST_func;
+            Ast->Func = Function;
+            ReadAstType(Reader, &FuncRecord->Type, &Function->Type);
+            Function->Name = ReadAstString(Reader, &FuncRecord->Name);
+            if(ReadAstVariables(Reader, &FuncRecord->Parameters, FuncRecord->ParameterCount, MAX_PARAMETER_COUNT, Function->Parameters) ||
+               (FuncRecord->ParameterCount <= MAX_PARAMETER_COUNT))
+            {
+                Function->ParameterCount = FuncRecord->ParameterCount;
+            }
+            CheckAstArray(Reader, &FuncRecord->Expressions, FuncRecord->ExpressionCount);
+            if(FuncRecord->ExpressionCount > MAX_EXPRESSION_COUNT)
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            for(uint32_t i = 0; i < FuncRecord->ExpressionCount; ++i)
+            {
+                Function->Expressions[Function->ExpressionCount++] =
+                    ReadAstExpression(Reader, ReadAstElement(Reader, &FuncRecord->Expressions, FuncRecord->ExpressionCount, i), 0);
+                Reader->IsValid = Reader->IsValid && Function->Expressions[i];
+            }
+        } break;
+        case AST_struct:
+        {
+            const df_ast_struct* StructRecord = (const df_ast_struct*)ReadAstOffset(Reader, &Record->Node, sizeof(df_ast_struct), 8);
+            if(!StructRecord)
+            {
+                Reader->IsValid = false;
+                break;
+            }
+            struct_decl* Struct = (struct_decl*)Allocate(MEMORY_ast, sizeof(struct_decl));
+            memset(Struct, 0, sizeof(struct_decl));
+            Ast->AstType = AST_struct;
+            Ast->Struct = Struct;
+            Struct->Name = ReadAstString(Reader, &StructRecord->Name);
+            Struct->IsSoa = (StructRecord->IsSoa != 0);
+            if(ReadAstVariables(Reader, &StructRecord->Fields, StructRecord->FieldCount, MAX_FIELD_COUNT, Struct->Fields) ||
+               (StructRecord->FieldCount <= MAX_FIELD_COUNT))
+            {
+                Struct->FieldCount = StructRecord->FieldCount;
+            }
+        } break;
+    }
+    return Reader->IsValid;
+}
+
+static void FreeDeclarations(source_file* File)
+{
+    for(uint32_t i = 0; i < File->DeclarationCount; ++i)
+    {
+        if(File->Declarations[i].HasAst)
+        {
+            FreeAst(&File->Declarations[i].Ast);
+        }
+    }
+    File->DeclarationCount = 0;
+}
+
+// The translator lowers parts of the AST in place, so records are turned into expressions rather than translated from
+// the mapping directly. Strings aren't copied, they stay in the mapping for as long as the file is loaded.
+static int32_t LoadAstFile(source_file* File)
+{
+    FreeDeclarations(File);
+    DF_AstUnmap(&File->Mapping);
+
+    const df_ast_header* Header = DF_AstMap(File->Name, &File->Mapping);
+    if(!Header)
+    {
+        fprintf(stderr, "Error: %s is not a D Flat AST file of version %d.\n", File->Name, DF_AST_VERSION);
+        return -1;
+    }
+
+    ast_reader Reader = {(const char*)Header, File->Mapping.Size, NULL, Header->StringsSize, true};
+    Reader.Strings = (const char*)ReadAstOffset(&Reader, &Header->Strings, Header->StringsSize, 1);
+    Reader.IsValid = Reader.IsValid && Reader.Strings;
+    CheckAstArray(&Reader, &Header->Declarations, Header->DeclarationCount);
+    const df_ast_declaration* Declarations =
+        (const df_ast_declaration*)ReadAstOffset(&Reader, &Header->Declarations, (uint64_t)Header->DeclarationCount * sizeof(df_ast_declaration), 8);
+    for(uint32_t i = 0; Reader.IsValid && Declarations && (i < Header->DeclarationCount); ++i)
+    {
+        declaration* Declaration = PushDeclaration(&File->Declarations, &File->DeclarationCapacity, &File->DeclarationCount);
+        Declaration->HasAst = true;
+        ReadAstDeclaration(&Reader, &Declarations[i], &Declaration->Ast);
+    }
+
+    if(!Reader.IsValid)
+    {
+        fprintf(stderr, "Error: %s is damaged.\n", File->Name);
+        FreeDeclarations(File);
+        DF_AstUnmap(&File->Mapping);
+        return -1;
+    }
+    return (int32_t)File->DeclarationCount;
+}
+
+// ----------
+// --DRIVER--
+// ----------
+
+// Lexing from the start of the file keeps line numbers of errors right.
+static bool ParseDeclaration(ast* Ast, char* Text, char* Start, char* End, string_storage* Storage, char* LexerStorage)
+{
+    lexer Lexer;
+    InitLexer(&Lexer, Text, End, LexerStorage, LEXER_STORAGE_SIZE);
+    Lexer.ParsePoint = Start;
+    GetToken(&Lexer);
+    return Parse(Ast, &Lexer, Storage) != 0;
+}
+
+// The Index-th declaration of a file to parse into Ast, IsParsed telling whether it could be.
+struct parse_job
+{
+    char* Start;
+    char* End;
+    uint32_t Index;
+    ast* Ast;
+    bool IsParsed;
+    // Set for functions main can't reach, which are only checked.
+    bool IsUnreachable;
+};
+
+struct parse_batch
+{
+    char* Text;
+    string_storage* Storage;
+    parse_job* Jobs;
+    uint32_t JobCount;
+    uint32_t NextJob; // Taken atomically by the threads
+};
+
+// Parses the jobs not taken yet by another thread, with a lexer storage of its own.
+static void ParseJobs(void* Data)
+{
+    parse_batch* Batch = (parse_batch*)Data;
+    char* LexerStorage = (char*)Allocate(MEMORY_lexer, LEXER_STORAGE_SIZE);
+    for(uint32_t Index = AtomicIncrement(&Batch->NextJob) - 1; Index < Batch->JobCount; Index = AtomicIncrement(&Batch->NextJob) - 1)
+    {
+        parse_job* Job = &Batch->Jobs[Index];
+        Job->IsParsed = ParseDeclaration(Job->Ast, Batch->Text, Job->Start, Job->End, Batch->Storage, LexerStorage);
+    }
+    Deallocate(LexerStorage);
+}
+
+// Parses the declarations of a file, on as many threads as there are processors when they're big enough to be worth
+// it. Every job writes its own AST only, so the results come out in source order whichever thread parsed them.
+static void ParseDeclarations(char* Text, parse_job* Jobs, uint32_t JobCount, string_storage* Storage, char* LexerStorage)
+{
+    uint64_t Size = 0;
+    for(uint32_t i = 0; i < JobCount; ++i)
+    {
+        Size += (uint64_t)(Jobs[i].End - Jobs[i].Start);
+    }
+    uint64_t ThreadCount = 1 + Size / MIN_PARSE_BYTES_PER_THREAD;
+    ThreadCount = (ThreadCount < JobCount) ? ThreadCount : JobCount;
+    ThreadCount = (ThreadCount < GetProcessorCount()) ? ThreadCount : GetProcessorCount();
+    ThreadCount = (ThreadCount < MAX_PARSE_THREAD_COUNT) ? ThreadCount : MAX_PARSE_THREAD_COUNT;
+    if(ThreadCount <= 1)
+    {
+        for(uint32_t i = 0; i < JobCount; ++i)
+        {
+            Jobs[i].IsParsed = ParseDeclaration(Jobs[i].Ast, Text, Jobs[i].Start, Jobs[i].End, Storage, LexerStorage);
+        }
+        return;
+    }
+
+    // The calling thread parses too, and takes over the jobs of threads that couldn't start.
+    parse_batch Batch = {Text, Storage, Jobs, JobCount, 0};
+    platform_thread Threads[MAX_PARSE_THREAD_COUNT];
+    uint32_t StartedCount = 0;
+    while((StartedCount + 1 < ThreadCount) && StartThread(&Threads[StartedCount], ParseJobs, &Batch))
+    {
+        ++StartedCount;
+    }
+    ParseJobs(&Batch);
+    for(uint32_t i = 0; i < StartedCount; ++i)
+    {
+        JoinThread(&Threads[i]);
+    }
+}
+
+// Frees the parsed declarations of a source file, so that the next load parses all of them.
+static void ForgetDeclarations(source_file* File)
+{
+    for(uint32_t i = 0; i < File->DeclarationCount; ++i)
+    {
+        if(File->Declarations[i].HasAst)
+        {
+            FreeAst(&File->Declarations[i].Ast);
+        }
+    }
+    File->DeclarationCount = 0;
+}
+
+// Re-reads a source file and parses the declarations whose text changed since the previous load, the others keep
+// their ASTs. Returns the number of parsed declarations, or -1 when the file can't be read.
+static int32_t LoadSourceFile(source_file* File, string_storage* Storage, char* LexerStorage)
+{
+    if(File->IsAstFile)
+    {
+        return LoadAstFile(File);
+    }
+
+    uint32_t Length;
+    char* Text = ReadEntireFile(File->Name, &Length);
+    if(!Text)
+    {
+        fprintf(stderr, "Error: could not read %s.\n", File->Name);
+        return -1;
+    }
+
+    declaration* Declarations = NULL;
+    uint32_t DeclarationCapacity = 0;
+    uint32_t DeclarationCount = 0;
+    bool* IsReused = (bool*)Allocate(MEMORY_input, sizeof(bool) * (File->DeclarationCount + 1));
+    memset(IsReused, 0, sizeof(bool) * (File->DeclarationCount + 1));
+    uint32_t JobCount = 0;
+    parse_job* Jobs = NULL;
+
+    lexer Lexer;
+    InitLexer(&Lexer, Text, Text + Length, LexerStorage, LEXER_STORAGE_SIZE);
+    char* Start;
+    char* End;
+    while(SkimDeclaration(&Lexer, &Start, &End, NULL))
+    {
+        declaration* Declaration = PushDeclaration(&Declarations, &DeclarationCapacity, &DeclarationCount);
+        Declaration->Offset = (uint32_t)(Start - Text);
+        Declaration->Length = (uint32_t)(End - Start);
+        Declaration->Hash = HashBytes(Start, Declaration->Length);
+
+        // Declarations mostly stay in place between edits, so the matching old one is searched from the same index.
+        bool IsFound = false;
+        for(uint32_t Probe = 0; Probe < File->DeclarationCount; ++Probe)
+        {
+            uint32_t OldIndex = (DeclarationCount - 1 + Probe) % File->DeclarationCount;
+            declaration* Old = &File->Declarations[OldIndex];
+            if(!IsReused[OldIndex] && (Old->Hash == Declaration->Hash) && (Old->Length == Declaration->Length) &&
+               (memcmp(File->Text + Old->Offset, Start, Declaration->Length) == 0))
+            {
+                IsReused[OldIndex] = true;
+                Declaration->HasAst = Old->HasAst;
+                Declaration->Ast = Old->Ast;
+                IsFound = true;
+                break;
+            }
+        }
+
+        // Parsed once every declaration is found, as Declarations may still move.
+        if(!IsFound)
+        {
+            Declaration->HasAst = false;
+            Jobs = (parse_job*)Reallocate(MEMORY_scratch, Jobs, sizeof(parse_job) * (JobCount + 1));
+            Jobs[JobCount].Start = Start;
+            Jobs[JobCount].End = End;
+            Jobs[JobCount].Index = DeclarationCount - 1;
+            ++JobCount;
+        }
+    }
+    for(uint32_t i = 0; i < JobCount; ++i)
+    {
+        Jobs[i].Ast = &Declarations[Jobs[i].Index].Ast;
+    }
+    ParseDeclarations(Text, Jobs, JobCount, Storage, LexerStorage);
+    for(uint32_t i = 0; i < JobCount; ++i)
+    {
+        Declarations[Jobs[i].Index].HasAst = Jobs[i].IsParsed;
+    }
+    Deallocate(Jobs);
+
+    for(uint32_t i = 0; i < File->DeclarationCount; ++i)
+    {
+        if(!IsReused[i] && File->Declarations[i].HasAst)
+        {
+            FreeAst(&File->Declarations[i].Ast);
+        }
+    }
+    Deallocate(File->Text);
+    Deallocate(File->Declarations);
+    Deallocate(IsReused);
+    File->Text = Text;
+    File->DeclarationCount = DeclarationCount;
+    File->DeclarationCapacity = DeclarationCapacity;
+    File->Declarations = Declarations;
+    return (int32_t)JobCount;
+}
+
+// Replaces the file only when its content differs, so that unchanged outputs don't trigger C rebuilds.
+static int32_t WriteFileIfChanged(FILE* Source, const char* FileName)
+{
+    long Length = ftell(Source);
+    char* Buffer = (char*)Allocate(MEMORY_output, 2 * (size_t)Length + 1);
+    char* Existing = Buffer + Length;
+    rewind(Source);
+    if(fread(Buffer, 1, (size_t)Length, Source) != (size_t)Length)
+    {
+        Deallocate(Buffer);
+        return 0;
+    }
+
+    FILE* FileHandle = fopen(FileName, "rb");
+    if(FileHandle)
+    {
+        size_t ExistingLength = fread(Existing, 1, (size_t)Length + 1, FileHandle);
+        fclose(FileHandle);
+        if((ExistingLength == (size_t)Length) && (memcmp(Buffer, Existing, (size_t)Length) == 0))
+        {
+            Deallocate(Buffer);
+            return 1;
+        }
+    }
+
+    FileHandle = fopen(FileName, "wb");
+    int32_t Result = FileHandle && (fwrite(Buffer, 1, (size_t)Length, FileHandle) == (size_t)Length);
+    if(FileHandle)
+    {
+        fclose(FileHandle);
+    }
+    Deallocate(Buffer);
+    return Result;
+}
+
+static void ReportTranslationError(source_file* File, uint32_t Index)
+{
+    fprintf(stderr, "Error: translation of AST[%d] in %s failed.\n", Index, File->Name);
+}
+
+// Without --watch, --emit-ast or --split the declarations aren't needed after translation, so sources are translated
+// a batch of declarations at a time as they are parsed.
+static bool IsStreamed(source_file* File, options* Options)
+{
+    return !File->IsAstFile && !Options->IsWatching && !Options->AstFileName && !Options->SplitCount;
+}
+
+// Whether the declaration is a function, a name and :: followed by anything but struct. Sets the hash of its name.
+static bool GetFunctionHash(char* Text, char* Start, char* End, char* LexerStorage, uint64_t* NameHash)
+{
+    lexer Lexer;
+    InitLexer(&Lexer, Text, End, LexerStorage, LEXER_STORAGE_SIZE);
+    Lexer.ParsePoint = Start;
+    if(!GetToken(&Lexer) || (Lexer.Token != TOKEN_id))
+    {
+        return false;
+    }
+    *NameHash = HashBytes(Lexer.String, (uint32_t)strlen(Lexer.String));
+    return GetToken(&Lexer) && (Lexer.Token == TOKEN_double_colon) && GetToken(&Lexer) && (Lexer.Token != TOKEN_struct);
+}
+
+// Adds the declarations of a file to be streamed by skimming it, without building any AST. Returns 0 when the file
+// can't be read.
+static int32_t SkimReferences(reference_graph* Graph, source_file* File, char* LexerStorage)
+{
+    uint32_t Length;
+    char* Text = ReadEntireFile(File->Name, &Length);
+    if(!Text)
+    {
+        return 0;
+    }
+
+    lexer Lexer;
+    InitLexer(&Lexer, Text, Text + Length, LexerStorage, LEXER_STORAGE_SIZE);
+    char* Start;
+    char* End;
+    for(;;)
+    {
+        BeginReferenceNode(Graph, false, 0);
+        if(!SkimDeclaration(&Lexer, &Start, &End, &Graph->Names))
+        {
+            --Graph->NodeCount;
+            break;
+        }
+        reference_node* Node = &Graph->Nodes[Graph->NodeCount - 1];
+        Node->IsFunction = GetFunctionHash(Text, Start, End, LexerStorage, &Node->NameHash);
+        EndReferenceNode(Graph);
+    }
+    Deallocate(Text);
+    return 1;
+}
+
+static void AddAstReferences(reference_graph* Graph, source_file* File)
+{
+    for(uint32_t i = 0; i < File->DeclarationCount; ++i)
+    {
+        ast* Ast = &File->Declarations[i].Ast;
+        bool HasAst = File->Declarations[i].HasAst;
+        if(HasAst && (Ast->AstType == AST_func) && Ast->Func)
+        {
+            func* Function = Ast->Func;
+            BeginReferenceNode(Graph, true, HashBytes(Function->Name, (uint32_t)strlen(Function->Name)));
+            for(uint32_t StatementIndex = 0; StatementIndex < Function->ExpressionCount; ++StatementIndex)
+            {
+                AddExpressionNames(&Graph->Names, Function->Expressions[StatementIndex]);
+            }
+        }
+        else
+        {
+            BeginReferenceNode(Graph, false, 0);
+            if(HasAst && (Ast->AstType == AST_expr))
+            {
+                AddExpressionNames(&Graph->Names, Ast->Expr);
+            }
+        }
+        EndReferenceNode(Graph);
+    }
+}
+
+// Loaded declarations take the marks of their nodes, which were added in the same order. Returns the next node.
+static uint32_t MarkLoadedDeclarations(reference_graph* Graph, uint32_t FirstNode, source_file* File)
+{
+    for(uint32_t i = 0; i < File->DeclarationCount; ++i)
+    {
+        uint32_t Node = FirstNode + i;
+        File->Declarations[i].IsUnreachable = (Node < Graph->NodeCount) && !Graph->Nodes[Node].IsReachable;
+    }
+    return FirstNode + File->DeclarationCount;
+}
+
+// Releases each declaration's AST as soon as it is translated, so memory stays bounded by a batch of PARSE_BATCH_SIZE
+// declarations rather than the whole program. Unreachable functions are parsed only to be checked. Returns 0 when the
+// file can't be read.
+static int32_t StreamSourceFile(translator* Translator, source_file* File, string_storage* Storage, char* LexerStorage, reference_graph* Graph,
+                                uint32_t* NextNode)
+{
+    uint32_t Length;
+    char* Text = ReadEntireFile(File->Name, &Length);
+    if(!Text)
+    {
+        fprintf(stderr, "Error: could not read %s.\n", File->Name);
+        return 0;
+    }
+
+    lexer Lexer;
+    InitLexer(&Lexer, Text, Text + Length, LexerStorage, LEXER_STORAGE_SIZE);
+    parse_job Jobs[PARSE_BATCH_SIZE];
+    ast Asts[PARSE_BATCH_SIZE];
+    uint32_t DeclarationCount = 0;
+    for(bool IsSkimmed = false; !IsSkimmed;)
+    {
+        // Declarations are parsed a batch at a time, which bounds the ASTs held at once.
+        uint32_t JobCount = 0;
+        char* Start;
+        char* End;
+        while((JobCount < PARSE_BATCH_SIZE) && !IsSkimmed)
+        {
+            IsSkimmed = !SkimDeclaration(&Lexer, &Start, &End, NULL);
+            if(IsSkimmed)
             {
-                fprintf(FileHandle, ")");
+                break;
             }
-        } break;
-        case EXPR_if:
+
+            // The file was skimmed from an earlier read, so a node only drops a declaration that still is the same function.
+            uint32_t Index = DeclarationCount++;
+            reference_node* Node = (*NextNode < Graph->NodeCount) ? &Graph->Nodes[(*NextNode)++] : NULL;
+            uint64_t NameHash;
+            bool IsUnreachable = Node && !Node->IsReachable && GetFunctionHash(Text, Start, End, LexerStorage, &NameHash) &&
+                                 (NameHash == Node->NameHash);
+
+            parse_job* Job = &Jobs[JobCount];
+            Job->Start = Start;
+            Job->End = End;
+            Job->Index = Index;
+            Job->IsUnreachable = IsUnreachable;
+            Job->Ast = &Asts[JobCount];
+            memset(Job->Ast, 0, sizeof(ast));
+            ++JobCount;
+        }
+
+        ParseDeclarations(Text, Jobs, JobCount, Storage, LexerStorage);
+        for(uint32_t i = 0; i < JobCount; ++i)
         {
-            fprintf(FileHandle, "if(");
-            if(!TranslateExpression(FileHandle, Expression->IfExpr.Statement, false))
-            {
-                return 0;
-            }
-            fprintf(FileHandle, ")\n{\n");
-            for(uint32_t i = 0; i < Expression->IfExpr.TrueExpressionCount; ++i)
+            if(Jobs[i].IsParsed)
             {
-                if(!TranslateExpression(FileHandle, Expression->IfExpr.TrueExpressions[i], true))
+                if(!TranslateReachable(Translator, Jobs[i].Ast, Jobs[i].IsUnreachable))
                 {
-                    return 0;
-                }
-            }
-            fprintf(FileHandle, "}\n");
-            if(Expression->IfExpr.FalseExpressionCount > 0)
-            {
-                fprintf(FileHandle, "else\n{\n");
-                for(uint32_t i = 0; i < Expression->IfExpr.FalseExpressionCount; ++i)
-                {
-                    if(!TranslateExpression(FileHandle, Expression->IfExpr.FalseExpressions[i], true))
-                    {
-                        return 0;
-                    }
+                    ReportTranslationError(File, Jobs[i].Index);
                 }
-                fprintf(FileHandle, "}\n");
+                FreeAst(Jobs[i].Ast);
             }
-        } break;
-        case EXPR_for:
+        }
+    }
+    Deallocate(Text);
+    return 1;
+}
+
+// Declarations go to the split header except function bodies, which are spread over the units, and global definitions,
+// which go to the first unit. Every signature is known before any body and every prototype is in the header, so the
+// order of declarations doesn't matter.
+static void TranslateSplitSources(translator* Translator, source_file** Files, uint32_t FileCount, FILE* Header, FILE** Units,
+                                  uint32_t UnitCount)
+{
+    fprintf(Header, "#ifndef DF_RESULT_H\n#define DF_RESULT_H\n\n#include \"%s\"\n#include \"%s\"\n\n", PRELUDE_FILE_NAME, RUNTIME_FILE_NAME);
+    for(uint32_t i = 0; i < UnitCount; ++i)
+    {
+        fprintf(Units[i], "#include \"%s\"\n", SPLIT_HEADER_FILE_NAME);
+    }
+
+    for(uint32_t FileIndex = 0; FileIndex < FileCount; ++FileIndex)
+    {
+        source_file* File = Files[FileIndex];
+        for(uint32_t i = 0; i < File->DeclarationCount; ++i)
         {
-            if(Expression->ForExpr.Condition && !Expression->ForExpr.Definition && !Expression->ForExpr.Action)
+            ast* Ast = &File->Declarations[i].Ast;
+            if(!File->Declarations[i].HasAst || File->Declarations[i].IsUnreachable ||
+               ((Ast->AstType == AST_func) && (!Ast->Func || (Ast->Func->ExpressionCount > 0))))
             {
-                fprintf(FileHandle, "while(");
-                if(!TranslateExpression(FileHandle, Expression->ForExpr.Condition, false))
-                {
-                    return 0;
-                }
+                continue;
             }
-            else
-            {
-                fprintf(FileHandle, "for(");
-                if(Expression->ForExpr.Definition)
-                {
-                    if(!TranslateExpression(FileHandle, Expression->ForExpr.Definition, false))
-                    {
-                        return 0;
-                    }
-                }
-                fprintf(FileHandle, ";");
 
-                if(Expression->ForExpr.Condition)
+            if((Ast->AstType == AST_expr) && Ast->Expr && (Ast->Expr->ExprType == EXPR_var))
+            {
+                type_spec* Type = &Ast->Expr->VarExpr.Type;
+                char* Name = Ast->Expr->VarExpr.Name;
+                if((Type->ArrayKind == ARRAY_fixed) && GetSoaStruct(Translator, Type) && !Ast->Expr->VarExpr.Expr)
                 {
-                    if(!TranslateExpression(FileHandle, Expression->ForExpr.Condition, false))
+                    // Its anonymous struct type is named, so that the extern declaration and the definition agree.
+                    Translator->FileHandle = Header;
+                    char TypeName[256];
+                    snprintf(TypeName, sizeof(TypeName), "df_soa_array_%s", Name);
+                    fprintf(Header, "typedef ");
+                    TranslateDeclaration(Translator, Type, TypeName);
+                    fprintf(Header, ";\nextern %s %s;\n", TypeName, Name);
+                    fprintf(Units[0], "%s %s;\n", TypeName, Name);
+                    if(!AddSymbol(Translator, Name, Type))
                     {
-                        return 0;
+                        ReportTranslationError(File, i);
                     }
+                    continue;
                 }
-                fprintf(FileHandle, ";");
-
-                if(Expression->ForExpr.Action)
+                Translator->FileHandle = Units[0];
+                if(!Translate(Translator, Ast))
                 {
-                    if(!TranslateExpression(FileHandle, Expression->ForExpr.Action, false))
-                    {
-                        return 0;
-                    }
+                    ReportTranslationError(File, i);
+                    continue;
                 }
+                Translator->FileHandle = Header;
+                fprintf(Header, "extern ");
+                TranslateDeclaration(Translator, Type, Name);
+                fprintf(Header, ";\n");
             }
-            fprintf(FileHandle, ")\n{\n");
-            for(uint32_t i = 0; i < Expression->ForExpr.ExpressionCount; ++i)
+            else
             {
-                if(!TranslateExpression(FileHandle, Expression->ForExpr.Expressions[i], true))
+                Translator->FileHandle = Header;
+                if(!Translate(Translator, Ast))
                 {
-                    return 0;
+                    ReportTranslationError(File, i);
                 }
             }
-            fprintf(FileHandle, "}\n");
-        } break;
-        case EXPR_return:
+        }
+    }
+
+    for(uint32_t FileIndex = 0; FileIndex < FileCount; ++FileIndex)
+    {
+        source_file* File = Files[FileIndex];
+        for(uint32_t i = 0; i < File->DeclarationCount; ++i)
         {
-            fprintf(FileHandle, "return ");
-            if(!TranslateExpression(FileHandle, Expression->ReturnExpr.Expression, false))
+            ast* Ast = &File->Declarations[i].Ast;
+            if(File->Declarations[i].HasAst && (Ast->AstType == AST_func) && Ast->Func)
             {
-                return 0;
+                RegisterFunction(Translator, Ast->Func);
             }
-            fprintf(FileHandle, ";\n");
-        } break;
-        case EXPR_inline:
+        }
+    }
+
+    for(uint32_t FileIndex = 0; FileIndex < FileCount; ++FileIndex)
+    {
+        source_file* File = Files[FileIndex];
+        for(uint32_t i = 0; i < File->DeclarationCount; ++i)
         {
-            char* CurrentChar = Expression->InlineExpr.Text;
-            while(*CurrentChar != '\0')
+            ast* Ast = &File->Declarations[i].Ast;
+            if(!File->Declarations[i].HasAst || (Ast->AstType != AST_func) || !Ast->Func || (Ast->Func->ExpressionCount == 0))
             {
-                if((*CurrentChar != '\r') && (*CurrentChar != '\t') && (*CurrentChar != '\f'))
+                continue;
+            }
+            if(File->Declarations[i].IsUnreachable)
+            {
+                if(!CheckFunction(Translator, Ast->Func))
                 {
-                    fprintf(FileHandle, "%c", *CurrentChar);
+                    ReportTranslationError(File, i);
                 }
-                ++CurrentChar;
+                continue;
             }
-            fprintf(FileHandle, "\n");
-        } break;
+
+            uint32_t SymbolCount = Translator->SymbolCount;
+            Translator->FileHandle = Header;
+            bool IsDeclared = TranslateFunctionSignature(Translator, Ast->Func);
+            fprintf(Header, ";\n");
+            Translator->SymbolCount = SymbolCount;
+
+            // Bodies are balanced by the size of the generated code.
+            FILE* Unit = Units[0];
+            for(uint32_t UnitIndex = 1; UnitIndex < UnitCount; ++UnitIndex)
+            {
+                if(ftell(Units[UnitIndex]) < ftell(Unit))
+                {
+                    Unit = Units[UnitIndex];
+                }
+            }
+            Translator->FileHandle = Unit;
+            if(!IsDeclared || !Translate(Translator, Ast))
+            {
+                ReportTranslationError(File, i);
+            }
+        }
     }
-    return 1;
+    fprintf(Header, "\n#endif\n");
 }
 
-static int32_t TranslateFunction(FILE* FileHandle, func* Function)
+static void WriteSplitMakefile(FILE* FileHandle, uint32_t UnitCount)
 {
-    if(!Function)
+    fprintf(FileHandle, "# Builds the units of transpiler --split=%u in parallel: make -j -f %s, or include it.\n\n", UnitCount, SPLIT_MAKEFILE_NAME);
+    fprintf(FileHandle, "DF_PROGRAM ?= result\nDF_OBJECTS =");
+    for(uint32_t i = 0; i < UnitCount; ++i)
+    {
+        fprintf(FileHandle, " result_%u.o", i);
+    }
+    fprintf(FileHandle, "\n\n$(DF_PROGRAM): $(DF_OBJECTS)\n\t$(CC) $(LDFLAGS) -o $@ $(DF_OBJECTS) $(LDLIBS)\n\n");
+    fprintf(FileHandle, "$(DF_OBJECTS): %s %s %s\n", SPLIT_HEADER_FILE_NAME, RUNTIME_FILE_NAME, PRELUDE_FILE_NAME);
+}
+
+static int32_t TranslateSources(source_file** Files, uint32_t FileCount, options* Options, string_storage* Storage, char* LexerStorage)
+{
+    // The runtime and the prelude, then either RESULT_FILE_NAME or the split header, Makefile fragment and units.
+    char OutputNames[MAX_SPLIT_COUNT + 4][32];
+    FILE* Outputs[MAX_SPLIT_COUNT + 4];
+    uint32_t OutputCount = 0;
+    strcpy(OutputNames[OutputCount++], RUNTIME_FILE_NAME);
+    strcpy(OutputNames[OutputCount++], PRELUDE_FILE_NAME);
+    if(Options->SplitCount)
+    {
+        strcpy(OutputNames[OutputCount++], SPLIT_HEADER_FILE_NAME);
+        strcpy(OutputNames[OutputCount++], SPLIT_MAKEFILE_NAME);
+        for(uint32_t i = 0; i < Options->SplitCount; ++i)
+        {
+            sprintf(OutputNames[OutputCount++], SPLIT_UNIT_FILE_NAME, i);
+        }
+    }
+    else
+    {
+        strcpy(OutputNames[OutputCount++], RESULT_FILE_NAME);
+    }
+
+    bool IsCreated = true;
+    for(uint32_t i = 0; i < OutputCount; ++i)
+    {
+        Outputs[i] = tmpfile();
+        IsCreated = IsCreated && Outputs[i];
+    }
+    if(!IsCreated)
     {
+        fprintf(stderr, "Error: could not create temporary files.\n");
+        for(uint32_t i = 0; i < OutputCount; ++i)
+        {
+            if(Outputs[i])
+            {
+                fclose(Outputs[i]);
+            }
+        }
         return 0;
     }
 
-    TranslateType(FileHandle, Function->Type);
-    fprintf(FileHandle, "%s(", Function->Name);
-    for(uint32_t i = 0; i < Function->ParameterCount; ++i)
+    translator* Translator = (translator*)Allocate(MEMORY_translator, sizeof(translator));
+    InitTranslator(Translator, Outputs[2]);
+    Translator->IsProfiling = Options->IsProfiling;
+    bool IsRead = true;
+
+    // What main reaches is only known from the whole program, so files to be streamed are skimmed for it first.
+    reference_graph Graph = {};
+    for(uint32_t FileIndex = 0; FileIndex < FileCount; ++FileIndex)
     {
-        if(!TranslateExpression(FileHandle, Function->Parameters[i], false))
+        if(IsStreamed(Files[FileIndex], Options))
         {
-            return 0;
+            SkimReferences(&Graph, Files[FileIndex], LexerStorage);
         }
-        if(i != (Function->ParameterCount - 1))
+        else
         {
-            fprintf(FileHandle, ",");
+            AddAstReferences(&Graph, Files[FileIndex]);
         }
     }
+    MarkReachableDeclarations(&Graph);
+    uint32_t NextNode = 0;
 
-    if(Function->ExpressionCount <= 0)
+    if(Options->SplitCount)
     {
-        fprintf(FileHandle, ");");
+        for(uint32_t FileIndex = 0; FileIndex < FileCount; ++FileIndex)
+        {
+            NextNode = MarkLoadedDeclarations(&Graph, NextNode, Files[FileIndex]);
+        }
+        TranslateSplitSources(Translator, Files, FileCount, Outputs[2], Outputs + 4, Options->SplitCount);
+        WriteSplitMakefile(Outputs[3], Options->SplitCount);
     }
     else
     {
-        fprintf(FileHandle, ")\n{\n");
-        for(uint32_t i = 0; i < Function->ExpressionCount; ++i)
+        fprintf(Outputs[2], "#include \"%s\"\n#include \"%s\"\n", PRELUDE_FILE_NAME, RUNTIME_FILE_NAME);
+        for(uint32_t FileIndex = 0; FileIndex < FileCount; ++FileIndex)
         {
-            if(!TranslateExpression(FileHandle, Function->Expressions[i], true))
+            source_file* File = Files[FileIndex];
+            if(IsStreamed(File, Options))
             {
-                return 0;
+                IsRead = StreamSourceFile(Translator, File, Storage, LexerStorage, &Graph, &NextNode) && IsRead;
+                continue;
+            }
+            NextNode = MarkLoadedDeclarations(&Graph, NextNode, File);
+            for(uint32_t i = 0; i < File->DeclarationCount; ++i)
+            {
+                if(File->Declarations[i].HasAst &&
+                   !TranslateReachable(Translator, &File->Declarations[i].Ast, File->Declarations[i].IsUnreachable))
+                {
+                    ReportTranslationError(File, i);
+                }
             }
         }
-        fprintf(FileHandle, "}");
     }
-    fprintf(FileHandle, "\n");
-    return 1;
+    FreeReferenceGraph(&Graph);
+    if(Translator->RuntimeFlags & RUNTIME_output)
+    {
+        fprintf(Outputs[Options->SplitCount ? 4 : 2], "\ndf_writer DF_Output;\n");
+    }
+    if(Translator->RuntimeFlags & RUNTIME_profile)
+    {
+        fprintf(Outputs[Options->SplitCount ? 4 : 2], "\ndf_profile DF_Profile;\n");
+    }
+    WriteStringPool(Translator, Outputs[Options->SplitCount ? 4 : 2]);
+    WriteRuntime(Translator, Outputs[0]);
+    WritePrelude(Translator, Outputs[1]);
+    for(uint32_t i = 0; i < Translator->IncludeCount; ++i)
+    {
+        Deallocate(Translator->Includes[i]);
+    }
+    Deallocate(Translator->PooledBytes);
+    if(Translator->CheckFile)
+    {
+        fclose(Translator->CheckFile);
+    }
+    Deallocate(Translator);
+
+    // A missing source would leave out part of the program, so the previous outputs are kept.
+    int32_t Result = IsRead;
+    for(uint32_t i = 0; i < OutputCount; ++i)
+    {
+        if(IsRead && !WriteFileIfChanged(Outputs[i], OutputNames[i]))
+        {
+            fprintf(stderr, "Error: could not write %s.\n", OutputNames[i]);
+            Result = 0;
+        }
+        fclose(Outputs[i]);
+    }
+    return Result;
 }
 
-static int32_t Translate(FILE* FileHandle, ast* Ast)
+static int32_t EmitOutputs(source_file** Files, uint32_t FileCount, options* Options, string_storage* Storage, char* LexerStorage)
 {
-    switch(Ast->AstType)
+    // Written before translating, so that the image holds the declarations as parsed.
+    int32_t Result = 1;
+    if(Options->AstFileName && !WriteAstFile(Files, FileCount, Options->AstFileName))
     {
-        default:
-        {
-            return 0;
-        } break;
-        case AST_expr:
-        {
-            expr* Expression = Ast->Expr;
-            return TranslateExpression(FileHandle, Expression, true);
-        } break;
-        case AST_func:
+        fprintf(stderr, "Error: could not write %s.\n", Options->AstFileName);
+        Result = 0;
+    }
+    Result = TranslateSources(Files, FileCount, Options, Storage, LexerStorage) && Result;
+
+    // MSVC builds a precompiled header from a source file including it (cl /Yc"df_prelude.h" df_prelude.c).
+    FILE* PrecompiledSource = Options->IsPrecompilingPrelude ? tmpfile() : NULL;
+    if(PrecompiledSource)
+    {
+        fprintf(PrecompiledSource, "#include \"%s\"\n", PRELUDE_FILE_NAME);
+        if(!WriteFileIfChanged(PrecompiledSource, PRELUDE_SOURCE_FILE_NAME))
         {
-            func* Function = Ast->Func;
-            return TranslateFunction(FileHandle, Function);
-        } break;
+            fprintf(stderr, "Error: could not write %s.\n", PRELUDE_SOURCE_FILE_NAME);
+            Result = 0;
+        }
+        fclose(PrecompiledSource);
     }
+    return Result;
 }
 
-int main(int ArgCount, char** ArgValues)
+static void RebuildSources(source_file** Files, uint32_t FileCount, bool* IsChanged, options* Options, string_storage* Storage,
+                           char* LexerStorage)
 {
-    if(ArgCount != 2)
+    // Strings of edited declarations stay in the storage, so once it is half full it is cleared and every source is
+    // parsed again, which only keeps the strings still in use.
+    bool IsStorageCleared = (2 * Storage->StringCount > MAX_STRING_COUNT) || (2 * Storage->Length > Storage->Capacity);
+    if(IsStorageCleared)
     {
-        fprintf(stderr, "Error: Expected file name.\n");
-        return 0;
+        for(uint32_t i = 0; i < FileCount; ++i)
+        {
+            if(!Files[i]->IsAstFile)
+            {
+                ForgetDeclarations(Files[i]);
+            }
+        }
+        ClearStringStorage(Storage);
     }
-    char* FileName = ArgValues[1];
 
-    FILE* FileHandle = fopen(FileName, "rb");
-    char* Text = (char*)malloc(1 << 20);
-    int32_t Length = FileHandle ? (int32_t)fread(Text, 1, 1 << 20, FileHandle): -1;
-    if(Length < 0)
+    int32_t ParsedCount = 0;
+    uint32_t DeclarationCount = 0;
+    for(uint32_t i = 0; i < FileCount; ++i)
     {
-        printf("Error reading file!\n");
-        free(Text);
-        fclose(FileHandle);
-        return 1;
+        if(IsChanged[i] || (IsStorageCleared && !Files[i]->IsAstFile))
+        {
+            int32_t FileParsedCount = LoadSourceFile(Files[i], Storage, LexerStorage);
+            ParsedCount += (FileParsedCount > 0) ? FileParsedCount : 0;
+        }
+        DeclarationCount += Files[i]->DeclarationCount;
     }
-    fclose(FileHandle);
-
-    lexer Lexer;
-    InitLexer(&Lexer, Text, Text + Length, (char*)malloc(0x10000), 0x10000);
+    EmitOutputs(Files, FileCount, Options, Storage, LexerStorage);
+    printf("Rebuilt %s: re-parsed %d of %u declarations.\n", RESULT_FILE_NAME, ParsedCount, DeclarationCount);
+    fflush(stdout);
+    if(Options->IsReportingMemory)
+    {
+        PrintMemoryReport();
+    }
+}
 
-    string_storage StringStorage;
-    InitStringStorage(&StringStorage, (char*)malloc(1 << 20), 1 << 20);
+static const char* GetBaseName(const char* Path)
+{
+    const char* Result = Path;
+    for(const char* At = Path; *At; ++At)
+    {
+        if((*At == '/') || (*At == '\\'))
+        {
+            Result = At + 1;
+        }
+    }
+    return Result;
+}
 
-    uint32_t ResultCount = 0;
-    ast Results[100]; // Arbitrary number for now
+// Runs until interrupted, rebuilding whenever one of the sources is saved.
+static void WatchSources(source_file** Files, uint32_t FileCount, options* Options, string_storage* Storage, char* LexerStorage)
+{
+    bool IsChanged[MAX_SOURCE_FILE_COUNT];
+    printf("Watching %u file(s), press Ctrl+C to stop.\n", FileCount);
+    fflush(stdout);
+
+#if defined(__linux__)
+    // Directories are watched instead of the files, since editors often save by replacing the file.
+    int Handle = inotify_init();
+    int Watches[MAX_SOURCE_FILE_COUNT];
+    for(uint32_t i = 0; i < FileCount; ++i)
+    {
+        char Directory[4096];
+        size_t DirectoryLength = (size_t)(GetBaseName(Files[i]->Name) - Files[i]->Name);
+        if((DirectoryLength == 0) || (DirectoryLength >= sizeof(Directory)))
+        {
+            strcpy(Directory, ".");
+        }
+        else
+        {
+            memcpy(Directory, Files[i]->Name, DirectoryLength);
+            Directory[DirectoryLength] = '\0';
+        }
+        Watches[i] = inotify_add_watch(Handle, Directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(Watches[i] < 0)
+        {
+            fprintf(stderr, "Error: could not watch %s.\n", Directory);
+        }
+    }
 
-    while(GetToken(&Lexer))
+    for(;;)
     {
-#if 0
-        // Testing out the lexer
-        if(Lexer.Token == TOKEN_parse_error)
+        alignas(struct inotify_event) char Buffer[4096];
+        ssize_t Size = read(Handle, Buffer, sizeof(Buffer));
+        if(Size <= 0)
         {
-            printf("\nPARSE ERROR\n");
+            fprintf(stderr, "Error: watching the sources failed.\n");
             break;
         }
-        PrintToken(&Lexer);
-        printf(" ");
+
+        bool IsAnyChanged = false;
+        memset(IsChanged, 0, sizeof(IsChanged));
+        for(char* At = Buffer; At < Buffer + Size; At += sizeof(struct inotify_event) + ((struct inotify_event*)At)->len)
+        {
+            struct inotify_event* Event = (struct inotify_event*)At;
+            for(uint32_t i = 0; i < FileCount; ++i)
+            {
+                if((Event->wd == Watches[i]) && Event->len && (strcmp(Event->name, GetBaseName(Files[i]->Name)) == 0))
+                {
+                    IsChanged[i] = true;
+                    IsAnyChanged = true;
+                }
+            }
+        }
+        if(IsAnyChanged)
+        {
+            RebuildSources(Files, FileCount, IsChanged, Options, Storage, LexerStorage);
+        }
+    }
+    close(Handle);
+#else
+    // Without inotify the modification times are polled.
+    struct stat FileStats[MAX_SOURCE_FILE_COUNT];
+    for(uint32_t i = 0; i < FileCount; ++i)
+    {
+        stat(Files[i]->Name, &FileStats[i]);
+    }
+
+    for(;;)
+    {
+#if defined(_WIN32)
+        Sleep(100);
 #else
-        Results[ResultCount] = {};
-        if(Parse(&Results[ResultCount], &Lexer, &StringStorage))
+        usleep(100 * 1000);
+#endif
+        bool IsAnyChanged = false;
+        for(uint32_t i = 0; i < FileCount; ++i)
+        {
+            struct stat FileStat;
+            IsChanged[i] = (stat(Files[i]->Name, &FileStat) == 0) &&
+                           ((FileStat.st_mtime != FileStats[i].st_mtime) || (FileStat.st_size != FileStats[i].st_size));
+            if(IsChanged[i])
+            {
+                FileStats[i] = FileStat;
+                IsAnyChanged = true;
+            }
+        }
+        if(IsAnyChanged)
         {
-            ++ResultCount;
+            RebuildSources(Files, FileCount, IsChanged, Options, Storage, LexerStorage);
         }
+    }
 #endif
+}
+
+int main(int ArgCount, char** ArgValues)
+{
+    options Options = {};
+    uint32_t FileCount = 0;
+    source_file* Files[MAX_SOURCE_FILE_COUNT];
+    for(int32_t i = 1; i < ArgCount; ++i)
+    {
+        if(strcmp(ArgValues[i], "--watch") == 0)
+        {
+            Options.IsWatching = true;
+        }
+        else if(strcmp(ArgValues[i], "--pch") == 0)
+        {
+            Options.IsPrecompilingPrelude = true;
+        }
+        else if(strcmp(ArgValues[i], "--mem-report") == 0)
+        {
+            Options.IsReportingMemory = true;
+        }
+        else if(strcmp(ArgValues[i], "--profile") == 0)
+        {
+            Options.IsProfiling = true;
+        }
+        else if(strncmp(ArgValues[i], "--emit-ast=", 11) == 0)
+        {
+            Options.AstFileName = ArgValues[i] + 11;
+        }
+        else if(strncmp(ArgValues[i], "--split=", 8) == 0)
+        {
+            char* End;
+            unsigned long SplitCount = strtoul(ArgValues[i] + 8, &End, 10);
+            if((*End != '\0') || (SplitCount < 1) || (SplitCount > MAX_SPLIT_COUNT))
+            {
+                fprintf(stderr, "Error: --split expects a unit count from 1 to %d.\n", MAX_SPLIT_COUNT);
+                return 1;
+            }
+            Options.SplitCount = (uint32_t)SplitCount;
+        }
+        else if(strncmp(ArgValues[i], "--", 2) == 0)
+        {
+            fprintf(stderr, "Error: unknown option %s.\n", ArgValues[i]);
+            return 1;
+        }
+        else if(FileCount == MAX_SOURCE_FILE_COUNT)
+        {
+            fprintf(stderr, "Error: at most %d source files can be translated at once.\n", MAX_SOURCE_FILE_COUNT);
+            return 1;
+        }
+        else
+        {
+            source_file* File = (source_file*)Allocate(MEMORY_input, sizeof(source_file));
+            File->Name = ArgValues[i];
+            size_t NameLength = strlen(File->Name);
+            File->Text = NULL;
+            File->DeclarationCount = 0;
+            File->DeclarationCapacity = 0;
+            File->Declarations = NULL;
+            File->IsAstFile = (NameLength > 4) && (strcmp(File->Name + NameLength - 4, ".dfa") == 0);
+            memset(&File->Mapping, 0, sizeof(File->Mapping));
+            Files[FileCount++] = File;
+        }
+    }
+    if(FileCount == 0)
+    {
+        fprintf(stderr, "Error: Expected file name.\n");
+        return 0;
     }
 
-    FILE* ResultFileHandle = fopen("result.c", "w");
+    char* LexerStorage = (char*)Allocate(MEMORY_lexer, LEXER_STORAGE_SIZE);
+    string_storage* StringStorage = (string_storage*)Allocate(MEMORY_strings, sizeof(string_storage));
+    InitStringStorage(StringStorage, (char*)Allocate(MEMORY_strings, STRING_STORAGE_SIZE), STRING_STORAGE_SIZE);
 
-    for(uint32_t i = 0; i < ResultCount; ++i)
+    int32_t Result = 0;
+    for(uint32_t i = 0; i < FileCount; ++i)
     {
-        if(!Translate(ResultFileHandle, &Results[i]))
+        if(!IsStreamed(Files[i], &Options) && (LoadSourceFile(Files[i], StringStorage, LexerStorage) < 0))
         {
-            fprintf(stderr, "Error: translation of AST[%d] failed.\n", i);
+            fprintf(stderr, "Error reading file!\n");
+            Result = 1;
         }
     }
-    fclose(FileHandle);
+    if((Result == 0) && !EmitOutputs(Files, FileCount, &Options, StringStorage, LexerStorage))
+    {
+        Result = 1;
+    }
+    if(Options.IsReportingMemory)
+    {
+        PrintMemoryReport();
+    }
+    if(Options.IsWatching)
+    {
+        WatchSources(Files, FileCount, &Options, StringStorage, LexerStorage);
+    }
 
-    // Freeing all the expressions
-    // printf("\nResultCount = %d\n", ResultCount);
-    for(uint32_t i = 0; i < ResultCount; ++i)
+    for(uint32_t i = 0; i < FileCount; ++i)
     {
-        FreeAst(&Results[i]);
+        FreeDeclarations(Files[i]);
+        DF_AstUnmap(&Files[i]->Mapping);
+        Deallocate(Files[i]->Declarations);
+        Deallocate(Files[i]->Text);
+        Deallocate(Files[i]);
     }
-    free(Lexer.InputStream);
-    free(Lexer.StringStorage);
-    free(StringStorage.Strings);
-    return 0;
+    Deallocate(LexerStorage);
+    Deallocate(StringStorage->Strings);
+    Deallocate(StringStorage);
+    return Result;
 }